@@ -20,8 +20,18 @@
 
 #include <ipc_protocol.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Environment Variable for unix-domain-socket file path
 #define IPC_ENV_DOMAIN_SOCKET_PATH "IPC_DOMAIN_PATH"
+// for the client side only, overrides IPC_DOMAIN_PATH (ipc_broker connects to the producer with it)
+#define IPC_ENV_CLIENT_DOMAIN_SOCKET_PATH "IPC_CLIENT_DOMAIN_PATH"
+// "1": the server also serves all usages on one multiplexed socket, and the client receives all usages by it
+#define IPC_ENV_MUX "IPC_MUX"
+// directory of the persisted snapshots (see ipcServerSetPersist), not persisted if it is not set
+#define IPC_ENV_PERSIST_PATH "IPC_PERSIST_PATH"
 
 // return value for API
 typedef enum {
@@ -29,21 +39,198 @@ typedef enum {
     IPC_ERR_PARAM,
     IPC_ERR_SEQUENCE,
     IPC_ERR_NO_RESOURCE,
-    IPC_ERR_OTHER
+    IPC_ERR_OTHER,
+    IPC_ERR_TIMEOUT
 } IPC_RET_E;
 
 // format of callback function
 typedef void (*IPC_CHANGE_NOTIFY_CB)(void* pData, signed int size, int kind);
+typedef void (*IPC_DATA_NOTIFY_CB)(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size);
+typedef void (*IPC_KIND_NOTIFY_CB)(IPC_USAGE_TYPE_E usageType, int kind, const void* pData, signed int size,
+                                   void* pUserData);
+
+// link state of a client (see ipcRegisterLinkStateCallback)
+typedef enum {
+    IPC_LINK_STATE_DISCONNECTED = 0,
+    IPC_LINK_STATE_CONNECTED
+} IPC_LINK_STATE_E;
+
+typedef void (*IPC_LINK_STATE_CB)(IPC_USAGE_TYPE_E usageType, IPC_LINK_STATE_E state);
+
+// request/response from a client to the server (see ipcClientRequest)
+#define IPC_REQUEST_MAX_SIZE (256) // bytes of the payload of a request or a response
+
+// Called by the server thread (without the server lock) for each request. Writes the response to pResponse
+// and its size to *pResponseSize (0 to IPC_REQUEST_MAX_SIZE, initially 0), and returns the status for the client.
+typedef signed int (*IPC_REQUEST_HANDLER_CB)(IPC_USAGE_TYPE_E usageType, signed int op, const void* pPayload,
+                                            signed int size, void* pResponse, signed int* pResponseSize,
+                                            void* pUserData);
+// Called by the client thread when a request of ipcClientRequestAsync is completed.
+// ret: IPC_RET_OK (status and pResponse are valid), IPC_ERR_PARAM (no handler in the server),
+// IPC_ERR_TIMEOUT, IPC_ERR_NO_RESOURCE (disconnected) or IPC_ERR_SEQUENCE (ipcClientStop).
+typedef void (*IPC_RESPONSE_CB)(IPC_USAGE_TYPE_E usageType, unsigned int requestId, IPC_RET_E ret, signed int status,
+                                const void* pResponse, signed int size, void* pUserData);
+
+// state of the Data Pool of a client (see ipcGetDataState)
+typedef enum {
+    IPC_DATA_STATE_EMPTY = 0, // nothing has been received (all zero)
+    IPC_DATA_STATE_STALE,     // loaded from the persisted snapshot, no data has been received yet
+    IPC_DATA_STATE_LIVE       // received from the server
+} IPC_DATA_STATE_E;
+
+// real-time settings of the internal threads, mutexes and buffers (see ipcSetRtConfig)
+typedef struct {
+    int schedPolicy;            // SCHED_OTHER (default), SCHED_FIFO or SCHED_RR of <sched.h>
+    int schedPriority;          // 0 for SCHED_OTHER
+    unsigned long long cpuMask; // bit n: CPU n, 0: all CPUs
+    int priorityInherit;        // 1: the mutexes of the Data Pool and the server use PTHREAD_PRIO_INHERIT
+    int lockMemory;             // 1: the Data Pool and the buffers are locked (mlock) and prefaulted
+} IPC_RT_CONFIG_S;
+
+// interpolation of ipcReadInterpolated
+typedef enum {
+    IPC_INTERP_LINEAR = 0,        // between the samples around timeNs (render with a delay of one publish interval)
+    IPC_INTERP_CRITICALLY_DAMPED  // follows the samples without overshoot (no delay needed)
+} IPC_INTERP_MODE_E;
+
+// sending of ipcSendMessage (see ipcServerSetSendMode)
+typedef enum {
+    IPC_SEND_MODE_SYNC = 0, // sent to all clients in ipcSendMessage (default)
+    IPC_SEND_MODE_ASYNC     // queued by ipcSendMessage, and sent by the server thread (only the latest one)
+} IPC_SEND_MODE_E;
+
+// notification filter of a kind (see ipcSetKindFilter)
+typedef struct {
+    double deadband;            // notified when the value moves by this from the last notified value (0: any change)
+    double deadbandPercent;     // the same in % of the last notified value (the larger one is used)
+    double hysteresis;          // added to the deadband when the direction of the change is reversed
+    unsigned int minIntervalMs; // between notifications, the last change is notified when it has passed (0: off)
+} IPC_KIND_FILTER_S;
+
+// receiving of the client thread (see ipcClientSetReceiveMode)
+typedef enum {
+    IPC_RECV_MODE_ALL = 0, // every received message is processed (default)
+    IPC_RECV_MODE_LATEST   // only the newest message received in a wakeup is processed
+} IPC_RECV_MODE_E;
+
+// log level and output destination (see ipcSetLogSink)
+typedef enum {
+    IPC_LOG_LEVEL_ERROR = 0,
+    IPC_LOG_LEVEL_WARN,
+    IPC_LOG_LEVEL_INFO,
+    IPC_LOG_LEVEL_DEBUG
+} IPC_LOG_LEVEL_E;
+
+typedef void (*IPC_LOG_SINK_CB)(IPC_LOG_LEVEL_E level, const char *pMessage);
+
+// statistics (see ipcGetStats)
+#define IPC_STATS_CLIENT_MAX_NUM (64) // connection slots of a server
+
+typedef struct {
+    unsigned long long waitNum;      // number of lock acquisitions
+    unsigned long long waitTimeNs;   // total time spent waiting for the lock
+    unsigned long long holdTimeNs;   // total time the lock was held
+    unsigned long long maxWaitTimeNs;
+} IPC_STATS_LOCK_S;
+
+typedef struct {
+    unsigned long long writeErrors;
+    unsigned long long writeAgains;  // EAGAIN/EWOULDBLOCK
+} IPC_STATS_CONNECTION_S;
+
+typedef struct {
+    unsigned long long messagesSent;
+    unsigned long long bytesSent;
+    unsigned long long connects;
+    unsigned long long disconnects;
+    unsigned long long messagesConflated; // IPC_SEND_MODE_ASYNC: replaced by a newer message before sending
+    unsigned long long queueFulls;        // IPC_SEND_MODE_ASYNC: rejected because the send queue was full
+    IPC_STATS_CONNECTION_S connection[IPC_STATS_CLIENT_MAX_NUM]; // index is the connection slot
+    IPC_STATS_LOCK_S lock;           // server lock (shared by all usage types)
+} IPC_STATS_SERVER_S;
+
+typedef struct {
+    unsigned long long messagesReceived;
+    unsigned long long shortReads;   // received less than the data pool size
+    unsigned long long messagesSkipped; // IPC_RECV_MODE_LATEST: superseded by a newer message in the same wakeup
+    unsigned long long callbacks;
+    unsigned long long callbacksFiltered; // changes not notified by ipcSetKindFilter
+    unsigned long long callbackTimeNs;
+    unsigned long long connects;     // including reconnections of ipcClientStartDeferred
+    IPC_STATS_LOCK_S lock;           // data pool lock of the usage type
+} IPC_STATS_CLIENT_S;
+
+typedef struct {
+    IPC_STATS_SERVER_S server;
+    IPC_STATS_CLIENT_S client;
+} IPC_STATS_S;
+
+// usage types registered at runtime (see ipcRegisterUsage)
+#define IPC_REGISTERED_USAGE_MAX_NUM (16)
+#define IPC_REGISTERED_USAGE_MAX_SIZE (1024)     // bytes of the data structure
+#define IPC_REGISTERED_USAGE_KIND_MAX_NUM (256)  // kind is 0 to this - 1
+#define IPC_REGISTERED_USAGE_NAME_MAX_LEN (32)   // [0-9A-Za-z_-]
+
+// a member of the data structure notified to the callbacks with kind
+typedef struct {
+    int kind;
+    int offset;
+    int size;
+} IPC_USAGE_FIELD_S;
 
 // for Server Function
 IPC_RET_E ipcServerStart(IPC_USAGE_TYPE_E usageType);
+IPC_RET_E ipcServerStartWithFd(IPC_USAGE_TYPE_E usageType, int listenFd); // listenFd: not closed by the library
 IPC_RET_E ipcSendMessage(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size);
+IPC_RET_E ipcSendTopic(IPC_USAGE_TYPE_E usageType, int topic, const void* pData, signed int size); // pData: whole
+IPC_RET_E ipcServerSetSendMode(IPC_USAGE_TYPE_E usageType, IPC_SEND_MODE_E mode);
+IPC_RET_E ipcServerSetPersist(IPC_USAGE_TYPE_E usageType, signed int intervalMs); // -1: off, 0: at ipcServerStop
+IPC_RET_E ipcServerSetRequestHandler(IPC_USAGE_TYPE_E usageType, IPC_REQUEST_HANDLER_CB requestHandlerCb,
+                                     void* pUserData); // NULL: removed
 IPC_RET_E ipcServerStop(IPC_USAGE_TYPE_E usageType);
 
 // for Client Function
 IPC_RET_E ipcClientStart(IPC_USAGE_TYPE_E usageType);
+IPC_RET_E ipcClientStartDeferred(IPC_USAGE_TYPE_E usageType); // connects (and reconnects) in background
 IPC_RET_E ipcReadDataPool(IPC_USAGE_TYPE_E usageType, void* pData, signed int* pSize);
+IPC_RET_E ipcReadKind(IPC_USAGE_TYPE_E usageType, int kind, void* pData, signed int* pSize);
+IPC_RET_E ipcGetGeneration(IPC_USAGE_TYPE_E usageType, unsigned long long* pGeneration);
+IPC_RET_E ipcGetTopicSequence(IPC_USAGE_TYPE_E usageType, int topic, unsigned int* pSeq);
+IPC_RET_E ipcWaitForUpdate(IPC_USAGE_TYPE_E usageType, unsigned long long lastGeneration, signed int timeoutMs,
+                           unsigned long long* pGeneration); // timeoutMs: -1 is infinite
+IPC_RET_E ipcGetNotifyFd(IPC_USAGE_TYPE_E usageType, int* pFd); // readable when the generation is changed
+IPC_RET_E ipcReadInterpolated(IPC_USAGE_TYPE_E usageType, int kind, unsigned long long timeNs,
+                              IPC_INTERP_MODE_E mode, double* pValue); // timeNs: CLOCK_MONOTONIC
 IPC_RET_E ipcRegisterCallback(IPC_USAGE_TYPE_E usageType, IPC_CHANGE_NOTIFY_CB changeNotifyCb);
+IPC_RET_E ipcSubscribeKind(IPC_USAGE_TYPE_E usageType, int kind, IPC_KIND_NOTIFY_CB kindNotifyCb, void* pUserData,
+                           int* pHandle);
+IPC_RET_E ipcUnsubscribeKind(IPC_USAGE_TYPE_E usageType, int handle);
+IPC_RET_E ipcSetKindFilter(IPC_USAGE_TYPE_E usageType, int kind, const IPC_KIND_FILTER_S* pFilter); // NULL: removed
+IPC_RET_E ipcRegisterDataCallback(IPC_USAGE_TYPE_E usageType, IPC_DATA_NOTIFY_CB dataNotifyCb);
+IPC_RET_E ipcRegisterLinkStateCallback(IPC_USAGE_TYPE_E usageType, IPC_LINK_STATE_CB linkStateCb);
+IPC_RET_E ipcGetLinkState(IPC_USAGE_TYPE_E usageType, IPC_LINK_STATE_E *pState);
+IPC_RET_E ipcGetDataState(IPC_USAGE_TYPE_E usageType, IPC_DATA_STATE_E *pState);
+IPC_RET_E ipcClientSetReceiveMode(IPC_USAGE_TYPE_E usageType, IPC_RECV_MODE_E mode);
+IPC_RET_E ipcClientRequest(IPC_USAGE_TYPE_E usageType, signed int op, const void* pPayload, signed int size,
+                           signed int timeoutMs, void* pResponse, signed int* pResponseSize,
+                           signed int* pStatus); // *pResponseSize: in: size of pResponse, out: of the response
+IPC_RET_E ipcClientRequestAsync(IPC_USAGE_TYPE_E usageType, signed int op, const void* pPayload, signed int size,
+                                signed int timeoutMs, IPC_RESPONSE_CB responseCb, void* pUserData,
+                                unsigned int* pRequestId);
 IPC_RET_E ipcClientStop(IPC_USAGE_TYPE_E usageType);
 
+// for Server/Client Function
+IPC_RET_E ipcRegisterUsage(const char* pName, signed int size, const IPC_USAGE_FIELD_S* pField, int fieldNum,
+                           IPC_USAGE_TYPE_E* pUsageType);
+IPC_RET_E ipcGetTopicRange(IPC_USAGE_TYPE_E usageType, int topic, signed int* pOffset, signed int* pSize);
+IPC_RET_E ipcGetStats(IPC_USAGE_TYPE_E usageType, IPC_STATS_S *pStats);
+IPC_RET_E ipcSetRtConfig(const IPC_RT_CONFIG_S* pConfig); // before ipcServerStart / ipcClientStart (IPC_ERR_SEQUENCE after)
+IPC_RET_E ipcSetLogSink(IPC_LOG_SINK_CB logSinkCb); // NULL: stdout (default)
+IPC_RET_E ipcSetLogLevel(IPC_LOG_LEVEL_E level);
+void ipcLogSinkSyslog(IPC_LOG_LEVEL_E level, const char *pMessage); // sink for syslog(3)
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // IPC_H
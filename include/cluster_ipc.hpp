@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Header-only C++17 layer on cluster_ipc.h.
+// The sending data structure selects the usage, and the kind selects the member at compile time.
+
+#ifndef IPC_HPP
+#define IPC_HPP
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <tuple>
+#include <utility>
+
+#include <cluster_ipc.h>
+
+namespace ipc {
+
+// == usage descriptor ==
+// Not defined for a type which is not a sending data structure.
+template <typename T>
+struct Usage;
+
+template <>
+struct Usage<IPC_DATA_IC_SERVICE_S> {
+    static constexpr IPC_USAGE_TYPE_E type = IPC_USAGE_TYPE_IC_SERVICE;
+    using Kind = IPC_KIND_IC_SERVICE_E;
+    static constexpr int kindNum = IPC_KIND_ICS_NUM;
+};
+
+template <>
+struct Usage<IPC_DATA_FOR_TEST_S> {
+    static constexpr IPC_USAGE_TYPE_E type = IPC_USAGE_TYPE_FOR_TEST;
+    using Kind = IPC_KIND_FOR_TEST_E;
+    static constexpr int kindNum = IPC_KIND_TEST_NUM;
+};
+
+// == field descriptor ==
+// Expanded from the check change lists of ipc_protocol.h (IPC_CHANGE_LIST_*), as the table of src/ipc_usage_info_table.c.
+// The kind is specialized with its enum type, so a kind of another usage is a compile error.
+struct NoField {};
+
+template <typename T, auto Kind>
+struct Field {
+    static constexpr bool defined = false;
+    using type = NoField;
+};
+
+#define IPC_DEFINE_FIELD(struct_name, member, kind) \
+    template <> \
+    struct Field<struct_name, kind> { \
+        static constexpr bool defined = true; \
+        using type = decltype(struct_name::member); \
+        static constexpr type struct_name::*pMember = &struct_name::member; \
+    }
+
+#define IPC_DEFINE_FIELD_OF_LIST(struct_name, member, kind) IPC_DEFINE_FIELD(struct_name, member, kind);
+IPC_CHANGE_LIST_IC_SERVICE(IPC_DEFINE_FIELD_OF_LIST)
+IPC_CHANGE_LIST_FOR_TEST(IPC_DEFINE_FIELD_OF_LIST)
+
+// every kind of the usage has exactly one field (a duplicated kind is a redefinition error)
+namespace detail {
+template <typename T, std::size_t... I>
+constexpr bool allKindsDefined(std::index_sequence<I...>)
+{
+    return (Field<T, static_cast<typename Usage<T>::Kind>(I)>::defined && ...);
+}
+} // namespace detail
+
+#define IPC_COUNT_FIELD_OF_LIST(struct_name, member, kind) +1
+static_assert((0 IPC_CHANGE_LIST_IC_SERVICE(IPC_COUNT_FIELD_OF_LIST)) == Usage<IPC_DATA_IC_SERVICE_S>::kindNum
+              && detail::allKindsDefined<IPC_DATA_IC_SERVICE_S>(
+                  std::make_index_sequence<Usage<IPC_DATA_IC_SERVICE_S>::kindNum>{}),
+              "IPC_CHANGE_LIST_IC_SERVICE does not match IPC_KIND_IC_SERVICE_E");
+static_assert((0 IPC_CHANGE_LIST_FOR_TEST(IPC_COUNT_FIELD_OF_LIST)) == Usage<IPC_DATA_FOR_TEST_S>::kindNum
+              && detail::allKindsDefined<IPC_DATA_FOR_TEST_S>(
+                  std::make_index_sequence<Usage<IPC_DATA_FOR_TEST_S>::kindNum>{}),
+              "IPC_CHANGE_LIST_FOR_TEST does not match IPC_KIND_FOR_TEST_E");
+
+// == typed accessor for a received/sending data structure (a member access, no lock) ==
+template <auto Kind, typename T>
+constexpr const typename Field<T, Kind>::type& get(const T& data) noexcept
+{
+    static_assert(Field<T, Kind>::defined, "the kind is not in the change table of the usage");
+    return data.*(Field<T, Kind>::pMember);
+}
+
+template <auto Kind, typename T>
+constexpr void set(T& data, const typename Field<T, Kind>::type& value) noexcept
+{
+    static_assert(Field<T, Kind>::defined, "the kind is not in the change table of the usage");
+    data.*(Field<T, Kind>::pMember) = value;
+}
+
+// == Server ==
+template <typename T>
+class Publisher {
+public:
+    static constexpr IPC_USAGE_TYPE_E usage = Usage<T>::type;
+
+    Publisher() = default;
+    ~Publisher() { stop(); }
+    Publisher(const Publisher&) = delete;
+    Publisher& operator=(const Publisher&) = delete;
+
+    // listenFd: a listening socket created by another process (ipcServerStartWithFd), -1: ipcServerStart
+    IPC_RET_E start(int listenFd = -1)
+    {
+        IPC_RET_E ret = (listenFd >= 0) ? ipcServerStartWithFd(usage, listenFd) : ipcServerStart(usage);
+        m_started = (ret == IPC_RET_OK);
+        return ret;
+    }
+
+    IPC_RET_E stop()
+    {
+        if (!m_started) {
+            return IPC_ERR_SEQUENCE;
+        }
+        m_started = false;
+        return ipcServerStop(usage);
+    }
+
+    IPC_RET_E send(const T& data) const { return ipcSendMessage(usage, &data, sizeof(T)); }
+
+    // sends only the members of the topic in data
+    IPC_RET_E sendTopic(int topic, const T& data) const { return ipcSendTopic(usage, topic, &data, sizeof(T)); }
+
+    IPC_RET_E setSendMode(IPC_SEND_MODE_E mode) const { return ipcServerSetSendMode(usage, mode); }
+
+    IPC_RET_E setPersist(signed int intervalMs) const { return ipcServerSetPersist(usage, intervalMs); }
+
+    // handler is called from the server thread (see ipcServerSetRequestHandler)
+    IPC_RET_E setRequestHandler(IPC_REQUEST_HANDLER_CB handler, void* pUserData = nullptr) const
+    {
+        return ipcServerSetRequestHandler(usage, handler, pUserData);
+    }
+
+private:
+    bool m_started = false;
+};
+
+// == Client ==
+// One Subscriber for each usage in a process (same as ipcClientStart).
+// Handlers are called from the client thread, so set them before start().
+template <typename T>
+class Subscriber {
+public:
+    static constexpr IPC_USAGE_TYPE_E usage = Usage<T>::type;
+    static constexpr int kindNum = Usage<T>::kindNum;
+    using Kind = typename Usage<T>::Kind;
+
+    Subscriber() = default;
+    ~Subscriber() { stop(); }
+    Subscriber(const Subscriber&) = delete;
+    Subscriber& operator=(const Subscriber&) = delete;
+
+    // handler(const Field<T, K>::type& value) is called when the member of K is changed.
+    template <Kind K, typename F>
+    void on(F&& handler)
+    {
+        static_assert(Field<T, K>::defined, "the kind is not in the change table of the usage");
+        std::get<static_cast<std::size_t>(K)>(m_handlers) = std::forward<F>(handler);
+    }
+
+    // handler(const T& data) is called for every message after the Data Pool is updated.
+    template <typename F>
+    void onData(F&& handler) { m_dataHandler = std::forward<F>(handler); }
+
+    IPC_RET_E start(bool deferred = false)
+    {
+        IPC_RET_E ret;
+
+        if (s_pInstance != nullptr) {
+            return IPC_ERR_SEQUENCE;
+        }
+        ret = deferred ? ipcClientStartDeferred(usage) : ipcClientStart(usage);
+        if (ret != IPC_RET_OK) {
+            return ret;
+        }
+        s_pInstance = this; // published to the client thread by the lock in ipcRegisterCallback
+        ret = ipcRegisterCallback(usage, &Subscriber::changeNotify);
+        if (ret == IPC_RET_OK && m_dataHandler) {
+            ret = ipcRegisterDataCallback(usage, &Subscriber::dataNotify);
+        }
+        if (ret != IPC_RET_OK) {
+            stop();
+        }
+        return ret;
+    }
+
+    IPC_RET_E stop()
+    {
+        IPC_RET_E ret;
+
+        if (s_pInstance != this) {
+            return IPC_ERR_SEQUENCE;
+        }
+        ret = ipcClientStop(usage); // no callback is running after this
+        s_pInstance = nullptr;
+        return ret;
+    }
+
+    IPC_RET_E read(T& data) const
+    {
+        signed int size = sizeof(T);
+        return ipcReadDataPool(usage, &data, &size);
+    }
+
+    template <Kind K>
+    IPC_RET_E get(typename Field<T, K>::type& value) const
+    {
+        static_assert(Field<T, K>::defined, "the kind is not in the change table of the usage");
+        signed int size = sizeof(value);
+        return ipcReadKind(usage, K, &value, &size);
+    }
+
+    IPC_RET_E generation(unsigned long long& generation) const { return ipcGetGeneration(usage, &generation); }
+
+    IPC_RET_E dataState(IPC_DATA_STATE_E& state) const { return ipcGetDataState(usage, &state); }
+
+    IPC_RET_E waitForUpdate(unsigned long long lastGeneration, signed int timeoutMs, unsigned long long& generation) const
+    {
+        return ipcWaitForUpdate(usage, lastGeneration, timeoutMs, &generation);
+    }
+
+    // responseSize: the size of pResponse, and the size of the response on return
+    IPC_RET_E request(signed int op, const void* pPayload, signed int size, signed int timeoutMs,
+                      void* pResponse, signed int& responseSize, signed int& status) const
+    {
+        return ipcClientRequest(usage, op, pPayload, size, timeoutMs, pResponse, &responseSize, &status);
+    }
+
+    // responseCb is called from the client thread
+    IPC_RET_E requestAsync(signed int op, const void* pPayload, signed int size, signed int timeoutMs,
+                           IPC_RESPONSE_CB responseCb, void* pUserData = nullptr,
+                           unsigned int* pRequestId = nullptr) const
+    {
+        return ipcClientRequestAsync(usage, op, pPayload, size, timeoutMs, responseCb, pUserData, pRequestId);
+    }
+
+private:
+    template <int... K>
+    static auto makeHandlers(std::integer_sequence<int, K...>)
+        -> std::tuple<std::function<void(const typename Field<T, static_cast<Kind>(K)>::type&)>...>;
+    using Handlers = decltype(makeHandlers(std::make_integer_sequence<int, kindNum>()));
+    using Dispatch = void (*)(Handlers&, const void*);
+
+    template <int K>
+    static void dispatch(Handlers& handlers, const void* pData)
+    {
+        using FieldK = Field<T, static_cast<Kind>(K)>;
+
+        if constexpr (FieldK::defined) {
+            auto& handler = std::get<K>(handlers);
+            if (handler) {
+                handler(*static_cast<const typename FieldK::type*>(pData));
+            }
+        }
+    }
+
+    template <int... K>
+    static constexpr std::array<Dispatch, sizeof...(K)> makeDispatchTable(std::integer_sequence<int, K...>)
+    {
+        return {{&dispatch<K>...}};
+    }
+
+    // index is kind; the type of pData is fixed for each kind, so no size check is needed.
+    static constexpr std::array<Dispatch, kindNum> s_dispatchTable =
+        makeDispatchTable(std::make_integer_sequence<int, kindNum>());
+
+    static void changeNotify(void* pData, signed int, int kind)
+    {
+        if (0 <= kind && kind < kindNum) {
+            s_dispatchTable[kind](s_pInstance->m_handlers, pData);
+        }
+    }
+
+    static void dataNotify(IPC_USAGE_TYPE_E, const void* pData, signed int)
+    {
+        s_pInstance->m_dataHandler(*static_cast<const T*>(pData));
+    }
+
+    Handlers m_handlers;
+    std::function<void(const T&)> m_dataHandler;
+    static inline Subscriber* s_pInstance = nullptr;
+};
+
+} // namespace ipc
+
+#endif // IPC_HPP
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// C++20 coroutine layer on cluster_ipc.hpp.
+// The executor watches fd() in its own reactor (e.g. epoll) and calls onReadable() when it is readable.
+// Awaiting coroutines are resumed in onReadable(), so they run on the executor thread, not on the client thread.
+// Destroy the awaiting coroutines before the AsyncSubscriber.
+
+#ifndef IPC_CORO_HPP
+#define IPC_CORO_HPP
+
+#include <coroutine>
+#include <cstring>
+#include <initializer_list>
+#include <sys/eventfd.h>
+
+#include <cluster_ipc.hpp>
+
+namespace ipc {
+
+template <typename T>
+class AsyncSubscriber {
+private:
+    struct Waiter {
+        bool (*pMatch)(const T& previous, const T& current); // nullptr: any update
+        std::coroutine_handle<> handle;
+        Waiter* pNext = nullptr;
+    };
+
+    // base of the awaiters: unlinked by the destructor when the awaiting coroutine is destroyed
+    class AwaiterBase {
+    public:
+        AwaiterBase(AsyncSubscriber& subscriber, bool (*pMatch)(const T&, const T&)) : m_subscriber(subscriber)
+        {
+            m_waiter.pMatch = pMatch;
+        }
+        ~AwaiterBase() { m_subscriber.unlink(&m_waiter); }
+        AwaiterBase(const AwaiterBase&) = delete;
+        AwaiterBase& operator=(const AwaiterBase&) = delete;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            m_waiter.handle = handle;
+            m_subscriber.link(&m_waiter);
+        }
+
+    protected:
+        AsyncSubscriber& m_subscriber;
+        Waiter m_waiter;
+    };
+
+public:
+    static constexpr IPC_USAGE_TYPE_E usage = Usage<T>::type;
+    using Kind = typename Usage<T>::Kind;
+
+    // co_await next(): resumed with the snapshot of the Data Pool when it is updated.
+    class NextAwaiter : public AwaiterBase {
+    public:
+        explicit NextAwaiter(AsyncSubscriber& subscriber) : AwaiterBase(subscriber, nullptr) {}
+        T await_resume() const { return this->m_subscriber.m_snapshot; }
+    };
+
+    // co_await changed<K>(): resumed with the new value when the member of K is changed.
+    template <Kind K>
+    class ChangedAwaiter : public AwaiterBase {
+    public:
+        explicit ChangedAwaiter(AsyncSubscriber& subscriber) : AwaiterBase(subscriber, &ChangedAwaiter::match) {}
+        typename Field<T, K>::type await_resume() const { return ipc::get<K>(this->m_subscriber.m_snapshot); }
+
+    private:
+        static bool match(const T& previous, const T& current) { return ipc::get<K>(previous) != ipc::get<K>(current); }
+    };
+
+    AsyncSubscriber() = default;
+    ~AsyncSubscriber() { stop(); }
+    AsyncSubscriber(const AsyncSubscriber&) = delete;
+    AsyncSubscriber& operator=(const AsyncSubscriber&) = delete;
+
+    IPC_RET_E start(bool deferred = false)
+    {
+        IPC_RET_E ret;
+
+        if (m_fd >= 0) {
+            return IPC_ERR_SEQUENCE;
+        }
+        ret = deferred ? ipcClientStartDeferred(usage) : ipcClientStart(usage);
+        if (ret != IPC_RET_OK) {
+            return ret;
+        }
+        ret = ipcGetNotifyFd(usage, &m_fd);
+        if (ret == IPC_RET_OK) {
+            ret = ipcGetGeneration(usage, &m_generation);
+        }
+        if (ret == IPC_RET_OK) {
+            ret = read(m_snapshot);
+        }
+        if (ret != IPC_RET_OK) {
+            ipcClientStop(usage);
+            m_fd = -1;
+        }
+        return ret;
+    }
+
+    // Suspended coroutines are not resumed after stop().
+    IPC_RET_E stop()
+    {
+        if (m_fd < 0) {
+            return IPC_ERR_SEQUENCE;
+        }
+        m_fd = -1; // closed by ipcClientStop
+        m_pWaiters = nullptr;
+        m_pPending = nullptr;
+        return ipcClientStop(usage);
+    }
+
+    // for the reactor of the executor (readable when the Data Pool is updated)
+    int fd() const noexcept { return m_fd; }
+
+    // Called by the executor when fd() is readable. Resumes the matching coroutines.
+    void onReadable()
+    {
+        eventfd_t count;
+        unsigned long long generation;
+        Waiter* pWaiter;
+
+        if (m_fd < 0) {
+            return;
+        }
+        eventfd_read(m_fd, &count);
+
+        // The generation is read first, so the snapshot is never older than it.
+        if (ipcGetGeneration(usage, &generation) != IPC_RET_OK || generation == m_generation) {
+            return;
+        }
+        m_previous = m_snapshot;
+        if (read(m_snapshot) != IPC_RET_OK) {
+            return;
+        }
+        m_generation = generation;
+        if (std::memcmp(&m_previous, &m_snapshot, sizeof(T)) == 0) {
+            return; // already delivered with the previous generation
+        }
+
+        // Coroutines awaiting again in the resumption wait for the next update.
+        m_pPending = m_pWaiters;
+        m_pWaiters = nullptr;
+        while (m_pPending != nullptr) {
+            pWaiter = m_pPending;
+            m_pPending = pWaiter->pNext;
+            pWaiter->pNext = nullptr;
+            if (pWaiter->pMatch == nullptr || pWaiter->pMatch(m_previous, m_snapshot)) {
+                pWaiter->handle.resume();
+            }
+            else {
+                link(pWaiter);
+            }
+        }
+    }
+
+    NextAwaiter next() { return NextAwaiter(*this); }
+
+    template <Kind K>
+    ChangedAwaiter<K> changed()
+    {
+        static_assert(Field<T, K>::defined, "the kind is not in the change table of the usage");
+        return ChangedAwaiter<K>(*this);
+    }
+
+    // the latest snapshot read by start() or onReadable()
+    const T& snapshot() const noexcept { return m_snapshot; }
+
+private:
+    IPC_RET_E read(T& data) const
+    {
+        signed int size = sizeof(T);
+        return ipcReadDataPool(usage, &data, &size);
+    }
+
+    void link(Waiter* pWaiter)
+    {
+        pWaiter->pNext = m_pWaiters;
+        m_pWaiters = pWaiter;
+    }
+
+    void unlink(Waiter* pWaiter)
+    {
+        for (Waiter** ppList : {&m_pWaiters, &m_pPending}) {
+            for (Waiter** ppCur = ppList; *ppCur != nullptr; ppCur = &((*ppCur)->pNext)) {
+                if (*ppCur == pWaiter) {
+                    *ppCur = pWaiter->pNext;
+                    return;
+                }
+            }
+        }
+    }
+
+    int m_fd = -1;
+    unsigned long long m_generation = 0;
+    T m_snapshot{};
+    T m_previous{};
+    Waiter* m_pWaiters = nullptr; // waiting for the next update
+    Waiter* m_pPending = nullptr; // being checked in onReadable()
+};
+
+} // namespace ipc
+
+#endif // IPC_CORO_HPP
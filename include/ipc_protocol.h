@@ -61,9 +61,21 @@ typedef enum {
     IPC_KIND_ICS_SPORTS_MODE,
     IPC_KIND_ICS_DRIVING_POWER_MODE,
     IPC_KIND_ICS_HOT_TEMP,
-    IPC_KIND_ICS_LOW_TEMP
+    IPC_KIND_ICS_LOW_TEMP,
+    IPC_KIND_ICS_GEAR_AT,
+    IPC_KIND_ICS_SP_ANALOG,
+    IPC_KIND_ICS_TA_ANALOG,
+    IPC_KIND_ICS_O_TEMP,
+    IPC_KIND_ICS_NUM // number of the kinds (keep it last)
 } IPC_KIND_IC_SERVICE_E;
 
+// topics of IPC_USAGE_TYPE_IC_SERVICE (see ipcSendTopic)
+typedef enum {
+    IPC_TOPIC_ICS_FAST = 0,     // ShiftPosition, Speed and Tacho (gearAtVal to taAnalogVal)
+    IPC_TOPIC_ICS_TELLTALE,     // turnR to lowTemp
+    IPC_TOPIC_ICS_TRIP_COMPUTER // trcomTripAVal to fuelEconomyUnitVal
+} IPC_TOPIC_IC_SERVICE_E;
+
 typedef struct {
     // Telltale
     signed int turnR;
@@ -153,13 +165,59 @@ typedef struct {
     signed int fuelEconomyUnitVal;
 } IPC_DATA_IC_SERVICE_S;
 
+// check change table of IPC_USAGE_TYPE_IC_SERVICE: X(structure, member, kind) for every kind.
+// Expanded to the table of src/ipc_usage_info_table.c and to the field descriptors of cluster_ipc.hpp.
+#define IPC_CHANGE_LIST_IC_SERVICE(X) \
+    X(IPC_DATA_IC_SERVICE_S, turnR, IPC_KIND_ICS_TURN_R) \
+    X(IPC_DATA_IC_SERVICE_S, turnL, IPC_KIND_ICS_TURN_L) \
+    X(IPC_DATA_IC_SERVICE_S, brake, IPC_KIND_ICS_BRAKE) \
+    X(IPC_DATA_IC_SERVICE_S, seatbelt, IPC_KIND_ICS_SEATBELT) \
+    X(IPC_DATA_IC_SERVICE_S, highbeam, IPC_KIND_ICS_HIGHBEAM) \
+    X(IPC_DATA_IC_SERVICE_S, door, IPC_KIND_ICS_DOOR) \
+    X(IPC_DATA_IC_SERVICE_S, eps, IPC_KIND_ICS_EPS) \
+    X(IPC_DATA_IC_SERVICE_S, srsAirbag, IPC_KIND_ICS_SRS_AIRBAG) \
+    X(IPC_DATA_IC_SERVICE_S, abs, IPC_KIND_ICS_ABS) \
+    X(IPC_DATA_IC_SERVICE_S, lowBattery, IPC_KIND_ICS_LOW_BATTERY) \
+    X(IPC_DATA_IC_SERVICE_S, oilPress, IPC_KIND_ICS_OIL_PRESS) \
+    X(IPC_DATA_IC_SERVICE_S, engine, IPC_KIND_ICS_ENGINE) \
+    X(IPC_DATA_IC_SERVICE_S, fuel, IPC_KIND_ICS_FUEL) \
+    X(IPC_DATA_IC_SERVICE_S, immobi, IPC_KIND_ICS_IMMOBI) \
+    X(IPC_DATA_IC_SERVICE_S, tmFail, IPC_KIND_ICS_TM_FAIL) \
+    X(IPC_DATA_IC_SERVICE_S, espAct, IPC_KIND_ICS_ESP_ACT) \
+    X(IPC_DATA_IC_SERVICE_S, espOff, IPC_KIND_ICS_ESP_OFF) \
+    X(IPC_DATA_IC_SERVICE_S, adaptingLighting, IPC_KIND_ICS_ADAPTING_LIGHTING) \
+    X(IPC_DATA_IC_SERVICE_S, autoStop, IPC_KIND_ICS_AUTO_STOP) \
+    X(IPC_DATA_IC_SERVICE_S, autoStopFail, IPC_KIND_ICS_AUTO_STOP_FAIL) \
+    X(IPC_DATA_IC_SERVICE_S, parkingLights, IPC_KIND_ICS_PARKING_LIGHTS) \
+    X(IPC_DATA_IC_SERVICE_S, frontFog, IPC_KIND_ICS_FRONT_FOG) \
+    X(IPC_DATA_IC_SERVICE_S, exteriorLightFault, IPC_KIND_ICS_EXTERIOR_LIGHT_FAULT) \
+    X(IPC_DATA_IC_SERVICE_S, accFail, IPC_KIND_ICS_ACC_FAIL) \
+    X(IPC_DATA_IC_SERVICE_S, ldwOff, IPC_KIND_ICS_LDW_OFF) \
+    X(IPC_DATA_IC_SERVICE_S, hillDescent, IPC_KIND_ICS_HILL_DESCENT) \
+    X(IPC_DATA_IC_SERVICE_S, autoHiBeamGreen, IPC_KIND_ICS_AUTO_HI_BEAM_GREEN) \
+    X(IPC_DATA_IC_SERVICE_S, autoHiBeamAmber, IPC_KIND_ICS_AUTO_HI_BEAM_AMBER) \
+    X(IPC_DATA_IC_SERVICE_S, ldwOperate, IPC_KIND_ICS_LDW_OPERATE) \
+    X(IPC_DATA_IC_SERVICE_S, generalWarn, IPC_KIND_ICS_GENERAL_WARN) \
+    X(IPC_DATA_IC_SERVICE_S, sportsMode, IPC_KIND_ICS_SPORTS_MODE) \
+    X(IPC_DATA_IC_SERVICE_S, drivingPowerMode, IPC_KIND_ICS_DRIVING_POWER_MODE) \
+    X(IPC_DATA_IC_SERVICE_S, hotTemp, IPC_KIND_ICS_HOT_TEMP) \
+    X(IPC_DATA_IC_SERVICE_S, lowTemp, IPC_KIND_ICS_LOW_TEMP) \
+    X(IPC_DATA_IC_SERVICE_S, gearAtVal, IPC_KIND_ICS_GEAR_AT) \
+    X(IPC_DATA_IC_SERVICE_S, spAnalogVal, IPC_KIND_ICS_SP_ANALOG) \
+    X(IPC_DATA_IC_SERVICE_S, taAnalogVal, IPC_KIND_ICS_TA_ANALOG) \
+    X(IPC_DATA_IC_SERVICE_S, oTempVal, IPC_KIND_ICS_O_TEMP)
+
 // for IPC_USAGE_TYPE_FOR_TEST
 typedef enum {
-    IPC_KIND_TEST_TEST = 0
+    IPC_KIND_TEST_TEST = 0,
+    IPC_KIND_TEST_NUM // number of the kinds (keep it last)
 } IPC_KIND_FOR_TEST_E;
 
 typedef struct {
     signed int test;
 } IPC_DATA_FOR_TEST_S;
 
+#define IPC_CHANGE_LIST_FOR_TEST(X) \
+    X(IPC_DATA_FOR_TEST_S, test, IPC_KIND_TEST_TEST)
+
 #endif // IPC_PROTOCOL_H
@@ -0,0 +1,998 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// TCP bridge to mirror the state to other nodes.
+//   publish mode (-l): subscribes to the local IPC Server and sends the state
+//     to every connected remote node as delta-encoded, batched frames.
+//   mirror mode (-c): connects to a publisher and reconstructs the state as
+//     the local IPC Server, so remote clients use the unchanged client API.
+//
+// Frame (host byte order; both nodes must have the same ABI, as the data
+// structures of ipc_protocol.h are sent as they are):
+//   BRIDGE_FRAME_HEADER_S
+//   BRIDGE_RECORD_HEADER_S x recordNum (DATA only), each followed by
+//     BRIDGE_RUN_S x runNum, each followed by the changed bytes.
+// A new link starts with the full state (one run covering each usage type).
+// The mirror answers with ACK frames echoing timeNs, which gives the round trip time.
+// The mirror republishes a usage type with topics (e.g. IC-Service) per topic:
+// the topics which the runs of a record overlap are sent by ipcSendTopic.
+// The publisher never blocks on a link: a frame which does not fit in the socket
+// buffer is sent on POLLOUT, and the changes meanwhile go into the next frame.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // ppoll
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <limits.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <cluster_ipc.h>
+
+#define BRIDGE_MAGIC (0x49504342) // "IPCB"
+#define BRIDGE_FRAME_DATA (1)
+#define BRIDGE_FRAME_ACK (2)
+#define BRIDGE_STATE_MAX_SIZE (16384) // bytes of one usage type
+#define BRIDGE_RUN_MERGE_GAP (sizeof(BRIDGE_RUN_S)) // closer differences are sent as one run
+#define BRIDGE_FRAME_MAX_SIZE (sizeof(BRIDGE_FRAME_HEADER_S) \
+    + IPC_USAGE_TYPE_MAX * (sizeof(BRIDGE_RECORD_HEADER_S) + 2 * BRIDGE_STATE_MAX_SIZE))
+#define BRIDGE_LINK_MAX_NUM (8)
+#define BRIDGE_DEFAULT_BATCH_TIME (1000) // usec
+#define BRIDGE_DEFAULT_STATS_INTERVAL (10) // sec
+#define BRIDGE_ACK_INTERVAL (10) // msec
+#define BRIDGE_DEFAULT_BIND_ADDRESS "127.0.0.1"
+#define BRIDGE_SEND_TIMEOUT (1000) // msec, a remote node which can not receive for this time is disconnected
+#define BRIDGE_RETRY_MIN_TIME (100) // msec
+#define BRIDGE_RETRY_MAX_TIME (2000) // msec
+#define BRIDGE_TOPIC_WHOLE (1U << 31) // in a topic mask: bytes outside of the topics are changed
+
+typedef struct {
+    uint32_t magic;
+    uint16_t type;
+    uint16_t recordNum;
+    uint32_t length;     // bytes following this header
+    uint32_t seq;
+    uint64_t timeNs;     // CLOCK_MONOTONIC of the publisher (echoed by ACK)
+} BRIDGE_FRAME_HEADER_S;
+
+typedef struct {
+    uint16_t usage;
+    uint16_t runNum;
+    uint32_t stateSize;  // whole data size of the usage type
+} BRIDGE_RECORD_HEADER_S;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} BRIDGE_RUN_S;
+
+typedef struct {
+    int fd;
+    char name[64];
+    bool keyFrame;       // the next frame carries the full state
+    unsigned char sent[IPC_USAGE_TYPE_MAX][BRIDGE_STATE_MAX_SIZE]; // state the remote node has
+    int sentSize[IPC_USAGE_TYPE_MAX];
+    unsigned long long startNs;
+    unsigned long long frames;
+    unsigned long long wireBytes;
+    unsigned long long rawBytes; // bytes without the delta encoding and batching
+    unsigned long long rttSumNs;
+    unsigned long long rttNum;
+    unsigned long long rttMaxNs;
+    unsigned long long lastAckNs;
+    unsigned char out[BRIDGE_FRAME_MAX_SIZE]; // frame being sent (publish)
+    int outLen;
+    int outPos;
+    bool outDirty;       // the state changed while the frame was being sent
+    unsigned long long outProgressNs; // last time a part of the frame was sent
+    BRIDGE_FRAME_HEADER_S ack; // ACK being received (publish)
+    int ackLen;
+} BRIDGE_LINK_S;
+
+// latest state (publish: received from the local IPC Server, mirror: reconstructed)
+static pthread_mutex_t g_stateMutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned char g_state[IPC_USAGE_TYPE_MAX][BRIDGE_STATE_MAX_SIZE];
+static int g_stateSize[IPC_USAGE_TYPE_MAX]; // 0: not received yet
+static unsigned long long g_updates[IPC_USAGE_TYPE_MAX];
+
+static bool g_usageEnable[IPC_USAGE_TYPE_MAX];
+static BRIDGE_LINK_S *g_pLink[BRIDGE_LINK_MAX_NUM];
+static int g_eventFd = -1;
+static int g_signalFd = -1;
+static int g_batchTime = BRIDGE_DEFAULT_BATCH_TIME;
+static int g_statsInterval = BRIDGE_DEFAULT_STATS_INTERVAL;
+static unsigned char g_frame[BRIDGE_FRAME_MAX_SIZE];
+
+static unsigned long long nowNs(void);
+static int sendAll(int fd, const void *pData, int size);
+static int recvAll(int fd, void *pData, int size);
+static void setSocketOption(int fd);
+static int encodeRuns(const unsigned char *pOld, const unsigned char *pNew, int size, unsigned char *pOut, int *pRunNum);
+static void dataNotifyCb(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size);
+static void linkStateCb(IPC_USAGE_TYPE_E usageType, IPC_LINK_STATE_E state);
+static BRIDGE_LINK_S *linkOpen(int fd, const char *pName);
+static void linkClose(BRIDGE_LINK_S *pLink);
+static void linkReport(BRIDGE_LINK_S *pLink, const char *pMode);
+static int linkFlush(BRIDGE_LINK_S *pLink, unsigned char (*pState)[BRIDGE_STATE_MAX_SIZE], const int *pStateSize);
+static int linkSend(BRIDGE_LINK_S *pLink);
+static int linkRecvAck(BRIDGE_LINK_S *pLink);
+static void flushAll(void);
+static int pollUntil(struct pollfd *pPollFd, int pollNum, unsigned long long deadlineNs);
+static int publishMain(const char *pBind, int port);
+static int mirrorReceive(BRIDGE_LINK_S *pLink);
+static unsigned int mirrorRunTopics(IPC_USAGE_TYPE_E usage, const BRIDGE_RUN_S *pRun);
+static void mirrorPublish(IPC_USAGE_TYPE_E usage, unsigned int topicMask, int size);
+static int mirrorMain(const char *pHost, const char *pPort);
+static void usagePrint(const char *pName);
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    int i;
+    int usage;
+    bool usageSpecified = false;
+    int port = -1;
+    char *pConnect = NULL;
+    char *pBind = BRIDGE_DEFAULT_BIND_ADDRESS;
+    char *pPort;
+    sigset_t sigSet;
+    int ret;
+
+    while ((opt = getopt(argc, argv, "l:a:c:t:b:i:h")) != -1) {
+        switch (opt) {
+        case 'l':
+            port = atoi(optarg);
+            break;
+        case 'a':
+            pBind = optarg;
+            break;
+        case 'c':
+            pConnect = optarg;
+            break;
+        case 't':
+            usage = atoi(optarg);
+            if (usage < 0 || IPC_USAGE_TYPE_MAX <= usage) {
+                usagePrint(argv[0]);
+                return 1;
+            }
+            g_usageEnable[usage] = true;
+            usageSpecified = true;
+            break;
+        case 'b':
+            g_batchTime = atoi(optarg);
+            break;
+        case 'i':
+            g_statsInterval = atoi(optarg);
+            break;
+        default:
+            usagePrint(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((port > 0) == (pConnect != NULL)) {
+        usagePrint(argv[0]);
+        return 1;
+    }
+    if (usageSpecified == false) {
+        for (i = 0; i < IPC_USAGE_TYPE_MAX; i++) {
+            g_usageEnable[i] = true;
+        }
+    }
+
+    // Signals are received by the signalfd. Block them before the library creates its threads.
+    sigemptyset(&sigSet);
+    sigaddset(&sigSet, SIGINT);
+    sigaddset(&sigSet, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigSet, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    g_signalFd = signalfd(-1, &sigSet, SFD_CLOEXEC);
+    g_eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (g_signalFd < 0 || g_eventFd < 0) {
+        perror("signalfd/eventfd");
+        return 1;
+    }
+
+    if (port > 0) {
+        ret = publishMain(pBind, port);
+    }
+    else {
+        pPort = strrchr(pConnect, ':');
+        if (pPort == NULL) {
+            usagePrint(argv[0]);
+            return 1;
+        }
+        *pPort = '\0';
+        ret = mirrorMain(pConnect, pPort + 1);
+    }
+
+    return ret;
+}
+
+static unsigned long long nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int sendAll(int fd, const void *pData, int size)
+{
+    const char *p = pData;
+    ssize_t rc;
+
+    while (size > 0) {
+        rc = send(fd, p, size, MSG_NOSIGNAL);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return -1;
+        }
+        p += rc;
+        size -= rc;
+    }
+
+    return 0;
+}
+
+static int recvAll(int fd, void *pData, int size)
+{
+    char *p = pData;
+    ssize_t rc;
+
+    while (size > 0) {
+        rc = recv(fd, p, size, 0);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return -1;
+        }
+        p += rc;
+        size -= rc;
+    }
+
+    return 0;
+}
+
+static void setSocketOption(int fd)
+{
+    int on = 1;
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+// writes the runs of bytes which differ between pOld and pNew to pOut. returns the written bytes.
+static int encodeRuns(const unsigned char *pOld, const unsigned char *pNew, int size, unsigned char *pOut, int *pRunNum)
+{
+    int len = 0;
+    int i = 0;
+    int start, end;
+    BRIDGE_RUN_S run;
+
+    *pRunNum = 0;
+    while (i < size) {
+        if (pOld[i] == pNew[i]) {
+            i++;
+            continue;
+        }
+
+        start = i;
+        end = i + 1;
+        for (i = end; i < size && i - end < (int)BRIDGE_RUN_MERGE_GAP; i++) {
+            if (pOld[i] != pNew[i]) {
+                end = i + 1;
+            }
+        }
+        i = end;
+
+        run.offset = start;
+        run.length = end - start;
+        memcpy(&(pOut[len]), &run, sizeof(run));
+        len += sizeof(run);
+        memcpy(&(pOut[len]), &(pNew[start]), run.length);
+        len += run.length;
+        (*pRunNum)++;
+    }
+
+    return len;
+}
+
+// == publish mode ==
+// called by the client thread of the library.
+static void dataNotifyCb(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size)
+{
+    uint64_t one = 1;
+
+    if (size <= 0 || BRIDGE_STATE_MAX_SIZE < size) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_stateMutex);
+    memcpy(g_state[usageType], pData, size);
+    g_stateSize[usageType] = size;
+    g_updates[usageType]++;
+    pthread_mutex_unlock(&g_stateMutex);
+
+    if (write(g_eventFd, &one, sizeof(one)) < 0) {
+        // the counter is already signaled
+    }
+}
+
+static void linkStateCb(IPC_USAGE_TYPE_E usageType, IPC_LINK_STATE_E state)
+{
+    printf("ipc_bridge: usage %d local %s\n", usageType,
+           state == IPC_LINK_STATE_CONNECTED ? "connected" : "disconnected");
+    fflush(stdout);
+}
+
+static BRIDGE_LINK_S *linkOpen(int fd, const char *pName)
+{
+    int i;
+    BRIDGE_LINK_S *pLink;
+
+    for (i = 0; i < BRIDGE_LINK_MAX_NUM; i++) {
+        if (g_pLink[i] == NULL) {
+            break;
+        }
+    }
+    if (i == BRIDGE_LINK_MAX_NUM) {
+        return NULL;
+    }
+
+    pLink = calloc(1, sizeof(*pLink));
+    if (pLink == NULL) {
+        return NULL;
+    }
+    pLink->fd = fd;
+    snprintf(pLink->name, sizeof(pLink->name), "%s", pName);
+    pLink->keyFrame = true;
+    pLink->startNs = nowNs();
+    setSocketOption(fd);
+    g_pLink[i] = pLink;
+
+    printf("ipc_bridge: link %s opened\n", pLink->name);
+    fflush(stdout);
+    return pLink;
+}
+
+static void linkClose(BRIDGE_LINK_S *pLink)
+{
+    int i;
+
+    printf("ipc_bridge: link %s closed\n", pLink->name);
+    for (i = 0; i < BRIDGE_LINK_MAX_NUM; i++) {
+        if (g_pLink[i] == pLink) {
+            g_pLink[i] = NULL;
+        }
+    }
+    close(pLink->fd);
+    free(pLink);
+}
+
+static void linkReport(BRIDGE_LINK_S *pLink, const char *pMode)
+{
+    double sec;
+
+    sec = (nowNs() - pLink->startNs) / 1e9;
+    printf("link %s (%s): frames=%llu wire=%llu bytes (%.1f kB/s)", pLink->name, pMode,
+           pLink->frames, pLink->wireBytes, sec > 0 ? pLink->wireBytes / sec / 1000 : 0);
+    if (pLink->rawBytes > 0) {
+        printf(" raw=%llu bytes (%.1f%%)", pLink->rawBytes, 100.0 * pLink->wireBytes / pLink->rawBytes);
+    }
+    if (pLink->rttNum > 0) {
+        printf(" rtt avg=%llu max=%llu usec", pLink->rttSumNs / pLink->rttNum / 1000, pLink->rttMaxNs / 1000);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+// sends the difference between the state and the state the remote node has. returns -1 if the link is broken.
+// while the previous frame is still being sent, the difference is taken again when it is done.
+static int linkFlush(BRIDGE_LINK_S *pLink, unsigned char (*pState)[BRIDGE_STATE_MAX_SIZE], const int *pStateSize)
+{
+    BRIDGE_FRAME_HEADER_S frame;
+    BRIDGE_RECORD_HEADER_S record;
+    unsigned char *pOut = pLink->out;
+    int len = sizeof(frame);
+    int recordLen;
+    int runNum;
+    int usage;
+
+    if (pLink->outPos < pLink->outLen) {
+        pLink->outDirty = true;
+        return 0;
+    }
+
+    frame.recordNum = 0;
+    for (usage = 0; usage < IPC_USAGE_TYPE_MAX; usage++) {
+        if (pStateSize[usage] == 0) {
+            continue;
+        }
+
+        if (pLink->keyFrame == true || pLink->sentSize[usage] != pStateSize[usage]) {
+            // full state as one run
+            recordLen = sizeof(BRIDGE_RUN_S) + pStateSize[usage];
+            ((BRIDGE_RUN_S *)&(pOut[len + sizeof(record)]))->offset = 0;
+            ((BRIDGE_RUN_S *)&(pOut[len + sizeof(record)]))->length = pStateSize[usage];
+            memcpy(&(pOut[len + sizeof(record) + sizeof(BRIDGE_RUN_S)]), pState[usage], pStateSize[usage]);
+            runNum = 1;
+        }
+        else {
+            recordLen = encodeRuns(pLink->sent[usage], pState[usage], pStateSize[usage],
+                                   &(pOut[len + sizeof(record)]), &runNum);
+        }
+        if (runNum == 0) {
+            continue;
+        }
+
+        record.usage = usage;
+        record.runNum = runNum;
+        record.stateSize = pStateSize[usage];
+        memcpy(&(pOut[len]), &record, sizeof(record));
+        len += sizeof(record) + recordLen;
+        frame.recordNum++;
+
+        memcpy(pLink->sent[usage], pState[usage], pStateSize[usage]);
+        pLink->sentSize[usage] = pStateSize[usage];
+        pLink->rawBytes += sizeof(frame) + pStateSize[usage];
+    }
+    pLink->keyFrame = false;
+
+    if (frame.recordNum == 0) {
+        return 0;
+    }
+
+    frame.magic = BRIDGE_MAGIC;
+    frame.type = BRIDGE_FRAME_DATA;
+    frame.length = len - sizeof(frame);
+    frame.seq = (uint32_t)pLink->frames;
+    frame.timeNs = nowNs();
+    memcpy(pOut, &frame, sizeof(frame));
+
+    pLink->outLen = len;
+    pLink->outPos = 0;
+    pLink->outProgressNs = nowNs();
+    pLink->frames++;
+    pLink->wireBytes += len;
+
+    return linkSend(pLink);
+}
+
+// sends the rest of the frame without blocking. returns -1 if the link is broken or stalled.
+static int linkSend(BRIDGE_LINK_S *pLink)
+{
+    ssize_t rc;
+
+    while (pLink->outPos < pLink->outLen) {
+        rc = send(pLink->fd, &(pLink->out[pLink->outPos]), pLink->outLen - pLink->outPos, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (rc <= 0) {
+            return -1;
+        }
+        pLink->outPos += rc;
+        pLink->outProgressNs = nowNs();
+    }
+
+    if (pLink->outPos < pLink->outLen
+        && nowNs() - pLink->outProgressNs >= BRIDGE_SEND_TIMEOUT * 1000000ULL) {
+        printf("ipc_bridge: link %s: send stalled\n", pLink->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+// receives the ACK without blocking. returns -1 if the link is broken.
+static int linkRecvAck(BRIDGE_LINK_S *pLink)
+{
+    ssize_t rc;
+    unsigned long long rtt;
+
+    rc = recv(pLink->fd, (char *)&(pLink->ack) + pLink->ackLen, sizeof(pLink->ack) - pLink->ackLen, MSG_DONTWAIT);
+    if (rc < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    if (rc <= 0) {
+        return -1;
+    }
+    pLink->ackLen += rc;
+    if (pLink->ackLen < (int)sizeof(pLink->ack)) {
+        return 0;
+    }
+    pLink->ackLen = 0;
+
+    if (pLink->ack.magic != BRIDGE_MAGIC || pLink->ack.type != BRIDGE_FRAME_ACK) {
+        return -1;
+    }
+    rtt = nowNs() - pLink->ack.timeNs;
+    pLink->rttSumNs += rtt;
+    pLink->rttNum++;
+    if (rtt > pLink->rttMaxNs) {
+        pLink->rttMaxNs = rtt;
+    }
+
+    return 0;
+}
+
+static void flushAll(void)
+{
+    static unsigned char state[IPC_USAGE_TYPE_MAX][BRIDGE_STATE_MAX_SIZE];
+    int stateSize[IPC_USAGE_TYPE_MAX];
+    int i;
+
+    pthread_mutex_lock(&g_stateMutex);
+    for (i = 0; i < IPC_USAGE_TYPE_MAX; i++) {
+        stateSize[i] = g_stateSize[i];
+        memcpy(state[i], g_state[i], stateSize[i]);
+    }
+    pthread_mutex_unlock(&g_stateMutex);
+
+    for (i = 0; i < BRIDGE_LINK_MAX_NUM; i++) {
+        if (g_pLink[i] != NULL && linkFlush(g_pLink[i], state, stateSize) != 0) {
+            linkClose(g_pLink[i]);
+        }
+    }
+}
+
+// poll() until deadlineNs (ULLONG_MAX: no timeout), with the resolution of the batch time.
+static int pollUntil(struct pollfd *pPollFd, int pollNum, unsigned long long deadlineNs)
+{
+    struct timespec ts;
+    unsigned long long now;
+
+    if (deadlineNs == ULLONG_MAX) {
+        return ppoll(pPollFd, pollNum, NULL, NULL);
+    }
+
+    now = nowNs();
+    if (deadlineNs < now) {
+        deadlineNs = now;
+    }
+    ts.tv_sec = (deadlineNs - now) / 1000000000ULL;
+    ts.tv_nsec = (deadlineNs - now) % 1000000000ULL;
+    return ppoll(pPollFd, pollNum, &ts, NULL);
+}
+
+static int publishMain(const char *pBind, int port)
+{
+    int ret = 1;
+    int listenFd;
+    int fd;
+    int on = 1;
+    int i;
+    int usage;
+    int pollNum;
+    struct sockaddr_in addr;
+    socklen_t addrLen;
+    struct pollfd pollFd[3 + BRIDGE_LINK_MAX_NUM];
+    BRIDGE_LINK_S *pPollLink[3 + BRIDGE_LINK_MAX_NUM];
+    BRIDGE_LINK_S *pLink;
+    unsigned long long nextReport;
+    unsigned long long flushTime = 0; // 0: no change to send
+    unsigned long long deadline;
+    uint64_t count;
+    char name[64];
+
+    for (usage = 0; usage < IPC_USAGE_TYPE_MAX; usage++) {
+        if (g_usageEnable[usage] == false) {
+            continue;
+        }
+        if (ipcClientStartDeferred(usage) != IPC_RET_OK) {
+            printf("ipcClientStartDeferred(%d) failed\n", usage);
+            g_usageEnable[usage] = false;
+            goto end;
+        }
+        ipcRegisterLinkStateCallback(usage, linkStateCb);
+        ipcRegisterDataCallback(usage, dataNotifyCb);
+    }
+
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, pBind, &(addr.sin_addr)) != 1) {
+        printf("ipc_bridge: invalid bind address %s\n", pBind);
+        close(listenFd);
+        goto end;
+    }
+    if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd, BRIDGE_LINK_MAX_NUM) != 0) {
+        perror("bind/listen");
+        close(listenFd);
+        goto end;
+    }
+    printf("ipc_bridge: publishing on %s:%d\n", pBind, port);
+    fflush(stdout);
+
+    nextReport = nowNs() + g_statsInterval * 1000000000ULL;
+    while (1) {
+        pollFd[0].fd = g_signalFd;
+        pollFd[1].fd = g_eventFd;
+        pollFd[2].fd = listenFd;
+        pollNum = 3;
+        for (i = 0; i < 3; i++) {
+            pollFd[i].events = POLLIN;
+            pollFd[i].revents = 0;
+        }
+
+        deadline = ULLONG_MAX;
+        if (g_statsInterval > 0) {
+            deadline = nextReport;
+        }
+        if (flushTime != 0 && flushTime < deadline) {
+            deadline = flushTime;
+        }
+        for (i = 0; i < BRIDGE_LINK_MAX_NUM; i++) {
+            pLink = g_pLink[i];
+            if (pLink == NULL) {
+                continue;
+            }
+            pPollLink[pollNum] = pLink;
+            pollFd[pollNum].fd = pLink->fd;
+            pollFd[pollNum].events = POLLIN;
+            pollFd[pollNum].revents = 0;
+            if (pLink->outPos < pLink->outLen) {
+                pollFd[pollNum].events |= POLLOUT;
+                if (pLink->outProgressNs + BRIDGE_SEND_TIMEOUT * 1000000ULL < deadline) {
+                    deadline = pLink->outProgressNs + BRIDGE_SEND_TIMEOUT * 1000000ULL;
+                }
+            }
+            pollNum++;
+        }
+
+        if (pollUntil(pollFd, pollNum, deadline) < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+
+        if (pollFd[0].revents & POLLIN) {
+            break;
+        }
+
+        if (pollFd[1].revents & POLLIN) {
+            if (read(g_eventFd, &count, sizeof(count)) < 0) {
+                // already cleared
+            }
+            // the changes during the batch time are sent in one frame
+            if (flushTime == 0) {
+                flushTime = nowNs() + g_batchTime * 1000ULL;
+            }
+        }
+
+        if (pollFd[2].revents & POLLIN) {
+            addrLen = sizeof(addr);
+            fd = accept(listenFd, (struct sockaddr *)&addr, &addrLen);
+            if (fd >= 0) {
+                snprintf(name, sizeof(name), "%s:%d", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+                if (linkOpen(fd, name) == NULL) {
+                    close(fd);
+                }
+                else {
+                    flushTime = nowNs(); // the full state for the new link
+                }
+            }
+        }
+
+        for (i = 3; i < pollNum; i++) {
+            pLink = pPollLink[i];
+            if ((pollFd[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0 && linkRecvAck(pLink) != 0) {
+                linkClose(pLink);
+                continue;
+            }
+            if (pLink->outPos < pLink->outLen) {
+                // also detects a stalled link without POLLOUT
+                if (linkSend(pLink) != 0) {
+                    linkClose(pLink);
+                    continue;
+                }
+                if (pLink->outPos == pLink->outLen && pLink->outDirty == true) {
+                    pLink->outDirty = false;
+                    if (flushTime == 0) {
+                        flushTime = nowNs();
+                    }
+                }
+            }
+        }
+
+        if (flushTime != 0 && nowNs() >= flushTime) {
+            flushTime = 0;
+            flushAll();
+        }
+
+        if (g_statsInterval > 0 && nowNs() >= nextReport) {
+            nextReport += g_statsInterval * 1000000000ULL;
+            for (i = 0; i < BRIDGE_LINK_MAX_NUM; i++) {
+                if (g_pLink[i] != NULL) {
+                    linkReport(g_pLink[i], "publish");
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < BRIDGE_LINK_MAX_NUM; i++) {
+        if (g_pLink[i] != NULL) {
+            linkReport(g_pLink[i], "publish");
+            linkClose(g_pLink[i]);
+        }
+    }
+    close(listenFd);
+    ret = 0;
+
+end:
+    for (usage = 0; usage < IPC_USAGE_TYPE_MAX; usage++) {
+        if (g_usageEnable[usage] == true) {
+            ipcClientStop(usage);
+        }
+    }
+    return ret;
+}
+
+// == mirror mode ==
+// receives one frame and republishes the changed usage types. returns -1 if the link is broken.
+static int mirrorReceive(BRIDGE_LINK_S *pLink)
+{
+    BRIDGE_FRAME_HEADER_S frame;
+    BRIDGE_RECORD_HEADER_S record;
+    BRIDGE_RUN_S run;
+    unsigned int topicMask;
+    int pos;
+    int i, j;
+
+    if (recvAll(pLink->fd, &frame, sizeof(frame)) != 0) {
+        return -1;
+    }
+    if (frame.magic != BRIDGE_MAGIC || frame.type != BRIDGE_FRAME_DATA || frame.length > BRIDGE_FRAME_MAX_SIZE) {
+        printf("ipc_bridge: link %s: invalid frame\n", pLink->name);
+        return -1;
+    }
+    if (recvAll(pLink->fd, g_frame, frame.length) != 0) {
+        return -1;
+    }
+    pLink->frames++;
+    pLink->wireBytes += sizeof(frame) + frame.length;
+
+    pos = 0;
+    for (i = 0; i < frame.recordNum; i++) {
+        if (pos + sizeof(record) > frame.length) {
+            return -1;
+        }
+        memcpy(&record, &(g_frame[pos]), sizeof(record));
+        pos += sizeof(record);
+        if (record.usage >= IPC_USAGE_TYPE_MAX || record.stateSize > BRIDGE_STATE_MAX_SIZE) {
+            return -1;
+        }
+
+        topicMask = 0;
+        for (j = 0; j < record.runNum; j++) {
+            if (pos + sizeof(run) > frame.length) {
+                return -1;
+            }
+            memcpy(&run, &(g_frame[pos]), sizeof(run));
+            pos += sizeof(run);
+            // (no addition, which can wrap around with a malformed run)
+            if (run.length > record.stateSize || run.offset > record.stateSize - run.length
+                || run.length > frame.length - pos) {
+                return -1;
+            }
+            memcpy(&(g_state[record.usage][run.offset]), &(g_frame[pos]), run.length);
+            pos += run.length;
+            topicMask |= mirrorRunTopics(record.usage, &run);
+        }
+        g_stateSize[record.usage] = record.stateSize;
+
+        if (g_usageEnable[record.usage] == true) {
+            mirrorPublish(record.usage, topicMask, record.stateSize);
+            g_updates[record.usage]++;
+        }
+    }
+
+    // ACK for the round trip time (not for every frame)
+    if (nowNs() - pLink->lastAckNs >= BRIDGE_ACK_INTERVAL * 1000000ULL) {
+        pLink->lastAckNs = nowNs();
+        frame.type = BRIDGE_FRAME_ACK;
+        frame.length = 0;
+        frame.recordNum = 0;
+        if (sendAll(pLink->fd, &frame, sizeof(frame)) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// returns the bits of the topics which the run overlaps, and BRIDGE_TOPIC_WHOLE
+// if the usage type has no topics or the run has bytes outside of them.
+static unsigned int mirrorRunTopics(IPC_USAGE_TYPE_E usage, const BRIDGE_RUN_S *pRun)
+{
+    unsigned int topicMask = 0;
+    unsigned int covered = 0; // bytes of the run in the topics (they do not overlap each other)
+    unsigned int start;
+    unsigned int end;
+    signed int offset;
+    signed int size;
+    int topic;
+
+    for (topic = 0; ipcGetTopicRange(usage, topic, &offset, &size) == IPC_RET_OK; topic++) {
+        start = pRun->offset > (unsigned int)offset ? pRun->offset : (unsigned int)offset;
+        end = pRun->offset + pRun->length < (unsigned int)(offset + size) ? pRun->offset + pRun->length
+                                                                           : (unsigned int)(offset + size);
+        if (start < end) {
+            topicMask |= 1U << topic;
+            covered += end - start;
+        }
+    }
+    if (covered < pRun->length) {
+        topicMask |= BRIDGE_TOPIC_WHOLE;
+    }
+
+    return topicMask;
+}
+
+// republishes the changed topics of the reconstructed state, or the whole of it.
+static void mirrorPublish(IPC_USAGE_TYPE_E usage, unsigned int topicMask, int size)
+{
+    int topic;
+
+    if ((topicMask & BRIDGE_TOPIC_WHOLE) != 0) {
+        ipcSendMessage(usage, g_state[usage], size);
+        return;
+    }
+
+    for (topic = 0; (topicMask >> topic) != 0; topic++) {
+        if ((topicMask & (1U << topic)) != 0) {
+            ipcSendTopic(usage, topic, g_state[usage], size);
+        }
+    }
+}
+
+static int mirrorMain(const char *pHost, const char *pPort)
+{
+    int ret = 1;
+    int usage;
+    int fd;
+    int rc;
+    int retryTime = BRIDGE_RETRY_MIN_TIME;
+    struct addrinfo hints;
+    struct addrinfo *pAddr = NULL;
+    struct pollfd pollFd[2];
+    BRIDGE_LINK_S *pLink;
+    char name[64];
+    unsigned long long nextReport;
+    int timeout;
+    bool stop = false;
+
+    for (usage = 0; usage < IPC_USAGE_TYPE_MAX; usage++) {
+        if (g_usageEnable[usage] == false) {
+            continue;
+        }
+        if (ipcServerStart(usage) != IPC_RET_OK) {
+            printf("ipcServerStart(%d) failed\n", usage);
+            g_usageEnable[usage] = false;
+            goto end;
+        }
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    rc = getaddrinfo(pHost, pPort, &hints, &pAddr);
+    if (rc != 0) {
+        printf("getaddrinfo: %s\n", gai_strerror(rc));
+        goto end;
+    }
+    snprintf(name, sizeof(name), "%s:%s", pHost, pPort);
+
+    pollFd[0].fd = g_signalFd;
+    pollFd[0].events = POLLIN;
+    while (stop == false) {
+        fd = socket(pAddr->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, pAddr->ai_addr, pAddr->ai_addrlen) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            // retry with backoff (the publisher may not be running yet)
+            pollFd[0].revents = 0;
+            poll(pollFd, 1, retryTime);
+            if (pollFd[0].revents & POLLIN) {
+                break;
+            }
+            retryTime = retryTime * 2 > BRIDGE_RETRY_MAX_TIME ? BRIDGE_RETRY_MAX_TIME : retryTime * 2;
+            continue;
+        }
+        retryTime = BRIDGE_RETRY_MIN_TIME;
+
+        pLink = linkOpen(fd, name);
+        if (pLink == NULL) {
+            close(fd);
+            break;
+        }
+
+        nextReport = nowNs() + g_statsInterval * 1000000000ULL;
+        while (1) {
+            pollFd[1].fd = pLink->fd;
+            pollFd[1].events = POLLIN;
+            pollFd[0].revents = 0;
+            pollFd[1].revents = 0;
+            timeout = -1;
+            if (g_statsInterval > 0) {
+                timeout = nextReport > nowNs() ? (int)((nextReport - nowNs()) / 1000000ULL) : 0;
+            }
+            if (poll(pollFd, 2, timeout) < 0 && errno != EINTR) {
+                stop = true;
+                break;
+            }
+            if (pollFd[0].revents & POLLIN) {
+                stop = true;
+                break;
+            }
+            if (pollFd[1].revents != 0 && mirrorReceive(pLink) != 0) {
+                break;
+            }
+            if (g_statsInterval > 0 && nowNs() >= nextReport) {
+                nextReport += g_statsInterval * 1000000000ULL;
+                linkReport(pLink, "mirror");
+            }
+        }
+        linkReport(pLink, "mirror");
+        linkClose(pLink);
+    }
+    ret = 0;
+
+end:
+    if (pAddr != NULL) {
+        freeaddrinfo(pAddr);
+    }
+    for (usage = 0; usage < IPC_USAGE_TYPE_MAX; usage++) {
+        if (g_usageEnable[usage] == true) {
+            ipcServerStop(usage);
+        }
+    }
+    return ret;
+}
+
+static void usagePrint(const char *pName)
+{
+    printf("usage: %s -l port [-a bind address] [-t usage type]... [-b batch usec] [-i stats interval sec]\n", pName);
+    printf("         publishes the state of the local IPC Server to remote nodes.\n");
+    printf("         listens on %s unless -a is given (0.0.0.0: all interfaces).\n", BRIDGE_DEFAULT_BIND_ADDRESS);
+    printf("       %s -c host:port [-t usage type]... [-i stats interval sec]\n", pName);
+    printf("         mirrors the state of a remote node as the local IPC Server.\n");
+}
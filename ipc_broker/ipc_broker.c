@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Local fan-out broker.
+//   The producer serves on the upstream directory and has only the broker as client.
+//   The broker connects there as an IPC Client (IPC_CLIENT_DOMAIN_PATH) and
+//   republishes every received message as an IPC Server on IPC_DOMAIN_PATH,
+//   so the consumers use the unchanged client API.
+//   The last received message of each usage type is sent to a newly connected
+//   consumer by the IPC Server (last-value cache).
+//   The downstream usages use IPC_SEND_MODE_ASYNC, so the client thread only
+//   queues a message and the server thread sends it to the consumers: a slow
+//   consumer never stalls the upstream connection, and the messages queued
+//   meanwhile are conflated to the latest one.
+//   A usage type with topics (e.g. IC-Service) is forwarded per topic: only the
+//   topics whose members differ from the last forwarded data are sent by
+//   ipcSendTopic, so the consumers see the topics of the producer.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <limits.h>
+#include <cluster_ipc.h>
+
+#define BROKER_DEFAULT_STATS_INTERVAL (0) // sec, 0: no report
+#define BROKER_DATA_MAX_SIZE (16384) // bytes of one usage type compared per topic
+
+static bool g_usageEnable[IPC_USAGE_TYPE_MAX];
+static unsigned long long g_forwardErrors[IPC_USAGE_TYPE_MAX];
+// last forwarded data of the usage types with topics (used only by the client thread)
+static unsigned char g_forwarded[IPC_USAGE_TYPE_MAX][BROKER_DATA_MAX_SIZE];
+static unsigned int g_forwardedTopics[IPC_USAGE_TYPE_MAX]; // bit of the topic: in g_forwarded
+
+static void dataNotifyCb(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size);
+static void forwardTopics(IPC_USAGE_TYPE_E usageType, const unsigned char *pData, signed int size);
+static void linkStateCb(IPC_USAGE_TYPE_E usageType, IPC_LINK_STATE_E state);
+static bool isSamePath(const char *pUpstream, const char *pDownstream);
+static void report(void);
+static void stopAll(void);
+static void usagePrint(const char *pName);
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    int i;
+    int usage;
+    bool usageSpecified = false;
+    int statsInterval = BROKER_DEFAULT_STATS_INTERVAL;
+    char *pUpstream = NULL;
+    sigset_t sigSet;
+    struct timespec timeout;
+    int sig;
+    IPC_RET_E ret;
+
+    while ((opt = getopt(argc, argv, "u:t:i:h")) != -1) {
+        switch (opt) {
+        case 'u':
+            pUpstream = optarg;
+            break;
+        case 't':
+            usage = atoi(optarg);
+            if (usage < 0 || IPC_USAGE_TYPE_MAX <= usage) {
+                usagePrint(argv[0]);
+                return 1;
+            }
+            g_usageEnable[usage] = true;
+            usageSpecified = true;
+            break;
+        case 'i':
+            statsInterval = atoi(optarg);
+            break;
+        default:
+            usagePrint(argv[0]);
+            return 1;
+        }
+    }
+
+    if (pUpstream != NULL) {
+        setenv(IPC_ENV_CLIENT_DOMAIN_SOCKET_PATH, pUpstream, 1);
+    }
+    pUpstream = getenv(IPC_ENV_CLIENT_DOMAIN_SOCKET_PATH);
+    if (pUpstream == NULL || isSamePath(pUpstream, getenv(IPC_ENV_DOMAIN_SOCKET_PATH)) == true) {
+        // The broker would connect to itself.
+        printf("The upstream directory must differ from %s.\n", IPC_ENV_DOMAIN_SOCKET_PATH);
+        usagePrint(argv[0]);
+        return 1;
+    }
+
+    if (usageSpecified == false) {
+        for (i = 0; i < IPC_USAGE_TYPE_MAX; i++) {
+            g_usageEnable[i] = true;
+        }
+    }
+
+    // Signals are received by sigtimedwait. Block them before the library creates its threads.
+    sigemptyset(&sigSet);
+    sigaddset(&sigSet, SIGINT);
+    sigaddset(&sigSet, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigSet, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (i = 0; i < IPC_USAGE_TYPE_MAX; i++) {
+        if (g_usageEnable[i] == false) {
+            continue;
+        }
+
+        ret = ipcServerStart(i);
+        if (ret == IPC_RET_OK) {
+            ret = ipcServerSetSendMode(i, IPC_SEND_MODE_ASYNC);
+        }
+        if (ret != IPC_RET_OK) {
+            printf("ipcServerStart(%d) failed: %d\n", i, ret);
+            ipcServerStop(i);
+            g_usageEnable[i] = false;
+            stopAll();
+            return 1;
+        }
+
+        ret = ipcClientStartDeferred(i);
+        if (ret == IPC_RET_OK) {
+            ret = ipcRegisterLinkStateCallback(i, linkStateCb);
+        }
+        if (ret == IPC_RET_OK) {
+            ret = ipcRegisterDataCallback(i, dataNotifyCb);
+        }
+        if (ret != IPC_RET_OK) {
+            printf("ipcClientStartDeferred(%d) failed: %d\n", i, ret);
+            ipcServerStop(i);
+            g_usageEnable[i] = false;
+            stopAll();
+            return 1;
+        }
+    }
+
+    printf("ipc_broker: upstream=%s downstream=%s\n", pUpstream,
+           getenv(IPC_ENV_DOMAIN_SOCKET_PATH) != NULL ? getenv(IPC_ENV_DOMAIN_SOCKET_PATH) : ".");
+    fflush(stdout);
+
+    timeout.tv_sec = statsInterval > 0 ? statsInterval : INT_MAX;
+    timeout.tv_nsec = 0;
+    while (1) {
+        sig = sigtimedwait(&sigSet, NULL, &timeout);
+        if (sig == SIGINT || sig == SIGTERM) {
+            break;
+        }
+        if (statsInterval > 0) {
+            report();
+        }
+    }
+
+    stopAll();
+    return 0;
+}
+
+// called by the client thread for every message from the producer.
+// only queues the message (async send mode), the server thread forwards it.
+static void dataNotifyCb(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size)
+{
+    signed int offset;
+    signed int topicSize;
+
+    if (ipcGetTopicRange(usageType, 0, &offset, &topicSize) == IPC_RET_OK && size <= BROKER_DATA_MAX_SIZE) {
+        forwardTopics(usageType, pData, size);
+        return;
+    }
+
+    if (ipcSendMessage(usageType, pData, size) != IPC_RET_OK) {
+        g_forwardErrors[usageType]++;
+    }
+}
+
+// sends the topics changed from the last forwarded data (each of them once first).
+// A topic which could not be queued is not recorded, so it is sent with the next message.
+static void forwardTopics(IPC_USAGE_TYPE_E usageType, const unsigned char *pData, signed int size)
+{
+    int topic;
+    signed int offset;
+    signed int topicSize;
+
+    for (topic = 0; ipcGetTopicRange(usageType, topic, &offset, &topicSize) == IPC_RET_OK; topic++) {
+        if ((g_forwardedTopics[usageType] & (1U << topic)) != 0
+            && memcmp(&(g_forwarded[usageType][offset]), &(pData[offset]), topicSize) == 0) {
+            continue;
+        }
+        if (ipcSendTopic(usageType, topic, pData, size) != IPC_RET_OK) {
+            g_forwardErrors[usageType]++;
+            continue;
+        }
+        memcpy(&(g_forwarded[usageType][offset]), &(pData[offset]), topicSize);
+        g_forwardedTopics[usageType] |= 1U << topic;
+    }
+}
+
+static void linkStateCb(IPC_USAGE_TYPE_E usageType, IPC_LINK_STATE_E state)
+{
+    printf("ipc_broker: usage %d upstream %s\n", usageType,
+           state == IPC_LINK_STATE_CONNECTED ? "connected" : "disconnected");
+    fflush(stdout);
+}
+
+static bool isSamePath(const char *pUpstream, const char *pDownstream)
+{
+    char upstream[PATH_MAX];
+    char downstream[PATH_MAX];
+
+    if (pDownstream == NULL) {
+        pDownstream = ".";
+    }
+    if (realpath(pUpstream, upstream) == NULL || realpath(pDownstream, downstream) == NULL) {
+        return strcmp(pUpstream, pDownstream) == 0;
+    }
+
+    return strcmp(upstream, downstream) == 0;
+}
+
+static void report(void)
+{
+    int i;
+    IPC_STATS_S stats;
+    IPC_LINK_STATE_E state;
+
+    for (i = 0; i < IPC_USAGE_TYPE_MAX; i++) {
+        if (g_usageEnable[i] == false) {
+            continue;
+        }
+        if (ipcGetStats(i, &stats) != IPC_RET_OK || ipcGetLinkState(i, &state) != IPC_RET_OK) {
+            continue;
+        }
+        printf("usage %d: upstream %s recv=%llu | downstream clients=%llu sent=%llu bytes=%llu errors=%llu\n",
+               i, state == IPC_LINK_STATE_CONNECTED ? "up" : "down",
+               stats.client.messagesReceived,
+               stats.server.connects - stats.server.disconnects,
+               stats.server.messagesSent, stats.server.bytesSent, g_forwardErrors[i]);
+    }
+    fflush(stdout);
+}
+
+static void stopAll(void)
+{
+    int i;
+
+    for (i = 0; i < IPC_USAGE_TYPE_MAX; i++) {
+        if (g_usageEnable[i] == true) {
+            ipcClientStop(i);
+            ipcServerStop(i);
+        }
+    }
+}
+
+static void usagePrint(const char *pName)
+{
+    printf("usage: %s -u upstream directory [-t usage type]... [-i stats interval sec]\n", pName);
+    printf("  The producer runs with %s=<upstream directory>.\n", IPC_ENV_DOMAIN_SOCKET_PATH);
+    printf("  Consumers connect to %s of the broker. (-u can be given by %s)\n",
+           IPC_ENV_DOMAIN_SOCKET_PATH, IPC_ENV_CLIENT_DOMAIN_SOCKET_PATH);
+}
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Malformed frame test of ipc_bridge (mirror mode).
+//   The test plays the publisher: it runs "ipc_bridge -c" against its own
+//   listening socket, sends a valid frame, then malformed ones. The mirror has
+//   to drop the link on each malformed frame without touching the state, and
+//   to keep republishing the valid frames after it reconnects.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <cluster_ipc.h>
+
+// same wire format as ipc_bridge.c
+#define BRIDGE_MAGIC (0x49504342)
+#define BRIDGE_FRAME_DATA (1)
+
+#define BRIDGE_TEST_TIMEOUT (5000) // msec
+
+typedef struct {
+    uint32_t magic;
+    uint16_t type;
+    uint16_t recordNum;
+    uint32_t length;
+    uint32_t seq;
+    uint64_t timeNs;
+} BRIDGE_FRAME_HEADER_S;
+
+typedef struct {
+    uint16_t usage;
+    uint16_t runNum;
+    uint32_t stateSize;
+} BRIDGE_RECORD_HEADER_S;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} BRIDGE_RUN_S;
+
+typedef struct {
+    const char *pName;
+    uint32_t magic;
+    uint32_t stateSize;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t payload;  // bytes following the run
+} BRIDGE_TEST_CASE_S;
+
+static const BRIDGE_TEST_CASE_S g_malformed[] = {
+    {"wrapping run offset", BRIDGE_MAGIC, sizeof(IPC_DATA_IC_SERVICE_S), 0xFFFFFFF0, 0x20, 0x20},
+    {"run beyond the state", BRIDGE_MAGIC, sizeof(IPC_DATA_IC_SERVICE_S), 8, sizeof(IPC_DATA_IC_SERVICE_S), sizeof(IPC_DATA_IC_SERVICE_S)},
+    {"run beyond the frame", BRIDGE_MAGIC, sizeof(IPC_DATA_IC_SERVICE_S), 0, 0xFFFFFFF8, 16},
+    {"state too large", BRIDGE_MAGIC, 0x7FFFFFFF, 0, 16, 16},
+    {"bad magic", 0x12345678, sizeof(IPC_DATA_IC_SERVICE_S), 0, 16, 16},
+};
+
+static int sendFrame(int fd, const BRIDGE_TEST_CASE_S *pCase, const void *pPayload);
+static int sendState(int fd, int brake);
+static int acceptLink(int listenFd);
+static bool waitClosed(int fd);
+static bool waitBrake(int brake);
+
+int main(int argc, char *argv[])
+{
+    char domainPath[] = "/tmp/ipc_bridge_test.XXXXXX";
+    char socketPath[128];
+    char connect[64];
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    int listenFd;
+    int fd;
+    pid_t pid;
+    int status;
+    int result = 1;
+    unsigned char payload[sizeof(IPC_DATA_IC_SERVICE_S)];
+    size_t i;
+
+    if (argc != 2) {
+        printf("usage: %s <path of ipc_bridge>\n", argv[0]);
+        return 1;
+    }
+
+    if (mkdtemp(domainPath) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    setenv(IPC_ENV_DOMAIN_SOCKET_PATH, domainPath, 1);
+    snprintf(socketPath, sizeof(socketPath), "%s/ipcIcService", domainPath);
+    signal(SIGPIPE, SIG_IGN);
+
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd, 1) != 0
+        || getsockname(listenFd, (struct sockaddr *)&addr, &addrLen) != 0) {
+        perror("bind/listen");
+        return 1;
+    }
+    snprintf(connect, sizeof(connect), "127.0.0.1:%d", ntohs(addr.sin_port));
+
+    pid = fork();
+    if (pid == 0) {
+        execl(argv[1], argv[1], "-c", connect, "-t", "0", "-i", "0", (char *)NULL);
+        perror("execl");
+        _exit(1);
+    }
+
+    fd = acceptLink(listenFd);
+    if (fd < 0 || sendState(fd, 1) != 0) {
+        printf("NG: no link\n");
+        goto end;
+    }
+    while (ipcClientStart(IPC_USAGE_TYPE_IC_SERVICE) != IPC_RET_OK) {
+        usleep(10000);
+    }
+    if (waitBrake(1) == false) {
+        printf("NG: the valid frame was not republished\n");
+        close(fd);
+        goto end;
+    }
+
+    memset(payload, 0xA5, sizeof(payload));
+    for (i = 0; i < sizeof(g_malformed) / sizeof(g_malformed[0]); i++) {
+        if (sendFrame(fd, &g_malformed[i], payload) != 0 || waitClosed(fd) == false) {
+            printf("NG: %s: the link was not closed\n", g_malformed[i].pName);
+            close(fd);
+            goto end;
+        }
+        close(fd);
+        if (waitpid(pid, &status, WNOHANG) != 0) {
+            printf("NG: %s: ipc_bridge exited (status=0x%x)\n", g_malformed[i].pName, status);
+            pid = -1;
+            goto end;
+        }
+
+        fd = acceptLink(listenFd);
+        if (fd < 0) {
+            printf("NG: %s: no reconnection\n", g_malformed[i].pName);
+            goto end;
+        }
+        printf("%s: closed and reconnected\n", g_malformed[i].pName);
+    }
+
+    if (waitBrake(1) == false || sendState(fd, 2) != 0 || waitBrake(2) == false) {
+        printf("NG: the state was broken by the malformed frames\n");
+        close(fd);
+        goto end;
+    }
+    close(fd);
+    result = 0;
+
+end:
+    ipcClientStop(IPC_USAGE_TYPE_IC_SERVICE);
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+    close(listenFd);
+    unlink(socketPath);
+    rmdir(domainPath);
+    printf("%s\n", result == 0 ? "OK" : "NG");
+    return result;
+}
+
+static int sendFrame(int fd, const BRIDGE_TEST_CASE_S *pCase, const void *pPayload)
+{
+    unsigned char buf[sizeof(BRIDGE_FRAME_HEADER_S) + sizeof(BRIDGE_RECORD_HEADER_S) + sizeof(BRIDGE_RUN_S)
+                      + sizeof(IPC_DATA_IC_SERVICE_S)];
+    BRIDGE_FRAME_HEADER_S frame;
+    BRIDGE_RECORD_HEADER_S record;
+    BRIDGE_RUN_S run;
+    int len = sizeof(frame);
+
+    if (pCase->payload > sizeof(IPC_DATA_IC_SERVICE_S)) {
+        return -1;
+    }
+
+    record.usage = IPC_USAGE_TYPE_IC_SERVICE;
+    record.runNum = 1;
+    record.stateSize = pCase->stateSize;
+    memcpy(&(buf[len]), &record, sizeof(record));
+    len += sizeof(record);
+    run.offset = pCase->offset;
+    run.length = pCase->length;
+    memcpy(&(buf[len]), &run, sizeof(run));
+    len += sizeof(run);
+    memcpy(&(buf[len]), pPayload, pCase->payload);
+    len += pCase->payload;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.magic = pCase->magic;
+    frame.type = BRIDGE_FRAME_DATA;
+    frame.recordNum = 1;
+    frame.length = len - sizeof(frame);
+    memcpy(buf, &frame, sizeof(frame));
+
+    return send(fd, buf, len, MSG_NOSIGNAL) == len ? 0 : -1;
+}
+
+static int sendState(int fd, int brake)
+{
+    IPC_DATA_IC_SERVICE_S data;
+    BRIDGE_TEST_CASE_S valid = {"valid", BRIDGE_MAGIC, sizeof(data), 0, sizeof(data), sizeof(data)};
+
+    memset(&data, 0, sizeof(data));
+    data.brake = brake;
+    return sendFrame(fd, &valid, &data);
+}
+
+static int acceptLink(int listenFd)
+{
+    struct pollfd pollFd;
+
+    pollFd.fd = listenFd;
+    pollFd.events = POLLIN;
+    if (poll(&pollFd, 1, BRIDGE_TEST_TIMEOUT) != 1) {
+        return -1;
+    }
+
+    return accept(listenFd, NULL, NULL);
+}
+
+// the ACK frames are skipped until the mirror closes the link.
+static bool waitClosed(int fd)
+{
+    struct pollfd pollFd;
+    char buf[256];
+    ssize_t rc;
+
+    pollFd.fd = fd;
+    pollFd.events = POLLIN;
+    while (poll(&pollFd, 1, BRIDGE_TEST_TIMEOUT) == 1) {
+        rc = recv(fd, buf, sizeof(buf), 0);
+        if (rc <= 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool waitBrake(int brake)
+{
+    IPC_DATA_IC_SERVICE_S data;
+    signed int size;
+    int i;
+
+    for (i = 0; i < BRIDGE_TEST_TIMEOUT / 10; i++) {
+        size = sizeof(data);
+        if (ipcReadDataPool(IPC_USAGE_TYPE_IC_SERVICE, &data, &size) == IPC_RET_OK && data.brake == brake) {
+            return true;
+        }
+        usleep(10000);
+    }
+
+    return false;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compile test of cluster_ipc_coro.hpp (C++20).
+//   AsyncSubscriber is instantiated explicitly, and a coroutine awaits next()
+//   and changed<K>(). The suspended coroutine is destroyed, which unlinks its
+//   awaiter (nothing is started, so it is never resumed).
+
+#include <cstdio>
+#include <coroutine>
+#include <cluster_ipc_coro.hpp>
+
+template class ipc::AsyncSubscriber<IPC_DATA_IC_SERVICE_S>;
+template class ipc::AsyncSubscriber<IPC_DATA_FOR_TEST_S>;
+
+namespace {
+
+// the smallest coroutine type: started eagerly, destroyed by the owner
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() {}
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+int g_brake = -1;
+
+Task watchBrake(ipc::AsyncSubscriber<IPC_DATA_IC_SERVICE_S>& subscriber)
+{
+    IPC_DATA_IC_SERVICE_S data = co_await subscriber.next();
+    g_brake = ipc::get<IPC_KIND_ICS_BRAKE>(data);
+    g_brake = co_await subscriber.changed<IPC_KIND_ICS_BRAKE>();
+}
+
+} // namespace
+
+int main()
+{
+    ipc::AsyncSubscriber<IPC_DATA_IC_SERVICE_S> subscriber;
+    Task task = watchBrake(subscriber);
+    bool suspended = !task.handle.done();
+
+    task.handle.destroy();
+    subscriber.onReadable(); // not started: nothing is resumed
+
+    if (suspended == false || g_brake != -1 || subscriber.fd() != -1 || subscriber.stop() != IPC_ERR_SEQUENCE) {
+        std::printf("NG\n");
+        return 1;
+    }
+
+    std::printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// IPC_MUX test.
+//   A forked server serves FOR_TEST, then IC-Service after the client has
+//   started both usages on one multiplexed connection. The server sends the two
+//   usages alternately, and the client checks that every message arrives in the
+//   sending order across the usages (which only one connection guarantees).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <cluster_ipc.h>
+
+#define MUX_TEST_MESSAGE_NUM (200)
+#define MUX_TEST_TIMEOUT (5000) // msec
+#define MUX_TEST_SEND_INTERVAL (1000) // usec
+
+static int g_lastBrake;
+static int g_lastTest;
+static int g_received;
+static bool g_outOfOrder;
+
+static int serverMain(int readyFd, int goFd);
+static void dataNotifyCb(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size);
+
+int main(void)
+{
+    char domainPath[] = "/tmp/ipc_mux_test.XXXXXX";
+    int readyPipe[2];
+    int goPipe[2];
+    char c = 'g';
+    pid_t pid;
+    int status;
+    int result = 1;
+    int i;
+    IPC_RET_E ret;
+
+    if (mkdtemp(domainPath) == NULL || pipe(readyPipe) != 0 || pipe(goPipe) != 0) {
+        perror("mkdtemp/pipe");
+        return 1;
+    }
+    setenv(IPC_ENV_DOMAIN_SOCKET_PATH, domainPath, 1);
+    setenv(IPC_ENV_MUX, "1", 1);
+
+    pid = fork();
+    if (pid == 0) {
+        close(readyPipe[0]);
+        close(goPipe[1]);
+        _exit(serverMain(readyPipe[1], goPipe[0]));
+    }
+    close(readyPipe[1]);
+    close(goPipe[0]);
+
+    if (read(readyPipe[0], &c, 1) != 1) {
+        printf("NG: the server did not start\n");
+        goto end;
+    }
+
+    // the server runs, but does not serve IC-Service yet: the start succeeds with IPC_MUX
+    ret = ipcClientStart(IPC_USAGE_TYPE_IC_SERVICE);
+    if (ret != IPC_RET_OK) {
+        printf("NG: ipcClientStart(IC_SERVICE)=%d\n", ret);
+        goto end;
+    }
+    ret = ipcClientStart(IPC_USAGE_TYPE_FOR_TEST);
+    if (ret != IPC_RET_OK) {
+        printf("NG: ipcClientStart(FOR_TEST)=%d\n", ret);
+        goto end;
+    }
+    ipcRegisterDataCallback(IPC_USAGE_TYPE_IC_SERVICE, dataNotifyCb);
+    ipcRegisterDataCallback(IPC_USAGE_TYPE_FOR_TEST, dataNotifyCb);
+    if (write(goPipe[1], &c, 1) != 1) {
+        goto end;
+    }
+
+    for (i = 0; i < MUX_TEST_TIMEOUT / 10; i++) {
+        if (__atomic_load_n(&g_lastTest, __ATOMIC_ACQUIRE) == MUX_TEST_MESSAGE_NUM) {
+            break;
+        }
+        usleep(10000);
+    }
+    printf("received=%d brake=%d test=%d\n", g_received, g_lastBrake, g_lastTest);
+    if (g_lastBrake != MUX_TEST_MESSAGE_NUM || g_lastTest != MUX_TEST_MESSAGE_NUM) {
+        printf("NG: the last messages did not arrive\n");
+        goto end;
+    }
+    if (g_outOfOrder == true) {
+        printf("NG: the messages of the usages arrived out of the sending order\n");
+        goto end;
+    }
+    result = 0;
+
+end:
+    ipcClientStop(IPC_USAGE_TYPE_IC_SERVICE);
+    ipcClientStop(IPC_USAGE_TYPE_FOR_TEST);
+    close(goPipe[1]); // ends the server
+    if (pid > 0 && (waitpid(pid, &status, 0) != pid || WIFEXITED(status) == 0 || WEXITSTATUS(status) != 0)) {
+        printf("NG: server\n");
+        result = 1;
+    }
+    rmdir(domainPath);
+    printf("%s\n", result == 0 ? "OK" : "NG");
+    return result;
+}
+
+static int serverMain(int readyFd, int goFd)
+{
+    IPC_DATA_IC_SERVICE_S icService;
+    IPC_DATA_FOR_TEST_S forTest;
+    char c = 'r';
+    int i;
+
+    if (ipcServerStart(IPC_USAGE_TYPE_FOR_TEST) != IPC_RET_OK || write(readyFd, &c, 1) != 1
+        || read(goFd, &c, 1) != 1 || ipcServerStart(IPC_USAGE_TYPE_IC_SERVICE) != IPC_RET_OK) {
+        return 1;
+    }
+
+    memset(&icService, 0, sizeof(icService));
+    memset(&forTest, 0, sizeof(forTest));
+    for (i = 1; i <= MUX_TEST_MESSAGE_NUM; i++) {
+        icService.brake = i;
+        forTest.test = i;
+        if (ipcSendMessage(IPC_USAGE_TYPE_IC_SERVICE, &icService, sizeof(icService)) != IPC_RET_OK
+            || ipcSendMessage(IPC_USAGE_TYPE_FOR_TEST, &forTest, sizeof(forTest)) != IPC_RET_OK) {
+            return 1;
+        }
+        // the server does not wait for a multiplexed client which can not take a frame, but closes it
+        usleep(MUX_TEST_SEND_INTERVAL);
+    }
+
+    while (read(goFd, &c, 1) > 0) {
+        // until the client ends
+    }
+    ipcServerStop(IPC_USAGE_TYPE_IC_SERVICE);
+    ipcServerStop(IPC_USAGE_TYPE_FOR_TEST);
+    return 0;
+}
+
+// IC-Service i is sent before FOR_TEST i, and FOR_TEST i before IC-Service i + 1.
+static void dataNotifyCb(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size)
+{
+    int value;
+
+    g_received++;
+    if (usageType == IPC_USAGE_TYPE_IC_SERVICE) {
+        value = ((const IPC_DATA_IC_SERVICE_S *)pData)->brake;
+        if (value <= g_lastBrake || value > g_lastTest + 1) {
+            g_outOfOrder = true;
+        }
+        g_lastBrake = value;
+    }
+    else {
+        value = ((const IPC_DATA_FOR_TEST_S *)pData)->test;
+        if (value <= g_lastTest || value > g_lastBrake) {
+            g_outOfOrder = true;
+        }
+        __atomic_store_n(&g_lastTest, value, __ATOMIC_RELEASE);
+    }
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Persistence test.
+//   Forked servers persist IC-Service to IPC_PERSIST_PATH and go away: one is
+//   killed after its interval write, one stops (written at ipcServerStop).
+//   A client started after each preloads the last data as
+//   IPC_DATA_STATE_STALE, and gets IPC_DATA_STATE_LIVE with the data of the
+//   next server when it is restarted.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <cluster_ipc.h>
+
+#define PERSIST_TEST_DOMAIN_NAME "ipcIcService" // of IPC_USAGE_TYPE_IC_SERVICE
+#define PERSIST_TEST_SNAPSHOT_SUFFIX ".snapshot"
+#define PERSIST_TEST_INTERVAL (50) // msec
+#define PERSIST_TEST_WRITE_TIME (500) // msec for the interval write
+#define PERSIST_TEST_TIMEOUT (5000) // msec
+
+typedef struct {
+    pid_t pid;
+    int endFd; // closed: the server stops
+} PERSIST_TEST_SERVER_S;
+
+static bool startServer(PERSIST_TEST_SERVER_S *pServer, int brake, signed int intervalMs);
+static bool stopServer(PERSIST_TEST_SERVER_S *pServer);
+static int serverMain(int brake, signed int intervalMs, int readyFd, int endFd);
+static bool checkClient(const char *pName, int brake, IPC_DATA_STATE_E state, int timeoutMs);
+
+int main(void)
+{
+    char domainPath[] = "/tmp/ipc_persist_test.XXXXXX";
+    char persistPath[] = "/tmp/ipc_persist_test_data.XXXXXX";
+    char snapshotPath[sizeof(persistPath) + sizeof(PERSIST_TEST_DOMAIN_NAME PERSIST_TEST_SNAPSHOT_SUFFIX)];
+    char socketPath[sizeof(domainPath) + sizeof(PERSIST_TEST_DOMAIN_NAME)];
+    PERSIST_TEST_SERVER_S server = {-1, -1};
+    int result = 1;
+
+    if (mkdtemp(domainPath) == NULL || mkdtemp(persistPath) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    setenv(IPC_ENV_DOMAIN_SOCKET_PATH, domainPath, 1);
+    setenv(IPC_ENV_PERSIST_PATH, persistPath, 1);
+    snprintf(socketPath, sizeof(socketPath), "%s/%s", domainPath, PERSIST_TEST_DOMAIN_NAME);
+    snprintf(snapshotPath, sizeof(snapshotPath), "%s/%s%s", persistPath, PERSIST_TEST_DOMAIN_NAME,
+             PERSIST_TEST_SNAPSHOT_SUFFIX);
+
+    // nothing persisted yet
+    if (ipcClientStartDeferred(IPC_USAGE_TYPE_IC_SERVICE) != IPC_RET_OK
+        || checkClient("empty", 0, IPC_DATA_STATE_EMPTY, 0) == false) {
+        goto end;
+    }
+    ipcClientStop(IPC_USAGE_TYPE_IC_SERVICE);
+
+    // written every interval: the data is there after the server is killed
+    if (startServer(&server, 11, PERSIST_TEST_INTERVAL) == false) {
+        goto end;
+    }
+    usleep(PERSIST_TEST_WRITE_TIME * 1000);
+    kill(server.pid, SIGKILL);
+    waitpid(server.pid, NULL, 0);
+    close(server.endFd);
+    server.pid = -1;
+    unlink(socketPath); // left by the killed server
+    if (ipcClientStartDeferred(IPC_USAGE_TYPE_IC_SERVICE) != IPC_RET_OK
+        || checkClient("killed", 11, IPC_DATA_STATE_STALE, 0) == false) {
+        goto end;
+    }
+    ipcClientStop(IPC_USAGE_TYPE_IC_SERVICE);
+
+    // written at ipcServerStop
+    if (startServer(&server, 22, 0) == false || stopServer(&server) == false) {
+        goto end;
+    }
+    if (ipcClientStartDeferred(IPC_USAGE_TYPE_IC_SERVICE) != IPC_RET_OK
+        || checkClient("stopped", 22, IPC_DATA_STATE_STALE, 0) == false) {
+        goto end;
+    }
+
+    // the restarted server replaces it (the client keeps running)
+    if (startServer(&server, 33, -1) == false
+        || checkClient("restarted", 33, IPC_DATA_STATE_LIVE, PERSIST_TEST_TIMEOUT) == false
+        || stopServer(&server) == false) {
+        goto end;
+    }
+    result = 0;
+
+end:
+    ipcClientStop(IPC_USAGE_TYPE_IC_SERVICE);
+    if (server.pid > 0) {
+        kill(server.pid, SIGKILL);
+        waitpid(server.pid, NULL, 0);
+    }
+    unlink(socketPath);
+    unlink(snapshotPath);
+    rmdir(persistPath);
+    rmdir(domainPath);
+    printf("%s\n", result == 0 ? "OK" : "NG");
+    return result;
+}
+
+static bool startServer(PERSIST_TEST_SERVER_S *pServer, int brake, signed int intervalMs)
+{
+    int readyPipe[2];
+    int endPipe[2];
+    char c;
+
+    if (pipe(readyPipe) != 0 || pipe(endPipe) != 0) {
+        perror("pipe");
+        return false;
+    }
+    pServer->pid = fork();
+    if (pServer->pid == 0) {
+        close(readyPipe[0]);
+        close(endPipe[1]);
+        _exit(serverMain(brake, intervalMs, readyPipe[1], endPipe[0]));
+    }
+    close(readyPipe[1]);
+    close(endPipe[0]);
+    pServer->endFd = endPipe[1];
+
+    if (read(readyPipe[0], &c, 1) != 1) {
+        printf("NG: the server (brake=%d) did not start\n", brake);
+        close(readyPipe[0]);
+        return false;
+    }
+    close(readyPipe[0]);
+
+    return true;
+}
+
+static bool stopServer(PERSIST_TEST_SERVER_S *pServer)
+{
+    int status;
+
+    close(pServer->endFd);
+    if (waitpid(pServer->pid, &status, 0) != pServer->pid || WIFEXITED(status) == 0 || WEXITSTATUS(status) != 0) {
+        printf("NG: server\n");
+        return false;
+    }
+    pServer->pid = -1;
+
+    return true;
+}
+
+// intervalMs: of ipcServerSetPersist, -1: not persisted
+static int serverMain(int brake, signed int intervalMs, int readyFd, int endFd)
+{
+    IPC_DATA_IC_SERVICE_S icService;
+    char c = 'r';
+
+    memset(&icService, 0, sizeof(icService));
+    icService.brake = brake;
+    if (ipcServerStart(IPC_USAGE_TYPE_IC_SERVICE) != IPC_RET_OK
+        || ipcServerSetPersist(IPC_USAGE_TYPE_IC_SERVICE, intervalMs) != IPC_RET_OK
+        || ipcSendMessage(IPC_USAGE_TYPE_IC_SERVICE, &icService, sizeof(icService)) != IPC_RET_OK
+        || write(readyFd, &c, 1) != 1) {
+        return 1;
+    }
+
+    while (read(endFd, &c, 1) > 0) {
+        // until the client closes it
+    }
+
+    return ipcServerStop(IPC_USAGE_TYPE_IC_SERVICE) == IPC_RET_OK ? 0 : 1;
+}
+
+static bool checkClient(const char *pName, int brake, IPC_DATA_STATE_E state, int timeoutMs)
+{
+    IPC_DATA_IC_SERVICE_S icService;
+    IPC_DATA_STATE_E dataState = IPC_DATA_STATE_EMPTY;
+    signed int size;
+    int i;
+
+    memset(&icService, 0, sizeof(icService));
+    for (i = 0; i <= timeoutMs / 10; i++) {
+        size = sizeof(icService);
+        if (ipcReadDataPool(IPC_USAGE_TYPE_IC_SERVICE, &icService, &size) == IPC_RET_OK
+            && ipcGetDataState(IPC_USAGE_TYPE_IC_SERVICE, &dataState) == IPC_RET_OK
+            && icService.brake == brake && dataState == state) {
+            printf("%s: OK\n", pName);
+            return true;
+        }
+        usleep(10000);
+    }
+
+    printf("NG: %s: brake=%d state=%d\n", pName, icService.brake, dataState);
+    return false;
+}
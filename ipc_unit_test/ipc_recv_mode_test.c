@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Receive mode change test.
+//   The test serves FOR_TEST on a raw socket, so a message can be sent in two
+//   parts. The client receives the head of a message in IPC_RECV_MODE_LATEST,
+//   is switched to IPC_RECV_MODE_ALL, and then receives the rest and one more
+//   message: both must arrive whole, not shifted by the head.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <cluster_ipc.h>
+
+#define RECV_MODE_TEST_DOMAIN_NAME "ipcForTest" // of IPC_USAGE_TYPE_FOR_TEST
+#define RECV_MODE_TEST_HEAD_SIZE (2) // bytes of the message sent before the mode change
+#define RECV_MODE_TEST_SETTLE_TIME (100) // msec for the client thread to read what is sent
+#define RECV_MODE_TEST_TIMEOUT (5000) // msec
+
+// the bytes of each value differ, so a shifted message is not one of them
+static const signed int g_value[] = {0x11223344, 0x0A0B0C0D, 0x01020304};
+#define RECV_MODE_TEST_VALUE_NUM ((int)(sizeof(g_value) / sizeof(g_value[0])))
+
+static signed int g_received[RECV_MODE_TEST_VALUE_NUM + 1];
+static int g_receivedNum;
+
+static int listenDomain(const char *pDomainPath);
+static void dataNotifyCb(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size);
+static bool waitReceived(int num);
+
+int main(void)
+{
+    char domainPath[] = "/tmp/ipc_recv_mode_test.XXXXXX";
+    char socketPath[sizeof(domainPath) + sizeof(RECV_MODE_TEST_DOMAIN_NAME)];
+    int listenFd = -1;
+    int fd = -1;
+    int result = 1;
+    int i;
+    IPC_RET_E ret;
+
+    if (mkdtemp(domainPath) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    setenv(IPC_ENV_DOMAIN_SOCKET_PATH, domainPath, 1);
+    snprintf(socketPath, sizeof(socketPath), "%s/%s", domainPath, RECV_MODE_TEST_DOMAIN_NAME);
+
+    listenFd = listenDomain(socketPath);
+    if (listenFd < 0) {
+        printf("NG: listen\n");
+        goto end;
+    }
+    ret = ipcClientStart(IPC_USAGE_TYPE_FOR_TEST);
+    if (ret == IPC_RET_OK) {
+        ret = ipcClientSetReceiveMode(IPC_USAGE_TYPE_FOR_TEST, IPC_RECV_MODE_LATEST);
+    }
+    if (ret == IPC_RET_OK) {
+        ret = ipcRegisterDataCallback(IPC_USAGE_TYPE_FOR_TEST, dataNotifyCb);
+    }
+    fd = accept(listenFd, NULL, NULL);
+    if (ret != IPC_RET_OK || fd < 0) {
+        printf("NG: ipcClientStart=%d accept=%d\n", ret, fd);
+        goto end;
+    }
+
+    // a whole message in IPC_RECV_MODE_LATEST
+    if (send(fd, &(g_value[0]), sizeof(g_value[0]), 0) != sizeof(g_value[0]) || waitReceived(1) == false) {
+        printf("NG: the first message did not arrive\n");
+        goto end;
+    }
+
+    // the head of the next one, then IPC_RECV_MODE_ALL
+    if (send(fd, &(g_value[1]), RECV_MODE_TEST_HEAD_SIZE, 0) != RECV_MODE_TEST_HEAD_SIZE) {
+        goto end;
+    }
+    usleep(RECV_MODE_TEST_SETTLE_TIME * 1000);
+    ret = ipcClientSetReceiveMode(IPC_USAGE_TYPE_FOR_TEST, IPC_RECV_MODE_ALL);
+    if (ret != IPC_RET_OK) {
+        printf("NG: ipcClientSetReceiveMode(ALL)=%d\n", ret);
+        goto end;
+    }
+
+    // the rest of it, and one more
+    if (send(fd, (const char *)&(g_value[1]) + RECV_MODE_TEST_HEAD_SIZE, sizeof(g_value[1]) - RECV_MODE_TEST_HEAD_SIZE,
+             0) != sizeof(g_value[1]) - RECV_MODE_TEST_HEAD_SIZE) {
+        goto end;
+    }
+    usleep(RECV_MODE_TEST_SETTLE_TIME * 1000); // received separately in IPC_RECV_MODE_ALL
+    if (send(fd, &(g_value[2]), sizeof(g_value[2]), 0) != sizeof(g_value[2])) {
+        goto end;
+    }
+    waitReceived(RECV_MODE_TEST_VALUE_NUM);
+    usleep(RECV_MODE_TEST_SETTLE_TIME * 1000); // for an extra message
+
+    for (i = 0; i < g_receivedNum; i++) {
+        printf("received[%d]=0x%08x\n", i, (unsigned int)g_received[i]);
+    }
+    if (g_receivedNum != RECV_MODE_TEST_VALUE_NUM) {
+        printf("NG: %d messages\n", g_receivedNum);
+        goto end;
+    }
+    for (i = 0; i < RECV_MODE_TEST_VALUE_NUM; i++) {
+        if (g_received[i] != g_value[i]) {
+            printf("NG: the message %d is shifted\n", i);
+            goto end;
+        }
+    }
+    result = 0;
+
+end:
+    ipcClientStop(IPC_USAGE_TYPE_FOR_TEST);
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(socketPath);
+    }
+    rmdir(domainPath);
+    printf("%s\n", result == 0 ? "OK" : "NG");
+    return result;
+}
+
+static int listenDomain(const char *pDomainPath)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, pDomainPath, sizeof(addr.sun_path) - 1);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void dataNotifyCb(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size)
+{
+    int num = __atomic_load_n(&g_receivedNum, __ATOMIC_RELAXED);
+
+    (void)usageType;
+    if (num <= RECV_MODE_TEST_VALUE_NUM && size == sizeof(signed int)) {
+        g_received[num] = ((const IPC_DATA_FOR_TEST_S *)pData)->test;
+        __atomic_store_n(&g_receivedNum, num + 1, __ATOMIC_RELEASE);
+    }
+}
+
+static bool waitReceived(int num)
+{
+    int i;
+
+    for (i = 0; i <= RECV_MODE_TEST_TIMEOUT / 10; i++) {
+        if (__atomic_load_n(&g_receivedNum, __ATOMIC_ACQUIRE) >= num) {
+            return true;
+        }
+        usleep(10000);
+    }
+
+    return false;
+}
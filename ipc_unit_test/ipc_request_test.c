@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Request/response test.
+//   A forked server serves IC-Service with a request handler. The client checks
+//   that pipelined responses complete the requests of their ids, that the data
+//   sent by a handler arrives before its response, that an async request times
+//   out, and that the pending requests fail with IPC_ERR_SEQUENCE at
+//   ipcClientStop and with IPC_ERR_NO_RESOURCE when the server goes away.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <cluster_ipc.h>
+
+#define REQUEST_TEST_OP_ECHO (1) // the status is the int payload * 10, the payload is returned
+#define REQUEST_TEST_OP_SEND (2) // brake = the int payload is sent before the response
+#define REQUEST_TEST_OP_SLOW (3) // the response is sent after REQUEST_TEST_SLOW_TIME
+#define REQUEST_TEST_OP_EXIT (4) // the server exits without a response
+
+#define REQUEST_TEST_PIPELINE_NUM (16)
+#define REQUEST_TEST_SLOW_TIME (300) // msec
+#define REQUEST_TEST_TIMEOUT (5000) // msec
+
+typedef struct {
+    int done;
+    IPC_RET_E ret;
+    signed int status;
+    int echo;   // the int payload of the response
+    int brake;  // read from the Data Pool in the callback
+} REQUEST_TEST_RESULT_S;
+
+static REQUEST_TEST_RESULT_S g_result[REQUEST_TEST_PIPELINE_NUM + 1];
+static unsigned int g_requestId[REQUEST_TEST_PIPELINE_NUM + 1];
+
+static int serverMain(int readyFd);
+static signed int requestHandlerCb(IPC_USAGE_TYPE_E usageType, signed int op, const void* pPayload, signed int size,
+                                   void* pResponse, signed int* pResponseSize, void* pUserData);
+static void responseCb(IPC_USAGE_TYPE_E usageType, unsigned int requestId, IPC_RET_E ret, signed int status,
+                       const void* pResponse, signed int size, void* pUserData);
+static bool startAsync(int op, int value, int timeoutMs, int index);
+static bool waitDone(int index, int timeoutMs);
+static int readBrake(void);
+
+int main(void)
+{
+    char domainPath[] = "/tmp/ipc_request_test.XXXXXX";
+    int readyPipe[2];
+    char c;
+    pid_t pid;
+    int status;
+    int result = 1;
+    int i;
+    int value;
+    signed int responseStatus;
+    IPC_RET_E ret;
+
+    if (mkdtemp(domainPath) == NULL || pipe(readyPipe) != 0) {
+        perror("mkdtemp/pipe");
+        return 1;
+    }
+    setenv(IPC_ENV_DOMAIN_SOCKET_PATH, domainPath, 1);
+
+    pid = fork();
+    if (pid == 0) {
+        close(readyPipe[0]);
+        _exit(serverMain(readyPipe[1]));
+    }
+    close(readyPipe[1]);
+
+    if (read(readyPipe[0], &c, 1) != 1 || ipcClientStart(IPC_USAGE_TYPE_IC_SERVICE) != IPC_RET_OK) {
+        printf("NG: the server did not start\n");
+        goto end;
+    }
+
+    // pipelined: the responses of one wakeup of the server complete the requests of their ids
+    for (i = 0; i < REQUEST_TEST_PIPELINE_NUM; i++) {
+        if (startAsync(REQUEST_TEST_OP_ECHO, i, REQUEST_TEST_TIMEOUT, i) == false) {
+            goto end;
+        }
+    }
+    for (i = 0; i < REQUEST_TEST_PIPELINE_NUM; i++) {
+        if (waitDone(i, REQUEST_TEST_TIMEOUT) == false || g_result[i].ret != IPC_RET_OK
+            || g_result[i].status != i * 10 || g_result[i].echo != i) {
+            printf("NG: pipelined request %d: ret=%d status=%d echo=%d\n", i, g_result[i].ret, g_result[i].status,
+                   g_result[i].echo);
+            goto end;
+        }
+    }
+    printf("pipelined requests: OK\n");
+
+    // the data sent by the handler is in the Data Pool when the request completes
+    value = 1234;
+    ret = ipcClientRequest(IPC_USAGE_TYPE_IC_SERVICE, REQUEST_TEST_OP_SEND, &value, sizeof(value),
+                           REQUEST_TEST_TIMEOUT, NULL, NULL, &responseStatus);
+    if (ret != IPC_RET_OK || readBrake() != value) {
+        printf("NG: ipcClientRequest=%d brake=%d\n", ret, readBrake());
+        goto end;
+    }
+    memset(g_result, 0, sizeof(g_result));
+    if (startAsync(REQUEST_TEST_OP_SEND, 5678, REQUEST_TEST_TIMEOUT, 0) == false || waitDone(0, REQUEST_TEST_TIMEOUT) == false
+        || g_result[0].ret != IPC_RET_OK || g_result[0].brake != 5678) {
+        printf("NG: async: ret=%d brake=%d\n", g_result[0].ret, g_result[0].brake);
+        goto end;
+    }
+    printf("data before the response: OK\n");
+
+    // the async timeout, and the late response is discarded
+    memset(g_result, 0, sizeof(g_result));
+    if (startAsync(REQUEST_TEST_OP_SLOW, 0, 50, 0) == false || waitDone(0, REQUEST_TEST_SLOW_TIME - 100) == false
+        || g_result[0].ret != IPC_ERR_TIMEOUT) {
+        printf("NG: async timeout: done=%d ret=%d\n", g_result[0].done, g_result[0].ret);
+        goto end;
+    }
+    usleep(REQUEST_TEST_SLOW_TIME * 2 * 1000);
+    if (__atomic_load_n(&(g_result[0].done), __ATOMIC_ACQUIRE) != 1) {
+        printf("NG: the late response completed the request again\n");
+        goto end;
+    }
+    printf("async timeout: OK\n");
+
+    // ipcClientStop fails the pending requests
+    memset(g_result, 0, sizeof(g_result));
+    if (startAsync(REQUEST_TEST_OP_SLOW, 0, -1, 0) == false) {
+        goto end;
+    }
+    ipcClientStop(IPC_USAGE_TYPE_IC_SERVICE);
+    if (waitDone(0, 0) == false || g_result[0].ret != IPC_ERR_SEQUENCE) {
+        printf("NG: ipcClientStop: done=%d ret=%d\n", g_result[0].done, g_result[0].ret);
+        goto end;
+    }
+    printf("ipcClientStop: OK\n");
+
+    // the server goes away with a pending request
+    if (ipcClientStart(IPC_USAGE_TYPE_IC_SERVICE) != IPC_RET_OK) {
+        printf("NG: ipcClientStart again\n");
+        goto end;
+    }
+    memset(g_result, 0, sizeof(g_result));
+    if (startAsync(REQUEST_TEST_OP_EXIT, 0, -1, 0) == false || waitDone(0, REQUEST_TEST_TIMEOUT) == false
+        || g_result[0].ret != IPC_ERR_NO_RESOURCE) {
+        printf("NG: disconnect: done=%d ret=%d\n", g_result[0].done, g_result[0].ret);
+        goto end;
+    }
+    printf("disconnect: OK\n");
+
+    if (waitpid(pid, &status, 0) != pid || WIFEXITED(status) == 0 || WEXITSTATUS(status) != 0) {
+        printf("NG: server\n");
+        goto end;
+    }
+    pid = -1;
+    result = 0;
+
+end:
+    ipcClientStop(IPC_USAGE_TYPE_IC_SERVICE);
+    if (pid > 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+    rmdir(domainPath);
+    printf("%s\n", result == 0 ? "OK" : "NG");
+    return result;
+}
+
+static int serverMain(int readyFd)
+{
+    char c = 'r';
+
+    if (ipcServerStart(IPC_USAGE_TYPE_IC_SERVICE) != IPC_RET_OK
+        || ipcServerSetRequestHandler(IPC_USAGE_TYPE_IC_SERVICE, requestHandlerCb, NULL) != IPC_RET_OK
+        || write(readyFd, &c, 1) != 1) {
+        return 1;
+    }
+
+    while (1) {
+        pause(); // until REQUEST_TEST_OP_EXIT (or killed by the client)
+    }
+
+    return 0;
+}
+
+static signed int requestHandlerCb(IPC_USAGE_TYPE_E usageType, signed int op, const void* pPayload, signed int size,
+                                   void* pResponse, signed int* pResponseSize, void* pUserData)
+{
+    IPC_DATA_IC_SERVICE_S icService;
+    int value = 0;
+
+    (void)pUserData;
+    if (size == sizeof(value)) {
+        memcpy(&value, pPayload, sizeof(value));
+    }
+
+    switch (op) {
+    case REQUEST_TEST_OP_ECHO:
+        memcpy(pResponse, &value, sizeof(value));
+        *pResponseSize = sizeof(value);
+        return value * 10;
+    case REQUEST_TEST_OP_SEND:
+        memset(&icService, 0, sizeof(icService));
+        icService.brake = value;
+        ipcSendMessage(usageType, &icService, sizeof(icService));
+        return 0;
+    case REQUEST_TEST_OP_SLOW:
+        usleep(REQUEST_TEST_SLOW_TIME * 1000);
+        return 0;
+    case REQUEST_TEST_OP_EXIT:
+        _exit(0);
+    default:
+        return -1;
+    }
+}
+
+// pUserData: the index of g_result
+static void responseCb(IPC_USAGE_TYPE_E usageType, unsigned int requestId, IPC_RET_E ret, signed int status,
+                       const void* pResponse, signed int size, void* pUserData)
+{
+    REQUEST_TEST_RESULT_S *pResult = &(g_result[(long)pUserData]);
+
+    (void)usageType;
+    if (requestId != g_requestId[(long)pUserData]) {
+        ret = IPC_ERR_OTHER;
+    }
+    pResult->ret = ret;
+    pResult->status = status;
+    if (size == sizeof(pResult->echo)) {
+        memcpy(&(pResult->echo), pResponse, sizeof(pResult->echo));
+    }
+    pResult->brake = readBrake();
+    __atomic_add_fetch(&(pResult->done), 1, __ATOMIC_RELEASE);
+}
+
+static bool startAsync(int op, int value, int timeoutMs, int index)
+{
+    IPC_RET_E ret;
+
+    ret = ipcClientRequestAsync(IPC_USAGE_TYPE_IC_SERVICE, op, &value, sizeof(value), timeoutMs, responseCb,
+                                (void *)(long)index, &(g_requestId[index]));
+    if (ret != IPC_RET_OK) {
+        printf("NG: ipcClientRequestAsync(op=%d)=%d\n", op, ret);
+        return false;
+    }
+
+    return true;
+}
+
+static bool waitDone(int index, int timeoutMs)
+{
+    int i;
+
+    for (i = 0; i <= timeoutMs / 10; i++) {
+        if (__atomic_load_n(&(g_result[index].done), __ATOMIC_ACQUIRE) > 0) {
+            return true;
+        }
+        usleep(10000);
+    }
+
+    return false;
+}
+
+static int readBrake(void)
+{
+    IPC_DATA_IC_SERVICE_S icService;
+    signed int size = sizeof(icService);
+
+    if (ipcReadDataPool(IPC_USAGE_TYPE_IC_SERVICE, &icService, &size) != IPC_RET_OK) {
+        return -1;
+    }
+
+    return icService.brake;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Real-time configuration test.
+//   ipcSetRtConfig is accepted before the start, refused with
+//   IPC_ERR_SEQUENCE while a server or a client of any usage type is started,
+//   and accepted again after the last one is stopped. The server and the
+//   client of one process communicate with priority inheritance mutexes and
+//   locked buffers (SCHED_OTHER, so no privilege is needed).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sched.h>
+#include <cluster_ipc.h>
+
+#define RT_CONFIG_TEST_TIMEOUT (5000) // msec
+
+static bool checkSetRtConfig(const char *pName, IPC_RET_E expected);
+
+static IPC_RT_CONFIG_S g_config = {SCHED_OTHER, 0, 0, 1, 1};
+
+int main(void)
+{
+    char domainPath[] = "/tmp/ipc_rt_config_test.XXXXXX";
+    IPC_RT_CONFIG_S invalidConfig = g_config;
+    IPC_DATA_FOR_TEST_S forTest;
+    signed int size;
+    int result = 1;
+    int i;
+
+    if (mkdtemp(domainPath) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    setenv(IPC_ENV_DOMAIN_SOCKET_PATH, domainPath, 1);
+
+    invalidConfig.schedPolicy = -1;
+    if (ipcSetRtConfig(&invalidConfig) != IPC_ERR_PARAM || ipcSetRtConfig(NULL) != IPC_ERR_PARAM) {
+        printf("NG: an invalid configuration is accepted\n");
+        goto end;
+    }
+    if (checkSetRtConfig("before the start", IPC_RET_OK) == false) {
+        goto end;
+    }
+
+    if (ipcServerStart(IPC_USAGE_TYPE_FOR_TEST) != IPC_RET_OK
+        || checkSetRtConfig("server started", IPC_ERR_SEQUENCE) == false) {
+        goto end;
+    }
+    if (ipcClientStart(IPC_USAGE_TYPE_FOR_TEST) != IPC_RET_OK
+        || checkSetRtConfig("client started", IPC_ERR_SEQUENCE) == false) {
+        goto end;
+    }
+
+    // the configuration is in effect
+    forTest.test = 1234;
+    if (ipcSendMessage(IPC_USAGE_TYPE_FOR_TEST, &forTest, sizeof(forTest)) != IPC_RET_OK) {
+        printf("NG: ipcSendMessage\n");
+        goto end;
+    }
+    memset(&forTest, 0, sizeof(forTest));
+    for (i = 0; i < RT_CONFIG_TEST_TIMEOUT / 10 && forTest.test != 1234; i++) {
+        usleep(10000);
+        size = sizeof(forTest);
+        ipcReadDataPool(IPC_USAGE_TYPE_FOR_TEST, &forTest, &size);
+    }
+    if (forTest.test != 1234) {
+        printf("NG: the data did not arrive: test=%d\n", forTest.test);
+        goto end;
+    }
+    printf("communication: OK\n");
+
+    // refused until the last one is stopped
+    if (ipcServerStop(IPC_USAGE_TYPE_FOR_TEST) != IPC_RET_OK
+        || checkSetRtConfig("client still started", IPC_ERR_SEQUENCE) == false) {
+        goto end;
+    }
+    if (ipcClientStop(IPC_USAGE_TYPE_FOR_TEST) != IPC_RET_OK
+        || checkSetRtConfig("all stopped", IPC_RET_OK) == false) {
+        goto end;
+    }
+
+    // the client alone
+    if (ipcClientStartDeferred(IPC_USAGE_TYPE_FOR_TEST) != IPC_RET_OK
+        || checkSetRtConfig("deferred client started", IPC_ERR_SEQUENCE) == false
+        || ipcClientStop(IPC_USAGE_TYPE_FOR_TEST) != IPC_RET_OK
+        || checkSetRtConfig("deferred client stopped", IPC_RET_OK) == false) {
+        goto end;
+    }
+    result = 0;
+
+end:
+    ipcClientStop(IPC_USAGE_TYPE_FOR_TEST);
+    ipcServerStop(IPC_USAGE_TYPE_FOR_TEST);
+    rmdir(domainPath);
+    printf("%s\n", result == 0 ? "OK" : "NG");
+    return result;
+}
+
+static bool checkSetRtConfig(const char *pName, IPC_RET_E expected)
+{
+    IPC_RET_E ret = ipcSetRtConfig(&g_config);
+
+    if (ret != expected) {
+        printf("NG: %s: ipcSetRtConfig=%d (expected %d)\n", pName, ret, expected);
+        return false;
+    }
+    printf("%s: OK\n", pName);
+
+    return true;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Schema check test of the registered usage types.
+//   A forked server registers two usage types by ipcRegisterUsage. The client
+//   registers one of them with a different field table: ipcClientStart must
+//   fail with IPC_ERR_NO_RESOURCE, and ipcClientStartDeferred must stay
+//   disconnected. The other one, registered the same, must connect and
+//   receive the data of the server.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <cluster_ipc.h>
+
+#define SCHEMA_TEST_MISMATCH_NAME "schemaTestMismatch"
+#define SCHEMA_TEST_MATCH_NAME "schemaTestMatch"
+#define SCHEMA_TEST_RETRY_TIME (1000) // msec for ipcClientStartDeferred to retry
+#define SCHEMA_TEST_TIMEOUT (5000) // msec
+
+typedef struct {
+    signed int speed;
+    signed int tacho;
+} SCHEMA_TEST_DATA_S;
+
+// the server (and the client for SCHEMA_TEST_MATCH_NAME)
+static const IPC_USAGE_FIELD_S g_serverField[] = {
+    {0, offsetof(SCHEMA_TEST_DATA_S, speed), sizeof(signed int)},
+    {1, offsetof(SCHEMA_TEST_DATA_S, tacho), sizeof(signed int)},
+};
+// the client for SCHEMA_TEST_MISMATCH_NAME: the same size, the members swapped
+static const IPC_USAGE_FIELD_S g_clientField[] = {
+    {0, offsetof(SCHEMA_TEST_DATA_S, tacho), sizeof(signed int)},
+    {1, offsetof(SCHEMA_TEST_DATA_S, speed), sizeof(signed int)},
+};
+static const SCHEMA_TEST_DATA_S g_data = {120, 3000};
+
+static int serverMain(int readyFd, int endFd);
+
+int main(void)
+{
+    char domainPath[] = "/tmp/ipc_schema_test.XXXXXX";
+    int readyPipe[2];
+    int endPipe[2];
+    char c;
+    pid_t pid;
+    int status;
+    int result = 1;
+    int i;
+    IPC_USAGE_TYPE_E mismatch;
+    IPC_USAGE_TYPE_E match;
+    IPC_LINK_STATE_E state;
+    SCHEMA_TEST_DATA_S data;
+    signed int size;
+    IPC_RET_E ret;
+
+    if (mkdtemp(domainPath) == NULL || pipe(readyPipe) != 0 || pipe(endPipe) != 0) {
+        perror("mkdtemp/pipe");
+        return 1;
+    }
+    setenv(IPC_ENV_DOMAIN_SOCKET_PATH, domainPath, 1);
+
+    pid = fork();
+    if (pid == 0) {
+        close(readyPipe[0]);
+        close(endPipe[1]);
+        _exit(serverMain(readyPipe[1], endPipe[0]));
+    }
+    close(readyPipe[1]);
+    close(endPipe[0]);
+
+    if (read(readyPipe[0], &c, 1) != 1) {
+        printf("NG: the server did not start\n");
+        goto end;
+    }
+    if (ipcRegisterUsage(SCHEMA_TEST_MISMATCH_NAME, sizeof(SCHEMA_TEST_DATA_S), g_clientField, 2, &mismatch)
+            != IPC_RET_OK
+        || ipcRegisterUsage(SCHEMA_TEST_MATCH_NAME, sizeof(SCHEMA_TEST_DATA_S), g_serverField, 2, &match)
+            != IPC_RET_OK) {
+        printf("NG: ipcRegisterUsage\n");
+        goto end;
+    }
+
+    // a different field table is rejected
+    ret = ipcClientStart(mismatch);
+    if (ret != IPC_ERR_NO_RESOURCE) {
+        printf("NG: ipcClientStart(mismatch)=%d\n", ret);
+        goto end;
+    }
+    ret = ipcClientStartDeferred(mismatch);
+    if (ret != IPC_RET_OK) {
+        printf("NG: ipcClientStartDeferred(mismatch)=%d\n", ret);
+        goto end;
+    }
+    usleep(SCHEMA_TEST_RETRY_TIME * 1000);
+    if (ipcGetLinkState(mismatch, &state) != IPC_RET_OK || state != IPC_LINK_STATE_DISCONNECTED) {
+        printf("NG: the deferred client of a different schema is connected\n");
+        goto end;
+    }
+    ipcClientStop(mismatch);
+    printf("mismatch: OK\n");
+
+    // the same one connects
+    ret = ipcClientStart(match);
+    if (ret != IPC_RET_OK) {
+        printf("NG: ipcClientStart(match)=%d\n", ret);
+        goto end;
+    }
+    memset(&data, 0, sizeof(data));
+    for (i = 0; i < SCHEMA_TEST_TIMEOUT / 10; i++) {
+        size = sizeof(data);
+        if (ipcReadDataPool(match, &data, &size) == IPC_RET_OK && data.speed == g_data.speed) {
+            break;
+        }
+        usleep(10000);
+    }
+    if (data.speed != g_data.speed || data.tacho != g_data.tacho) {
+        printf("NG: match: speed=%d tacho=%d\n", data.speed, data.tacho);
+        goto end;
+    }
+    printf("match: OK\n");
+    result = 0;
+
+end:
+    ipcClientStop(match);
+    close(endPipe[1]); // ends the server
+    if (pid > 0 && (waitpid(pid, &status, 0) != pid || WIFEXITED(status) == 0 || WEXITSTATUS(status) != 0)) {
+        printf("NG: server\n");
+        result = 1;
+    }
+    rmdir(domainPath);
+    printf("%s\n", result == 0 ? "OK" : "NG");
+    return result;
+}
+
+static int serverMain(int readyFd, int endFd)
+{
+    IPC_USAGE_TYPE_E mismatch;
+    IPC_USAGE_TYPE_E match;
+    char c = 'r';
+
+    if (ipcRegisterUsage(SCHEMA_TEST_MISMATCH_NAME, sizeof(SCHEMA_TEST_DATA_S), g_serverField, 2, &mismatch)
+            != IPC_RET_OK
+        || ipcRegisterUsage(SCHEMA_TEST_MATCH_NAME, sizeof(SCHEMA_TEST_DATA_S), g_serverField, 2, &match)
+            != IPC_RET_OK
+        || ipcServerStart(mismatch) != IPC_RET_OK || ipcServerStart(match) != IPC_RET_OK
+        || ipcSendMessage(mismatch, &g_data, sizeof(g_data)) != IPC_RET_OK
+        || ipcSendMessage(match, &g_data, sizeof(g_data)) != IPC_RET_OK
+        || write(readyFd, &c, 1) != 1) {
+        return 1;
+    }
+
+    while (read(endFd, &c, 1) > 0) {
+        // until the client ends
+    }
+    ipcServerStop(mismatch);
+    ipcServerStop(match);
+    return 0;
+}
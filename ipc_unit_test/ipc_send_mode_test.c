@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Send mode switch test.
+//   A forked server sends FOR_TEST from several producer threads, while its
+//   main thread switches the send mode between IPC_SEND_MODE_ASYNC and
+//   IPC_SEND_MODE_SYNC. Each producer sends its own increasing sequence, so the
+//   client checks that a message queued before a switch to SYNC never arrives
+//   after a newer message of the same producer, and that the last message of
+//   every producer arrives.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <cluster_ipc.h>
+
+#define SEND_MODE_TEST_PRODUCER_NUM (4)
+#define SEND_MODE_TEST_MESSAGE_NUM (5000) // of each producer
+#define SEND_MODE_TEST_SEND_INTERVAL (10) // usec
+#define SEND_MODE_TEST_SWITCH_INTERVAL (300) // usec
+#define SEND_MODE_TEST_TIMEOUT (10000) // msec
+
+// test = producer << SEND_MODE_TEST_PRODUCER_SHIFT | sequence (from 1, the last is MESSAGE_NUM + 1)
+#define SEND_MODE_TEST_PRODUCER_SHIFT (24)
+#define SEND_MODE_TEST_SEQ_MASK ((1 << SEND_MODE_TEST_PRODUCER_SHIFT) - 1)
+
+static int g_lastSeq[SEND_MODE_TEST_PRODUCER_NUM];
+static int g_received;
+static bool g_outOfOrder;
+static int g_producerDone; // producers which have sent all their messages
+
+static int serverMain(int readyFd, int goFd);
+static void *producerMain(void *arg);
+static void dataNotifyCb(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size);
+static bool allArrived(void);
+
+int main(void)
+{
+    char domainPath[] = "/tmp/ipc_send_mode_test.XXXXXX";
+    int readyPipe[2];
+    int goPipe[2];
+    char c = 'g';
+    pid_t pid;
+    int status;
+    int result = 1;
+    int i;
+
+    if (mkdtemp(domainPath) == NULL || pipe(readyPipe) != 0 || pipe(goPipe) != 0) {
+        perror("mkdtemp/pipe");
+        return 1;
+    }
+    setenv(IPC_ENV_DOMAIN_SOCKET_PATH, domainPath, 1);
+
+    pid = fork();
+    if (pid == 0) {
+        close(readyPipe[0]);
+        close(goPipe[1]);
+        _exit(serverMain(readyPipe[1], goPipe[0]));
+    }
+    close(readyPipe[1]);
+    close(goPipe[0]);
+
+    if (read(readyPipe[0], &c, 1) != 1 || ipcClientStart(IPC_USAGE_TYPE_FOR_TEST) != IPC_RET_OK) {
+        printf("NG: the server did not start\n");
+        goto end;
+    }
+    ipcRegisterDataCallback(IPC_USAGE_TYPE_FOR_TEST, dataNotifyCb);
+    if (write(goPipe[1], &c, 1) != 1) {
+        goto end;
+    }
+
+    for (i = 0; i < SEND_MODE_TEST_TIMEOUT / 10; i++) {
+        if (allArrived() == true) {
+            break;
+        }
+        usleep(10000);
+    }
+    printf("received=%d last=", g_received);
+    for (i = 0; i < SEND_MODE_TEST_PRODUCER_NUM; i++) {
+        printf("%d ", __atomic_load_n(&(g_lastSeq[i]), __ATOMIC_ACQUIRE));
+    }
+    printf("\n");
+    if (allArrived() == false) {
+        printf("NG: the last messages did not arrive\n");
+        goto end;
+    }
+    if (g_outOfOrder == true) {
+        printf("NG: a queued message arrived after a newer one of the same producer\n");
+        goto end;
+    }
+    result = 0;
+
+end:
+    ipcClientStop(IPC_USAGE_TYPE_FOR_TEST);
+    close(goPipe[1]); // ends the server
+    if (pid > 0 && (waitpid(pid, &status, 0) != pid || WIFEXITED(status) == 0 || WEXITSTATUS(status) != 0)) {
+        printf("NG: server\n");
+        result = 1;
+    }
+    rmdir(domainPath);
+    printf("%s\n", result == 0 ? "OK" : "NG");
+    return result;
+}
+
+static int serverMain(int readyFd, int goFd)
+{
+    pthread_t thread[SEND_MODE_TEST_PRODUCER_NUM];
+    IPC_DATA_FOR_TEST_S forTest;
+    IPC_SEND_MODE_E mode = IPC_SEND_MODE_ASYNC;
+    char c = 'r';
+    int switches = 0;
+    int retry;
+    int i;
+
+    if (ipcServerStart(IPC_USAGE_TYPE_FOR_TEST) != IPC_RET_OK || write(readyFd, &c, 1) != 1
+        || read(goFd, &c, 1) != 1) {
+        return 1;
+    }
+
+    for (i = 0; i < SEND_MODE_TEST_PRODUCER_NUM; i++) {
+        if (pthread_create(&(thread[i]), NULL, producerMain, (void *)(long)i) != 0) {
+            return 1;
+        }
+    }
+
+    // switched while the producers are sending (some of them are between reading the mode and queuing)
+    while (__atomic_load_n(&g_producerDone, __ATOMIC_ACQUIRE) < SEND_MODE_TEST_PRODUCER_NUM) {
+        if (ipcServerSetSendMode(IPC_USAGE_TYPE_FOR_TEST, mode) != IPC_RET_OK) {
+            return 1;
+        }
+        mode = (mode == IPC_SEND_MODE_ASYNC) ? IPC_SEND_MODE_SYNC : IPC_SEND_MODE_ASYNC;
+        switches++;
+        usleep(SEND_MODE_TEST_SWITCH_INTERVAL);
+    }
+    for (i = 0; i < SEND_MODE_TEST_PRODUCER_NUM; i++) {
+        pthread_join(thread[i], NULL);
+    }
+    printf("switches=%d\n", switches);
+    fflush(stdout);
+
+    // the last message of each producer (the asynchronous ones may have been conflated)
+    if (ipcServerSetSendMode(IPC_USAGE_TYPE_FOR_TEST, IPC_SEND_MODE_SYNC) != IPC_RET_OK) {
+        return 1;
+    }
+    for (i = 0; i < SEND_MODE_TEST_PRODUCER_NUM; i++) {
+        forTest.test = (i << SEND_MODE_TEST_PRODUCER_SHIFT) | (SEND_MODE_TEST_MESSAGE_NUM + 1);
+        for (retry = 0; ipcSendMessage(IPC_USAGE_TYPE_FOR_TEST, &forTest, sizeof(forTest)) != IPC_RET_OK; retry++) {
+            if (retry == SEND_MODE_TEST_TIMEOUT) {
+                return 1;
+            }
+            usleep(1000); // the socket of the client is full
+        }
+    }
+
+    while (read(goFd, &c, 1) > 0) {
+        // until the client ends
+    }
+    ipcServerStop(IPC_USAGE_TYPE_FOR_TEST);
+    return 0;
+}
+
+// arg: the number of the producer
+static void *producerMain(void *arg)
+{
+    IPC_DATA_FOR_TEST_S forTest;
+    int producer = (int)(long)arg;
+    int seq;
+
+    for (seq = 1; seq <= SEND_MODE_TEST_MESSAGE_NUM; seq++) {
+        forTest.test = (producer << SEND_MODE_TEST_PRODUCER_SHIFT) | seq;
+        (void)ipcSendMessage(IPC_USAGE_TYPE_FOR_TEST, &forTest, sizeof(forTest)); // a full queue drops it
+        usleep(SEND_MODE_TEST_SEND_INTERVAL);
+    }
+    __atomic_add_fetch(&g_producerDone, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void dataNotifyCb(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size)
+{
+    int value = ((const IPC_DATA_FOR_TEST_S *)pData)->test;
+    int producer = value >> SEND_MODE_TEST_PRODUCER_SHIFT;
+    int seq = value & SEND_MODE_TEST_SEQ_MASK;
+
+    (void)usageType;
+    (void)size;
+    g_received++;
+    if (producer < 0 || SEND_MODE_TEST_PRODUCER_NUM <= producer || seq <= g_lastSeq[producer]) {
+        g_outOfOrder = true;
+        return;
+    }
+    __atomic_store_n(&(g_lastSeq[producer]), seq, __ATOMIC_RELEASE);
+}
+
+static bool allArrived(void)
+{
+    int i;
+
+    for (i = 0; i < SEND_MODE_TEST_PRODUCER_NUM; i++) {
+        if (__atomic_load_n(&(g_lastSeq[i]), __ATOMIC_ACQUIRE) != SEND_MODE_TEST_MESSAGE_NUM + 1) {
+            return false;
+        }
+    }
+
+    return true;
+}
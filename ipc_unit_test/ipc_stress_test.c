@@ -0,0 +1,572 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Multi-process soak / fault-injection test.
+//   The supervisor forks one IC-Service server and several clients, kills and
+//   restarts them at random, and reports corrupted data pools, fd/memory growth
+//   and latency drift of each report interval.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <cluster_ipc.h>
+
+#define STRESS_CLIENT_MAX_NUM (16)
+#define STRESS_DEFAULT_DURATION (60)     // sec
+#define STRESS_DEFAULT_CLIENT_NUM (4)
+#define STRESS_DEFAULT_RATE (1000)       // messages/sec
+#define STRESS_DEFAULT_KILL_INTERVAL (2000) // msec
+#define STRESS_DEFAULT_SLOW_PERCENT (25) // percentage of slow clients
+#define STRESS_REPORT_INTERVAL (10)      // sec
+#define STRESS_SERVER_KILL_RATIO (8)     // 1 of N kills hits the server
+#define STRESS_FD_GROWTH_LIMIT (4)
+#define STRESS_RSS_GROWTH_LIMIT (8 * 1024) // kB
+#define STRESS_PATH_MAX (128)
+
+typedef struct {
+    pid_t pid;
+    bool slow;
+    unsigned long long restarts;
+    unsigned long long count;        // sent (server) or received (client)
+    unsigned long long errors;       // send errors (server) or corrupted pools (client)
+    unsigned long long latSumNs;     // current report interval
+    unsigned long long latNum;
+    unsigned long long latMaxNs;
+    int fdNum;
+    int fdNumStart;                  // of the current process (taken after ipcServerStart / ipcClientStart)
+    long rssKb;
+    long rssKbStart;
+    bool leaked;                     // the growth limit was exceeded by a previous process
+} STRESS_PROC_STAT_S;
+
+typedef struct {
+    STRESS_PROC_STAT_S server;
+    STRESS_PROC_STAT_S client[STRESS_CLIENT_MAX_NUM];
+} STRESS_SHARED_S;
+
+typedef struct {
+    int duration;
+    int clientNum;
+    int rate;
+    int killInterval;
+    int slowPercent;
+} STRESS_CONFIG_S;
+
+static STRESS_SHARED_S *g_pShared;
+static STRESS_CONFIG_S g_config = {
+    STRESS_DEFAULT_DURATION,
+    STRESS_DEFAULT_CLIENT_NUM,
+    STRESS_DEFAULT_RATE,
+    STRESS_DEFAULT_KILL_INTERVAL,
+    STRESS_DEFAULT_SLOW_PERCENT
+};
+static volatile sig_atomic_t g_stopFlag = 0;
+static bool g_slowCallback = false;
+
+static unsigned long long nowNs(void);
+static unsigned long long checksum(const IPC_DATA_IC_SERVICE_S *pData);
+static void makePayload(IPC_DATA_IC_SERVICE_S *pData, unsigned long long seq);
+static int countFd(void);
+static long readRssKb(void);
+static void updateResource(STRESS_PROC_STAT_S *pStat);
+static bool checkResource(const char *pName, STRESS_PROC_STAT_S *pStat, int fdExpected);
+static void serverMain(void);
+static void clientMain(int id);
+static void changeNotifyCb(void* pData, signed int size, int kind);
+static pid_t spawnServer(void);
+static pid_t spawnClient(int id);
+static unsigned long long report(int elapsed);
+static void onSignal(int sig);
+static void usagePrint(const char *pName);
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    int i;
+    int victim;
+    char domainPath[] = "/tmp/ipc_stress_XXXXXX";
+    char socketPath[STRESS_PATH_MAX];
+    unsigned long long startNs, lastKillNs, lastReportNs, now;
+    int elapsed;
+    int result = 0;
+    STRESS_PROC_STAT_S *pStat;
+    unsigned long long latAvg;
+    unsigned long long latFirst = 0, latLast = 0;
+
+    while ((opt = getopt(argc, argv, "d:c:r:k:s:h")) != -1) {
+        switch (opt) {
+        case 'd':
+            g_config.duration = atoi(optarg);
+            break;
+        case 'c':
+            g_config.clientNum = atoi(optarg);
+            break;
+        case 'r':
+            g_config.rate = atoi(optarg);
+            break;
+        case 'k':
+            g_config.killInterval = atoi(optarg);
+            break;
+        case 's':
+            g_config.slowPercent = atoi(optarg);
+            break;
+        default:
+            usagePrint(argv[0]);
+            return 1;
+        }
+    }
+    if (g_config.clientNum < 1 || STRESS_CLIENT_MAX_NUM < g_config.clientNum
+        || g_config.rate < 1 || g_config.duration < 1) {
+        usagePrint(argv[0]);
+        return 1;
+    }
+
+    if (getenv(IPC_ENV_DOMAIN_SOCKET_PATH) == NULL) {
+        if (mkdtemp(domainPath) == NULL) {
+            perror("mkdtemp");
+            return 1;
+        }
+        setenv(IPC_ENV_DOMAIN_SOCKET_PATH, domainPath, 1);
+    }
+    snprintf(socketPath, sizeof(socketPath), "%s/ipcIcService", getenv(IPC_ENV_DOMAIN_SOCKET_PATH));
+
+    g_pShared = mmap(NULL, sizeof(STRESS_SHARED_S), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (g_pShared == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(g_pShared, 0, sizeof(STRESS_SHARED_S));
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    srand(time(NULL));
+
+    printf("duration=%ds clients=%d rate=%d/s kill=%dms slow=%d%% path=%s\n",
+           g_config.duration, g_config.clientNum, g_config.rate, g_config.killInterval,
+           g_config.slowPercent, getenv(IPC_ENV_DOMAIN_SOCKET_PATH));
+    fflush(stdout);
+
+    g_pShared->server.pid = spawnServer();
+    for (i = 0; i < g_config.clientNum; i++) {
+        g_pShared->client[i].slow = (rand() % 100) < g_config.slowPercent;
+        g_pShared->client[i].pid = spawnClient(i);
+    }
+
+    startNs = nowNs();
+    lastKillNs = startNs;
+    lastReportNs = startNs;
+    while (g_stopFlag == 0) {
+        usleep(10 * 1000);
+        now = nowNs();
+        elapsed = (int)((now - startNs) / 1000000000ULL);
+        if (elapsed >= g_config.duration) {
+            break;
+        }
+
+        // fault injection
+        if (g_config.killInterval > 0 && now - lastKillNs >= (unsigned long long)g_config.killInterval * 1000000ULL) {
+            lastKillNs = now;
+            victim = rand() % g_config.clientNum;
+            if ((rand() % STRESS_SERVER_KILL_RATIO) == 0) {
+                pStat = &(g_pShared->server);
+                kill(pStat->pid, SIGKILL);
+                waitpid(pStat->pid, NULL, 0);
+                pStat->restarts++;
+                pStat->pid = spawnServer();
+            }
+            else {
+                pStat = &(g_pShared->client[victim]);
+                kill(pStat->pid, SIGKILL);
+                waitpid(pStat->pid, NULL, 0);
+                pStat->restarts++;
+                pStat->pid = spawnClient(victim);
+            }
+        }
+
+        if (now - lastReportNs >= STRESS_REPORT_INTERVAL * 1000000000ULL) {
+            lastReportNs = now;
+            latAvg = report(elapsed);
+            if (latFirst == 0) {
+                latFirst = latAvg;
+            }
+            latLast = latAvg != 0 ? latAvg : latLast;
+        }
+    }
+
+    latAvg = report(g_config.duration);
+    if (latFirst == 0) {
+        latFirst = latAvg;
+    }
+    latLast = latAvg != 0 ? latAvg : latLast;
+
+    kill(g_pShared->server.pid, SIGTERM);
+    for (i = 0; i < g_config.clientNum; i++) {
+        kill(g_pShared->client[i].pid, SIGTERM);
+    }
+    while (wait(NULL) > 0) {
+    }
+
+    // final verdict (fd and rss of the last process of each, and of the killed ones)
+    pStat = &(g_pShared->server);
+    printf("\n== result ==\n");
+    printf("server: sent=%llu errors=%llu restarts=%llu fd %d->%d rss %ldkB->%ldkB\n",
+           pStat->count, pStat->errors, pStat->restarts, pStat->fdNumStart, pStat->fdNum,
+           pStat->rssKbStart, pStat->rssKb);
+    // fdNumStart is taken before the clients connect; one socket per client is expected.
+    if (checkResource("server", pStat, g_config.clientNum) == false) {
+        result = 1;
+    }
+    printf("latency drift: first interval avg=%lluus last interval avg=%lluus\n", latFirst / 1000, latLast / 1000);
+    for (i = 0; i < g_config.clientNum; i++) {
+        pStat = &(g_pShared->client[i]);
+        printf("client%d%s: received=%llu corrupted=%llu restarts=%llu fd %d->%d rss %ldkB->%ldkB\n",
+               i, pStat->slow ? "(slow)" : "", pStat->count, pStat->errors, pStat->restarts,
+               pStat->fdNumStart, pStat->fdNum, pStat->rssKbStart, pStat->rssKb);
+        if (pStat->errors != 0) {
+            printf("NG: corrupted data pool in client%d\n", i);
+            result = 1;
+        }
+        // a client reconnects in the same process when the server is restarted
+        if (checkResource("client", pStat, 0) == false) {
+            result = 1;
+        }
+    }
+    printf("%s\n", result == 0 ? "OK" : "NG");
+
+    unlink(socketPath);
+    if (strcmp(getenv(IPC_ENV_DOMAIN_SOCKET_PATH), domainPath) == 0) {
+        rmdir(domainPath);
+    }
+
+    return result;
+}
+
+static unsigned long long nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// FNV-1a over the whole structure except the checksum field itself.
+static unsigned long long checksum(const IPC_DATA_IC_SERVICE_S *pData)
+{
+    IPC_DATA_IC_SERVICE_S data;
+    const unsigned char *p = (const unsigned char *)&data;
+    unsigned long long hash = 14695981039346656037ULL;
+    size_t i;
+
+    memcpy(&data, pData, sizeof(data));
+    data.trcomTripBVal = 0;
+    for (i = 0; i < sizeof(data); i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// trcomOdoVal = sequence, trcomTripAVal = send time, trcomTripBVal = checksum.
+// turnR toggles on every message so that each one fires a callback.
+static void makePayload(IPC_DATA_IC_SERVICE_S *pData, unsigned long long seq)
+{
+    unsigned char *p = (unsigned char *)pData;
+    unsigned long long x = seq * 6364136223846793005ULL + 1442695040888963407ULL;
+    size_t i;
+
+    for (i = 0; i < sizeof(*pData); i++) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        p[i] = (unsigned char)x;
+    }
+    pData->turnR = (int)(seq & 1);
+    pData->trcomOdoVal = seq;
+    pData->trcomTripAVal = nowNs();
+    pData->trcomTripBVal = checksum(pData);
+}
+
+static int countFd(void)
+{
+    DIR *pDir;
+    struct dirent *pEnt;
+    int num = 0;
+
+    pDir = opendir("/proc/self/fd");
+    if (pDir == NULL) {
+        return -1;
+    }
+    while ((pEnt = readdir(pDir)) != NULL) {
+        if (pEnt->d_name[0] != '.') {
+            num++;
+        }
+    }
+    closedir(pDir);
+
+    return num - 1; // opendir() itself
+}
+
+static long readRssKb(void)
+{
+    FILE *fp;
+    long pages = 0;
+    long rss = 0;
+
+    fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    if (fscanf(fp, "%ld %ld", &pages, &rss) != 2) {
+        rss = 0;
+    }
+    fclose(fp);
+
+    return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void updateResource(STRESS_PROC_STAT_S *pStat)
+{
+    pStat->fdNum = countFd();
+    pStat->rssKb = readRssKb();
+}
+
+// returns false if the fd or rss growth of the process is over the limit (fdExpected: connections opened after start)
+static bool checkResource(const char *pName, STRESS_PROC_STAT_S *pStat, int fdExpected)
+{
+    bool ok = !pStat->leaked;
+
+    if (pStat->fdNumStart == 0) {
+        return ok; // not measured yet
+    }
+    if (pStat->fdNum - pStat->fdNumStart > fdExpected + STRESS_FD_GROWTH_LIMIT) {
+        printf("NG: fd growth in %s (pid=%d)\n", pName, (int)pStat->pid);
+        ok = false;
+    }
+    if (pStat->rssKb - pStat->rssKbStart > STRESS_RSS_GROWTH_LIMIT) {
+        printf("NG: rss growth in %s (pid=%d)\n", pName, (int)pStat->pid);
+        ok = false;
+    }
+    return ok;
+}
+
+static void serverMain(void)
+{
+    IPC_DATA_IC_SERVICE_S data;
+    IPC_RET_E ret;
+    STRESS_PROC_STAT_S *pStat = &(g_pShared->server);
+    unsigned long long seq;
+    unsigned long long periodNs = 1000000000ULL / g_config.rate;
+    unsigned long long next;
+    char socketPath[STRESS_PATH_MAX];
+    struct timespec ts;
+
+    // a killed server leaves its socket file behind
+    snprintf(socketPath, sizeof(socketPath), "%s/ipcIcService", getenv(IPC_ENV_DOMAIN_SOCKET_PATH));
+    unlink(socketPath);
+
+    ret = ipcServerStart(IPC_USAGE_TYPE_IC_SERVICE);
+    if (ret != IPC_RET_OK) {
+        printf("ipcServerStart Error:%d\n", ret);
+        exit(1);
+    }
+
+    // the sequence continues across restarts so that clients see monotonic values
+    seq = pStat->count + 1;
+    updateResource(pStat);
+    pStat->fdNumStart = pStat->fdNum;
+    pStat->rssKbStart = pStat->rssKb;
+
+    next = nowNs();
+    while (g_stopFlag == 0) {
+        makePayload(&data, seq);
+        ret = ipcSendMessage(IPC_USAGE_TYPE_IC_SERVICE, &data, sizeof(data));
+        if (ret != IPC_RET_OK) {
+            __atomic_fetch_add(&(pStat->errors), 1, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&(pStat->count), seq, __ATOMIC_RELAXED);
+        seq++;
+
+        if ((seq & 0xff) == 0) {
+            updateResource(pStat);
+        }
+
+        next += periodNs;
+        ts.tv_sec = next / 1000000000ULL;
+        ts.tv_nsec = next % 1000000000ULL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+
+    ipcServerStop(IPC_USAGE_TYPE_IC_SERVICE);
+    exit(0);
+}
+
+static void clientMain(int id)
+{
+    IPC_DATA_IC_SERVICE_S data;
+    IPC_RET_E ret;
+    STRESS_PROC_STAT_S *pStat = &(g_pShared->client[id]);
+    signed int size;
+    unsigned long long lastSeq = 0;
+    unsigned long long lat;
+    bool connected = false;
+
+    srand(getpid());
+    g_slowCallback = pStat->slow;
+
+    while (g_stopFlag == 0) {
+        if (connected == false) {
+            ret = ipcClientStart(IPC_USAGE_TYPE_IC_SERVICE);
+            if (ret != IPC_RET_OK) {
+                usleep(50 * 1000);
+                continue;
+            }
+            ipcRegisterCallback(IPC_USAGE_TYPE_IC_SERVICE, changeNotifyCb);
+            connected = true;
+            if (pStat->fdNumStart == 0) {
+                updateResource(pStat);
+                pStat->fdNumStart = pStat->fdNum;
+                pStat->rssKbStart = pStat->rssKb;
+            }
+        }
+
+        size = sizeof(data);
+        ret = ipcReadDataPool(IPC_USAGE_TYPE_IC_SERVICE, &data, &size);
+        if (ret != IPC_RET_OK) {
+            // disconnected by the server
+            ipcClientStop(IPC_USAGE_TYPE_IC_SERVICE);
+            connected = false;
+            continue;
+        }
+
+        if (data.trcomOdoVal != 0 && data.trcomOdoVal != lastSeq) {
+            if (checksum(&data) != data.trcomTripBVal) {
+                __atomic_fetch_add(&(pStat->errors), 1, __ATOMIC_RELAXED);
+            }
+            else {
+                lat = nowNs() - data.trcomTripAVal;
+                __atomic_fetch_add(&(pStat->latSumNs), lat, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&(pStat->latNum), 1, __ATOMIC_RELAXED);
+                if (lat > pStat->latMaxNs) {
+                    pStat->latMaxNs = lat;
+                }
+            }
+            __atomic_fetch_add(&(pStat->count), 1, __ATOMIC_RELAXED);
+            lastSeq = data.trcomOdoVal;
+            if ((pStat->count & 0xff) == 0) {
+                updateResource(pStat);
+            }
+        }
+
+        usleep(200);
+    }
+
+    if (connected) {
+        ipcClientStop(IPC_USAGE_TYPE_IC_SERVICE);
+    }
+    exit(0);
+}
+
+static void changeNotifyCb(void* pData, signed int size, int kind)
+{
+    // slow consumer: block the receive thread of the library now and then
+    // (turnR toggles on every message, so this is evaluated once per message)
+    if (g_slowCallback && kind == IPC_KIND_ICS_TURN_R && (rand() % 16) == 0) {
+        usleep((rand() % 20) * 1000);
+    }
+}
+
+static pid_t spawnServer(void)
+{
+    pid_t pid;
+
+    // the last measurement of the killed process is checked before it is reset by the new one
+    if (checkResource("server", &(g_pShared->server), g_config.clientNum) == false) {
+        g_pShared->server.leaked = true;
+    }
+    g_pShared->server.fdNumStart = 0;
+    pid = fork();
+
+    if (pid == 0) {
+        signal(SIGTERM, onSignal);
+        serverMain();
+    }
+    return pid;
+}
+
+static pid_t spawnClient(int id)
+{
+    pid_t pid;
+
+    if (checkResource("client", &(g_pShared->client[id]), 0) == false) {
+        g_pShared->client[id].leaked = true;
+    }
+    g_pShared->client[id].fdNumStart = 0;
+    pid = fork();
+
+    if (pid == 0) {
+        signal(SIGTERM, onSignal);
+        clientMain(id);
+    }
+    return pid;
+}
+
+// returns average latency (ns) of the interval
+static unsigned long long report(int elapsed)
+{
+    int i;
+    STRESS_PROC_STAT_S *pStat;
+    unsigned long long latSum = 0, latNum = 0, latMax = 0;
+    unsigned long long received = 0, corrupted = 0;
+
+    for (i = 0; i < g_config.clientNum; i++) {
+        pStat = &(g_pShared->client[i]);
+        latSum += __atomic_exchange_n(&(pStat->latSumNs), 0, __ATOMIC_RELAXED);
+        latNum += __atomic_exchange_n(&(pStat->latNum), 0, __ATOMIC_RELAXED);
+        if (pStat->latMaxNs > latMax) {
+            latMax = pStat->latMaxNs;
+        }
+        pStat->latMaxNs = 0;
+        received += pStat->count;
+        corrupted += pStat->errors;
+    }
+
+    pStat = &(g_pShared->server);
+    printf("[%6ds] sent=%llu received=%llu corrupted=%llu lat(avg/max)=%llu/%lluus server fd=%d rss=%ldkB\n",
+           elapsed, pStat->count, received, corrupted,
+           latNum ? latSum / latNum / 1000 : 0, latMax / 1000, pStat->fdNum, pStat->rssKb);
+    fflush(stdout);
+
+    return latNum ? latSum / latNum : 0;
+}
+
+static void onSignal(int sig)
+{
+    g_stopFlag = 1;
+}
+
+static void usagePrint(const char *pName)
+{
+    printf("usage: %s [-d sec] [-c clients] [-r msg/sec] [-k kill interval msec (0=off)] [-s slow client %%]\n", pName);
+    printf("  ex) 24 hours run: %s -d 86400\n", pName);
+}
@@ -24,14 +24,27 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <errno.h>
+#include <math.h>
+#include <time.h>
 
 #include <cluster_ipc.h>
 #include "ipc_internal.h"
+#include "ipc_trace.h"
 
 #define IPC_CLIENT_USAGE_MAX_NUM (4)
 #define IPC_CLIENT_EPOLL_WAIT_NUM (IPC_CLIENT_USAGE_MAX_NUM + 1)
 #define IPC_CLIENT_CONNECT_CHECK_TIME (500) // msec
+#define IPC_CLIENT_RETRY_MIN_TIME (2) // msec, first interval of the background connect
+#define IPC_CLIENT_RETRY_MAX_TIME (100) // msec, the interval is doubled up to this value
+#define IPC_CLIENT_SAMPLE_NUM (8) // samples kept for ipcReadInterpolated
+#define IPC_CLIENT_DAMPED_OMEGA (4.0) // x sample rate: a step settles by 91% in one sample interval
+#define IPC_CLIENT_DRAIN_NUM (16) // messages read by one recv in IPC_RECV_MODE_LATEST
+#define IPC_CLIENT_REQUEST_MAX_NUM (16) // requests of a usage waiting for the responses
+#define IPC_CLIENT_MUX_BUFFER_SIZE \
+    (4 * (sizeof(IPC_MUX_HEADER_S) + sizeof(IPC_TOPIC_HEADER_S) + sizeof(IPC_ALL_USAGE_DATA_POOL_U)))
 
 // == Internal global values ==
 static bool g_initedFlag = false;
@@ -39,74 +52,375 @@ static pthread_t g_clientThread;
 static bool g_threadRunning = false;
 static int g_threadCtlPipeFd[2] = {-1, -1};
 static int g_epollFd = -1;
+static int g_subscriptionHandle = 0; // the last handle of ipcSubscribeKind
+static int g_schemaPendingNum = 0; // usages with pendingFd (read by the client thread without the lock)
+
+// multiplexed connection (IPC_MUX): serverFd of all connected usages is g_muxFd
+static bool g_muxEnabled = false;
+static int g_muxFd = -1;
+static char g_muxRecvBuf[IPC_CLIENT_MUX_BUFFER_SIZE]; // frames not processed yet (used by the client thread)
+static int g_muxRecvLen = 0;
+
+// requests (ipcClientRequest): the requests of the usages sharing g_muxFd are sent one by one
+static unsigned int g_requestId = 0; // the last id, counted up atomically (0 is not used)
+static pthread_mutex_t g_requestSendMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// location of the data of a kind
+typedef struct {
+    int poolOffset; // in pDataPool
+    int size; // 0: the kind is not defined
+    int segment;
+    int analog; // index of pSampleRing, -1: not an analog value
+} IPC_KIND_MAP_S;
+
+// timestamped samples of an analog value (written by the client thread with the usage lock)
+typedef struct {
+    unsigned long long timeNs[IPC_CLIENT_SAMPLE_NUM];
+    double value[IPC_CLIENT_SAMPLE_NUM];
+    unsigned int count; // number of recorded samples, the latest one is at (count - 1) % IPC_CLIENT_SAMPLE_NUM
+} IPC_SAMPLE_RING_S;
+
+// subscribers of a kind (ipcSubscribeKind)
+// A list is replaced as a whole under the usage lock, so the client thread calls them without the lock.
+typedef struct IPC_KIND_SUBSCRIBER_LIST {
+    struct IPC_KIND_SUBSCRIBER_LIST *pNextRetired; // a replaced list is freed when the client thread is not using it
+    int num;
+    struct {
+        int handle;
+        IPC_KIND_NOTIFY_CB kindNotifyCb;
+        void *pUserData;
+    } entry[];
+} IPC_KIND_SUBSCRIBER_LIST_S;
+
+// state of the notification filter of a kind (used by the client thread)
+typedef struct {
+    bool enabled;
+    IPC_KIND_FILTER_S config;
+    double lastValue; // last notified value (analog kinds)
+    int lastDirection; // of the last notified change: 1 up, -1 down, 0 unknown
+    unsigned long long lastTimeNs; // of the last notification, 0: none
+    unsigned long long pendingTimeNs; // a change suppressed by minIntervalMs is notified at this time, 0: none
+} IPC_KIND_FILTER_STATE_S;
+
+// the result of ipcClientRequest, written by the client thread with the usage lock
+typedef struct {
+    bool done;
+    IPC_RET_E ret;
+    signed int status;
+    void *pResponse;
+    signed int responseSize; // in: size of pResponse, out: size of the response
+} IPC_REQUEST_WAIT_S;
+
+// a request waiting for its response
+typedef struct {
+    unsigned int id; // 0: not used
+    unsigned long long deadline; // ipcGetTimeNs(), 0: no timeout (ipcClientRequest: timed out by the caller)
+    IPC_RESPONSE_CB responseCb; // ipcClientRequestAsync
+    void *pUserData;
+    IPC_REQUEST_WAIT_S *pWait; // ipcClientRequest
+} IPC_CLIENT_REQUEST_S;
 
 typedef struct {
     IPC_USAGE_TYPE_E usage;
     int serverFd;
-    void *pDataPool;
-    int poolSize;
+    void *pDataPool; // internal layout: each segment starts at a cache line (see ipcAllocDataPool)
+    int poolSize; // size of the sending/receiving data structure
+    int segmentNum;
+    IPC_POOL_SEGMENT_S segment[IPC_POOL_SEGMENT_MAX_NUM]; // offset and size in the data structure
+    int segmentOffset[IPC_POOL_SEGMENT_MAX_NUM]; // offset in pDataPool
+    IPC_KIND_MAP_S *pKindMap; // index is kind
+    int kindNum;
+    IPC_SAMPLE_RING_S *pSampleRing; // index is g_ipcAnalogInfoTbl[usage].pInfo[]
+    IPC_KIND_FILTER_STATE_S *pFilter; // index is kind, NULL: no filter has been set
+    IPC_KIND_SUBSCRIBER_LIST_S **ppSubscriber; // index is kind, NULL: no subscriber
+    IPC_KIND_SUBSCRIBER_LIST_S *pRetiredSubscriber; // replaced lists
+    int subscriberNum;
     IPC_CHANGE_NOTIFY_CB changeNotifyCb;
+    IPC_DATA_NOTIFY_CB dataNotifyCb;
+    pthread_mutex_t mutex; // protects pDataPool contents, changeNotifyCb and dataNotifyCb of this usage
+    unsigned long long mutexLockedTime; // valid while mutex is held
+    pthread_cond_t updateCond; // with mutex, broadcast when generation is changed or the usage is removed
+    unsigned long long generation; // counts the receptions which changed the data pool
+    int waiterNum; // threads in ipcWaitForUpdate (the slot is used without the registry lock)
+    int readerNum; // threads in ipcPinClientInfo (the slot is used without the registry lock)
+    int notifyFd; // eventfd counted up with generation (created by ipcGetNotifyFd), -1: not created
+    unsigned long long rxSeq; // sequence of the last received message (for trace)
+    IPC_RECV_MODE_E recvMode;
+    char *pRecvBuf; // IPC_RECV_MODE_LATEST or topics: IPC_CLIENT_DRAIN_NUM messages
+    int recvLen; // bytes of the incomplete message at the head of pRecvBuf (IPC_MUX: size of the newest frame)
+    int topicNum; // 0: the messages are the data as is, otherwise they have IPC_TOPIC_HEADER_S
+    unsigned int topicSegment[IPC_TOPIC_MAX_NUM]; // bit mask of the segments of each topic
+    unsigned int topicSeq[IPC_TOPIC_MAX_NUM + 1]; // of the processed messages (the last is of IPC_TOPIC_WHOLE)
+    unsigned int recvSeq[IPC_TOPIC_MAX_NUM + 1]; // of the applied messages, copied to topicSeq when processed
+    unsigned int recvSegmentMask; // IPC_RECV_MODE_LATEST with IPC_MUX: merged in pRecvBuf in this wakeup
+    unsigned int recvTopicMask;
+    bool autoReconnect; // started by ipcClientStartDeferred: serverFd is -1 while the server is not connected
+    int pendingFd; // connected by the client thread, waiting for the schema hash of the server (-1: none)
+    IPC_LINK_STATE_CB linkStateCb;
+    int retryInterval; // msec
+    unsigned long long retryTime; // ipcGetTimeNs() of the next connect attempt
+    IPC_DATA_STATE_E dataState; // IPC_DATA_STATE_LIVE is written by the client thread with release
+    IPC_CLIENT_REQUEST_S request[IPC_CLIENT_REQUEST_MAX_NUM]; // with mutex
+    int requestNum; // used entries of request[] (read by the client thread without mutex)
 } IPC_CLIENT_INFO_S;
 static IPC_CLIENT_INFO_S g_clientInfo[IPC_CLIENT_USAGE_MAX_NUM];
 
-static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+// link state change to be notified after the registry lock is released
+typedef struct {
+    IPC_USAGE_TYPE_E usage;
+    IPC_LINK_STATE_CB linkStateCb;
+    IPC_LINK_STATE_E state;
+} IPC_LINK_NOTIFY_S;
+
+// completion of ipcClientRequestAsync without a response, to be notified after the registry lock is released
+typedef struct {
+    IPC_USAGE_TYPE_E usage;
+    unsigned int id;
+    IPC_RET_E ret;
+    IPC_RESPONSE_CB responseCb;
+    void *pUserData;
+} IPC_REQUEST_DONE_S;
+
+// g_registryLock protects the g_clientInfo[] slots themselves (usage, serverFd, pDataPool pointer).
+// It has no priority inheritance, so the reads of the render thread (ipcReadDataPool, ipcReadKind) do not
+// take it: they find the slot by ipcPinClientInfo, and wait only for the mutex of the slot.
+static pthread_rwlock_t g_registryLock = PTHREAD_RWLOCK_INITIALIZER;
 
 // == Prototype declaration
+static void ipcClientLock(IPC_CLIENT_INFO_S *pInfo);
+static void ipcClientUnlock(IPC_CLIENT_INFO_S *pInfo);
+static int ipcClientWait(IPC_CLIENT_INFO_S *pInfo, IPC_USAGE_TYPE_E usageType, const struct timespec *pAbsTime);
+static void ipcClientWaitLeave(void *arg);
 static void *ipcClientThread(void *arg);
 static int ipcClientInit(void);
 static int ipcClientDeinit(void);
 static void ipcClientInfoClear(int index);
 static int ipcGetClientInfoIndex(IPC_USAGE_TYPE_E usageType);
-static int ipcClientCreateSocket(IPC_USAGE_TYPE_E usageType);
-static void ipcCloseConnectFromServer(int eventFd);
-static void ipcReceiveDataFromServer(int eventFd, int *pIndex, void *pLocalDataPool);
-static void ipcCheckChangeAndCallback(int index, void *pLocalDataPool);
-static void ipcWriteToDataPool(int index, void *pLocalDataPool);
-static int ipcAddClient(IPC_USAGE_TYPE_E usageType);
-static int ipcRemoveClient(IPC_USAGE_TYPE_E usageType);
+static int ipcPinClientInfo(IPC_USAGE_TYPE_E usageType);
+static void ipcUnpinClientInfo(int index);
+static bool ipcIsMuxUsage(IPC_USAGE_TYPE_E usageType);
+static int ipcClientCreateSocket(IPC_USAGE_TYPE_E usageType, bool retryFlag);
+static int ipcClientConnectDomain(const char *domainName, bool retryFlag);
+static int ipcClientCheckSchema(int fd, IPC_USAGE_TYPE_E usageType, int timeoutMs);
+static void ipcSetSchemaPending(IPC_CLIENT_INFO_S *pInfo, int fd);
+static void ipcClosePendingFd(IPC_CLIENT_INFO_S *pInfo);
+static bool ipcIsSchemaPending(int eventFd);
+static int ipcCheckPendingSchema(int eventFd, IPC_LINK_NOTIFY_S *pNotify);
+static void ipcClientConnected(IPC_CLIENT_INFO_S *pInfo, int fd);
+static void ipcMuxAttach(int fd);
+static void ipcMuxSubscribe(void);
+static int ipcCountMuxClient(void);
+static void ipcCloseMuxConnect(void);
+static int ipcCloseConnectFromServer(int eventFd, IPC_LINK_NOTIFY_S *pNotify, IPC_REQUEST_DONE_S *pDone,
+                                     int *pDoneNum);
+static int ipcGetRetryTimeout(void);
+static int ipcGetFilterTimeout(void);
+static bool ipcPassFilter(IPC_CLIENT_INFO_S *pInfo, int kind, const void *pValue, unsigned long long timeNs);
+static void ipcFlushFilter(void *pScratch);
+static int ipcGetRetryUsage(IPC_USAGE_TYPE_E *pUsage, bool *pMuxConnect);
+static void ipcConnectRetry(const IPC_USAGE_TYPE_E *pUsage, int retryNum, bool muxConnect, int *pFd, int *pMuxFd);
+static void ipcRetryLater(IPC_CLIENT_INFO_S *pInfo, unsigned long long now);
+static int ipcRetryConnectServer(const IPC_USAGE_TYPE_E *pUsage, int *pFd, int retryNum, int muxFd,
+                                 IPC_LINK_NOTIFY_S *pNotify);
+static void ipcNotifyLinkState(IPC_LINK_NOTIFY_S *pNotify, int notifyNum);
+static bool ipcIsRequestEnabled(IPC_CLIENT_INFO_S *pInfo);
+static IPC_RET_E ipcStartRequest(IPC_CLIENT_INFO_S *pInfo, int op, const void *pPayload, int size, int timeoutMs,
+                                 IPC_RESPONSE_CB responseCb, void *pUserData, IPC_REQUEST_WAIT_S *pWait,
+                                 unsigned int *pRequestId);
+static int ipcSendRequest(IPC_CLIENT_INFO_S *pInfo, unsigned int id, int op, const void *pPayload, int size);
+static void ipcRemoveRequest(IPC_CLIENT_INFO_S *pInfo, unsigned int id);
+static void ipcClientRequestLeave(void *arg);
+static void ipcReceiveResponse(IPC_CLIENT_INFO_S *pInfo, const char *pMessage, int size);
+static int ipcEndRequest(IPC_CLIENT_INFO_S *pInfo, IPC_CLIENT_REQUEST_S *pRequest, IPC_RET_E ret,
+                         IPC_REQUEST_DONE_S *pDone);
+static int ipcFailRequest(IPC_CLIENT_INFO_S *pInfo, IPC_RET_E ret, IPC_REQUEST_DONE_S *pDone);
+static int ipcGetRequestTimeout(void);
+static int ipcExpireRequest(IPC_REQUEST_DONE_S *pDone);
+static void ipcNotifyRequestDone(IPC_REQUEST_DONE_S *pDone, int doneNum);
+static int ipcReceiveDataFromServer(int eventFd, int *pIndex, void *pLocalDataPool, int *pSize);
+static int ipcDrainFromServer(IPC_CLIENT_INFO_S *pInfo, void *pLocalDataPool, int *pSize);
+static int ipcReceiveMuxFromServer(int eventFd, void *pLocalDataPool);
+static void ipcProcessMuxLatest(int index, void *pLocalDataPool);
+static int ipcReceiveTopicFromServer(IPC_CLIENT_INFO_S *pInfo, int index, void *pLocalDataPool);
+static void ipcProcessReceivedData(int index, void *pLocalDataPool, int size, unsigned int segmentMask);
+static void ipcLoadDataPool(IPC_CLIENT_INFO_S *pInfo, void *pLocalDataPool);
+static unsigned int ipcGetSegmentMask(IPC_CLIENT_INFO_S *pInfo, int offset, int size);
+static int ipcApplyTopic(IPC_CLIENT_INFO_S *pInfo, const char *pMessage, int size, void *pLocalDataPool,
+                         unsigned int *pSegmentMask, unsigned int *pTopicMask);
+static void ipcProcessTopic(int index, void *pLocalDataPool, unsigned int segmentMask, unsigned int topicMask);
+static int ipcAllocDataPool(IPC_CLIENT_INFO_S *pInfo, IPC_USAGE_TYPE_E usageType);
+static void ipcFreeDataPool(IPC_CLIENT_INFO_S *pInfo);
+static unsigned int ipcGetChangedSegment(int index, void *pLocalDataPool, unsigned int segmentMask);
+static void ipcCheckChangeAndCallback(int index, void *pLocalDataPool, unsigned int changedSegment);
+static void ipcNotifyKind(IPC_CLIENT_INFO_S *pInfo, IPC_CHANGE_NOTIFY_CB changeNotifyCb, int kind, void *pValue,
+                          int size);
+static void ipcFreeRetiredSubscriber(IPC_KIND_SUBSCRIBER_LIST_S *pList);
+static bool ipcIsClientThread(void);
+static void ipcWriteToDataPool(int index, void *pLocalDataPool, unsigned int changedSegment);
+static double ipcGetAnalogValue(const IPC_ANALOG_INFO_S *pAnalogInfo, const void *pValue);
+static void ipcRecordSample(int index, void *pLocalDataPool, unsigned int segmentMask);
+static double ipcLinearValue(const IPC_SAMPLE_RING_S *pRing, unsigned long long timeNs);
+static double ipcDampedValue(const IPC_SAMPLE_RING_S *pRing, unsigned long long timeNs);
+static void ipcDataCallback(int index, void *pLocalDataPool, int size);
+static void ipcLoadPersist(IPC_CLIENT_INFO_S *pInfo, IPC_USAGE_TYPE_E usageType);
+static int ipcAddClient(IPC_USAGE_TYPE_E usageType, bool autoReconnect, int fd);
+static int ipcRemoveClient(IPC_USAGE_TYPE_E usageType, IPC_REQUEST_DONE_S *pDone, int *pDoneNum);
 static int ipcCountClient(void);
+static IPC_RET_E ipcClientStartInternal(IPC_USAGE_TYPE_E usageType, bool autoReconnect);
+
+// == Lock function ==
+static void ipcClientLock(IPC_CLIENT_INFO_S *pInfo)
+{
+    pInfo->mutexLockedTime = ipcStatsLock(&(pInfo->mutex), &(g_ipcStats[pInfo->usage].client.lock));
+}
+
+static void ipcClientUnlock(IPC_CLIENT_INFO_S *pInfo)
+{
+    ipcStatsUnlock(&(pInfo->mutex), &(g_ipcStats[pInfo->usage].client.lock), pInfo->mutexLockedTime);
+}
+
+// waits on updateCond with the mutex held by ipcClientLock. The wait is not counted in the hold time.
+static int ipcClientWait(IPC_CLIENT_INFO_S *pInfo, IPC_USAGE_TYPE_E usageType, const struct timespec *pAbsTime)
+{
+    int rc;
+
+    IPC_STATS_ADD(g_ipcStats[usageType].client.lock.holdTimeNs, ipcGetTimeNs() - pInfo->mutexLockedTime);
+    if (pAbsTime != NULL) {
+        rc = pthread_cond_timedwait(&(pInfo->updateCond), &(pInfo->mutex), pAbsTime);
+    }
+    else {
+        rc = pthread_cond_wait(&(pInfo->updateCond), &(pInfo->mutex));
+    }
+    pInfo->mutexLockedTime = ipcGetTimeNs();
+
+    return rc;
+}
+
+// called with the mutex held, also as the cancellation cleanup of ipcWaitForUpdate.
+static void ipcClientWaitLeave(void *arg)
+{
+    IPC_CLIENT_INFO_S *pInfo = (IPC_CLIENT_INFO_S *)arg;
+
+    pInfo->waiterNum--;
+    if (pInfo->waiterNum == 0 && pInfo->usage == IPC_USAGE_NONE) {
+        pthread_cond_broadcast(&(pInfo->updateCond)); // ipcClientDeinit waits for this
+    }
+}
 
 // == Thread function ==
 static void *ipcClientThread(void *arg)
 {
     int fdNum;
-    struct epoll_event epEvents[IPC_CLIENT_USAGE_MAX_NUM];
+    struct epoll_event epEvents[IPC_CLIENT_EPOLL_WAIT_NUM];
     int i;
     int index;
     IPC_ALL_USAGE_DATA_POOL_U localDataPool;
     char dummy;
     int rc;
+    int timeout;
+    int filterTimeout;
+    int requestTimeout;
+    int size;
+    IPC_LINK_NOTIFY_S notify[IPC_CLIENT_USAGE_MAX_NUM];
+    int notifyNum;
+    IPC_USAGE_TYPE_E retryUsage[IPC_CLIENT_USAGE_MAX_NUM];
+    int retryFd[IPC_CLIENT_USAGE_MAX_NUM];
+    int retryNum;
+    int muxFd;
+    bool muxConnect;
+    IPC_REQUEST_DONE_S done[IPC_CLIENT_USAGE_MAX_NUM * IPC_CLIENT_REQUEST_MAX_NUM];
+    int doneNum;
+
+    // ipcClientDeinit cancels this thread. Cancellation is allowed only in epoll_wait,
+    // so the thread is never cancelled while it holds the registry lock (recv and connect are cancellation points).
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
     while(g_threadRunning != false) {
-        fdNum = epoll_wait(g_epollFd, epEvents, IPC_CLIENT_USAGE_MAX_NUM, -1);
+        pthread_rwlock_rdlock(&g_registryLock);
+        timeout = ipcGetRetryTimeout();
+        filterTimeout = ipcGetFilterTimeout();
+        requestTimeout = ipcGetRequestTimeout();
+        pthread_rwlock_unlock(&g_registryLock);
+        if (filterTimeout >= 0 && (timeout < 0 || filterTimeout < timeout)) {
+            timeout = filterTimeout;
+        }
+        if (requestTimeout >= 0 && (timeout < 0 || requestTimeout < timeout)) {
+            timeout = requestTimeout;
+        }
+
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        fdNum = epoll_wait(g_epollFd, epEvents, IPC_CLIENT_EPOLL_WAIT_NUM, timeout);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
         if (g_threadRunning == false) {
             break;
         }
 
-        pthread_mutex_lock(&g_mutex);
         for (i = 0; i < fdNum; i++) {
             if (epEvents[i].data.fd == g_threadCtlPipeFd[0]) {
                 // dummy notify from API function.
                 rc = read(g_threadCtlPipeFd[0], &dummy, 1);
                 if (rc < 0) {
-                    printf("[##ERROR##] %s:%s:%d (%s) is false. (%s=%d)\n", __FILE__, __func__, __LINE__, "rc >= 0", "rc", (int)rc);
+                    IPC_LOG(IPC_LOG_LEVEL_ERROR, "rc >= 0", rc);
                     continue;
                 }
             }
+            else if (__atomic_load_n(&g_schemaPendingNum, __ATOMIC_RELAXED) > 0
+                     && ipcIsSchemaPending(epEvents[i].data.fd) == true) {
+                // the schema hash (or the rejection) of a registered usage has arrived
+                pthread_rwlock_wrlock(&g_registryLock);
+                notifyNum = ipcCheckPendingSchema(epEvents[i].data.fd, notify);
+                pthread_rwlock_unlock(&g_registryLock);
+                ipcNotifyLinkState(notify, notifyNum);
+            }
             else {
                 if (epEvents[i].events & EPOLLRDHUP) {
-                    ipcCloseConnectFromServer(epEvents[i].data.fd);
+                    pthread_rwlock_wrlock(&g_registryLock);
+                    notifyNum = ipcCloseConnectFromServer(epEvents[i].data.fd, notify, done, &doneNum);
+                    pthread_rwlock_unlock(&g_registryLock);
+                    ipcNotifyLinkState(notify, notifyNum);
+                    ipcNotifyRequestDone(done, doneNum);
                 }
                 else if (epEvents[i].events & EPOLLIN) {
-                    ipcReceiveDataFromServer(epEvents[i].data.fd, &index, (void *)&localDataPool);
-                    if (index >= 0) {
-                        ipcCheckChangeAndCallback(index, &localDataPool);
-                        ipcWriteToDataPool(index, &localDataPool);
+                    pthread_rwlock_rdlock(&g_registryLock);
+                    if (epEvents[i].data.fd == g_muxFd) {
+                        // all usages received in this wakeup are processed at once
+                        rc = ipcReceiveMuxFromServer(epEvents[i].data.fd, (void *)&localDataPool);
+                    }
+                    else {
+                        rc = ipcReceiveDataFromServer(epEvents[i].data.fd, &index, (void *)&localDataPool, &size);
+                        if (index >= 0) {
+                            ipcProcessReceivedData(index, &localDataPool, size, ~0U);
+                        }
+                    }
+                    pthread_rwlock_unlock(&g_registryLock);
+
+                    if (rc != 0) {
+                        pthread_rwlock_wrlock(&g_registryLock);
+                        notifyNum = ipcCloseConnectFromServer(epEvents[i].data.fd, notify, done, &doneNum);
+                        pthread_rwlock_unlock(&g_registryLock);
+                        ipcNotifyLinkState(notify, notifyNum);
+                        ipcNotifyRequestDone(done, doneNum);
                     }
                 }
             }
         }
-        pthread_mutex_unlock(&g_mutex);
+
+        pthread_rwlock_rdlock(&g_registryLock);
+        ipcFlushFilter((void *)&localDataPool);
+        doneNum = ipcExpireRequest(done);
+        retryNum = ipcGetRetryUsage(retryUsage, &muxConnect);
+        pthread_rwlock_unlock(&g_registryLock);
+        ipcNotifyRequestDone(done, doneNum);
+
+        if (retryNum > 0) {
+            // connect() may take time, so it is done without the registry lock.
+            // The write lock (which blocks ipcReadDataPool) is taken only to add the connections.
+            ipcConnectRetry(retryUsage, retryNum, muxConnect, retryFd, &muxFd);
+            pthread_rwlock_wrlock(&g_registryLock);
+            notifyNum = ipcRetryConnectServer(retryUsage, retryFd, retryNum, muxFd, notify);
+            pthread_rwlock_unlock(&g_registryLock);
+            ipcNotifyLinkState(notify, notifyNum);
+        }
     }
 
     pthread_exit(NULL);
@@ -120,12 +434,24 @@ static int ipcClientInit(void)
     int rc;
     int i;
     struct epoll_event epollEv;
+    pthread_condattr_t condAttr;
 
     if (g_initedFlag == false) {
+        ipcRtAcquire(); // the settings are fixed until ipcClientDeinit
+        pthread_condattr_init(&condAttr);
+        pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
         for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
             ipcClientInfoClear(i);
+            ipcRtInitMutex(&(g_clientInfo[i].mutex)); // the render thread and the client thread
+            pthread_cond_init(&(g_clientInfo[i].updateCond), &condAttr);
+            g_clientInfo[i].waiterNum = 0;
         }
+        pthread_condattr_destroy(&condAttr);
         g_threadRunning = false;
+        g_muxEnabled = ipcIsMuxEnabled();
+        if (g_muxEnabled == true) {
+            ipcRtLockMemory(g_muxRecvBuf, sizeof(g_muxRecvBuf));
+        }
         rc = pipe(g_threadCtlPipeFd);
         IPC_E_CHECK(rc == 0, rc, end);
 
@@ -143,6 +469,7 @@ static int ipcClientInit(void)
 
 end:
     if (ret == -1) {
+        ipcRtRelease();
         for (i = 0; i < 2; i++) {
             if (g_threadCtlPipeFd[i] >= 0) {
                 close(g_threadCtlPipeFd[i]);
@@ -165,6 +492,22 @@ static int ipcClientDeinit(void)
         }
         for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
             ipcClientInfoClear(i);
+
+            // the readers which have seen the usage before it was cleared are leaving (see ipcPinClientInfo)
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            while (__atomic_load_n(&(g_clientInfo[i].readerNum), __ATOMIC_SEQ_CST) > 0) {
+                usleep(10);
+            }
+
+            // all usages are removed, so the waiters are leaving
+            pthread_mutex_lock(&(g_clientInfo[i].mutex));
+            while (g_clientInfo[i].waiterNum > 0) {
+                pthread_cond_wait(&(g_clientInfo[i].updateCond), &(g_clientInfo[i].mutex));
+            }
+            pthread_mutex_unlock(&(g_clientInfo[i].mutex));
+
+            pthread_cond_destroy(&(g_clientInfo[i].updateCond));
+            pthread_mutex_destroy(&(g_clientInfo[i].mutex));
         }
         for (i = 0; i < 2; i++) {
             if (g_threadCtlPipeFd[i] >= 0) {
@@ -172,10 +515,13 @@ static int ipcClientDeinit(void)
                 g_threadCtlPipeFd[i] = -1;
             }
         }
+        ipcCloseMuxConnect();
         close(g_epollFd);
         g_epollFd = -1;
 
         g_initedFlag = false;
+        ipcRtRelease();
+        ipcLogFlush();
     }
 
     return 0;
@@ -185,11 +531,37 @@ static void ipcClientInfoClear(int index)
 {
     IPC_E_CHECK(0 <= index && index < IPC_CLIENT_USAGE_MAX_NUM, index, end);
 
-    g_clientInfo[index].usage = IPC_USAGE_TYPE_MAX;
+    g_clientInfo[index].usage = IPC_USAGE_NONE;
     g_clientInfo[index].serverFd = -1;
     g_clientInfo[index].pDataPool = NULL;
     g_clientInfo[index].poolSize = 0;
+    g_clientInfo[index].segmentNum = 0;
+    g_clientInfo[index].pKindMap = NULL;
+    g_clientInfo[index].kindNum = 0;
+    g_clientInfo[index].pSampleRing = NULL;
+    g_clientInfo[index].pFilter = NULL;
+    g_clientInfo[index].ppSubscriber = NULL;
+    g_clientInfo[index].pRetiredSubscriber = NULL;
+    g_clientInfo[index].subscriberNum = 0;
+    g_clientInfo[index].generation = 0;
+    g_clientInfo[index].notifyFd = -1;
+    g_clientInfo[index].recvMode = IPC_RECV_MODE_ALL;
+    g_clientInfo[index].pRecvBuf = NULL;
+    g_clientInfo[index].recvLen = 0;
+    g_clientInfo[index].topicNum = 0;
+    memset(g_clientInfo[index].topicSeq, 0, sizeof(g_clientInfo[index].topicSeq));
+    g_clientInfo[index].recvSegmentMask = 0;
+    g_clientInfo[index].recvTopicMask = 0;
     g_clientInfo[index].changeNotifyCb = NULL;
+    g_clientInfo[index].dataNotifyCb = NULL;
+    g_clientInfo[index].autoReconnect = false;
+    g_clientInfo[index].pendingFd = -1;
+    g_clientInfo[index].linkStateCb = NULL;
+    g_clientInfo[index].dataState = IPC_DATA_STATE_EMPTY;
+    g_clientInfo[index].retryInterval = 0;
+    g_clientInfo[index].retryTime = 0;
+    memset(g_clientInfo[index].request, 0, sizeof(g_clientInfo[index].request));
+    g_clientInfo[index].requestNum = 0;
 
 end:
     return;
@@ -210,27 +582,92 @@ static int ipcGetClientInfoIndex(IPC_USAGE_TYPE_E usageType)
     return index;
 }
 
-static int ipcClientCreateSocket(IPC_USAGE_TYPE_E usageType)
+// Finds the slot of the usage without the registry lock, and locks its mutex (a priority inheritance mutex
+// with ipcSetRtConfig). Returns the index, or -1 if the usage is not started. Release it by ipcUnpinClientInfo.
+// The slot is counted in readerNum before its usage is checked, so ipcClientDeinit does not destroy the mutex
+// meanwhile; ipcAddClient and ipcRemoveClient change the usage and the data pool of a used slot with the mutex.
+static int ipcPinClientInfo(IPC_USAGE_TYPE_E usageType)
+{
+    int i;
+    IPC_CLIENT_INFO_S *pInfo;
+
+    for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
+        pInfo = &(g_clientInfo[i]);
+        if (__atomic_load_n(&(pInfo->usage), __ATOMIC_RELAXED) != usageType) {
+            continue;
+        }
+
+        __atomic_add_fetch(&(pInfo->readerNum), 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&(pInfo->usage), __ATOMIC_SEQ_CST) == usageType) {
+            pInfo->mutexLockedTime = ipcStatsLock(&(pInfo->mutex), &(g_ipcStats[usageType].client.lock));
+            if (pInfo->usage == usageType && pInfo->pDataPool != NULL) {
+                return i;
+            }
+            ipcStatsUnlock(&(pInfo->mutex), &(g_ipcStats[usageType].client.lock), pInfo->mutexLockedTime);
+        }
+        __atomic_sub_fetch(&(pInfo->readerNum), 1, __ATOMIC_RELEASE);
+    }
+
+    return -1;
+}
+
+static void ipcUnpinClientInfo(int index)
+{
+    IPC_CLIENT_INFO_S *pInfo = &(g_clientInfo[index]);
+
+    ipcClientUnlock(pInfo);
+    __atomic_sub_fetch(&(pInfo->readerNum), 1, __ATOMIC_RELEASE);
+}
+
+// the registered usages are not multiplexed (their numbers are local to each process)
+static bool ipcIsMuxUsage(IPC_USAGE_TYPE_E usageType)
+{
+    return g_muxEnabled == true && usageType < IPC_USAGE_TYPE_MAX;
+}
+
+// Connects to the server of the usage (a multiplexed usage: a new multiplexed connection, see ipcMuxAttach).
+// It is called without the registry lock. The schema of a registered usage is checked by the caller.
+// retryFlag: the server may not be running yet, so connection failures are not logged.
+static int ipcClientCreateSocket(IPC_USAGE_TYPE_E usageType, bool retryFlag)
 {
-    int rc;
     int fd = -1;
-    struct sockaddr_un unixAddr;
-    int len;
+    int rc;
     char domainName[IPC_DOMAIN_PATH_MAX] = "";
     int domainLen = IPC_DOMAIN_PATH_MAX;
 
-    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, err);
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+
+    if (ipcIsMuxUsage(usageType) == true) {
+        rc = ipcCreateMuxDomainName(IPC_SIDE_CLIENT, domainName, &domainLen);
+    }
+    else {
+        rc = ipcCreateDomainName(usageType, IPC_SIDE_CLIENT, domainName, &domainLen);
+    }
+    IPC_E_CHECK(rc == 0, rc, end);
+
+    fd = ipcClientConnectDomain(domainName, retryFlag);
+
+end:
+    return fd;
+}
+
+static int ipcClientConnectDomain(const char *domainName, bool retryFlag)
+{
+    int rc;
+    int fd = -1;
+    struct sockaddr_un unixAddr;
+    int len;
 
     fd = socket(AF_UNIX, SOCK_STREAM, 0);
     IPC_E_CHECK(fd >= 0, fd, err);
 
-    rc = ipcCreateDomainName(usageType, domainName, &domainLen);
-    IPC_E_CHECK(rc == 0, rc, err);
-
     rc = ipcCreateUnixDomainAddr(domainName, &unixAddr, &len);
     IPC_E_CHECK(rc == 0, rc, err);
 
     rc = connect(fd, (struct sockaddr *)&unixAddr, len);
+    if (rc != 0 && retryFlag == true && (errno == ENOENT || errno == ECONNREFUSED)) {
+        goto err;
+    }
     IPC_E_CHECK(rc == 0, rc, err);
 
     return fd;
@@ -243,202 +680,183 @@ err:
     return -1;
 }
 
-static void ipcCloseConnectFromServer(int eventFd)
-{
-    int index;
-    IPC_CLIENT_INFO_S *pInfo;
-    struct epoll_event epollEv;
-
-    for (index = 0; index < IPC_CLIENT_USAGE_MAX_NUM; index++) {
-        pInfo = &(g_clientInfo[index]);
-        if (pInfo->usage == IPC_USAGE_TYPE_MAX) {
-            continue;
-        }
-
-        if (pInfo->serverFd == eventFd) {
-            shutdown(pInfo->serverFd, SHUT_RDWR);
-            close(pInfo->serverFd);
-            if (pInfo->pDataPool != NULL) {
-                free(pInfo->pDataPool);
-                pInfo->pDataPool = NULL;
-            }
-            memset(&epollEv, 0, sizeof(epollEv));
-            epoll_ctl(g_epollFd, EPOLL_CTL_DEL, pInfo->serverFd, &epollEv);
-            ipcClientInfoClear(index);
-        }
-    }
-}
-
-static void ipcReceiveDataFromServer(int eventFd, int *pIndex, void *pLocalDataPool)
+// A registered usage: the server sends its schema hash first (see ipcAcceptClient).
+// timeoutMs: ipcClientStart waits for it, the client thread calls this when it has arrived (0).
+static int ipcClientCheckSchema(int fd, IPC_USAGE_TYPE_E usageType, int timeoutMs)
 {
+    int ret = -1;
     int rc;
-    int i;
-    IPC_CLIENT_INFO_S *pInfo = NULL;
-
-    *pIndex = -1;
-
-    // check fd
-    for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
-        if (g_clientInfo[i].serverFd == eventFd) {
-            pInfo = &(g_clientInfo[i]);
-            break;
-        }
-    }
+    struct pollfd pollFd;
+    unsigned long long schemaHash = 0;
 
-    IPC_E_CHECK(pInfo != NULL, eventFd, end);
-    IPC_E_CHECK(pInfo->pDataPool != NULL, i, end);
-    IPC_E_CHECK(pInfo->poolSize > 0, i, end);
+    pollFd.fd = fd;
+    pollFd.events = POLLIN;
+    pollFd.revents = 0;
+    rc = poll(&pollFd, 1, timeoutMs);
+    IPC_E_CHECK(rc == 1, rc, end);
 
-    // receive from server and write to data pool.
-    rc = recv(eventFd, pLocalDataPool, pInfo->poolSize, 0);
-    if ((rc == 0)
-        || (rc >= 0 && errno == ECONNREFUSED)) {
-        ipcCloseConnectFromServer(eventFd);
-    }
-    IPC_E_CHECK(rc >= 0, errno, end);
+    rc = recv(fd, &schemaHash, sizeof(schemaHash), MSG_WAITALL | MSG_DONTWAIT);
+    IPC_E_CHECK(rc == (int)sizeof(schemaHash), rc, end); // 0: rejected by the server
 
-    *pIndex = i;
+    // the data structure of the server is different
+    IPC_E_CHECK(schemaHash == g_ipcDomainInfoList[usageType].schemaHash, usageType, end);
 
+    ret = 0;
 end:
-    return;
+    return ret;
 }
 
-static void ipcCheckChangeAndCallback(int index, void *pLocalDataPool)
+// The connection of a registered usage made by the client thread is watched by epoll until the schema hash
+// arrives, so the thread does not wait for the server. called with the registry write lock.
+static void ipcSetSchemaPending(IPC_CLIENT_INFO_S *pInfo, int fd)
 {
-    IPC_CLIENT_INFO_S *pInfo = NULL;
-    IPC_CHECK_CHANGE_INFO_TABLE_S *pChangeInfoTbl = NULL;
-    IPC_CHECK_CHANGE_INFO_S *pChangeInfo = NULL;
-    int i;
-    void *pMemCmpData, *pMemCmpLocal;
+    struct epoll_event epollEv;
 
-    pInfo = &(g_clientInfo[index]);
-    if (pInfo->changeNotifyCb == NULL) {
-        goto end;
-    }
+    pInfo->pendingFd = fd;
+    __atomic_add_fetch(&g_schemaPendingNum, 1, __ATOMIC_RELAXED);
 
-    pChangeInfoTbl = &(g_ipcCheckChangeInfoTbl[pInfo->usage]);
+    memset(&epollEv, 0, sizeof(epollEv));
+    epollEv.events = EPOLLIN | EPOLLRDHUP;
+    epollEv.data.fd = fd;
+    epoll_ctl(g_epollFd, EPOLL_CTL_ADD, epollEv.data.fd, &epollEv);
+}
 
-    // Check for changes in the data pool.
-    for (i = 0; i < pChangeInfoTbl->num; i++) {
-        pChangeInfo = &(pChangeInfoTbl->pInfo[i]);
-        pMemCmpData = pInfo->pDataPool + pChangeInfo->offset;
-        pMemCmpLocal = pLocalDataPool + pChangeInfo->offset;
+// called with the registry write lock.
+static void ipcClosePendingFd(IPC_CLIENT_INFO_S *pInfo)
+{
+    struct epoll_event epollEv;
 
-        if (0 != memcmp(pMemCmpData, pMemCmpLocal, pChangeInfo->size)) {
-            pInfo->changeNotifyCb(pMemCmpLocal, pChangeInfo->size, pChangeInfo->kind);
-        }
+    if (pInfo->pendingFd < 0) {
+        return;
     }
 
-end:
-    return;
+    memset(&epollEv, 0, sizeof(epollEv));
+    epoll_ctl(g_epollFd, EPOLL_CTL_DEL, pInfo->pendingFd, &epollEv);
+    shutdown(pInfo->pendingFd, SHUT_RDWR);
+    close(pInfo->pendingFd);
+    pInfo->pendingFd = -1;
+    __atomic_sub_fetch(&g_schemaPendingNum, 1, __ATOMIC_RELAXED);
 }
 
-static void ipcWriteToDataPool(int index, void *pLocalDataPool)
+static bool ipcIsSchemaPending(int eventFd)
 {
-    IPC_CLIENT_INFO_S *pInfo = NULL;
-
-    pInfo = &(g_clientInfo[index]);
+    bool pending = false;
+    int i;
 
-    memcpy(pInfo->pDataPool, pLocalDataPool, pInfo->poolSize);
+    pthread_rwlock_rdlock(&g_registryLock);
+    for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
+        if (g_clientInfo[i].usage != IPC_USAGE_NONE && g_clientInfo[i].pendingFd == eventFd) {
+            pending = true;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&g_registryLock);
 
-    return;
+    return pending;
 }
 
-static int ipcAddClient(IPC_USAGE_TYPE_E usageType)
+// Checks the schema hash which has arrived on the pending connection. The usage is connected if it matches,
+// otherwise it is retried later. returns the number of pNotify[] entries. called with the registry write lock.
+static int ipcCheckPendingSchema(int eventFd, IPC_LINK_NOTIFY_S *pNotify)
 {
-    int ret = -1;
-    int index = -1;
     int i;
-    IPC_CLIENT_INFO_S *pInfo;
     int fd;
-    void *pDataPool = NULL;
-    int dataPoolSize;
+    int rc;
+    IPC_CLIENT_INFO_S *pInfo = NULL;
     struct epoll_event epollEv;
 
-    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
-
-    // check if the usageType is already used
-    index = ipcGetClientInfoIndex(usageType);
-    IPC_E_CHECK(index == -1, usageType, end);
-
-    // find empty index
     for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
-        pInfo = &(g_clientInfo[i]);
-        if (pInfo->usage == IPC_USAGE_TYPE_MAX) {
-            index = i;
+        if (g_clientInfo[i].usage != IPC_USAGE_NONE && g_clientInfo[i].pendingFd == eventFd) {
+            pInfo = &(g_clientInfo[i]);
             break;
         }
     }
+    if (pInfo == NULL) {
+        return 0; // removed by ipcClientStop
+    }
 
-    IPC_E_CHECK(index >= 0, i, end);
-    pInfo = &(g_clientInfo[index]);
+    rc = ipcClientCheckSchema(eventFd, pInfo->usage, 0);
+    if (rc != 0) {
+        ipcClosePendingFd(pInfo);
+        ipcRetryLater(pInfo, ipcGetTimeNs());
+        return 0;
+    }
 
-    dataPoolSize = g_ipcDomainInfoList[usageType].size;
-    pDataPool = malloc(dataPoolSize);
-    IPC_E_CHECK(pDataPool != NULL, 0, end);
-    memset(pDataPool, 0, dataPoolSize);
+    fd = pInfo->pendingFd;
+    pInfo->pendingFd = -1;
+    __atomic_sub_fetch(&g_schemaPendingNum, 1, __ATOMIC_RELAXED);
+    memset(&epollEv, 0, sizeof(epollEv));
+    epoll_ctl(g_epollFd, EPOLL_CTL_DEL, fd, &epollEv); // added again by ipcClientConnected
 
-    fd = ipcClientCreateSocket(usageType);
+    // the latest message of the server follows the schema hash
+    ipcClientConnected(pInfo, fd);
+    pNotify[0].usage = pInfo->usage;
+    pNotify[0].linkStateCb = pInfo->linkStateCb;
+    pNotify[0].state = IPC_LINK_STATE_CONNECTED;
 
-    IPC_E_CHECK(fd >= 0, usageType, end);
+    return 1;
+}
 
-    pInfo->usage = usageType;
-    pInfo->serverFd = fd;
-    pInfo->pDataPool = pDataPool;
-    pInfo->poolSize = dataPoolSize;
+// Makes fd (of ipcClientCreateSocket) the multiplexed connection, or closes it if another one has been made.
+// called with the registry write lock.
+static void ipcMuxAttach(int fd)
+{
+    struct epoll_event epollEv;
+
+    if (g_muxFd >= 0) {
+        shutdown(fd, SHUT_RDWR);
+        close(fd);
+        return;
+    }
+
+    g_muxFd = fd;
+    g_muxRecvLen = 0;
 
     memset(&epollEv, 0, sizeof(epollEv));
     epollEv.events = EPOLLIN | EPOLLRDHUP;
     epollEv.data.fd = fd;
     epoll_ctl(g_epollFd, EPOLL_CTL_ADD, epollEv.data.fd, &epollEv);
-
-    ret = 0;
-end:
-    if (ret != 0 && pDataPool != NULL) {
-        free(pDataPool);
-    }
-    return ret;
 }
 
-static int ipcRemoveClient(IPC_USAGE_TYPE_E usageType)
+// Tells the server the usages connected by the multiplexed connection.
+// The server sends the latest message of the newly added usages.
+static void ipcMuxSubscribe(void)
 {
-    int ret = -1;
-    int index;
-    IPC_CLIENT_INFO_S *pInfo;
-    struct epoll_event epollEv;
-
-    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
-
-    index = ipcGetClientInfoIndex(usageType);
-    IPC_E_CHECK(index >= 0, usageType, end);
-
-    pInfo = &(g_clientInfo[index]);
+    struct {
+        IPC_MUX_HEADER_S header;
+        unsigned int usageMask;
+    } subscribe;
+    int i;
+    int rc;
 
-    shutdown(pInfo->serverFd, SHUT_RDWR);
-    close(pInfo->serverFd);
-    if (pInfo->pDataPool != NULL) {
-        free(pInfo->pDataPool);
-        pInfo->pDataPool = NULL;
+    if (g_muxFd < 0) {
+        return;
     }
 
-    memset(&epollEv, 0, sizeof(epollEv));
-    epoll_ctl(g_epollFd, EPOLL_CTL_DEL, pInfo->serverFd, &epollEv);
-
-    ipcClientInfoClear(index);
+    memset(&subscribe, 0, sizeof(subscribe));
+    subscribe.header.type = IPC_MUX_TYPE_SUBSCRIBE;
+    subscribe.header.size = sizeof(subscribe.usageMask);
+    for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
+        if (g_clientInfo[i].usage != IPC_USAGE_NONE && g_clientInfo[i].serverFd == g_muxFd) {
+            subscribe.usageMask |= 1U << g_clientInfo[i].usage;
+        }
+    }
 
-    ret = 0;
+    // a failure is detected by EPOLLRDHUP
+    rc = send(g_muxFd, &subscribe, sizeof(subscribe), MSG_NOSIGNAL);
+    IPC_E_CHECK(rc == (int)sizeof(subscribe), errno, end);
 
 end:
-    return ret;
+    return;
 }
 
-static int ipcCountClient(void)
+static int ipcCountMuxClient(void)
 {
     int count = 0;
     int i;
 
     for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
-        if (g_clientInfo[i].usage != IPC_USAGE_TYPE_MAX) {
+        if (g_muxFd >= 0 && g_clientInfo[i].usage != IPC_USAGE_NONE && g_clientInfo[i].serverFd == g_muxFd) {
             count++;
         }
     }
@@ -446,114 +864,2578 @@ static int ipcCountClient(void)
     return count;
 }
 
-// == API function for client ==
-IPC_RET_E ipcClientStart(IPC_USAGE_TYPE_E usageType)
+static void ipcCloseMuxConnect(void)
 {
-    IPC_RET_E ret;
-    int rc;
-    char dummy = 's';
-    int index;
-
-    ret = IPC_ERR_PARAM;
-    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
-
-    ret = IPC_ERR_OTHER;
-    rc = ipcClientInit();
-    IPC_E_CHECK(rc == 0, rc, end);
+    struct epoll_event epollEv;
 
-    pthread_mutex_lock(&g_mutex);
-    rc = ipcAddClient(usageType);
-    pthread_mutex_unlock(&g_mutex);
+    if (g_muxFd >= 0) {
+        memset(&epollEv, 0, sizeof(epollEv));
+        epoll_ctl(g_epollFd, EPOLL_CTL_DEL, g_muxFd, &epollEv);
+        shutdown(g_muxFd, SHUT_RDWR);
+        close(g_muxFd);
+        g_muxFd = -1;
+        g_muxRecvLen = 0;
+    }
+}
 
-    ret = IPC_ERR_NO_RESOURCE;
-    IPC_E_CHECK(rc == 0, rc, end);
+static void ipcClientConnected(IPC_CLIENT_INFO_S *pInfo, int fd)
+{
+    struct epoll_event epollEv;
 
-    if (g_threadRunning == false) {
-        rc = pthread_create(&g_clientThread, NULL, ipcClientThread, NULL);
-        IPC_E_CHECK(rc == 0, rc, end);
+    pInfo->serverFd = fd;
+    pInfo->retryInterval = IPC_CLIENT_RETRY_MIN_TIME;
+    IPC_STATS_ADD(g_ipcStats[pInfo->usage].client.connects, 1);
 
-        g_threadRunning = true;
+    if (fd == g_muxFd) {
+        return; // registered by ipcMuxAttach
     }
 
-    rc = write(g_threadCtlPipeFd[1], &dummy, 1); // for wakeup epoll_wait
+    memset(&epollEv, 0, sizeof(epollEv));
+    epollEv.events = EPOLLIN | EPOLLRDHUP;
+    epollEv.data.fd = fd;
+    epoll_ctl(g_epollFd, EPOLL_CTL_ADD, epollEv.data.fd, &epollEv);
+}
+
+// The connection may be shared by all usages (IPC_MUX). returns the number of pNotify[] entries.
+// The requests waiting on the connection are failed (*pDoneNum: the number of pDone[] entries).
+static int ipcCloseConnectFromServer(int eventFd, IPC_LINK_NOTIFY_S *pNotify, IPC_REQUEST_DONE_S *pDone,
+                                     int *pDoneNum)
+{
+    int notifyNum = 0;
+    int index;
+    IPC_USAGE_TYPE_E usageType;
+    IPC_CLIENT_INFO_S *pInfo;
+    struct epoll_event epollEv;
+
+    *pDoneNum = 0;
+    for (index = 0; index < IPC_CLIENT_USAGE_MAX_NUM; index++) {
+        pInfo = &(g_clientInfo[index]);
+        if (pInfo->usage == IPC_USAGE_NONE) {
+            continue;
+        }
+
+        if (pInfo->serverFd == eventFd) {
+            // the responses are not sent by the new connection
+            *pDoneNum += ipcFailRequest(pInfo, IPC_ERR_NO_RESOURCE, pDone + *pDoneNum);
+            pNotify[notifyNum].usage = pInfo->usage;
+            pNotify[notifyNum].linkStateCb = pInfo->linkStateCb;
+            pNotify[notifyNum].state = IPC_LINK_STATE_DISCONNECTED;
+            notifyNum++;
+
+            if (pInfo->autoReconnect == true) {
+                // keep the data pool and wait for the server to come back.
+                pInfo->serverFd = -1;
+                pInfo->recvLen = 0; // the rest of the message is not sent by the new connection
+                pInfo->retryTime = ipcGetTimeNs() + pInfo->retryInterval * 1000000ULL;
+                continue;
+            }
+
+            // with the mutex, as ipcRemoveClient
+            ipcClientLock(pInfo);
+            usageType = pInfo->usage;
+            ipcFreeDataPool(pInfo);
+            ipcClientInfoClear(index);
+            pthread_cond_broadcast(&(pInfo->updateCond));
+            ipcStatsUnlock(&(pInfo->mutex), &(g_ipcStats[usageType].client.lock), pInfo->mutexLockedTime);
+        }
+    }
+
+    if (eventFd == g_muxFd) {
+        ipcCloseMuxConnect();
+    }
+    else if (notifyNum > 0) {
+        shutdown(eventFd, SHUT_RDWR);
+        close(eventFd);
+        memset(&epollEv, 0, sizeof(epollEv));
+        epoll_ctl(g_epollFd, EPOLL_CTL_DEL, eventFd, &epollEv);
+    }
+
+    return notifyNum;
+}
+
+// returns the epoll_wait timeout until the next connect attempt, or -1 if no usage is waiting for the server.
+static int ipcGetRetryTimeout(void)
+{
+    int timeout = -1;
+    int i;
+    IPC_CLIENT_INFO_S *pInfo;
+    unsigned long long now;
+    int wait;
+
+    now = ipcGetTimeNs();
+    for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
+        pInfo = &(g_clientInfo[i]);
+        if (pInfo->usage == IPC_USAGE_NONE || pInfo->serverFd >= 0) {
+            continue;
+        }
+
+        wait = 0;
+        if (pInfo->retryTime > now) {
+            wait = (int)((pInfo->retryTime - now + 999999ULL) / 1000000ULL);
+        }
+        if (timeout < 0 || wait < timeout) {
+            timeout = wait;
+        }
+    }
+
+    return timeout;
+}
+
+// returns the epoll_wait timeout until a change suppressed by minIntervalMs is notified, or -1 if there is none.
+static int ipcGetFilterTimeout(void)
+{
+    int timeout = -1;
+    int i;
+    int kind;
+    IPC_CLIENT_INFO_S *pInfo;
+    unsigned long long now;
+    int wait;
+
+    now = ipcGetTimeNs();
+    for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
+        pInfo = &(g_clientInfo[i]);
+        if (pInfo->usage == IPC_USAGE_NONE || pInfo->pFilter == NULL) {
+            continue;
+        }
+
+        for (kind = 0; kind < pInfo->kindNum; kind++) {
+            if (pInfo->pFilter[kind].pendingTimeNs == 0) {
+                continue;
+            }
+            wait = 0;
+            if (pInfo->pFilter[kind].pendingTimeNs > now) {
+                wait = (int)((pInfo->pFilter[kind].pendingTimeNs - now + 999999ULL) / 1000000ULL);
+            }
+            if (timeout < 0 || wait < timeout) {
+                timeout = wait;
+            }
+        }
+    }
+
+    return timeout;
+}
+
+// Decides whether the change of the kind to pValue (the member) is notified, and records it if so.
+static bool ipcPassFilter(IPC_CLIENT_INFO_S *pInfo, int kind, const void *pValue, unsigned long long timeNs)
+{
+    IPC_KIND_FILTER_STATE_S *pState = &(pInfo->pFilter[kind]);
+    const IPC_ANALOG_INFO_S *pAnalogInfo = NULL;
+    unsigned long long intervalNs = pState->config.minIntervalMs * 1000000ULL;
+    double value = 0;
+    double threshold;
+    int direction = 0;
+
+    if (pInfo->pKindMap[kind].analog >= 0) {
+        pAnalogInfo = &(g_ipcAnalogInfoTbl[pInfo->usage].pInfo[pInfo->pKindMap[kind].analog]);
+        value = ipcGetAnalogValue(pAnalogInfo, pValue);
+        if (value == pState->lastValue) {
+            pState->pendingTimeNs = 0; // came back to the notified value
+            return false;
+        }
+        direction = (value > pState->lastValue) ? 1 : -1;
+
+        threshold = fmax(pState->config.deadband, fabs(pState->lastValue) * pState->config.deadbandPercent / 100.0);
+        if (pState->lastDirection != 0 && direction != pState->lastDirection) {
+            threshold += pState->config.hysteresis;
+        }
+        if (fabs(value - pState->lastValue) < threshold) {
+            pState->pendingTimeNs = 0;
+            return false;
+        }
+    }
+
+    if (intervalNs > 0 && pState->lastTimeNs != 0 && timeNs - pState->lastTimeNs < intervalNs) {
+        pState->pendingTimeNs = pState->lastTimeNs + intervalNs;
+        return false;
+    }
+
+    if (pAnalogInfo != NULL) {
+        pState->lastValue = value;
+        pState->lastDirection = direction;
+    }
+    pState->lastTimeNs = timeNs;
+    pState->pendingTimeNs = 0;
+    return true;
+}
+
+// Notifies the changes suppressed by minIntervalMs whose time has come, with the value in the data pool.
+// pScratch: a buffer of IPC_ALL_USAGE_DATA_POOL_U
+static void ipcFlushFilter(void *pScratch)
+{
+    int i;
+    int kind;
+    IPC_CLIENT_INFO_S *pInfo;
+    IPC_KIND_MAP_S *pKindMap;
+    IPC_CHANGE_NOTIFY_CB changeNotifyCb;
+    unsigned long long now;
+
+    now = ipcGetTimeNs();
+    for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
+        pInfo = &(g_clientInfo[i]);
+        if (pInfo->usage == IPC_USAGE_NONE || pInfo->pFilter == NULL) {
+            continue;
+        }
+
+        for (kind = 0; kind < pInfo->kindNum; kind++) {
+            if (pInfo->pFilter[kind].pendingTimeNs == 0 || pInfo->pFilter[kind].pendingTimeNs > now) {
+                continue;
+            }
+            pInfo->pFilter[kind].pendingTimeNs = 0;
+            pKindMap = &(pInfo->pKindMap[kind]);
+
+            ipcClientLock(pInfo);
+            changeNotifyCb = pInfo->changeNotifyCb;
+            memcpy(pScratch, pInfo->pDataPool + pKindMap->poolOffset, pKindMap->size);
+            ipcClientUnlock(pInfo);
+
+            if ((changeNotifyCb != NULL || pInfo->ppSubscriber[kind] != NULL)
+                && ipcPassFilter(pInfo, kind, pScratch, now) == true) {
+                ipcNotifyKind(pInfo, changeNotifyCb, kind, pScratch, pKindMap->size);
+            }
+        }
+    }
+}
+
+// returns the usages whose retry time has come (with the registry read lock).
+// *pMuxConnect: the multiplexed connection is needed for some of them.
+static int ipcGetRetryUsage(IPC_USAGE_TYPE_E *pUsage, bool *pMuxConnect)
+{
+    int retryNum = 0;
+    int i;
+    IPC_CLIENT_INFO_S *pInfo;
+    unsigned long long now;
+
+    *pMuxConnect = false;
+    now = ipcGetTimeNs();
+    for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
+        pInfo = &(g_clientInfo[i]);
+        if (pInfo->usage == IPC_USAGE_NONE || pInfo->serverFd >= 0 || pInfo->pendingFd >= 0
+            || pInfo->retryTime > now) {
+            continue;
+        }
+        if (ipcIsMuxUsage(pInfo->usage) == true && g_muxFd < 0) {
+            *pMuxConnect = true;
+        }
+        pUsage[retryNum++] = pInfo->usage;
+    }
+
+    return retryNum;
+}
+
+// Connects the usages of ipcGetRetryUsage without the registry lock.
+// The multiplexed usages share *pMuxFd (pFd[] of them is -1).
+static void ipcConnectRetry(const IPC_USAGE_TYPE_E *pUsage, int retryNum, bool muxConnect, int *pFd, int *pMuxFd)
+{
+    int i;
+
+    *pMuxFd = -1;
+    for (i = 0; i < retryNum; i++) {
+        pFd[i] = -1;
+        if (ipcIsMuxUsage(pUsage[i]) == true) {
+            if (muxConnect == true && *pMuxFd < 0) {
+                *pMuxFd = ipcClientCreateSocket(pUsage[i], true);
+                muxConnect = false; // tried once in a wakeup
+            }
+            continue;
+        }
+        pFd[i] = ipcClientCreateSocket(pUsage[i], true);
+    }
+}
+
+static void ipcRetryLater(IPC_CLIENT_INFO_S *pInfo, unsigned long long now)
+{
+    pInfo->retryTime = now + pInfo->retryInterval * 1000000ULL;
+    pInfo->retryInterval *= 2;
+    if (pInfo->retryInterval > IPC_CLIENT_RETRY_MAX_TIME) {
+        pInfo->retryInterval = IPC_CLIENT_RETRY_MAX_TIME;
+    }
+}
+
+// Adds the connections of ipcConnectRetry to the usages (with the registry write lock), and closes the ones
+// which are not used (the usage has been stopped or connected meanwhile). returns the number of pNotify[] entries.
+static int ipcRetryConnectServer(const IPC_USAGE_TYPE_E *pUsage, int *pFd, int retryNum, int muxFd,
+                                 IPC_LINK_NOTIFY_S *pNotify)
+{
+    int notifyNum = 0;
+    int i;
+    int index;
+    IPC_CLIENT_INFO_S *pInfo;
+    unsigned long long now;
+    int fd;
+
+    now = ipcGetTimeNs();
+    for (i = 0; i < retryNum; i++) {
+        index = ipcGetClientInfoIndex(pUsage[i]);
+        if (index < 0 || g_clientInfo[index].serverFd >= 0 || g_clientInfo[index].pendingFd >= 0) {
+            continue;
+        }
+        pInfo = &(g_clientInfo[index]);
+
+        fd = pFd[i];
+        if (ipcIsMuxUsage(pInfo->usage) == true) {
+            if (g_muxFd < 0 && muxFd >= 0) {
+                ipcMuxAttach(muxFd);
+            }
+            fd = g_muxFd;
+        }
+        if (fd < 0) {
+            ipcRetryLater(pInfo, now);
+            continue;
+        }
+        pFd[i] = -1; // used
+
+        if (g_ipcDomainInfoList[pInfo->usage].schemaHash != 0) {
+            ipcSetSchemaPending(pInfo, fd); // connected by ipcCheckPendingSchema
+            continue;
+        }
+
+        // The server sends its latest message on accept, and the data pool is resynchronized by it.
+        ipcClientConnected(pInfo, fd);
+        pNotify[notifyNum].usage = pInfo->usage;
+        pNotify[notifyNum].linkStateCb = pInfo->linkStateCb;
+        pNotify[notifyNum].state = IPC_LINK_STATE_CONNECTED;
+        notifyNum++;
+    }
+
+    for (i = 0; i < retryNum; i++) {
+        if (pFd[i] >= 0) {
+            shutdown(pFd[i], SHUT_RDWR);
+            close(pFd[i]);
+        }
+    }
+    if (muxFd >= 0 && muxFd != g_muxFd) {
+        shutdown(muxFd, SHUT_RDWR);
+        close(muxFd);
+    }
+
+    if (notifyNum > 0) {
+        ipcMuxSubscribe();
+    }
+
+    return notifyNum;
+}
+
+static void ipcNotifyLinkState(IPC_LINK_NOTIFY_S *pNotify, int notifyNum)
+{
+    int i;
+
+    for (i = 0; i < notifyNum; i++) {
+        if (pNotify[i].linkStateCb != NULL) {
+            pNotify[i].linkStateCb(pNotify[i].usage, pNotify[i].state);
+        }
+    }
+}
+
+// The response is sent as a framed message: by the multiplexed connection, or as a topic message.
+static bool ipcIsRequestEnabled(IPC_CLIENT_INFO_S *pInfo)
+{
+    return (g_muxEnabled == true && pInfo->usage < IPC_USAGE_TYPE_MAX) || pInfo->topicNum > 0;
+}
+
+// Adds the request to the slot and sends it. called with the registry read lock.
+// pWait: ipcClientRequest (timed out by the caller), otherwise responseCb is called by the client thread.
+static IPC_RET_E ipcStartRequest(IPC_CLIENT_INFO_S *pInfo, int op, const void *pPayload, int size, int timeoutMs,
+                                 IPC_RESPONSE_CB responseCb, void *pUserData, IPC_REQUEST_WAIT_S *pWait,
+                                 unsigned int *pRequestId)
+{
+    IPC_RET_E ret;
+    int rc;
+    int i;
+    int slot = -1;
+    unsigned int id;
+    unsigned long long deadline = 0;
+    bool wakeup = (pWait == NULL && timeoutMs >= 0);
+    IPC_CLIENT_REQUEST_S *pRequest;
+    char dummy = 'r';
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(ipcIsRequestEnabled(pInfo) == true, pInfo->usage, end);
+
+    ret = IPC_ERR_NO_RESOURCE;
+    if (pInfo->serverFd < 0) {
+        goto end; // not connected yet (ipcClientStartDeferred)
+    }
+
+    do {
+        id = __atomic_add_fetch(&g_requestId, 1, __ATOMIC_RELAXED);
+    } while (id == 0);
+    if (timeoutMs >= 0) {
+        deadline = ipcGetTimeNs() + timeoutMs * 1000000ULL;
+    }
+
+    ipcClientLock(pInfo);
+    for (i = 0; i < IPC_CLIENT_REQUEST_MAX_NUM; i++) {
+        pRequest = &(pInfo->request[i]);
+        if (pRequest->id == 0) {
+            if (slot < 0) {
+                slot = i;
+            }
+        }
+        else if (pRequest->pWait == NULL && pRequest->deadline != 0 && pRequest->deadline <= deadline) {
+            wakeup = false; // the client thread wakes up before the deadline of this
+        }
+    }
+    if (slot >= 0) {
+        pRequest = &(pInfo->request[slot]);
+        pRequest->id = id;
+        pRequest->deadline = deadline;
+        pRequest->responseCb = responseCb;
+        pRequest->pUserData = pUserData;
+        pRequest->pWait = pWait;
+        pInfo->requestNum++;
+    }
+    ipcClientUnlock(pInfo);
+    IPC_E_CHECK(slot >= 0, pInfo->usage, end);
+
+    // set before sending, the response may be notified before this function returns
+    if (pRequestId != NULL) {
+        *pRequestId = id;
+    }
+
+    rc = ipcSendRequest(pInfo, id, op, pPayload, size);
+    if (rc != 0) {
+        ipcRemoveRequest(pInfo, id);
+        goto end;
+    }
+
+    if (wakeup == true) {
+        // for epoll_wait to be timed out by the deadline
+        rc = write(g_threadCtlPipeFd[1], &dummy, 1);
+        IPC_E_CHECK(rc >= 0, rc, end);
+    }
+
+    ret = IPC_RET_OK;
+end:
+    return ret;
+}
+
+static int ipcSendRequest(IPC_CLIENT_INFO_S *pInfo, unsigned int id, int op, const void *pPayload, int size)
+{
+    int ret = -1;
+    int rc;
+    char frame[sizeof(IPC_MUX_HEADER_S) + sizeof(IPC_REQUEST_HEADER_S) + IPC_REQUEST_MAX_SIZE];
+    IPC_MUX_HEADER_S muxHeader;
+    IPC_REQUEST_HEADER_S header;
+    int headerSize = 0;
+    int fd = pInfo->serverFd;
+
+    header.id = id;
+    header.code = op;
+    header.ret = IPC_RET_OK;
+    header.size = size;
+    if (fd == g_muxFd) {
+        muxHeader.usage = pInfo->usage;
+        muxHeader.type = IPC_MUX_TYPE_REQUEST;
+        muxHeader.size = sizeof(header) + size;
+        memcpy(frame, &muxHeader, sizeof(muxHeader));
+        headerSize = sizeof(muxHeader);
+    }
+    memcpy(frame + headerSize, &header, sizeof(header));
+    if (size > 0) {
+        memcpy(frame + headerSize + sizeof(header), pPayload, size);
+    }
+    size += headerSize + sizeof(header);
+
+    // one send() for a request, the server reads it at once
+    pthread_mutex_lock(&g_requestSendMutex);
+    rc = send(fd, frame, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+    pthread_mutex_unlock(&g_requestSendMutex);
+    if (rc > 0 && rc < size) {
+        // the stream can not be resynchronized, the connection is closed by EPOLLRDHUP
+        shutdown(fd, SHUT_RDWR);
+    }
+    IPC_E_CHECK(rc == size, errno, end);
+
+    ret = 0;
+end:
+    return ret;
+}
+
+// removes the request if it is still waiting (no callback is called).
+static void ipcRemoveRequest(IPC_CLIENT_INFO_S *pInfo, unsigned int id)
+{
+    int i;
+
+    ipcClientLock(pInfo);
+    for (i = 0; i < IPC_CLIENT_REQUEST_MAX_NUM; i++) {
+        if (pInfo->request[i].id == id) {
+            pInfo->request[i].id = 0;
+            pInfo->requestNum--;
+            break;
+        }
+    }
+    ipcClientUnlock(pInfo);
+}
+
+// called with the mutex held, also as the cancellation cleanup of ipcClientRequest.
+static void ipcClientRequestLeave(void *arg)
+{
+    struct {
+        IPC_CLIENT_INFO_S *pInfo;
+        unsigned int id;
+    } *pLeave = arg;
+    IPC_CLIENT_INFO_S *pInfo = pLeave->pInfo;
+    int i;
+
+    // the result is not written after this (it is on the stack of the caller)
+    for (i = 0; i < IPC_CLIENT_REQUEST_MAX_NUM; i++) {
+        if (pInfo->request[i].id == pLeave->id) {
+            pInfo->request[i].id = 0;
+            pInfo->requestNum--;
+            break;
+        }
+    }
+    ipcClientWaitLeave(pInfo);
+}
+
+// Completes the request of the response (IPC_REQUEST_HEADER_S and the payload).
+// The response of a request which has timed out is discarded.
+static void ipcReceiveResponse(IPC_CLIENT_INFO_S *pInfo, const char *pMessage, int size)
+{
+    IPC_REQUEST_HEADER_S header;
+    IPC_CLIENT_REQUEST_S request;
+    IPC_REQUEST_WAIT_S *pWait;
+    int i;
+
+    IPC_E_CHECK(size >= (int)sizeof(header), size, end);
+    memcpy(&header, pMessage, sizeof(header));
+    IPC_E_CHECK(size == (int)(sizeof(header) + header.size), size, end);
+    pMessage += sizeof(header);
+
+    ipcClientLock(pInfo);
+    for (i = 0; i < IPC_CLIENT_REQUEST_MAX_NUM; i++) {
+        if (pInfo->request[i].id == header.id) {
+            break;
+        }
+    }
+    if (i == IPC_CLIENT_REQUEST_MAX_NUM) {
+        ipcClientUnlock(pInfo);
+        goto end;
+    }
+
+    request = pInfo->request[i];
+    pInfo->request[i].id = 0;
+    pInfo->requestNum--;
+    pWait = request.pWait;
+    if (pWait != NULL) {
+        pWait->ret = (IPC_RET_E)header.ret;
+        pWait->status = header.code;
+        if (pWait->pResponse != NULL) {
+            memcpy(pWait->pResponse, pMessage, header.size < pWait->responseSize ? header.size : pWait->responseSize);
+        }
+        pWait->responseSize = header.size;
+        pWait->done = true;
+        pthread_cond_broadcast(&(pInfo->updateCond));
+    }
+    ipcClientUnlock(pInfo);
+
+    if (request.responseCb != NULL) {
+        request.responseCb(pInfo->usage, header.id, (IPC_RET_E)header.ret, header.code, pMessage, header.size,
+                           request.pUserData);
+    }
+
+end:
+    return;
+}
+
+// removes the request, and completes it with ret and no response. called with the mutex.
+// returns the number of pDone[] entries (ipcClientRequestAsync is notified after the locks are released).
+static int ipcEndRequest(IPC_CLIENT_INFO_S *pInfo, IPC_CLIENT_REQUEST_S *pRequest, IPC_RET_E ret,
+                         IPC_REQUEST_DONE_S *pDone)
+{
+    int doneNum = 0;
+
+    if (pRequest->pWait != NULL) {
+        pRequest->pWait->ret = ret;
+        pRequest->pWait->responseSize = 0;
+        pRequest->pWait->done = true;
+        pthread_cond_broadcast(&(pInfo->updateCond));
+    }
+    else {
+        pDone->usage = pInfo->usage;
+        pDone->id = pRequest->id;
+        pDone->ret = ret;
+        pDone->responseCb = pRequest->responseCb;
+        pDone->pUserData = pRequest->pUserData;
+        doneNum = 1;
+    }
+    pRequest->id = 0;
+    pInfo->requestNum--;
+
+    return doneNum;
+}
+
+// completes all requests of the usage with ret. returns the number of pDone[] entries.
+static int ipcFailRequest(IPC_CLIENT_INFO_S *pInfo, IPC_RET_E ret, IPC_REQUEST_DONE_S *pDone)
+{
+    int doneNum = 0;
+    int i;
+
+    if (pInfo->requestNum == 0) {
+        return 0;
+    }
+
+    ipcClientLock(pInfo);
+    for (i = 0; i < IPC_CLIENT_REQUEST_MAX_NUM; i++) {
+        if (pInfo->request[i].id != 0) {
+            doneNum += ipcEndRequest(pInfo, &(pInfo->request[i]), ret, pDone + doneNum);
+        }
+    }
+    ipcClientUnlock(pInfo);
+
+    return doneNum;
+}
+
+// returns the epoll_wait timeout until a request of ipcClientRequestAsync times out, or -1 if there is none.
+static int ipcGetRequestTimeout(void)
+{
+    int timeout = -1;
+    int i;
+    int j;
+    IPC_CLIENT_INFO_S *pInfo;
+    unsigned long long now;
+    int wait;
+
+    now = ipcGetTimeNs();
+    for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
+        pInfo = &(g_clientInfo[i]);
+        if (pInfo->usage == IPC_USAGE_NONE || __atomic_load_n(&(pInfo->requestNum), __ATOMIC_RELAXED) == 0) {
+            continue;
+        }
+
+        ipcClientLock(pInfo);
+        for (j = 0; j < IPC_CLIENT_REQUEST_MAX_NUM; j++) {
+            if (pInfo->request[j].id == 0 || pInfo->request[j].pWait != NULL || pInfo->request[j].deadline == 0) {
+                continue;
+            }
+            wait = 0;
+            if (pInfo->request[j].deadline > now) {
+                wait = (int)((pInfo->request[j].deadline - now + 999999ULL) / 1000000ULL);
+            }
+            if (timeout < 0 || wait < timeout) {
+                timeout = wait;
+            }
+        }
+        ipcClientUnlock(pInfo);
+    }
+
+    return timeout;
+}
+
+// times out the requests of ipcClientRequestAsync. returns the number of pDone[] entries.
+static int ipcExpireRequest(IPC_REQUEST_DONE_S *pDone)
+{
+    int doneNum = 0;
+    int i;
+    int j;
+    IPC_CLIENT_INFO_S *pInfo;
+    IPC_CLIENT_REQUEST_S *pRequest;
+    unsigned long long now;
+
+    now = ipcGetTimeNs();
+    for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
+        pInfo = &(g_clientInfo[i]);
+        if (pInfo->usage == IPC_USAGE_NONE || __atomic_load_n(&(pInfo->requestNum), __ATOMIC_RELAXED) == 0) {
+            continue;
+        }
+
+        ipcClientLock(pInfo);
+        for (j = 0; j < IPC_CLIENT_REQUEST_MAX_NUM; j++) {
+            pRequest = &(pInfo->request[j]);
+            if (pRequest->id != 0 && pRequest->pWait == NULL && pRequest->deadline != 0 && pRequest->deadline <= now) {
+                doneNum += ipcEndRequest(pInfo, pRequest, IPC_ERR_TIMEOUT, pDone + doneNum);
+            }
+        }
+        ipcClientUnlock(pInfo);
+    }
+
+    return doneNum;
+}
+
+static void ipcNotifyRequestDone(IPC_REQUEST_DONE_S *pDone, int doneNum)
+{
+    int i;
+
+    for (i = 0; i < doneNum; i++) {
+        pDone[i].responseCb(pDone[i].usage, pDone[i].id, pDone[i].ret, 0, NULL, 0, pDone[i].pUserData);
+    }
+}
+
+// Returns -1 when the connection has to be closed by the caller.
+// (Closing needs the registry write lock, which can not be taken while the read lock is held.)
+static int ipcReceiveDataFromServer(int eventFd, int *pIndex, void *pLocalDataPool, int *pSize)
+{
+    int ret = 0;
+    int rc;
+    int i;
+    int leftLen;
+    IPC_CLIENT_INFO_S *pInfo = NULL;
+
+    *pIndex = -1;
+
+    // check fd
+    for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
+        if (g_clientInfo[i].serverFd == eventFd) {
+            pInfo = &(g_clientInfo[i]);
+            break;
+        }
+    }
+
+    IPC_E_CHECK(pInfo != NULL, eventFd, end);
+    IPC_E_CHECK(pInfo->pDataPool != NULL, i, end);
+    IPC_E_CHECK(pInfo->poolSize > 0, i, end);
+
+    if (pInfo->topicNum > 0) {
+        ret = ipcReceiveTopicFromServer(pInfo, i, pLocalDataPool); // processed in it
+        goto end;
+    }
+
+    if (pInfo->recvMode == IPC_RECV_MODE_LATEST) {
+        // the newest message is processed even if the connection is closed after it
+        ret = ipcDrainFromServer(pInfo, pLocalDataPool, pSize);
+        if (*pSize > 0) {
+            *pIndex = i;
+        }
+        goto end;
+    }
+
+    // receive from server and write to data pool.
+    // (the head of a message left by IPC_RECV_MODE_LATEST is completed first, see ipcClientSetReceiveMode)
+    leftLen = pInfo->recvLen;
+    if (leftLen > 0) {
+        memcpy(pLocalDataPool, pInfo->pRecvBuf, leftLen);
+    }
+    rc = recv(eventFd, (char *)pLocalDataPool + leftLen, pInfo->poolSize - leftLen, 0);
+    if ((rc == 0)
+        || (rc >= 0 && errno == ECONNREFUSED)) {
+        ret = -1;
+        goto end;
+    }
+    IPC_E_CHECK(rc >= 0, errno, end);
+    pInfo->recvLen = 0;
+    rc += leftLen;
+
+    pInfo->rxSeq = __atomic_add_fetch(&(g_ipcStats[pInfo->usage].client.messagesReceived), 1, __ATOMIC_RELAXED);
+    IPC_TRACE(recv, pInfo->usage, -1, rc, pInfo->rxSeq);
+    if (rc < pInfo->poolSize) {
+        IPC_STATS_ADD(g_ipcStats[pInfo->usage].client.shortReads, 1);
+    }
+
+    *pIndex = i;
+    *pSize = rc;
+
+end:
+    return ret;
+}
+
+// Reads all messages queued on the connection, and copies only the newest complete one to pLocalDataPool.
+// (*pSize is 0 if there is none.) The stream is split by poolSize: the server completes a short message of
+// a usage without topics with its snapshot (see ipcSendToClients), so every message has the full size.
+static int ipcDrainFromServer(IPC_CLIENT_INFO_S *pInfo, void *pLocalDataPool, int *pSize)
+{
+    int ret = 0;
+    int rc;
+    int space;
+    int complete;
+    int bufSize = IPC_CLIENT_DRAIN_NUM * pInfo->poolSize;
+    int received = 0;
+
+    *pSize = 0;
+
+    do {
+        space = bufSize - pInfo->recvLen;
+        rc = recv(pInfo->serverFd, pInfo->pRecvBuf + pInfo->recvLen, space, MSG_DONTWAIT);
+        if (rc == 0) {
+            ret = -1;
+            goto end;
+        }
+        if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            break;
+        }
+        IPC_E_CHECK(rc > 0, errno, end);
+        pInfo->recvLen += rc;
+
+        complete = pInfo->recvLen / pInfo->poolSize;
+        if (complete > 0) {
+            memcpy(pLocalDataPool, pInfo->pRecvBuf + (complete - 1) * pInfo->poolSize, pInfo->poolSize);
+            *pSize = pInfo->poolSize;
+            received += complete;
+
+            pInfo->recvLen -= complete * pInfo->poolSize;
+            memmove(pInfo->pRecvBuf, pInfo->pRecvBuf + complete * pInfo->poolSize, pInfo->recvLen);
+        }
+    } while (rc == space); // the buffer was filled, more may be queued
+
+end:
+    if (received > 0) {
+        pInfo->rxSeq = __atomic_add_fetch(&(g_ipcStats[pInfo->usage].client.messagesReceived), received,
+                                          __ATOMIC_RELAXED);
+        IPC_STATS_ADD(g_ipcStats[pInfo->usage].client.messagesSkipped, received - 1);
+        IPC_TRACE(recv, pInfo->usage, -1, *pSize, pInfo->rxSeq);
+    }
+    return ret;
+}
+
+// A usage with topics: the stream is split by IPC_TOPIC_HEADER_S. The messages are applied to the data structure
+// loaded from the data pool, and processed one by one (IPC_RECV_MODE_LATEST: once for all messages of this wakeup).
+static int ipcReceiveTopicFromServer(IPC_CLIENT_INFO_S *pInfo, int index, void *pLocalDataPool)
+{
+    int ret = 0;
+    int rc;
+    int space;
+    int pos;
+    int size;
+    int bufSize = IPC_CLIENT_DRAIN_NUM * (sizeof(IPC_TOPIC_HEADER_S) + pInfo->poolSize);
+    IPC_TOPIC_HEADER_S header;
+    unsigned int segmentMask = 0;
+    unsigned int topicMask = 0;
+
+    ipcLoadDataPool(pInfo, pLocalDataPool);
+
+    do {
+        space = bufSize - pInfo->recvLen;
+        rc = recv(pInfo->serverFd, pInfo->pRecvBuf + pInfo->recvLen, space, MSG_DONTWAIT);
+        if (rc == 0) {
+            ret = -1;
+            goto end;
+        }
+        if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            break;
+        }
+        IPC_E_CHECK(rc > 0, errno, end);
+        pInfo->recvLen += rc;
+
+        pos = 0;
+        while (pInfo->recvLen - pos >= (int)sizeof(header)) {
+            memcpy(&header, pInfo->pRecvBuf + pos, sizeof(header));
+            size = sizeof(header) + header.size;
+            if ((header.topic != IPC_TOPIC_RESPONSE && header.size > pInfo->poolSize)
+                || (header.topic == IPC_TOPIC_RESPONSE
+                    && (header.size > sizeof(IPC_REQUEST_HEADER_S) + IPC_REQUEST_MAX_SIZE || size > bufSize))) {
+                // the stream can not be resynchronized
+                IPC_LOG(IPC_LOG_LEVEL_ERROR, "valid topic header", header.topic);
+                ret = -1;
+                goto end;
+            }
+            if (pInfo->recvLen - pos < size) {
+                break;
+            }
+
+            if (header.topic == IPC_TOPIC_RESPONSE) {
+                // the messages before it (e.g. sent by the request handler) are processed first
+                if (topicMask != 0) {
+                    ipcProcessTopic(index, pLocalDataPool, segmentMask, topicMask);
+                    segmentMask = 0;
+                    topicMask = 0;
+                }
+                ipcReceiveResponse(pInfo, pInfo->pRecvBuf + pos + sizeof(header), header.size);
+                pos += size;
+                continue;
+            }
+
+            pInfo->rxSeq = __atomic_add_fetch(&(g_ipcStats[pInfo->usage].client.messagesReceived), 1,
+                                              __ATOMIC_RELAXED);
+            IPC_TRACE(recv, pInfo->usage, -1, size, pInfo->rxSeq);
+            if (ipcApplyTopic(pInfo, pInfo->pRecvBuf + pos, size, pLocalDataPool, &segmentMask, &topicMask) != 0) {
+                ret = -1;
+                goto end;
+            }
+            pos += size;
+
+            if (pInfo->recvMode == IPC_RECV_MODE_ALL) {
+                ipcProcessTopic(index, pLocalDataPool, segmentMask, topicMask);
+                segmentMask = 0;
+                topicMask = 0;
+            }
+        }
+
+        memmove(pInfo->pRecvBuf, pInfo->pRecvBuf + pos, pInfo->recvLen - pos);
+        pInfo->recvLen -= pos;
+    } while (rc == space); // the buffer was filled, more may be queued
+
+end:
+    if (topicMask != 0) {
+        ipcProcessTopic(index, pLocalDataPool, segmentMask, topicMask);
+    }
+    return ret;
+}
+
+// Receives the frames of the multiplexed connection, and processes all of them in this wakeup.
+// A frame which is not complete yet is kept in g_muxRecvBuf until the rest is received.
+// Returns -1 when the connection has to be closed by the caller.
+static int ipcReceiveMuxFromServer(int eventFd, void *pLocalDataPool)
+{
+    int ret = 0;
+    int rc;
+    int space;
+    int pos;
+    int index;
+    int size;
+    IPC_MUX_HEADER_S header;
+    IPC_CLIENT_INFO_S *pInfo;
+    unsigned int segmentMask;
+    unsigned int topicMask;
+
+    do {
+        space = (int)sizeof(g_muxRecvBuf) - g_muxRecvLen;
+        rc = recv(eventFd, g_muxRecvBuf + g_muxRecvLen, space, MSG_DONTWAIT);
+        if (rc == 0) {
+            ret = -1;
+            goto end;
+        }
+        if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            break;
+        }
+        IPC_E_CHECK(rc > 0, errno, end);
+        g_muxRecvLen += rc;
+
+        pos = 0;
+        while (g_muxRecvLen - pos >= (int)sizeof(header)) {
+            memcpy(&header, g_muxRecvBuf + pos, sizeof(header));
+            if ((header.type != IPC_MUX_TYPE_DATA && header.type != IPC_MUX_TYPE_RESPONSE)
+                || header.usage >= IPC_USAGE_TYPE_MAX
+                || header.size > sizeof(IPC_TOPIC_HEADER_S) + sizeof(IPC_ALL_USAGE_DATA_POOL_U)) {
+                // the stream can not be resynchronized
+                IPC_LOG(IPC_LOG_LEVEL_ERROR, "valid mux header", header.usage);
+                ret = -1;
+                goto end;
+            }
+            if (g_muxRecvLen - pos < (int)(sizeof(header) + header.size)) {
+                break;
+            }
+
+            index = ipcGetClientInfoIndex((IPC_USAGE_TYPE_E)header.usage);
+            if (header.type == IPC_MUX_TYPE_RESPONSE) {
+                if (index >= 0 && g_clientInfo[index].serverFd == eventFd) {
+                    // the messages before it (e.g. sent by the request handler) are processed first
+                    ipcProcessMuxLatest(index, pLocalDataPool);
+                    ipcReceiveResponse(&(g_clientInfo[index]), g_muxRecvBuf + pos + sizeof(header), header.size);
+                }
+            }
+            else if (index >= 0 && g_clientInfo[index].serverFd == eventFd && g_clientInfo[index].pDataPool != NULL) {
+                pInfo = &(g_clientInfo[index]);
+                size = (int)header.size < pInfo->poolSize ? (int)header.size : pInfo->poolSize;
+
+                pInfo->rxSeq = __atomic_add_fetch(&(g_ipcStats[pInfo->usage].client.messagesReceived), 1,
+                                                  __ATOMIC_RELAXED);
+                IPC_TRACE(recv, pInfo->usage, -1, size, pInfo->rxSeq);
+                if (pInfo->topicNum == 0 && size < pInfo->poolSize) {
+                    IPC_STATS_ADD(g_ipcStats[pInfo->usage].client.shortReads, 1);
+                }
+
+                if (pInfo->topicNum > 0) {
+                    // merged in pRecvBuf (IPC_RECV_MODE_LATEST), or processed now
+                    if (pInfo->recvMode == IPC_RECV_MODE_LATEST) {
+                        if (pInfo->recvLen == 0) {
+                            ipcLoadDataPool(pInfo, pInfo->pRecvBuf);
+                            pInfo->recvLen = pInfo->poolSize;
+                        }
+                        rc = ipcApplyTopic(pInfo, g_muxRecvBuf + pos + sizeof(header), header.size, pInfo->pRecvBuf,
+                                           &(pInfo->recvSegmentMask), &(pInfo->recvTopicMask));
+                    }
+                    else {
+                        segmentMask = 0;
+                        topicMask = 0;
+                        ipcLoadDataPool(pInfo, pLocalDataPool);
+                        rc = ipcApplyTopic(pInfo, g_muxRecvBuf + pos + sizeof(header), header.size, pLocalDataPool,
+                                           &segmentMask, &topicMask);
+                        if (rc == 0) {
+                            ipcProcessTopic(index, pLocalDataPool, segmentMask, topicMask);
+                        }
+                    }
+                    if (rc != 0) {
+                        ret = -1;
+                        goto end;
+                    }
+                }
+                else if (pInfo->recvMode == IPC_RECV_MODE_LATEST) {
+                    // processed after all frames of this wakeup are received
+                    if (pInfo->recvLen > 0) {
+                        IPC_STATS_ADD(g_ipcStats[pInfo->usage].client.messagesSkipped, 1);
+                    }
+                    memcpy(pInfo->pRecvBuf, g_muxRecvBuf + pos + sizeof(header), size);
+                    pInfo->recvLen = size;
+                }
+                else {
+                    memcpy(pLocalDataPool, g_muxRecvBuf + pos + sizeof(header), size);
+                    ipcProcessReceivedData(index, pLocalDataPool, size, ~0U);
+                }
+            }
+            pos += sizeof(header) + header.size;
+        }
+
+        memmove(g_muxRecvBuf, g_muxRecvBuf + pos, g_muxRecvLen - pos);
+        g_muxRecvLen -= pos;
+    } while (rc == space); // the buffer was filled, more may be queued
+
+end:
+    for (index = 0; index < IPC_CLIENT_USAGE_MAX_NUM; index++) {
+        if (g_clientInfo[index].serverFd == eventFd) {
+            ipcProcessMuxLatest(index, pLocalDataPool);
+        }
+    }
+    return ret;
+}
+
+// IPC_RECV_MODE_LATEST with IPC_MUX: processes the newest message of the usage kept in pRecvBuf, if any.
+static void ipcProcessMuxLatest(int index, void *pLocalDataPool)
+{
+    IPC_CLIENT_INFO_S *pInfo = &(g_clientInfo[index]);
+    int size;
+
+    if (pInfo->recvMode != IPC_RECV_MODE_LATEST || pInfo->recvLen == 0) {
+        return;
+    }
+
+    size = pInfo->recvLen;
+    memcpy(pLocalDataPool, pInfo->pRecvBuf, size);
+    pInfo->recvLen = 0;
+    if (pInfo->topicNum > 0) {
+        ipcProcessTopic(index, pLocalDataPool, pInfo->recvSegmentMask, pInfo->recvTopicMask);
+        pInfo->recvSegmentMask = 0;
+        pInfo->recvTopicMask = 0;
+    }
+    else {
+        ipcProcessReceivedData(index, pLocalDataPool, size, ~0U);
+    }
+}
+
+// segmentMask: the segments which may have been changed by the message (the others are not compared)
+static void ipcProcessReceivedData(int index, void *pLocalDataPool, int size, unsigned int segmentMask)
+{
+    unsigned int changedSegment;
+
+    changedSegment = ipcGetChangedSegment(index, pLocalDataPool, segmentMask);
+    ipcCheckChangeAndCallback(index, pLocalDataPool, changedSegment);
+    ipcWriteToDataPool(index, pLocalDataPool, changedSegment);
+    if (g_clientInfo[index].dataState != IPC_DATA_STATE_LIVE) {
+        __atomic_store_n(&(g_clientInfo[index].dataState), IPC_DATA_STATE_LIVE, __ATOMIC_RELEASE);
+    }
+    ipcRecordSample(index, pLocalDataPool, segmentMask);
+    ipcDataCallback(index, pLocalDataPool, size);
+}
+
+// copies the data pool to pLocalDataPool in the layout of the data structure.
+// The data pool is written only by this thread, so it can be read without the usage lock.
+static void ipcLoadDataPool(IPC_CLIENT_INFO_S *pInfo, void *pLocalDataPool)
+{
+    int i;
+
+    for (i = 0; i < pInfo->segmentNum; i++) {
+        memcpy(pLocalDataPool + pInfo->segment[i].offset, pInfo->pDataPool + pInfo->segmentOffset[i],
+               pInfo->segment[i].size);
+    }
+}
+
+// returns the bit mask of the segments which overlap the range of the data structure.
+static unsigned int ipcGetSegmentMask(IPC_CLIENT_INFO_S *pInfo, int offset, int size)
+{
+    unsigned int segmentMask = 0;
+    int i;
+
+    for (i = 0; i < pInfo->segmentNum; i++) {
+        if (pInfo->segment[i].offset < offset + size && offset < pInfo->segment[i].offset + pInfo->segment[i].size) {
+            segmentMask |= 1U << i;
+        }
+    }
+
+    return segmentMask;
+}
+
+// Copies the payload of a message with IPC_TOPIC_HEADER_S to pLocalDataPool, and adds its segments and topic
+// to the masks. (bit IPC_TOPIC_MAX_NUM of pTopicMask is IPC_TOPIC_WHOLE) returns -1 if the message is broken.
+static int ipcApplyTopic(IPC_CLIENT_INFO_S *pInfo, const char *pMessage, int size, void *pLocalDataPool,
+                         unsigned int *pSegmentMask, unsigned int *pTopicMask)
+{
+    int ret = -1;
+    IPC_TOPIC_HEADER_S header;
+    const IPC_POOL_SEGMENT_S *pRange;
+    int bit;
+
+    IPC_E_CHECK(size >= (int)sizeof(header), size, end);
+    memcpy(&header, pMessage, sizeof(header));
+    IPC_E_CHECK(size == (int)sizeof(header) + header.size, header.size, end);
+
+    if (header.topic == IPC_TOPIC_WHOLE) {
+        IPC_E_CHECK(header.size <= pInfo->poolSize, header.size, end);
+        memcpy(pLocalDataPool, pMessage + sizeof(header), header.size);
+        *pSegmentMask |= ipcGetSegmentMask(pInfo, 0, header.size);
+        bit = IPC_TOPIC_MAX_NUM;
+    }
+    else {
+        IPC_E_CHECK(header.topic < pInfo->topicNum, header.topic, end);
+        pRange = &(g_ipcTopicTbl[pInfo->usage].pRange[header.topic]);
+        IPC_E_CHECK(header.size == pRange->size, header.size, end);
+        memcpy(pLocalDataPool + pRange->offset, pMessage + sizeof(header), header.size);
+        *pSegmentMask |= pInfo->topicSegment[header.topic];
+        bit = header.topic;
+    }
+
+    if ((*pTopicMask & (1U << bit)) != 0) {
+        IPC_STATS_ADD(g_ipcStats[pInfo->usage].client.messagesSkipped, 1); // merged (IPC_RECV_MODE_LATEST)
+    }
+    *pTopicMask |= 1U << bit;
+    pInfo->recvSeq[bit] = header.seq;
+
+    ret = 0;
+end:
+    return ret;
+}
+
+// processes the merged messages of the topics, and publishes their sequence numbers.
+static void ipcProcessTopic(int index, void *pLocalDataPool, unsigned int segmentMask, unsigned int topicMask)
+{
+    IPC_CLIENT_INFO_S *pInfo = &(g_clientInfo[index]);
+    int i;
+
+    ipcProcessReceivedData(index, pLocalDataPool, pInfo->poolSize, segmentMask);
+    for (i = 0; i <= IPC_TOPIC_MAX_NUM; i++) {
+        if ((topicMask & (1U << i)) != 0) {
+            __atomic_store_n(&(pInfo->topicSeq[i]), pInfo->recvSeq[i], __ATOMIC_RELEASE);
+        }
+    }
+}
+
+// Allocates the data pool in the internal layout.
+// The segments of g_ipcPoolLayoutTbl are placed in the table order, each from a cache line,
+// so the data updated by every message shares one line and the others are not touched.
+static int ipcAllocDataPool(IPC_CLIENT_INFO_S *pInfo, IPC_USAGE_TYPE_E usageType)
+{
+    int ret = -1;
+    int rc;
+    int i, j;
+    int poolOffset = 0;
+    IPC_POOL_LAYOUT_TABLE_S *pLayout;
+    IPC_CHECK_CHANGE_INFO_TABLE_S *pChangeInfoTbl;
+    IPC_CHECK_CHANGE_INFO_S *pChangeInfo;
+    IPC_POOL_SEGMENT_S *pSegment;
+    IPC_ANALOG_INFO_TABLE_S *pAnalogInfoTbl;
+    char *pCovered = NULL;
+
+    pInfo->poolSize = g_ipcDomainInfoList[usageType].size;
+    pLayout = &(g_ipcPoolLayoutTbl[usageType]);
+    if (pLayout->pSegment == NULL) {
+        pInfo->segmentNum = 1;
+        pInfo->segment[0].offset = 0;
+        pInfo->segment[0].size = pInfo->poolSize;
+    }
+    else {
+        IPC_E_CHECK(0 < pLayout->num && pLayout->num <= IPC_POOL_SEGMENT_MAX_NUM, pLayout->num, end);
+        pInfo->segmentNum = pLayout->num;
+        memcpy(pInfo->segment, pLayout->pSegment, sizeof(IPC_POOL_SEGMENT_S) * pLayout->num);
+    }
+
+    // the segments must cover every byte of the data structure once.
+    pCovered = calloc(pInfo->poolSize, 1);
+    IPC_E_CHECK(pCovered != NULL, 0, end);
+    for (i = 0; i < pInfo->segmentNum; i++) {
+        pSegment = &(pInfo->segment[i]);
+        IPC_E_CHECK(0 <= pSegment->offset && pSegment->offset + pSegment->size <= pInfo->poolSize, i, end);
+        for (j = pSegment->offset; j < pSegment->offset + pSegment->size; j++) {
+            IPC_E_CHECK(pCovered[j] == 0, j, end);
+            pCovered[j] = 1;
+        }
+
+        pInfo->segmentOffset[i] = poolOffset;
+        poolOffset += (pSegment->size + IPC_CACHE_LINE_SIZE - 1) & ~(IPC_CACHE_LINE_SIZE - 1);
+    }
+    IPC_E_CHECK(memchr(pCovered, 0, pInfo->poolSize) == NULL, usageType, end);
+
+    rc = posix_memalign(&(pInfo->pDataPool), IPC_CACHE_LINE_SIZE, poolOffset);
+    IPC_E_CHECK(rc == 0, rc, end);
+    memset(pInfo->pDataPool, 0, poolOffset);
+    ipcRtLockMemory(pInfo->pDataPool, poolOffset);
+
+    // kind -> location in the data pool
+    pChangeInfoTbl = &(g_ipcCheckChangeInfoTbl[usageType]);
+    pInfo->kindNum = 0;
+    for (i = 0; i < pChangeInfoTbl->num; i++) {
+        if (pChangeInfoTbl->pInfo[i].kind >= pInfo->kindNum) {
+            pInfo->kindNum = pChangeInfoTbl->pInfo[i].kind + 1;
+        }
+    }
+    pInfo->pKindMap = calloc(pInfo->kindNum > 0 ? pInfo->kindNum : 1, sizeof(IPC_KIND_MAP_S));
+    IPC_E_CHECK(pInfo->pKindMap != NULL, 0, end);
+    pInfo->ppSubscriber = calloc(pInfo->kindNum > 0 ? pInfo->kindNum : 1, sizeof(IPC_KIND_SUBSCRIBER_LIST_S *));
+    IPC_E_CHECK(pInfo->ppSubscriber != NULL, 0, end);
+    for (i = 0; i < pChangeInfoTbl->num; i++) {
+        pChangeInfo = &(pChangeInfoTbl->pInfo[i]);
+        for (j = 0; j < pInfo->segmentNum; j++) {
+            pSegment = &(pInfo->segment[j]);
+            if (pSegment->offset <= pChangeInfo->offset
+                && pChangeInfo->offset + pChangeInfo->size <= pSegment->offset + pSegment->size) {
+                break;
+            }
+        }
+        IPC_E_CHECK(j < pInfo->segmentNum, pChangeInfo->kind, end); // a member must not cross segments
+        pInfo->pKindMap[pChangeInfo->kind].poolOffset = pInfo->segmentOffset[j] + pChangeInfo->offset - pSegment->offset;
+        pInfo->pKindMap[pChangeInfo->kind].size = pChangeInfo->size;
+        pInfo->pKindMap[pChangeInfo->kind].segment = j;
+        pInfo->pKindMap[pChangeInfo->kind].analog = -1;
+    }
+
+    // analog values (an analog value must be in the change table to be read by kind)
+    pAnalogInfoTbl = &(g_ipcAnalogInfoTbl[usageType]);
+    if (pAnalogInfoTbl->num > 0) {
+        pInfo->pSampleRing = calloc(pAnalogInfoTbl->num, sizeof(IPC_SAMPLE_RING_S));
+        IPC_E_CHECK(pInfo->pSampleRing != NULL, 0, end);
+        ipcRtLockMemory(pInfo->pSampleRing, pAnalogInfoTbl->num * sizeof(IPC_SAMPLE_RING_S));
+    }
+    for (i = 0; i < pAnalogInfoTbl->num; i++) {
+        IPC_E_CHECK(pAnalogInfoTbl->pInfo[i].kind < pInfo->kindNum, pAnalogInfoTbl->pInfo[i].kind, end);
+        IPC_E_CHECK((pAnalogInfoTbl->pInfo[i].size & (pAnalogInfoTbl->pInfo[i].size - 1)) == 0
+                    && pAnalogInfoTbl->pInfo[i].size <= 8, pAnalogInfoTbl->pInfo[i].size, end);
+        pInfo->pKindMap[pAnalogInfoTbl->pInfo[i].kind].analog = i;
+    }
+
+    // topics (the receive buffer is used to split the stream by IPC_TOPIC_HEADER_S)
+    pInfo->topicNum = g_ipcTopicTbl[usageType].num;
+    IPC_E_CHECK(pInfo->topicNum <= IPC_TOPIC_MAX_NUM, pInfo->topicNum, end);
+    for (i = 0; i < pInfo->topicNum; i++) {
+        pInfo->topicSegment[i] = ipcGetSegmentMask(pInfo, g_ipcTopicTbl[usageType].pRange[i].offset,
+                                                   g_ipcTopicTbl[usageType].pRange[i].size);
+    }
+    if (pInfo->topicNum > 0) {
+        pInfo->pRecvBuf = malloc(IPC_CLIENT_DRAIN_NUM * (sizeof(IPC_TOPIC_HEADER_S) + pInfo->poolSize));
+        IPC_E_CHECK(pInfo->pRecvBuf != NULL, 0, end);
+        ipcRtLockMemory(pInfo->pRecvBuf, IPC_CLIENT_DRAIN_NUM * (sizeof(IPC_TOPIC_HEADER_S) + pInfo->poolSize));
+        pInfo->recvLen = 0;
+    }
+
+    ret = 0;
+
+end:
+    free(pCovered);
+    if (ret != 0) {
+        ipcFreeDataPool(pInfo);
+    }
+    return ret;
+}
+
+static void ipcFreeDataPool(IPC_CLIENT_INFO_S *pInfo)
+{
+    int i;
+
+    for (i = 0; pInfo->ppSubscriber != NULL && i < pInfo->kindNum; i++) {
+        free(pInfo->ppSubscriber[i]);
+    }
+    free(pInfo->ppSubscriber);
+    pInfo->ppSubscriber = NULL;
+    ipcFreeRetiredSubscriber(pInfo->pRetiredSubscriber);
+    pInfo->pRetiredSubscriber = NULL;
+    pInfo->subscriberNum = 0;
+
+    free(pInfo->pDataPool);
+    pInfo->pDataPool = NULL;
+    free(pInfo->pKindMap);
+    pInfo->pKindMap = NULL;
+    pInfo->kindNum = 0;
+    free(pInfo->pSampleRing);
+    pInfo->pSampleRing = NULL;
+    free(pInfo->pRecvBuf);
+    pInfo->pRecvBuf = NULL;
+    free(pInfo->pFilter);
+    pInfo->pFilter = NULL;
+}
+
+// returns the bit mask of the segments which differ from the data pool.
+// The data pool is written only by this thread, so it can be compared without the usage lock.
+static unsigned int ipcGetChangedSegment(int index, void *pLocalDataPool, unsigned int segmentMask)
+{
+    IPC_CLIENT_INFO_S *pInfo;
+    unsigned int changedSegment = 0;
+    int i;
+
+    pInfo = &(g_clientInfo[index]);
+    for (i = 0; i < pInfo->segmentNum; i++) {
+        if ((segmentMask & (1U << i)) != 0
+            && 0 != memcmp(pInfo->pDataPool + pInfo->segmentOffset[i], pLocalDataPool + pInfo->segment[i].offset,
+                           pInfo->segment[i].size)) {
+            changedSegment |= 1U << i;
+        }
+    }
+
+    return changedSegment;
+}
+
+static void ipcCheckChangeAndCallback(int index, void *pLocalDataPool, unsigned int changedSegment)
+{
+    IPC_CLIENT_INFO_S *pInfo = NULL;
+    IPC_CHECK_CHANGE_INFO_TABLE_S *pChangeInfoTbl = NULL;
+    IPC_CHECK_CHANGE_INFO_S *pChangeInfo = NULL;
+    int i;
+    void *pMemCmpData, *pMemCmpLocal;
+    IPC_CHANGE_NOTIFY_CB changeNotifyCb;
+    IPC_STATS_CLIENT_S *pStats;
+    IPC_KIND_MAP_S *pKindMap;
+    int subscriberNum;
+    IPC_KIND_SUBSCRIBER_LIST_S *pRetired;
+
+    pInfo = &(g_clientInfo[index]);
+    ipcClientLock(pInfo);
+    changeNotifyCb = pInfo->changeNotifyCb;
+    subscriberNum = pInfo->subscriberNum;
+    pRetired = pInfo->pRetiredSubscriber; // this thread is not using them now
+    pInfo->pRetiredSubscriber = NULL;
+    ipcClientUnlock(pInfo);
+    ipcFreeRetiredSubscriber(pRetired);
+    if ((changeNotifyCb == NULL && subscriberNum == 0) || changedSegment == 0) {
+        goto end;
+    }
+
+    pChangeInfoTbl = &(g_ipcCheckChangeInfoTbl[pInfo->usage]);
+    pStats = &(g_ipcStats[pInfo->usage].client);
+
+    // Check for changes in the data pool. (only in the changed segments)
+    for (i = 0; i < pChangeInfoTbl->num; i++) {
+        pChangeInfo = &(pChangeInfoTbl->pInfo[i]);
+        pKindMap = &(pInfo->pKindMap[pChangeInfo->kind]);
+        if ((changedSegment & (1U << pKindMap->segment)) == 0) {
+            continue;
+        }
+        if (changeNotifyCb == NULL
+            && __atomic_load_n(&(pInfo->ppSubscriber[pChangeInfo->kind]), __ATOMIC_ACQUIRE) == NULL) {
+            continue; // nobody listens to this kind
+        }
+        pMemCmpData = pInfo->pDataPool + pKindMap->poolOffset;
+        pMemCmpLocal = pLocalDataPool + pChangeInfo->offset;
+
+        if (0 != memcmp(pMemCmpData, pMemCmpLocal, pChangeInfo->size)) {
+            IPC_TRACE(diff, pInfo->usage, pChangeInfo->kind, pChangeInfo->size, pInfo->rxSeq);
+            if (pInfo->pFilter != NULL && pInfo->pFilter[pChangeInfo->kind].enabled == true
+                && ipcPassFilter(pInfo, pChangeInfo->kind, pMemCmpLocal, ipcGetTimeNs()) == false) {
+                IPC_STATS_ADD(pStats->callbacksFiltered, 1);
+                continue;
+            }
+            ipcNotifyKind(pInfo, changeNotifyCb, pChangeInfo->kind, pMemCmpLocal, pChangeInfo->size);
+        }
+    }
+
+end:
+    return;
+}
+
+// Calls the callback of the usage and the subscribers of the kind. (the client thread, without the usage lock)
+static void ipcNotifyKind(IPC_CLIENT_INFO_S *pInfo, IPC_CHANGE_NOTIFY_CB changeNotifyCb, int kind, void *pValue,
+                          int size)
+{
+    IPC_KIND_SUBSCRIBER_LIST_S *pList;
+    IPC_STATS_CLIENT_S *pStats = &(g_ipcStats[pInfo->usage].client);
+    unsigned long long startTime;
+    int i;
+
+    IPC_TRACE(callback_entry, pInfo->usage, kind, size, pInfo->rxSeq);
+    startTime = ipcGetTimeNs();
+    if (changeNotifyCb != NULL) {
+        changeNotifyCb(pValue, size, kind);
+        IPC_STATS_ADD(pStats->callbacks, 1);
+    }
+    pList = __atomic_load_n(&(pInfo->ppSubscriber[kind]), __ATOMIC_ACQUIRE);
+    for (i = 0; pList != NULL && i < pList->num; i++) {
+        pList->entry[i].kindNotifyCb(pInfo->usage, kind, pValue, size, pList->entry[i].pUserData);
+        IPC_STATS_ADD(pStats->callbacks, 1);
+    }
+    IPC_STATS_ADD(pStats->callbackTimeNs, ipcGetTimeNs() - startTime);
+    IPC_TRACE(callback_exit, pInfo->usage, kind, size, pInfo->rxSeq);
+}
+
+static void ipcFreeRetiredSubscriber(IPC_KIND_SUBSCRIBER_LIST_S *pList)
+{
+    IPC_KIND_SUBSCRIBER_LIST_S *pNext;
+
+    while (pList != NULL) {
+        pNext = pList->pNextRetired;
+        free(pList);
+        pList = pNext;
+    }
+}
+
+static bool ipcIsClientThread(void)
+{
+    return (g_threadRunning == true && pthread_equal(pthread_self(), g_clientThread) != 0);
+}
+
+// writes only the changed segments, so the cache lines of the others stay clean in the readers.
+static void ipcWriteToDataPool(int index, void *pLocalDataPool, unsigned int changedSegment)
+{
+    IPC_CLIENT_INFO_S *pInfo = NULL;
+    int i;
+
+    pInfo = &(g_clientInfo[index]);
+    if (changedSegment == 0) {
+        return;
+    }
+
+    ipcClientLock(pInfo);
+    for (i = 0; i < pInfo->segmentNum; i++) {
+        if ((changedSegment & (1U << i)) != 0) {
+            memcpy(pInfo->pDataPool + pInfo->segmentOffset[i], pLocalDataPool + pInfo->segment[i].offset,
+                   pInfo->segment[i].size);
+        }
+    }
+    pInfo->generation++;
+    if (pInfo->waiterNum > 0) {
+        pthread_cond_broadcast(&(pInfo->updateCond));
+    }
+    if (pInfo->notifyFd >= 0) {
+        eventfd_write(pInfo->notifyFd, 1); // EAGAIN only when the counter is saturated, then it is readable anyway
+    }
+    ipcClientUnlock(pInfo);
+
+    return;
+}
+
+// pValue: the member of the analog value
+static double ipcGetAnalogValue(const IPC_ANALOG_INFO_S *pAnalogInfo, const void *pValue)
+{
+    double value = 0;
+
+    switch (pAnalogInfo->size) {
+    case 1:
+        value = pAnalogInfo->isSigned ? *(const signed char *)pValue : *(const unsigned char *)pValue;
+        break;
+    case 2:
+        value = pAnalogInfo->isSigned ? *(const signed short *)pValue : *(const unsigned short *)pValue;
+        break;
+    case 4:
+        value = pAnalogInfo->isSigned ? *(const signed int *)pValue : *(const unsigned int *)pValue;
+        break;
+    case 8:
+        value = pAnalogInfo->isSigned ? *(const signed long long *)pValue : *(const unsigned long long *)pValue;
+        break;
+    default:
+        break; // checked by ipcAllocDataPool
+    }
+
+    return value;
+}
+
+// records the analog values of every message (also unchanged ones) with the receive time.
+static void ipcRecordSample(int index, void *pLocalDataPool, unsigned int segmentMask)
+{
+    IPC_CLIENT_INFO_S *pInfo;
+    IPC_ANALOG_INFO_TABLE_S *pAnalogInfoTbl;
+    IPC_SAMPLE_RING_S *pRing;
+    unsigned long long timeNs;
+    int i;
+
+    pInfo = &(g_clientInfo[index]);
+    pAnalogInfoTbl = &(g_ipcAnalogInfoTbl[pInfo->usage]);
+    if (pAnalogInfoTbl->num == 0) {
+        return;
+    }
+
+    timeNs = ipcGetTimeNs();
+    ipcClientLock(pInfo);
+    for (i = 0; i < pAnalogInfoTbl->num; i++) {
+        if ((segmentMask & (1U << pInfo->pKindMap[pAnalogInfoTbl->pInfo[i].kind].segment)) == 0) {
+            continue; // not sent by the message (a topic of the other segments)
+        }
+        pRing = &(pInfo->pSampleRing[i]);
+        pRing->timeNs[pRing->count % IPC_CLIENT_SAMPLE_NUM] = timeNs;
+        pRing->value[pRing->count % IPC_CLIENT_SAMPLE_NUM] = ipcGetAnalogValue(&(pAnalogInfoTbl->pInfo[i]),
+                                                                        pLocalDataPool + pAnalogInfoTbl->pInfo[i].offset);
+        pRing->count++;
+    }
+    ipcClientUnlock(pInfo);
+}
+
+// linear interpolation between the samples around timeNs (no extrapolation)
+static double ipcLinearValue(const IPC_SAMPLE_RING_S *pRing, unsigned long long timeNs)
+{
+    unsigned int num;
+    unsigned int i;
+    unsigned int cur, prev;
+
+    num = pRing->count < IPC_CLIENT_SAMPLE_NUM ? pRing->count : IPC_CLIENT_SAMPLE_NUM;
+    cur = (pRing->count - 1) % IPC_CLIENT_SAMPLE_NUM;
+    if (timeNs >= pRing->timeNs[cur]) {
+        return pRing->value[cur];
+    }
+
+    for (i = 1; i < num; i++) {
+        prev = (pRing->count - 1 - i) % IPC_CLIENT_SAMPLE_NUM;
+        if (timeNs >= pRing->timeNs[prev]) {
+            return pRing->value[prev] + (pRing->value[cur] - pRing->value[prev])
+                   * (double)(timeNs - pRing->timeNs[prev]) / (double)(pRing->timeNs[cur] - pRing->timeNs[prev]);
+        }
+        cur = prev;
+    }
+
+    return pRing->value[cur]; // older than the oldest sample
+}
+
+// Critically damped spring which follows the latest sample from the oldest one.
+// The stiffness is set from the sample interval, so the output is smooth at any publish rate.
+static double ipcDampedValue(const IPC_SAMPLE_RING_S *pRing, unsigned long long timeNs)
+{
+    unsigned int num;
+    unsigned int i;
+    unsigned int cur, next;
+    double interval, omega;
+    double x, v, d, c, e, dt;
+    double target;
+
+    num = pRing->count < IPC_CLIENT_SAMPLE_NUM ? pRing->count : IPC_CLIENT_SAMPLE_NUM;
+    cur = (pRing->count - num) % IPC_CLIENT_SAMPLE_NUM;
+    next = (pRing->count - 1) % IPC_CLIENT_SAMPLE_NUM;
+    if (num < 2 || pRing->timeNs[next] <= pRing->timeNs[cur] || timeNs <= pRing->timeNs[cur]) {
+        return pRing->value[num < 2 || timeNs > pRing->timeNs[cur] ? next : cur];
+    }
+    interval = (double)(pRing->timeNs[next] - pRing->timeNs[cur]) / (num - 1) / 1e9;
+    omega = IPC_CLIENT_DAMPED_OMEGA / interval;
+
+    x = pRing->value[cur];
+    v = 0;
+    for (i = 1; i <= num; i++) {
+        // the target is the value of the sample cur until the next sample arrives
+        target = pRing->value[cur];
+        if (i < num) {
+            next = (cur + 1) % IPC_CLIENT_SAMPLE_NUM;
+            dt = (double)((timeNs < pRing->timeNs[next] ? timeNs : pRing->timeNs[next]) - pRing->timeNs[cur]) / 1e9;
+        }
+        else {
+            dt = (double)(timeNs - pRing->timeNs[cur]) / 1e9;
+        }
+
+        // x(t) = g + (d + c t) e^(-wt), d = x0 - g, c = v0 + w d
+        d = x - target;
+        c = v + omega * d;
+        e = exp(-omega * dt);
+        x = target + (d + c * dt) * e;
+        v = (v - omega * c * dt) * e;
+
+        if (i == num || timeNs < pRing->timeNs[next]) {
+            break;
+        }
+        cur = next;
+    }
+
+    return x;
+}
+
+// notifies the whole received data after the data pool is updated.
+static void ipcDataCallback(int index, void *pLocalDataPool, int size)
+{
+    IPC_CLIENT_INFO_S *pInfo = NULL;
+    IPC_DATA_NOTIFY_CB dataNotifyCb;
+
+    pInfo = &(g_clientInfo[index]);
+    ipcClientLock(pInfo);
+    dataNotifyCb = pInfo->dataNotifyCb;
+    ipcClientUnlock(pInfo);
+
+    if (dataNotifyCb != NULL) {
+        dataNotifyCb(pInfo->usage, pLocalDataPool, size);
+    }
+}
+
+// preloads the data pool from the persisted snapshot of the server (IPC_DATA_STATE_STALE until data is received).
+// No callback is called for it; the change is notified when the received data differs from it.
+static void ipcLoadPersist(IPC_CLIENT_INFO_S *pInfo, IPC_USAGE_TYPE_E usageType)
+{
+    IPC_ALL_USAGE_DATA_POOL_U localDataPool;
+    int i;
+
+    pInfo->dataState = IPC_DATA_STATE_EMPTY;
+    if (ipcReadPersist(usageType, &localDataPool, g_ipcDomainInfoList[usageType].size) != 0) {
+        return;
+    }
+
+    // not used by the client thread yet
+    for (i = 0; i < pInfo->segmentNum; i++) {
+        memcpy(pInfo->pDataPool + pInfo->segmentOffset[i], (char *)&localDataPool + pInfo->segment[i].offset,
+               pInfo->segment[i].size);
+    }
+    pInfo->dataState = IPC_DATA_STATE_STALE;
+}
+
+// fd: the connection of ipcClientCreateSocket (made before the registry lock is taken), or -1.
+// It is closed if the usage is not added.
+static int ipcAddClient(IPC_USAGE_TYPE_E usageType, bool autoReconnect, int fd)
+{
+    int ret = -1;
+    int index = -1;
+    int i;
+    IPC_CLIENT_INFO_S *pInfo;
+    int rc;
+    bool allocFlag = false;
+
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+
+    // check if the usageType is already used
+    index = ipcGetClientInfoIndex(usageType);
+    IPC_E_CHECK(index == -1, usageType, end);
+
+    // find empty index
+    for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
+        pInfo = &(g_clientInfo[i]);
+        if (pInfo->usage == IPC_USAGE_NONE) {
+            index = i;
+            break;
+        }
+    }
+
+    IPC_E_CHECK(index >= 0, i, end);
+    pInfo = &(g_clientInfo[index]);
+
+    rc = ipcAllocDataPool(pInfo, usageType);
+    IPC_E_CHECK(rc == 0, rc, end);
+    allocFlag = true;
+    ipcLoadPersist(pInfo, usageType); // before the snapshot of the server is received
+
+    if (ipcIsMuxUsage(usageType) == true) {
+        if (fd >= 0) {
+            ipcMuxAttach(fd); // or closed, if the multiplexed connection is made by another usage
+        }
+        fd = g_muxFd;
+    }
+
+    IPC_E_CHECK(fd >= 0 || autoReconnect == true, usageType, end);
+
+    // published after the data pool (see ipcPinClientInfo)
+    __atomic_store_n(&(pInfo->usage), usageType, __ATOMIC_RELEASE);
+    pInfo->autoReconnect = autoReconnect;
+    pInfo->retryInterval = IPC_CLIENT_RETRY_MIN_TIME;
+    if (fd >= 0) {
+        ipcClientConnected(pInfo, fd);
+        ipcMuxSubscribe();
+    }
+    else {
+        // the client thread connects when the server is started.
+        pInfo->retryTime = ipcGetTimeNs() + pInfo->retryInterval * 1000000ULL;
+    }
+
+    ret = 0;
+end:
+    if (ret != 0 && allocFlag == true) {
+        ipcFreeDataPool(pInfo);
+    }
+    if (ret != 0 && fd >= 0 && fd != g_muxFd) {
+        shutdown(fd, SHUT_RDWR);
+        close(fd);
+    }
+    return ret;
+}
+
+// The requests of the usage are failed (*pDoneNum: the number of pDone[] entries).
+static int ipcRemoveClient(IPC_USAGE_TYPE_E usageType, IPC_REQUEST_DONE_S *pDone, int *pDoneNum)
+{
+    int ret = -1;
+    int index;
+    IPC_CLIENT_INFO_S *pInfo;
+    struct epoll_event epollEv;
+
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+
+    index = ipcGetClientInfoIndex(usageType);
+    IPC_E_CHECK(index >= 0, usageType, end);
+
+    pInfo = &(g_clientInfo[index]);
+    *pDoneNum = ipcFailRequest(pInfo, IPC_ERR_SEQUENCE, pDone);
+    ipcClosePendingFd(pInfo);
+
+    if (pInfo->serverFd >= 0 && pInfo->serverFd != g_muxFd) {
+        shutdown(pInfo->serverFd, SHUT_RDWR);
+        close(pInfo->serverFd);
+
+        memset(&epollEv, 0, sizeof(epollEv));
+        epoll_ctl(g_epollFd, EPOLL_CTL_DEL, pInfo->serverFd, &epollEv);
+    }
+
+    // ipcWaitForUpdate sees the cleared usage and returns.
+    ipcClientLock(pInfo);
+    if (pInfo->notifyFd >= 0) {
+        close(pInfo->notifyFd);
+    }
+    ipcFreeDataPool(pInfo);
+    ipcClientInfoClear(index);
+    pthread_cond_broadcast(&(pInfo->updateCond));
+    ipcStatsUnlock(&(pInfo->mutex), &(g_ipcStats[usageType].client.lock), pInfo->mutexLockedTime);
+
+    if (ipcCountMuxClient() > 0) {
+        ipcMuxSubscribe();
+    }
+    else {
+        ipcCloseMuxConnect();
+    }
+
+    ret = 0;
+
+end:
+    return ret;
+}
+
+static int ipcCountClient(void)
+{
+    int count = 0;
+    int i;
+
+    for (i = 0; i < IPC_CLIENT_USAGE_MAX_NUM; i++) {
+        if (g_clientInfo[i].usage != IPC_USAGE_NONE) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static IPC_RET_E ipcClientStartInternal(IPC_USAGE_TYPE_E usageType, bool autoReconnect)
+{
+    IPC_RET_E ret;
+    int rc;
+    char dummy = 's';
+    int index;
+    int fd = -1;
+    bool connect = true;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+
+    ret = IPC_ERR_OTHER;
+    rc = ipcClientInit();
+    IPC_E_CHECK(rc == 0, rc, end);
+
+    // connect() and the schema check are done without the registry lock (see ipcClientCreateSocket)
+    if (ipcIsMuxUsage(usageType) == true) {
+        pthread_rwlock_rdlock(&g_registryLock);
+        connect = (g_muxFd < 0);
+        pthread_rwlock_unlock(&g_registryLock);
+    }
+    if (connect == true) {
+        fd = ipcClientCreateSocket(usageType, autoReconnect);
+    }
+    if (fd >= 0 && g_ipcDomainInfoList[usageType].schemaHash != 0
+        && ipcClientCheckSchema(fd, usageType, IPC_CLIENT_CONNECT_CHECK_TIME) != 0) {
+        shutdown(fd, SHUT_RDWR);
+        close(fd);
+        fd = -1;
+    }
+
+    pthread_rwlock_wrlock(&g_registryLock);
+    rc = ipcAddClient(usageType, autoReconnect, fd);
+    pthread_rwlock_unlock(&g_registryLock);
+
+    ret = IPC_ERR_NO_RESOURCE;
+    IPC_E_CHECK(rc == 0, rc, end);
+
+    if (g_threadRunning == false) {
+        // set before creation; the thread exits as soon as it sees false.
+        g_threadRunning = true;
+        rc = ipcRtCreateThread(&g_clientThread, ipcClientThread);
+        if (rc != 0) {
+            g_threadRunning = false;
+        }
+        IPC_E_CHECK(rc == 0, rc, end);
+    }
+
+    rc = write(g_threadCtlPipeFd[1], &dummy, 1); // for wakeup epoll_wait
     IPC_E_CHECK(rc >= 0, rc, end);
 
-    // Check to if the connection is rejected.
-    usleep(IPC_CLIENT_EPOLL_WAIT_NUM * 1000);
-    pthread_mutex_lock(&g_mutex);
+    if (autoReconnect == true) {
+        // A rejected connection is retried by the client thread.
+        ret = IPC_RET_OK;
+        goto end;
+    }
+
+    // Check to if the connection is rejected.
+    usleep(IPC_CLIENT_EPOLL_WAIT_NUM * 1000);
+    pthread_rwlock_rdlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+    pthread_rwlock_unlock(&g_registryLock);
+    ret = IPC_ERR_NO_RESOURCE;
+    IPC_E_CHECK(index >= 0, usageType, end);
+
+    ret = IPC_RET_OK;
+
+end:
+    if (ret != IPC_RET_OK && g_threadRunning == true) {
+        pthread_rwlock_rdlock(&g_registryLock);
+        if (ipcCountClient() == 0) {
+            pthread_rwlock_unlock(&g_registryLock);
+            ipcClientDeinit();
+        }
+        else {
+            pthread_rwlock_unlock(&g_registryLock);
+        }
+    }
+    return ret;
+}
+
+// == API function for client ==
+IPC_RET_E ipcClientStart(IPC_USAGE_TYPE_E usageType)
+{
+    return ipcClientStartInternal(usageType, false);
+}
+
+IPC_RET_E ipcClientStartDeferred(IPC_USAGE_TYPE_E usageType)
+{
+    return ipcClientStartInternal(usageType, true);
+}
+
+IPC_RET_E ipcReadDataPool(IPC_USAGE_TYPE_E usageType, void* pData, signed int* pSize)
+{
+    IPC_RET_E ret;
+    int index = -1;
+    IPC_CLIENT_INFO_S *pInfo;
+    int i;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(pData != NULL, 0, end);
+    IPC_E_CHECK(pSize != NULL, 0, end);
+
+    // without the registry lock (called by the render thread)
+    index = ipcPinClientInfo(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end);
+    pInfo = &(g_clientInfo[index]);
+    IPC_E_CHECK(*pSize >= pInfo->poolSize, *pSize, end_with_unpin);
+
+    for (i = 0; i < pInfo->segmentNum; i++) {
+        memcpy(pData + pInfo->segment[i].offset, pInfo->pDataPool + pInfo->segmentOffset[i], pInfo->segment[i].size);
+    }
+
+    ret = IPC_RET_OK;
+
+end_with_unpin:
+    ipcUnpinClientInfo(index);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcReadKind(IPC_USAGE_TYPE_E usageType, int kind, void* pData, signed int* pSize)
+{
+    IPC_RET_E ret;
+    int index = -1;
+    IPC_CLIENT_INFO_S *pInfo;
+    IPC_KIND_MAP_S *pKindMap;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(pData != NULL, 0, end);
+    IPC_E_CHECK(pSize != NULL, 0, end);
+
+    // without the registry lock (called by the render thread)
+    index = ipcPinClientInfo(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end);
+    pInfo = &(g_clientInfo[index]);
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(0 <= kind && kind < pInfo->kindNum && pInfo->pKindMap[kind].size > 0, kind, end_with_unpin);
+    pKindMap = &(pInfo->pKindMap[kind]);
+    IPC_E_CHECK(*pSize >= pKindMap->size, *pSize, end_with_unpin);
+
+    memcpy(pData, pInfo->pDataPool + pKindMap->poolOffset, pKindMap->size);
+    *pSize = pKindMap->size;
+
+    ret = IPC_RET_OK;
+
+end_with_unpin:
+    ipcUnpinClientInfo(index);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcGetGeneration(IPC_USAGE_TYPE_E usageType, unsigned long long* pGeneration)
+{
+    IPC_RET_E ret;
+    int index = -1;
+    IPC_CLIENT_INFO_S *pInfo;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(pGeneration != NULL, 0, end);
+
+    pthread_rwlock_rdlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+    pInfo = &(g_clientInfo[index]);
+    IPC_E_CHECK(pInfo->pDataPool != NULL, usageType, end_with_unlock);
+
+    ipcClientLock(pInfo);
+    *pGeneration = pInfo->generation;
+    ipcClientUnlock(pInfo);
+
+    ret = IPC_RET_OK;
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcGetTopicSequence(IPC_USAGE_TYPE_E usageType, int topic, unsigned int* pSeq)
+{
+    IPC_RET_E ret;
+    int index = -1;
+    IPC_CLIENT_INFO_S *pInfo;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(pSeq != NULL, 0, end);
+
+    pthread_rwlock_rdlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+    pInfo = &(g_clientInfo[index]);
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(0 <= topic && topic < pInfo->topicNum, topic, end_with_unlock);
+
+    *pSeq = __atomic_load_n(&(pInfo->topicSeq[topic]), __ATOMIC_ACQUIRE);
+    ret = IPC_RET_OK;
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcWaitForUpdate(IPC_USAGE_TYPE_E usageType, unsigned long long lastGeneration, signed int timeoutMs,
+                           unsigned long long* pGeneration)
+{
+    IPC_RET_E ret;
+    int index = -1;
+    IPC_CLIENT_INFO_S *pInfo;
+    struct timespec absTime;
+    int rc;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(timeoutMs >= -1, timeoutMs, end);
+    IPC_E_CHECK(pGeneration != NULL, 0, end);
+
+    if (timeoutMs >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &absTime);
+        absTime.tv_sec += timeoutMs / 1000;
+        absTime.tv_nsec += (timeoutMs % 1000) * 1000000L;
+        if (absTime.tv_nsec >= 1000000000L) {
+            absTime.tv_sec++;
+            absTime.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_rwlock_rdlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+    pInfo = &(g_clientInfo[index]);
+    IPC_E_CHECK(pInfo->pDataPool != NULL, usageType, end_with_unlock);
+
+    // The registry lock is not kept while waiting, so ipcClientStop is not blocked.
+    // waiterNum keeps the mutex and updateCond of the slot until this thread leaves.
+    ipcClientLock(pInfo);
+    pthread_rwlock_unlock(&g_registryLock);
+    pInfo->waiterNum++;
+
+    rc = 0;
+    pthread_cleanup_push(ipcClientWaitLeave, pInfo);
+    while (pInfo->usage == usageType && pInfo->generation == lastGeneration && rc != ETIMEDOUT) {
+        rc = ipcClientWait(pInfo, usageType, timeoutMs >= 0 ? &absTime : NULL);
+    }
+    pthread_cleanup_pop(1);
+
+    if (pInfo->usage != usageType) {
+        ret = IPC_ERR_SEQUENCE; // stopped while waiting
+    }
+    else {
+        *pGeneration = pInfo->generation;
+        ret = (pInfo->generation != lastGeneration) ? IPC_RET_OK : IPC_ERR_TIMEOUT;
+    }
+    ipcStatsUnlock(&(pInfo->mutex), &(g_ipcStats[usageType].client.lock), pInfo->mutexLockedTime);
+    goto end;
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcGetNotifyFd(IPC_USAGE_TYPE_E usageType, int* pFd)
+{
+    IPC_RET_E ret;
+    int index = -1;
+    IPC_CLIENT_INFO_S *pInfo;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(pFd != NULL, 0, end);
+
+    pthread_rwlock_rdlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+    pInfo = &(g_clientInfo[index]);
+    IPC_E_CHECK(pInfo->pDataPool != NULL, usageType, end_with_unlock);
+
+    ipcClientLock(pInfo);
+    if (pInfo->notifyFd < 0) {
+        pInfo->notifyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    *pFd = pInfo->notifyFd;
+    ipcClientUnlock(pInfo);
+
+    ret = IPC_ERR_NO_RESOURCE;
+    IPC_E_CHECK(*pFd >= 0, errno, end_with_unlock);
+
+    ret = IPC_RET_OK;
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcReadInterpolated(IPC_USAGE_TYPE_E usageType, int kind, unsigned long long timeNs,
+                              IPC_INTERP_MODE_E mode, double* pValue)
+{
+    IPC_RET_E ret;
+    int index = -1;
+    IPC_CLIENT_INFO_S *pInfo;
+    IPC_SAMPLE_RING_S *pRing;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(mode == IPC_INTERP_LINEAR || mode == IPC_INTERP_CRITICALLY_DAMPED, mode, end);
+    IPC_E_CHECK(pValue != NULL, 0, end);
+
+    pthread_rwlock_rdlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+    pInfo = &(g_clientInfo[index]);
+    IPC_E_CHECK(pInfo->pDataPool != NULL, usageType, end_with_unlock);
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(0 <= kind && kind < pInfo->kindNum && pInfo->pKindMap[kind].analog >= 0, kind, end_with_unlock);
+    pRing = &(pInfo->pSampleRing[pInfo->pKindMap[kind].analog]);
+
+    ipcClientLock(pInfo);
+    if (pRing->count == 0) {
+        ret = IPC_ERR_SEQUENCE; // nothing received yet
+    }
+    else {
+        if (mode == IPC_INTERP_LINEAR) {
+            *pValue = ipcLinearValue(pRing, timeNs);
+        }
+        else {
+            *pValue = ipcDampedValue(pRing, timeNs);
+        }
+        ret = IPC_RET_OK;
+    }
+    ipcClientUnlock(pInfo);
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcRegisterCallback(IPC_USAGE_TYPE_E usageType, IPC_CHANGE_NOTIFY_CB changeNotifyCb)
+{
+    IPC_RET_E ret;
+    int index = -1;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(changeNotifyCb != NULL, 0, end);
+
+    pthread_rwlock_rdlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+
+    ipcClientLock(&(g_clientInfo[index]));
+    g_clientInfo[index].changeNotifyCb = changeNotifyCb;
+    ipcClientUnlock(&(g_clientInfo[index]));
+
+    ret = IPC_RET_OK;
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcSubscribeKind(IPC_USAGE_TYPE_E usageType, int kind, IPC_KIND_NOTIFY_CB kindNotifyCb, void* pUserData,
+                           int* pHandle)
+{
+    IPC_RET_E ret;
+    int index = -1;
+    IPC_CLIENT_INFO_S *pInfo;
+    IPC_KIND_SUBSCRIBER_LIST_S *pOld;
+    IPC_KIND_SUBSCRIBER_LIST_S *pNew;
+    int num;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(kindNotifyCb != NULL, 0, end);
+    IPC_E_CHECK(pHandle != NULL, 0, end);
+
+    pthread_rwlock_rdlock(&g_registryLock);
     index = ipcGetClientInfoIndex(usageType);
-    pthread_mutex_unlock(&g_mutex);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+    pInfo = &(g_clientInfo[index]);
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(0 <= kind && kind < pInfo->kindNum && pInfo->pKindMap[kind].size > 0, kind, end_with_unlock);
+
+    ipcClientLock(pInfo);
+    pOld = pInfo->ppSubscriber[kind];
+    num = (pOld != NULL) ? pOld->num : 0;
+
     ret = IPC_ERR_NO_RESOURCE;
-    IPC_E_CHECK(index >= 0, usageType, end);
+    pNew = malloc(sizeof(IPC_KIND_SUBSCRIBER_LIST_S) + (num + 1) * sizeof(pNew->entry[0]));
+    IPC_E_CHECK(pNew != NULL, 0, end_with_client_unlock);
+    if (num > 0) {
+        memcpy(pNew->entry, pOld->entry, num * sizeof(pNew->entry[0]));
+    }
+    pNew->pNextRetired = NULL;
+    pNew->num = num + 1;
+    pNew->entry[num].handle = __atomic_add_fetch(&g_subscriptionHandle, 1, __ATOMIC_RELAXED);
+    pNew->entry[num].kindNotifyCb = kindNotifyCb;
+    pNew->entry[num].pUserData = pUserData;
+
+    __atomic_store_n(&(pInfo->ppSubscriber[kind]), pNew, __ATOMIC_RELEASE);
+    if (pOld != NULL) {
+        pOld->pNextRetired = pInfo->pRetiredSubscriber;
+        pInfo->pRetiredSubscriber = pOld;
+    }
+    pInfo->subscriberNum++;
+    *pHandle = pNew->entry[num].handle;
 
     ret = IPC_RET_OK;
 
+end_with_client_unlock:
+    ipcClientUnlock(pInfo);
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
+
 end:
-    if (ret != IPC_RET_OK && g_threadRunning == true) {
-        pthread_mutex_lock(&g_mutex);
-        if (ipcCountClient() == 0) {
-            pthread_mutex_unlock(&g_mutex);
-            ipcClientDeinit();
+    return ret;
+}
+
+IPC_RET_E ipcUnsubscribeKind(IPC_USAGE_TYPE_E usageType, int handle)
+{
+    IPC_RET_E ret;
+    int index = -1;
+    IPC_CLIENT_INFO_S *pInfo;
+    IPC_KIND_SUBSCRIBER_LIST_S *pList;
+    IPC_KIND_SUBSCRIBER_LIST_S *pOld = NULL;
+    IPC_KIND_SUBSCRIBER_LIST_S *pNew = NULL;
+    int kind;
+    int subscribedKind = -1;
+    int entryIndex = -1;
+    int i;
+    int j;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+
+    pthread_rwlock_rdlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+    pInfo = &(g_clientInfo[index]);
+
+    ipcClientLock(pInfo);
+    for (kind = 0; kind < pInfo->kindNum && pOld == NULL; kind++) {
+        pList = pInfo->ppSubscriber[kind];
+        for (i = 0; pList != NULL && i < pList->num; i++) {
+            if (pList->entry[i].handle == handle) {
+                pOld = pList;
+                subscribedKind = kind;
+                entryIndex = i;
+                break;
+            }
         }
-        else {
-            pthread_mutex_unlock(&g_mutex);
+    }
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(pOld != NULL, handle, end_with_client_unlock);
+
+    if (pOld->num > 1) {
+        ret = IPC_ERR_NO_RESOURCE;
+        pNew = malloc(sizeof(IPC_KIND_SUBSCRIBER_LIST_S) + (pOld->num - 1) * sizeof(pNew->entry[0]));
+        IPC_E_CHECK(pNew != NULL, 0, end_with_client_unlock);
+        pNew->pNextRetired = NULL;
+        pNew->num = pOld->num - 1;
+        for (j = 0; j < pNew->num; j++) {
+            pNew->entry[j] = pOld->entry[(j < entryIndex) ? j : j + 1];
         }
     }
+
+    __atomic_store_n(&(pInfo->ppSubscriber[subscribedKind]), pNew, __ATOMIC_RELEASE);
+    pOld->pNextRetired = pInfo->pRetiredSubscriber;
+    pInfo->pRetiredSubscriber = pOld;
+    pInfo->subscriberNum--;
+
+    ret = IPC_RET_OK;
+
+end_with_client_unlock:
+    ipcClientUnlock(pInfo);
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
+
+    if (ret == IPC_RET_OK && ipcIsClientThread() == false) {
+        // The client thread calls the subscribers with the read lock,
+        // so the removed one is not running after this, and its pUserData can be released.
+        pthread_rwlock_wrlock(&g_registryLock);
+        pthread_rwlock_unlock(&g_registryLock);
+    }
+
+end:
     return ret;
 }
 
-IPC_RET_E ipcReadDataPool(IPC_USAGE_TYPE_E usageType, void* pData, signed int* pSize)
+IPC_RET_E ipcSetKindFilter(IPC_USAGE_TYPE_E usageType, int kind, const IPC_KIND_FILTER_S* pFilter)
 {
     IPC_RET_E ret;
     int index = -1;
     IPC_CLIENT_INFO_S *pInfo;
+    IPC_KIND_FILTER_STATE_S *pState;
+    int analog;
 
     ret = IPC_ERR_PARAM;
     IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
-    IPC_E_CHECK(pData != NULL, 0, end);
-    IPC_E_CHECK(pSize != NULL, 0, end);
+    if (pFilter != NULL) {
+        IPC_E_CHECK(pFilter->deadband >= 0 && pFilter->deadbandPercent >= 0 && pFilter->hysteresis >= 0, 0, end);
+    }
 
-    pthread_mutex_lock(&g_mutex);
+    // the write lock: the client thread uses pFilter with the read lock
+    pthread_rwlock_wrlock(&g_registryLock);
     index = ipcGetClientInfoIndex(usageType);
 
     ret = IPC_ERR_SEQUENCE;
     IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
     pInfo = &(g_clientInfo[index]);
-    IPC_E_CHECK(pInfo->pDataPool != NULL, usageType, end_with_unlock);
-    IPC_E_CHECK(*pSize >= pInfo->poolSize, *pSize, end_with_unlock);
 
-    memcpy(pData, pInfo->pDataPool, pInfo->poolSize);
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(0 <= kind && kind < pInfo->kindNum && pInfo->pKindMap[kind].size > 0, kind, end_with_unlock);
+    analog = pInfo->pKindMap[kind].analog;
+
+    if (pFilter == NULL) {
+        if (pInfo->pFilter != NULL) {
+            memset(&(pInfo->pFilter[kind]), 0, sizeof(IPC_KIND_FILTER_STATE_S));
+        }
+        ret = IPC_RET_OK;
+        goto end_with_unlock;
+    }
+
+    // the deadband is only for the analog kinds
+    IPC_E_CHECK(analog >= 0 || (pFilter->deadband == 0 && pFilter->deadbandPercent == 0 && pFilter->hysteresis == 0),
+                kind, end_with_unlock);
+
+    if (pInfo->pFilter == NULL) {
+        ret = IPC_ERR_NO_RESOURCE;
+        pInfo->pFilter = calloc(pInfo->kindNum, sizeof(IPC_KIND_FILTER_STATE_S));
+        IPC_E_CHECK(pInfo->pFilter != NULL, 0, end_with_unlock);
+    }
+
+    pState = &(pInfo->pFilter[kind]);
+    memset(pState, 0, sizeof(IPC_KIND_FILTER_STATE_S));
+    pState->config = *pFilter;
+    if (analog >= 0) {
+        // the deadband starts from the current value
+        ipcClientLock(pInfo);
+        pState->lastValue = ipcGetAnalogValue(&(g_ipcAnalogInfoTbl[usageType].pInfo[analog]),
+                                              pInfo->pDataPool + pInfo->pKindMap[kind].poolOffset);
+        ipcClientUnlock(pInfo);
+    }
+    pState->enabled = true;
 
     ret = IPC_RET_OK;
 
 end_with_unlock:
-    pthread_mutex_unlock(&g_mutex);
+    pthread_rwlock_unlock(&g_registryLock);
 
 end:
     return ret;
 }
 
-IPC_RET_E ipcRegisterCallback(IPC_USAGE_TYPE_E usageType, IPC_CHANGE_NOTIFY_CB changeNotifyCb)
+IPC_RET_E ipcRegisterDataCallback(IPC_USAGE_TYPE_E usageType, IPC_DATA_NOTIFY_CB dataNotifyCb)
 {
     IPC_RET_E ret;
     int index = -1;
 
     ret = IPC_ERR_PARAM;
     IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
-    IPC_E_CHECK(changeNotifyCb != NULL, 0, end);
 
-    pthread_mutex_lock(&g_mutex);
+    pthread_rwlock_rdlock(&g_registryLock);
     index = ipcGetClientInfoIndex(usageType);
 
     ret = IPC_ERR_SEQUENCE;
     IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
 
-    g_clientInfo[index].changeNotifyCb = changeNotifyCb;
+    ipcClientLock(&(g_clientInfo[index]));
+    g_clientInfo[index].dataNotifyCb = dataNotifyCb;
+    ipcClientUnlock(&(g_clientInfo[index]));
+
+    ret = IPC_RET_OK;
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcRegisterLinkStateCallback(IPC_USAGE_TYPE_E usageType, IPC_LINK_STATE_CB linkStateCb)
+{
+    IPC_RET_E ret;
+    int index = -1;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+
+    // linkStateCb is read by the client thread with the registry write lock.
+    pthread_rwlock_wrlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+
+    g_clientInfo[index].linkStateCb = linkStateCb;
+
+    ret = IPC_RET_OK;
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcGetLinkState(IPC_USAGE_TYPE_E usageType, IPC_LINK_STATE_E *pState)
+{
+    IPC_RET_E ret;
+    int index = -1;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(pState != NULL, 0, end);
+
+    pthread_rwlock_rdlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+
+    if (g_clientInfo[index].serverFd >= 0) {
+        *pState = IPC_LINK_STATE_CONNECTED;
+    }
+    else {
+        *pState = IPC_LINK_STATE_DISCONNECTED;
+    }
+
+    ret = IPC_RET_OK;
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcGetDataState(IPC_USAGE_TYPE_E usageType, IPC_DATA_STATE_E *pState)
+{
+    IPC_RET_E ret;
+    int index = -1;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(pState != NULL, 0, end);
+
+    pthread_rwlock_rdlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+
+    // IPC_DATA_STATE_LIVE: the received data is in the data pool
+    *pState = __atomic_load_n(&(g_clientInfo[index].dataState), __ATOMIC_ACQUIRE);
+    ret = IPC_RET_OK;
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcClientSetReceiveMode(IPC_USAGE_TYPE_E usageType, IPC_RECV_MODE_E mode)
+{
+    IPC_RET_E ret;
+    int index = -1;
+    IPC_CLIENT_INFO_S *pInfo;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(mode == IPC_RECV_MODE_ALL || mode == IPC_RECV_MODE_LATEST, mode, end);
+
+    // the write lock: the client thread uses pRecvBuf with the read lock
+    pthread_rwlock_wrlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+    pInfo = &(g_clientInfo[index]);
+
+    if (mode == IPC_RECV_MODE_LATEST && pInfo->pRecvBuf == NULL) {
+        ret = IPC_ERR_NO_RESOURCE;
+        pInfo->pRecvBuf = malloc(IPC_CLIENT_DRAIN_NUM * pInfo->poolSize);
+        IPC_E_CHECK(pInfo->pRecvBuf != NULL, 0, end_with_unlock);
+        ipcRtLockMemory(pInfo->pRecvBuf, IPC_CLIENT_DRAIN_NUM * pInfo->poolSize);
+    }
+    // recvLen is kept: the head of an incomplete message in pRecvBuf is completed by the path of the new mode
+    pInfo->recvMode = mode;
 
     ret = IPC_RET_OK;
 
 end_with_unlock:
-    pthread_mutex_unlock(&g_mutex);
+    pthread_rwlock_unlock(&g_registryLock);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcClientRequest(IPC_USAGE_TYPE_E usageType, signed int op, const void* pPayload, signed int size,
+                           signed int timeoutMs, void* pResponse, signed int* pResponseSize, signed int* pStatus)
+{
+    IPC_RET_E ret;
+    int index = -1;
+    IPC_CLIENT_INFO_S *pInfo;
+    struct timespec absTime;
+    int rc;
+    IPC_REQUEST_WAIT_S wait;
+    struct {
+        IPC_CLIENT_INFO_S *pInfo;
+        unsigned int id;
+    } leave;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(0 <= size && size <= IPC_REQUEST_MAX_SIZE, size, end);
+    IPC_E_CHECK(size == 0 || pPayload != NULL, size, end);
+    IPC_E_CHECK(timeoutMs >= -1, timeoutMs, end);
+    IPC_E_CHECK(pResponseSize == NULL || *pResponseSize == 0 || (*pResponseSize > 0 && pResponse != NULL), 0, end);
+
+    // the response is received by the client thread
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(ipcIsClientThread() == false, usageType, end);
+
+    if (timeoutMs >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &absTime);
+        absTime.tv_sec += timeoutMs / 1000;
+        absTime.tv_nsec += (timeoutMs % 1000) * 1000000L;
+        if (absTime.tv_nsec >= 1000000000L) {
+            absTime.tv_sec++;
+            absTime.tv_nsec -= 1000000000L;
+        }
+    }
+
+    wait.done = false;
+    wait.ret = IPC_ERR_TIMEOUT;
+    wait.status = 0;
+    wait.pResponse = pResponse;
+    wait.responseSize = (pResponseSize != NULL) ? *pResponseSize : 0;
+
+    pthread_rwlock_rdlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+    pInfo = &(g_clientInfo[index]);
+
+    ret = ipcStartRequest(pInfo, op, pPayload, size, -1, NULL, NULL, &wait, &(leave.id));
+    if (ret != IPC_RET_OK) {
+        goto end_with_unlock;
+    }
+
+    // The registry lock is not kept while waiting (same as ipcWaitForUpdate).
+    ipcClientLock(pInfo);
+    pthread_rwlock_unlock(&g_registryLock);
+    pInfo->waiterNum++;
+    leave.pInfo = pInfo;
+
+    rc = 0;
+    pthread_cleanup_push(ipcClientRequestLeave, &leave);
+    while (pInfo->usage == usageType && wait.done == false && rc != ETIMEDOUT) {
+        rc = ipcClientWait(pInfo, usageType, timeoutMs >= 0 ? &absTime : NULL);
+    }
+    pthread_cleanup_pop(1);
+
+    if (wait.done == true) {
+        ret = wait.ret;
+        if (pStatus != NULL) {
+            *pStatus = wait.status;
+        }
+        if (pResponseSize != NULL) {
+            *pResponseSize = wait.responseSize;
+        }
+    }
+    else {
+        ret = (pInfo->usage != usageType) ? IPC_ERR_SEQUENCE : IPC_ERR_TIMEOUT;
+    }
+    ipcStatsUnlock(&(pInfo->mutex), &(g_ipcStats[usageType].client.lock), pInfo->mutexLockedTime);
+    goto end;
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcClientRequestAsync(IPC_USAGE_TYPE_E usageType, signed int op, const void* pPayload, signed int size,
+                                signed int timeoutMs, IPC_RESPONSE_CB responseCb, void* pUserData,
+                                unsigned int* pRequestId)
+{
+    IPC_RET_E ret;
+    int index = -1;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(0 <= size && size <= IPC_REQUEST_MAX_SIZE, size, end);
+    IPC_E_CHECK(size == 0 || pPayload != NULL, size, end);
+    IPC_E_CHECK(timeoutMs >= -1, timeoutMs, end);
+    IPC_E_CHECK(responseCb != NULL, 0, end);
+
+    pthread_rwlock_rdlock(&g_registryLock);
+    index = ipcGetClientInfoIndex(usageType);
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+
+    ret = ipcStartRequest(&(g_clientInfo[index]), op, pPayload, size, timeoutMs, responseCb, pUserData, NULL,
+                          pRequestId);
+
+end_with_unlock:
+    pthread_rwlock_unlock(&g_registryLock);
 
 end:
     return ret;
@@ -564,6 +3446,8 @@ IPC_RET_E ipcClientStop(IPC_USAGE_TYPE_E usageType)
     IPC_RET_E ret;
     int rc;
     char dummy = 'e';
+    IPC_REQUEST_DONE_S done[IPC_CLIENT_REQUEST_MAX_NUM];
+    int doneNum = 0;
 
     ret = IPC_ERR_SEQUENCE;
     IPC_E_CHECK(g_initedFlag != false, g_initedFlag, end);
@@ -571,8 +3455,8 @@ IPC_RET_E ipcClientStop(IPC_USAGE_TYPE_E usageType)
     ret = IPC_ERR_PARAM;
     IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
 
-    pthread_mutex_lock(&g_mutex);
-    rc = ipcRemoveClient(usageType);
+    pthread_rwlock_wrlock(&g_registryLock);
+    rc = ipcRemoveClient(usageType, done, &doneNum);
     ret = IPC_ERR_PARAM;
     IPC_E_CHECK(rc == 0, rc, end_with_unlock);
 
@@ -580,20 +3464,22 @@ IPC_RET_E ipcClientStop(IPC_USAGE_TYPE_E usageType)
     IPC_E_CHECK(rc >= 0, rc, end_with_unlock);
 
     if (ipcCountClient() == 0) {
-        pthread_mutex_unlock(&g_mutex);
+        pthread_rwlock_unlock(&g_registryLock);
         ipcClientDeinit();
     }
     else {
-        pthread_mutex_unlock(&g_mutex);
+        pthread_rwlock_unlock(&g_registryLock);
     }
 
     ret = IPC_RET_OK;
 
 end:
+    ipcNotifyRequestDone(done, doneNum); // the requests pending at the stop
     return ret;
 
 end_with_unlock:
-    pthread_mutex_unlock(&g_mutex);
+    pthread_rwlock_unlock(&g_registryLock);
+    ipcNotifyRequestDone(done, doneNum);
     return ret;
 }
 
@@ -18,25 +18,31 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <sys/socket.h>
 
 #include <cluster_ipc.h>
 #include "ipc_internal.h"
 
-int ipcCreateDomainName(IPC_USAGE_TYPE_E usageType, char *pOutName, int *pSize)
+static int ipcCreateDomainNameFrom(const char *domainName, IPC_SIDE_E side, char *pOutName, int *pSize);
+
+static int ipcCreateDomainNameFrom(const char *domainName, IPC_SIDE_E side, char *pOutName, int *pSize)
 {
     int ret = -1;
     int len;
     char *ipcDomainPath; // from getenv
-    char *domainName;
 
-    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
     IPC_E_CHECK(pSize != NULL, 0, end);
     IPC_E_CHECK(pOutName != NULL, 0, end);
 
-    domainName = g_ipcDomainInfoList[usageType].domainName;
     len = strlen(domainName);
-    ipcDomainPath = getenv(IPC_ENV_DOMAIN_SOCKET_PATH);
+    ipcDomainPath = NULL;
+    if (side == IPC_SIDE_CLIENT) {
+        ipcDomainPath = getenv(IPC_ENV_CLIENT_DOMAIN_SOCKET_PATH);
+    }
+    if (ipcDomainPath == NULL) {
+        ipcDomainPath = getenv(IPC_ENV_DOMAIN_SOCKET_PATH);
+    }
     if (ipcDomainPath != NULL) {
         len += strlen(ipcDomainPath);
     }
@@ -56,6 +62,30 @@ end:
     return ret;
 }
 
+int ipcCreateDomainName(IPC_USAGE_TYPE_E usageType, IPC_SIDE_E side, char *pOutName, int *pSize)
+{
+    int ret = -1;
+
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+
+    ret = ipcCreateDomainNameFrom(g_ipcDomainInfoList[usageType].domainName, side, pOutName, pSize);
+
+end:
+    return ret;
+}
+
+int ipcCreateMuxDomainName(IPC_SIDE_E side, char *pOutName, int *pSize)
+{
+    return ipcCreateDomainNameFrom(IPC_MUX_DOMAIN_NAME, side, pOutName, pSize);
+}
+
+bool ipcIsMuxEnabled(void)
+{
+    const char *pMux = getenv(IPC_ENV_MUX);
+
+    return (pMux != NULL && strcmp(pMux, "1") == 0);
+}
+
 int ipcCreateUnixDomainAddr(const char *domainName, struct sockaddr_un *pOutUnixAddr, int *pOutLen)
 {
     int ret = -1;
@@ -72,3 +102,11 @@ end:
     return ret;
 }
 
+unsigned long long ipcGetTimeNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
@@ -18,26 +18,57 @@
 #ifndef IPC_INTERNAL_H
 #define IPC_INTERNAL_H
 
-#include <ipc_protocol.h>
+#include <cluster_ipc.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
 #include <sys/un.h>
 
+// rate limit state of each log call site
+typedef struct {
+    unsigned int window;
+    unsigned int count;
+    unsigned int suppressed;
+} IPC_LOG_SITE_S;
+
+// Logging never blocks: the record is queued and written by a background thread (see ipc_log.c).
+#define IPC_LOG(level, condition, value) \
+    do { \
+        static IPC_LOG_SITE_S s_ipcLogSite; \
+        ipcLogPost(&s_ipcLogSite, level, __FILE__, __func__, __LINE__, condition, #value, (long)(value)); \
+    } while(0)
+
 #define IPC_E_CHECK(condition, value, label) \
     do { \
         if (!(condition)) { \
-            printf("[##ERROR##] %s:%s:%d (%s) is false. (%s=%d)\n", __FILE__, __func__, __LINE__, #condition, #value, (int)value); \
+            IPC_LOG(IPC_LOG_LEVEL_ERROR, #condition, value); \
             goto label; \
         } \
     } while(0)
 
+// the built-in usages (IPC_USAGE_TYPE_E) are followed by the usages of ipcRegisterUsage
+#define IPC_USAGE_NUM (IPC_USAGE_TYPE_MAX + IPC_REGISTERED_USAGE_MAX_NUM)
+#define IPC_USAGE_NONE ((IPC_USAGE_TYPE_E)-1) // unused slot of the server/client
+
 #define CHECK_VALID_USAGE(usageType) \
-    (0 <= usageType && usageType < IPC_USAGE_TYPE_MAX)
+    (0 <= usageType && (int)(usageType) < __atomic_load_n(&g_ipcUsageNum, __ATOMIC_ACQUIRE))
+
+// statistics counters are updated with relaxed atomics (no ordering is required)
+#define IPC_STATS_ADD(counter, value) \
+    ((void)__atomic_fetch_add(&(counter), (unsigned long long)(value), __ATOMIC_RELAXED))
 
 #define IPC_DOMAIN_PATH_MAX (108) // defined in sun_path[] of sys/un.h
 
+// which side creates the domain name (the client side can be redirected by IPC_CLIENT_DOMAIN_PATH)
+typedef enum {
+    IPC_SIDE_SERVER = 0,
+    IPC_SIDE_CLIENT
+} IPC_SIDE_E;
+
 typedef struct {
     signed long size;
     char *domainName;
+    unsigned long long schemaHash; // registered usages only, sent by the server when a client connects (0: built-in)
 } IPC_DOMAIN_INFO_S;
 
 typedef struct {
@@ -51,15 +82,140 @@ typedef struct {
     int num;
 } IPC_CHECK_CHANGE_INFO_TABLE_S;
 
+// The client data pool keeps the data in segments. Each segment starts at a cache line,
+// in the order of the layout table (hot data first).
+#define IPC_CACHE_LINE_SIZE (64)
+#define IPC_POOL_SEGMENT_MAX_NUM (8)
+
+typedef struct {
+    int offset; // in the sending/receiving data structure
+    int size;
+} IPC_POOL_SEGMENT_S;
+
+typedef struct {
+    IPC_POOL_SEGMENT_S* pSegment; // NULL: one segment of the whole structure
+    int num;
+} IPC_POOL_LAYOUT_TABLE_S;
+
+// Topics (see ipcSendTopic): ranges of the data structure sent and compared independently.
+// Every message of a usage with topics has this header (after IPC_MUX_HEADER_S with IPC_MUX).
+#define IPC_TOPIC_MAX_NUM (8)
+#define IPC_TOPIC_WHOLE (0xFFFF) // the data structure from the top (ipcSendMessage)
+#define IPC_TOPIC_RESPONSE (0xFFFE) // IPC_REQUEST_HEADER_S and the payload (see ipcClientRequest)
+
+typedef struct {
+    IPC_POOL_SEGMENT_S* pRange; // offset and size in the data structure
+    int num;
+} IPC_TOPIC_TABLE_S;
+
+typedef struct {
+    unsigned short topic;
+    unsigned short size; // of the payload after this header
+    unsigned int seq;    // counted up for each message of the topic
+} IPC_TOPIC_HEADER_S;
+
+// analog values which keep timestamped samples for ipcReadInterpolated
+typedef struct {
+    int kind;
+    int offset;
+    int size;
+    int isSigned;
+} IPC_ANALOG_INFO_S;
+
+typedef struct {
+    IPC_ANALOG_INFO_S* pInfo;
+    int num;
+} IPC_ANALOG_INFO_TABLE_S;
+
+// Multiplexed connection (IPC_MUX): all usages share one stream socket, and each message has this header.
+// The client sends IPC_MUX_TYPE_SUBSCRIBE with the bit mask of its usages (unsigned int) as the payload.
+#define IPC_MUX_DOMAIN_NAME "ipcMux"
+
+typedef enum {
+    IPC_MUX_TYPE_DATA = 0,
+    IPC_MUX_TYPE_SUBSCRIBE,
+    IPC_MUX_TYPE_REQUEST,  // client to server: IPC_REQUEST_HEADER_S and the payload
+    IPC_MUX_TYPE_RESPONSE  // server to client: the same
+} IPC_MUX_TYPE_E;
+
+typedef struct {
+    unsigned short usage;
+    unsigned short type;
+    unsigned int size; // of the payload after this header
+} IPC_MUX_HEADER_S;
+
+_Static_assert(IPC_USAGE_TYPE_MAX <= 32, "the subscription mask of IPC_MUX is 32 bits");
+
+// Request/response (see ipcClientRequest). The client sends a request on its connection to the server
+// (after IPC_MUX_HEADER_S with IPC_MUX), and the server sends the response as a framed message:
+// IPC_MUX_TYPE_RESPONSE with IPC_MUX, or IPC_TOPIC_RESPONSE on the connection of a usage with topics.
+typedef struct {
+    unsigned int id;      // chosen by the client, and returned in the response
+    signed int code;      // request: op, response: status returned by the handler
+    unsigned short ret;   // response: IPC_RET_E of the server (IPC_ERR_PARAM: no handler)
+    unsigned short size;  // of the payload after this header
+} IPC_REQUEST_HEADER_S;
+
+_Static_assert(IPC_REQUEST_MAX_SIZE <= 0xFFFF - sizeof(IPC_REQUEST_HEADER_S), "the sizes of the headers are 16 bits");
+
 // the union to know the maximum size of the data pool.
 typedef union {
     IPC_DATA_IC_SERVICE_S icService;
+    unsigned char registered[IPC_REGISTERED_USAGE_MAX_SIZE];
 } IPC_ALL_USAGE_DATA_POOL_U;
 
+#ifdef IPC_USE_IO_URING
+// minimal io_uring instance (raw syscalls, liburing is not required)
+typedef struct {
+    int fd;
+    unsigned int entries;
+    void *pRingMem;
+    size_t ringLen;
+    void *pSqes;
+    size_t sqeLen;
+    unsigned int *pSqHead;
+    unsigned int *pSqTail;
+    unsigned int *pSqMask;
+    unsigned int *pSqArray;
+    unsigned int *pCqHead;
+    unsigned int *pCqTail;
+    unsigned int *pCqMask;
+    void *pCqes;
+    unsigned int inflight; // submitted sends whose completions are not reaped yet
+} IPC_URING_S;
+#endif
+
+extern int g_ipcUsageNum;
 extern IPC_DOMAIN_INFO_S g_ipcDomainInfoList[];
 extern IPC_CHECK_CHANGE_INFO_TABLE_S g_ipcCheckChangeInfoTbl[];
+extern IPC_POOL_LAYOUT_TABLE_S g_ipcPoolLayoutTbl[];
+extern IPC_ANALOG_INFO_TABLE_S g_ipcAnalogInfoTbl[];
+extern IPC_TOPIC_TABLE_S g_ipcTopicTbl[];
+extern IPC_STATS_S g_ipcStats[];
+extern IPC_STATS_LOCK_S g_ipcServerLockStats;
 
-int ipcCreateDomainName(IPC_USAGE_TYPE_E usageType, char *pOutName, int *pSize);
+int ipcCreateDomainName(IPC_USAGE_TYPE_E usageType, IPC_SIDE_E side, char *pOutName, int *pSize);
+int ipcCreateMuxDomainName(IPC_SIDE_E side, char *pOutName, int *pSize);
+bool ipcIsMuxEnabled(void);
+int ipcRtCreateThread(pthread_t *pThread, void *(*pFunc)(void *));
+void ipcRtInitMutex(pthread_mutex_t *pMutex);
+void ipcRtLockMemory(void *pAddr, size_t size);
+void ipcRtAcquire(void);
+void ipcRtRelease(void);
+int ipcWritePersist(IPC_USAGE_TYPE_E usageType, const void *pData, int size, unsigned long long seq);
+int ipcReadPersist(IPC_USAGE_TYPE_E usageType, void *pData, int size);
 int ipcCreateUnixDomainAddr(const char *domainName, struct sockaddr_un *pOutUnixAddr, int *pOutLen);
+void ipcLogPost(IPC_LOG_SITE_S *pSite, IPC_LOG_LEVEL_E level, const char *file, const char *func, int line,
+                const char *condition, const char *valueName, long value);
+void ipcLogFlush(void);
+unsigned long long ipcGetTimeNs(void);
+unsigned long long ipcStatsLock(pthread_mutex_t *pMutex, IPC_STATS_LOCK_S *pStats);
+void ipcStatsUnlock(pthread_mutex_t *pMutex, IPC_STATS_LOCK_S *pStats, unsigned long long lockedTime);
+
+#ifdef IPC_USE_IO_URING
+int ipcUringInit(IPC_URING_S *pRing, unsigned int entries);
+void ipcUringDeinit(IPC_URING_S *pRing);
+int ipcUringSendAll(IPC_URING_S *pRing, const int *pFd, int fdNum, const void *pData, int size, int *pResult);
+#endif
 
 #endif // IPC_INTERNAL_H
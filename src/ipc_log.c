@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <syslog.h>
+
+#include <cluster_ipc.h>
+#include "ipc_internal.h"
+
+#define IPC_LOG_RING_NUM (256) // must be a power of 2
+#define IPC_LOG_MESSAGE_MAX (256)
+#define IPC_LOG_SITE_LIMIT (10) // records per second for each call site
+
+// Records keep only pointers to string literals and the value,
+// so posting does not format anything. Formatting is done by the drain thread.
+typedef struct {
+    unsigned long long seq; // 2 * lap: writable, 2 * lap + 1: readable
+    IPC_LOG_LEVEL_E level;
+    const char *file;
+    const char *func;
+    int line;
+    const char *condition;
+    const char *valueName;
+    long value;
+    unsigned int suppressed;
+} IPC_LOG_RECORD_S;
+
+// == Internal global values ==
+static IPC_LOG_RECORD_S g_logRing[IPC_LOG_RING_NUM];
+static unsigned long long g_logHead; // next position to write (producers)
+static unsigned long long g_logTail; // next position to read (drain thread)
+static unsigned int g_logDropped;
+static IPC_LOG_LEVEL_E g_logLevel = IPC_LOG_LEVEL_DEBUG;
+static IPC_LOG_SINK_CB g_logSinkCb = NULL; // NULL: stdout
+static int g_logThreadStarted = 0;
+static pthread_once_t g_logOnce = PTHREAD_ONCE_INIT;
+static sem_t g_logSem;
+static pthread_t g_logThread;
+static pthread_mutex_t g_logDrainMutex = PTHREAD_MUTEX_INITIALIZER; // one drainer (thread or ipcLogFlush)
+
+#define IPC_LOG_LAP(pos) (((pos) / IPC_LOG_RING_NUM) * 2)
+
+// == Prototype declaration
+static void *ipcLogThread(void *arg);
+static void ipcLogOnce(void);
+static void ipcLogStart(void);
+static void ipcLogAtForkChild(void);
+static void ipcLogAtExit(void);
+static bool ipcLogRateLimit(IPC_LOG_SITE_S *pSite, unsigned int *pSuppressed);
+static void ipcLogDrain(void);
+
+static const char *g_logLevelStr[] = {
+    "##ERROR##",
+    "##WARN##",
+    "##INFO##",
+    "##DEBUG##"
+};
+
+// == Thread function ==
+static void *ipcLogThread(void *arg)
+{
+    while (1) {
+        sem_wait(&g_logSem);
+        pthread_mutex_lock(&g_logDrainMutex);
+        ipcLogDrain();
+        pthread_mutex_unlock(&g_logDrainMutex);
+    }
+
+    return NULL;
+}
+
+// == Internal function ==
+static void ipcLogOnce(void)
+{
+    sem_init(&g_logSem, 0, 0);
+    pthread_atfork(NULL, NULL, ipcLogAtForkChild);
+    atexit(ipcLogAtExit);
+}
+
+static void ipcLogStart(void)
+{
+    int expected = 0;
+
+    pthread_once(&g_logOnce, ipcLogOnce);
+
+    if (__atomic_load_n(&g_logThreadStarted, __ATOMIC_ACQUIRE) != 0) {
+        return;
+    }
+    if (!__atomic_compare_exchange_n(&g_logThreadStarted, &expected, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    if (pthread_create(&g_logThread, NULL, ipcLogThread, NULL) == 0) {
+        pthread_detach(g_logThread);
+    }
+}
+
+// The drain thread does not exist in a forked child; start it again on the next record.
+static void ipcLogAtForkChild(void)
+{
+    __atomic_store_n(&g_logThreadStarted, 0, __ATOMIC_RELAXED);
+    pthread_mutex_init(&g_logDrainMutex, NULL); // may have been held by the drain thread of the parent
+}
+
+// The drain thread is detached, so the records still queued at exit (e.g. the error before a shutdown)
+// are written here.
+static void ipcLogAtExit(void)
+{
+    ipcLogFlush();
+}
+
+// allows IPC_LOG_SITE_LIMIT records per second for each call site.
+static bool ipcLogRateLimit(IPC_LOG_SITE_S *pSite, unsigned int *pSuppressed)
+{
+    struct timespec ts;
+    unsigned int now;
+    unsigned int window;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    now = (unsigned int)ts.tv_sec;
+
+    window = __atomic_load_n(&(pSite->window), __ATOMIC_RELAXED);
+    if (window != now
+        && __atomic_compare_exchange_n(&(pSite->window), &window, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&(pSite->count), 0, __ATOMIC_RELAXED);
+    }
+
+    if (__atomic_fetch_add(&(pSite->count), 1, __ATOMIC_RELAXED) >= IPC_LOG_SITE_LIMIT) {
+        __atomic_fetch_add(&(pSite->suppressed), 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    *pSuppressed = __atomic_exchange_n(&(pSite->suppressed), 0, __ATOMIC_RELAXED);
+    return true;
+}
+
+// Bounded MPSC ring: a slot is writable when seq == 2 * lap, readable when seq == 2 * lap + 1.
+// (zero cleared memory is an empty ring, so no initialization is needed)
+void ipcLogPost(IPC_LOG_SITE_S *pSite, IPC_LOG_LEVEL_E level, const char *file, const char *func, int line,
+                const char *condition, const char *valueName, long value)
+{
+    unsigned long long pos;
+    unsigned long long seq;
+    unsigned int suppressed = 0;
+    IPC_LOG_RECORD_S *pRecord;
+
+    if (level > __atomic_load_n(&g_logLevel, __ATOMIC_RELAXED)) {
+        return;
+    }
+    if (ipcLogRateLimit(pSite, &suppressed) == false) {
+        return;
+    }
+
+    ipcLogStart();
+
+    pos = __atomic_load_n(&g_logHead, __ATOMIC_RELAXED);
+    while (1) {
+        pRecord = &(g_logRing[pos & (IPC_LOG_RING_NUM - 1)]);
+        seq = __atomic_load_n(&(pRecord->seq), __ATOMIC_ACQUIRE);
+        if (seq == IPC_LOG_LAP(pos)) {
+            if (__atomic_compare_exchange_n(&g_logHead, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (seq < IPC_LOG_LAP(pos)) {
+            // full: the drain thread is behind
+            __atomic_fetch_add(&g_logDropped, 1 + suppressed, __ATOMIC_RELAXED);
+            return;
+        }
+        else {
+            pos = __atomic_load_n(&g_logHead, __ATOMIC_RELAXED);
+        }
+    }
+
+    pRecord->level = level;
+    pRecord->file = file;
+    pRecord->func = func;
+    pRecord->line = line;
+    pRecord->condition = condition;
+    pRecord->valueName = valueName;
+    pRecord->value = value;
+    pRecord->suppressed = suppressed;
+    __atomic_store_n(&(pRecord->seq), IPC_LOG_LAP(pos) + 1, __ATOMIC_RELEASE);
+
+    sem_post(&g_logSem);
+}
+
+static void ipcLogDrain(void)
+{
+    IPC_LOG_RECORD_S *pRecord;
+    IPC_LOG_RECORD_S record;
+    IPC_LOG_SINK_CB logSinkCb;
+    unsigned int dropped;
+    char message[IPC_LOG_MESSAGE_MAX];
+    int len;
+
+    while (1) {
+        pRecord = &(g_logRing[g_logTail & (IPC_LOG_RING_NUM - 1)]);
+        if (__atomic_load_n(&(pRecord->seq), __ATOMIC_ACQUIRE) != IPC_LOG_LAP(g_logTail) + 1) {
+            break;
+        }
+        record = *pRecord;
+        __atomic_store_n(&(pRecord->seq), IPC_LOG_LAP(g_logTail) + 2, __ATOMIC_RELEASE);
+        g_logTail++;
+
+        len = snprintf(message, sizeof(message), "[%s] %s:%s:%d (%s) is false. (%s=%ld)",
+                       g_logLevelStr[record.level], record.file, record.func, record.line,
+                       record.condition, record.valueName, record.value);
+        if (record.suppressed != 0 && 0 < len && len < (int)sizeof(message)) {
+            snprintf(&(message[len]), sizeof(message) - len, " (%u suppressed)", record.suppressed);
+        }
+
+        logSinkCb = __atomic_load_n(&g_logSinkCb, __ATOMIC_ACQUIRE);
+        if (logSinkCb != NULL) {
+            logSinkCb(record.level, message);
+        }
+        else {
+            printf("%s\n", message);
+            fflush(stdout);
+        }
+    }
+
+    dropped = __atomic_exchange_n(&g_logDropped, 0, __ATOMIC_RELAXED);
+    if (dropped != 0) {
+        snprintf(message, sizeof(message), "[%s] %u log records dropped", g_logLevelStr[IPC_LOG_LEVEL_WARN], dropped);
+        logSinkCb = __atomic_load_n(&g_logSinkCb, __ATOMIC_ACQUIRE);
+        if (logSinkCb != NULL) {
+            logSinkCb(IPC_LOG_LEVEL_WARN, message);
+        }
+        else {
+            printf("%s\n", message);
+            fflush(stdout);
+        }
+    }
+}
+
+// Writes the queued records in the calling thread (at exit, and when the server / client is stopped).
+void ipcLogFlush(void)
+{
+    if (__atomic_load_n(&g_logThreadStarted, __ATOMIC_ACQUIRE) != 0
+        && pthread_equal(pthread_self(), g_logThread)) {
+        return; // exit() from a sink callback: the drain thread is in ipcLogDrain
+    }
+
+    pthread_mutex_lock(&g_logDrainMutex);
+    ipcLogDrain();
+    pthread_mutex_unlock(&g_logDrainMutex);
+}
+
+// == API function for log ==
+IPC_RET_E ipcSetLogSink(IPC_LOG_SINK_CB logSinkCb)
+{
+    __atomic_store_n(&g_logSinkCb, logSinkCb, __ATOMIC_RELEASE);
+
+    return IPC_RET_OK;
+}
+
+IPC_RET_E ipcSetLogLevel(IPC_LOG_LEVEL_E level)
+{
+    IPC_RET_E ret;
+
+    ret = IPC_ERR_PARAM;
+    if (level < IPC_LOG_LEVEL_ERROR || IPC_LOG_LEVEL_DEBUG < level) {
+        goto end;
+    }
+
+    __atomic_store_n(&g_logLevel, level, __ATOMIC_RELAXED);
+    ret = IPC_RET_OK;
+
+end:
+    return ret;
+}
+
+void ipcLogSinkSyslog(IPC_LOG_LEVEL_E level, const char *pMessage)
+{
+    static const int priority[] = {LOG_ERR, LOG_WARNING, LOG_INFO, LOG_DEBUG};
+
+    if (level < IPC_LOG_LEVEL_ERROR || IPC_LOG_LEVEL_DEBUG < level) {
+        level = IPC_LOG_LEVEL_ERROR;
+    }
+    syslog(priority[level], "%s", pMessage);
+}
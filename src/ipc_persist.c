@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cluster_ipc.h>
+#include "ipc_internal.h"
+
+#define IPC_PERSIST_MAGIC (0x53435049U) // "IPCS"
+#define IPC_PERSIST_SUFFIX ".snapshot"
+#define IPC_PERSIST_TMP_SUFFIX ".tmp"
+
+// the file is this header followed by the data structure
+typedef struct {
+    unsigned int magic;
+    unsigned int size;
+    unsigned long long schemaHash; // of ipcRegisterUsage (0: built-in usage)
+} IPC_PERSIST_HEADER_S;
+
+// == Internal global values ==
+// The server thread (interval) and ipcServerStop (final) write the same file. An older copy is not written
+// over a newer one: seq is counted up by the server when the snapshot is copied.
+static unsigned long long g_writtenSeq[IPC_USAGE_NUM]; // used with g_persistMutex
+static pthread_mutex_t g_persistMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// == Prototype declaration
+static int ipcCreatePersistName(IPC_USAGE_TYPE_E usageType, const char *pSuffix, char *pOutName, int size);
+
+// == Internal function ==
+static int ipcCreatePersistName(IPC_USAGE_TYPE_E usageType, const char *pSuffix, char *pOutName, int size)
+{
+    int ret = -1;
+    int len;
+    const char *pPersistPath = getenv(IPC_ENV_PERSIST_PATH);
+
+    if (pPersistPath == NULL) {
+        goto end; // not persisted
+    }
+
+    len = snprintf(pOutName, size, "%s/%s%s", pPersistPath, g_ipcDomainInfoList[usageType].domainName, pSuffix);
+    IPC_E_CHECK(0 < len && len < size, len, end);
+
+    ret = 0;
+end:
+    return ret;
+}
+
+// Writes the snapshot to a temporary file, and renames it over the persisted one,
+// so a reader (or a power loss) sees either the old or the new snapshot, never a part of it.
+int ipcWritePersist(IPC_USAGE_TYPE_E usageType, const void *pData, int size, unsigned long long seq)
+{
+    int ret = -1;
+    int rc;
+    int fd = -1;
+    char fileName[PATH_MAX];
+    char tmpName[PATH_MAX];
+    IPC_PERSIST_HEADER_S header;
+
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(size == g_ipcDomainInfoList[usageType].size, size, end);
+    rc = ipcCreatePersistName(usageType, IPC_PERSIST_SUFFIX, fileName, sizeof(fileName));
+    IPC_E_CHECK(rc == 0, rc, end);
+    rc = ipcCreatePersistName(usageType, IPC_PERSIST_SUFFIX IPC_PERSIST_TMP_SUFFIX, tmpName, sizeof(tmpName));
+    IPC_E_CHECK(rc == 0, rc, end);
+
+    pthread_mutex_lock(&g_persistMutex);
+    if (seq < g_writtenSeq[usageType]) {
+        ret = 0; // a newer snapshot has been written
+        goto end_with_unlock;
+    }
+
+    fd = open(tmpName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    IPC_E_CHECK(fd >= 0, errno, end_with_unlock);
+
+    header.magic = IPC_PERSIST_MAGIC;
+    header.size = size;
+    header.schemaHash = g_ipcDomainInfoList[usageType].schemaHash;
+    rc = write(fd, &header, sizeof(header));
+    IPC_E_CHECK(rc == sizeof(header), errno, end_with_unlock);
+    rc = write(fd, pData, size);
+    IPC_E_CHECK(rc == size, errno, end_with_unlock);
+
+    // the data must be on the storage before the rename is
+    rc = fdatasync(fd);
+    IPC_E_CHECK(rc == 0, errno, end_with_unlock);
+    close(fd);
+    fd = -1;
+
+    rc = rename(tmpName, fileName);
+    IPC_E_CHECK(rc == 0, errno, end_with_unlock);
+    g_writtenSeq[usageType] = seq;
+
+    ret = 0;
+end_with_unlock:
+    if (fd >= 0) {
+        close(fd);
+        unlink(tmpName);
+    }
+    pthread_mutex_unlock(&g_persistMutex);
+end:
+    return ret;
+}
+
+// Reads the persisted snapshot to pData (size of the data structure).
+// returns -1 if there is no snapshot, or it is not of this data structure.
+int ipcReadPersist(IPC_USAGE_TYPE_E usageType, void *pData, int size)
+{
+    int ret = -1;
+    int rc;
+    int fd = -1;
+    char fileName[PATH_MAX];
+    struct stat st;
+    void *pMap = MAP_FAILED;
+    IPC_PERSIST_HEADER_S header;
+
+    if (ipcCreatePersistName(usageType, IPC_PERSIST_SUFFIX, fileName, sizeof(fileName)) != 0) {
+        goto end;
+    }
+    fd = open(fileName, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        goto end; // not written yet
+    }
+
+    rc = fstat(fd, &st);
+    IPC_E_CHECK(rc == 0, errno, end);
+    IPC_E_CHECK(st.st_size == (off_t)(sizeof(header) + size), st.st_size, end);
+
+    pMap = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    IPC_E_CHECK(pMap != MAP_FAILED, errno, end);
+
+    memcpy(&header, pMap, sizeof(header));
+    IPC_E_CHECK(header.magic == IPC_PERSIST_MAGIC, header.magic, end);
+    IPC_E_CHECK(header.size == (unsigned int)size, header.size, end);
+    IPC_E_CHECK(header.schemaHash == g_ipcDomainInfoList[usageType].schemaHash, usageType, end);
+    memcpy(pData, (char *)pMap + sizeof(header), size);
+
+    ret = 0;
+end:
+    if (pMap != MAP_FAILED) {
+        munmap(pMap, st.st_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ret;
+}
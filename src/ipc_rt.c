@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // pthread_attr_setaffinity_np
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <cluster_ipc.h>
+#include "ipc_internal.h"
+
+// == Internal global values ==
+// read when a thread, a mutex or a buffer is created (ipcServerStart / ipcClientStart)
+static IPC_RT_CONFIG_S g_rtConfig = {SCHED_OTHER, 0, 0, 0, 0};
+static pthread_mutex_t g_rtMutex = PTHREAD_MUTEX_INITIALIZER;
+static int g_rtUserNum; // the server and the client while they are initialized (g_rtConfig is not changed)
+
+// == Internal function ==
+// creates an internal thread with the scheduling and the affinity of ipcSetRtConfig.
+int ipcRtCreateThread(pthread_t *pThread, void *(*pFunc)(void *))
+{
+    int ret = -1;
+    int rc;
+    pthread_attr_t attr;
+    struct sched_param param;
+    cpu_set_t cpuSet;
+    int cpu;
+
+    pthread_attr_init(&attr);
+
+    if (g_rtConfig.schedPolicy != SCHED_OTHER) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = g_rtConfig.schedPriority;
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, g_rtConfig.schedPolicy);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+
+    if (g_rtConfig.cpuMask != 0) {
+        CPU_ZERO(&cpuSet);
+        for (cpu = 0; cpu < 64; cpu++) {
+            if ((g_rtConfig.cpuMask & (1ULL << cpu)) != 0) {
+                CPU_SET(cpu, &cpuSet);
+            }
+        }
+        pthread_attr_setaffinity_np(&attr, sizeof(cpuSet), &cpuSet);
+    }
+
+    // EPERM: the process is not allowed to use the real-time policy (CAP_SYS_NICE, RLIMIT_RTPRIO)
+    rc = pthread_create(pThread, &attr, pFunc, NULL);
+    IPC_E_CHECK(rc == 0, rc, end);
+
+    ret = 0;
+end:
+    pthread_attr_destroy(&attr);
+    return ret;
+}
+
+// (re)initializes a mutex which is not used, with priority inheritance if it is configured.
+void ipcRtInitMutex(pthread_mutex_t *pMutex)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    if (g_rtConfig.priorityInherit != 0) {
+        pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    }
+    pthread_mutex_destroy(pMutex);
+    pthread_mutex_init(pMutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+// Locks a buffer of the library in memory and touches all of its pages, so the first access from the
+// real-time path does not fault. The pages are not unlocked when the buffer is freed (they stay in the heap).
+void ipcRtLockMemory(void *pAddr, size_t size)
+{
+    volatile char *pByte = pAddr;
+    long pageSize;
+    size_t i;
+
+    if (g_rtConfig.lockMemory == 0 || pAddr == NULL || size == 0) {
+        return;
+    }
+
+    if (mlock(pAddr, size) != 0) {
+        // RLIMIT_MEMLOCK: still prefaulted, but may be paged out
+        IPC_LOG(IPC_LOG_LEVEL_WARN, "mlock() == 0", errno);
+    }
+
+    pageSize = sysconf(_SC_PAGESIZE);
+    for (i = 0; i < size; i += pageSize) {
+        pByte[i] = pByte[i]; // write: a read maps only the shared zero page
+    }
+    pByte[size - 1] = pByte[size - 1];
+}
+
+// called when the server or the client is initialized: ipcSetRtConfig is refused until ipcRtRelease.
+void ipcRtAcquire(void)
+{
+    pthread_mutex_lock(&g_rtMutex);
+    g_rtUserNum++;
+    pthread_mutex_unlock(&g_rtMutex);
+}
+
+void ipcRtRelease(void)
+{
+    pthread_mutex_lock(&g_rtMutex);
+    g_rtUserNum--;
+    pthread_mutex_unlock(&g_rtMutex);
+}
+
+// == API function ==
+IPC_RET_E ipcSetRtConfig(const IPC_RT_CONFIG_S* pConfig)
+{
+    IPC_RET_E ret = IPC_ERR_PARAM;
+
+    IPC_E_CHECK(pConfig != NULL, 0, end);
+    IPC_E_CHECK(pConfig->schedPolicy == SCHED_OTHER || pConfig->schedPolicy == SCHED_FIFO
+                || pConfig->schedPolicy == SCHED_RR, pConfig->schedPolicy, end);
+    IPC_E_CHECK(sched_get_priority_min(pConfig->schedPolicy) <= pConfig->schedPriority
+                && pConfig->schedPriority <= sched_get_priority_max(pConfig->schedPolicy),
+                pConfig->schedPriority, end);
+
+    // the threads and the mutexes which are already created would not follow the new settings
+    pthread_mutex_lock(&g_rtMutex);
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(g_rtUserNum == 0, g_rtUserNum, end_with_unlock);
+    g_rtConfig = *pConfig;
+    ret = IPC_RET_OK;
+
+end_with_unlock:
+    pthread_mutex_unlock(&g_rtMutex);
+
+end:
+    return ret;
+}
@@ -25,15 +25,27 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/stat.h>
 #include <pthread.h>
+#include <errno.h>
 
 #include <cluster_ipc.h>
 
 #include "ipc_internal.h"
+#include "ipc_trace.h"
 
-#define IPC_SERVER_USAGE_MAX_NUM (1)
-#define IPC_LISTEN_CLIENT_NUM (4)
+#define IPC_SERVER_USAGE_MAX_NUM (IPC_USAGE_NUM)
+#define IPC_LISTEN_CLIENT_NUM (IPC_STATS_CLIENT_MAX_NUM)
 #define IPC_SERVER_EPOLL_WAIT_NUM (IPC_SERVER_USAGE_MAX_NUM * IPC_LISTEN_CLIENT_NUM + 1)
+#define IPC_SEND_QUEUE_NUM (256) // entries of the send queue (power of 2)
+#define IPC_CACHE_LINE_SIZE (64)
+#define IPC_SERVER_PERSIST_SLACK_TIME (10) // msec, written at a tick this much earlier than the interval
+#define IPC_LISTEN_FDS_START (3) // the first socket passed by the service manager (LISTEN_FDS)
+#define IPC_SERVER_REQUEST_NUM (64) // requests handled in a wakeup of the server thread
+
+_Static_assert(IPC_LISTEN_CLIENT_NUM <= IPC_STATS_CLIENT_MAX_NUM, "IPC_STATS_CLIENT_MAX_NUM is too small");
 
 // == Internal global values ==
 static bool g_initedFlag = false;
@@ -41,30 +53,154 @@ static pthread_t g_serverThread;
 static bool g_threadRunning = false;
 static int g_threadCtlPipeFd[2] = {-1, -1};
 static int g_epollFd = -1;
+#ifdef IPC_USE_IO_URING
+static IPC_URING_S g_uring = {.fd = -1};
+#endif
 
 typedef struct {
     IPC_USAGE_TYPE_E usage;
     int fd;
+    bool externalFd; // fd is passed by LISTEN_FDS or ipcServerStartWithFd: not closed nor unlinked at stop
     int clientFd[IPC_LISTEN_CLIENT_NUM];
+    void *pFrame; // IPC_MUX_HEADER_S followed by the message being sent (see ipcBuildFrame)
+    void *pSnapshot; // data structure of the sent messages, sent to a client when it connects (resync)
+    int snapshotSize; // 0: nothing has been sent yet
+    int topicNum; // 0: the messages are the data as is, otherwise they have IPC_TOPIC_HEADER_S
+    unsigned int topicSeq[IPC_TOPIC_MAX_NUM + 1]; // the last is of IPC_TOPIC_WHOLE
+    int persistInterval; // msec, -1: not persisted, 0: only at ipcServerStop (see ipcServerSetPersist)
+    bool persistDirty; // the snapshot has been changed after it was persisted
+    unsigned long long persistTime; // ipcGetTimeNs() when the snapshot was copied to be persisted
+    IPC_REQUEST_HANDLER_CB requestHandlerCb;
+    void *pRequestUserData;
 } IPC_SERVER_INFO_S;
 static IPC_SERVER_INFO_S g_serverInfo[IPC_SERVER_USAGE_MAX_NUM];
 
+// Persisted snapshots: the server thread copies the changed snapshots at the tick of g_persistTimerFd with
+// g_mutex, and writes them to the files after g_mutex is released, so the senders are not blocked by the storage.
+typedef struct {
+    IPC_USAGE_TYPE_E usage; // IPC_USAGE_NONE: nothing to be written
+    int size;
+    unsigned long long seq;
+    IPC_ALL_USAGE_DATA_POOL_U data;
+} IPC_PERSIST_COPY_S;
+static int g_persistTimerFd = -1; // in epoll of the server thread, armed with the shortest interval
+static unsigned long long g_persistSeq; // counted up with g_mutex for each copy
+static IPC_PERSIST_COPY_S g_persistCopy[IPC_SERVER_USAGE_MAX_NUM]; // used only by the server thread
+
+// multiplexed connections (IPC_MUX)
+typedef struct {
+    int fd;
+    unsigned int usageMask; // subscribed usages (bit of IPC_USAGE_TYPE_E)
+} IPC_MUX_CLIENT_S;
+static int g_muxFd = -1; // listening socket, -1: IPC_MUX is not enabled
+static bool g_muxExternalFd = false; // g_muxFd is passed by LISTEN_FDS
+static IPC_MUX_CLIENT_S g_muxClient[IPC_LISTEN_CLIENT_NUM];
+
+// Requests of the clients: received with g_mutex, and handled by the server thread after g_mutex is released,
+// so a handler can send messages. The responses are sent with g_mutex, after the messages sent by the handler.
+typedef struct {
+    IPC_USAGE_TYPE_E usage;
+    int fd;
+    int index; // of g_serverInfo (-1: the usage is not served), and the connection slot in it
+    int slot;
+    int muxIndex; // of g_muxClient, -1: the own connection of the usage
+    IPC_REQUEST_HANDLER_CB requestHandlerCb;
+    void *pUserData;
+    IPC_REQUEST_HEADER_S header; // of the request, replaced with that of the response
+    char payload[IPC_REQUEST_MAX_SIZE];
+    char response[IPC_REQUEST_MAX_SIZE];
+} IPC_SERVER_REQUEST_S;
+static IPC_SERVER_REQUEST_S g_request[IPC_SERVER_REQUEST_NUM]; // used only by the server thread
+static int g_requestNum;
+
+// Send queue of IPC_SEND_MODE_ASYNC: a bounded MPSC ring.
+// Producers reserve an entry by a CAS of head, and publish it by its seq (the entry is readable when seq == pos + 1).
+// The consumer is the holder of g_mutex (the server thread, or ipcServerSetSendMode).
+typedef struct {
+    unsigned long long seq;
+    IPC_USAGE_TYPE_E usage;
+    int topic; // IPC_TOPIC_WHOLE: data from the top, otherwise only the range of the topic in data is valid
+    int size;
+    IPC_ALL_USAGE_DATA_POOL_U data;
+} __attribute__((aligned(IPC_CACHE_LINE_SIZE))) IPC_SEND_QUEUE_ENTRY_S;
+
+typedef struct {
+    unsigned long long head __attribute__((aligned(IPC_CACHE_LINE_SIZE))); // next position to be reserved
+    int wakeupPending; // 1: eventFd has been written and the queue is not drained yet
+    unsigned long long tail __attribute__((aligned(IPC_CACHE_LINE_SIZE))); // next position to be consumed
+    int eventFd; // in epoll of the server thread
+    IPC_SEND_QUEUE_ENTRY_S entry[IPC_SEND_QUEUE_NUM];
+} IPC_SEND_QUEUE_S;
+static IPC_SEND_QUEUE_S g_sendQueue = {.eventFd = -1};
+static IPC_SEND_MODE_E g_sendMode[IPC_SERVER_USAGE_MAX_NUM]; // read by ipcSendMessage without g_mutex
+static int g_asyncSenderNum[IPC_SERVER_USAGE_MAX_NUM]; // producers which may push to the queue (see ipcStopAsyncSend)
+static int g_asyncStopWaiterNum; // threads in ipcStopAsyncSend, woken up by the last producer leaving
+static pthread_mutex_t g_asyncStopMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_asyncStopCond = PTHREAD_COND_INITIALIZER;
+
+_Static_assert((IPC_SEND_QUEUE_NUM & (IPC_SEND_QUEUE_NUM - 1)) == 0, "IPC_SEND_QUEUE_NUM must be a power of 2");
+
 static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long long g_mutexLockedTime; // valid while g_mutex is held
 
 // == Prototype declaration
+static void ipcServerLock(void);
+static void ipcServerUnlock(void);
 static void *ipcServerThread(void *arg);
 static int ipcServerInit(void);
 static int ipcServerDeinit(void);
 static void ipcServerInfoClear(int index);
 static int ipcGetServerInfoIndex(IPC_USAGE_TYPE_E usageType);
-static int ipcServerCreateSocket(IPC_USAGE_TYPE_E usageType);
+static int ipcServerCreateSocket(IPC_USAGE_TYPE_E usageType, bool *pExternalFd);
+static int ipcServerCreateMuxSocket(bool *pExternalFd);
+static int ipcServerListen(const char *domainName);
+static bool ipcIsListenSocket(int fd);
+static int ipcFindListenFd(const char *domainName);
 static void ipcAcceptClient(int eventFd);
 static void ipcCloseClient(int eventFd);
-static int ipcAddServer(IPC_USAGE_TYPE_E usageType);
+static int ipcGetMuxClientIndex(int fd);
+static void ipcAcceptMuxClient(void);
+static void ipcCloseMuxClient(int muxIndex);
+static void ipcReceiveMuxMessage(int muxIndex);
+static int ipcMuxSubscribe(int muxIndex, unsigned int usageMask);
+static int ipcGetClientSlot(int fd, int *pSlot);
+static int ipcReadRequest(int fd, IPC_SERVER_REQUEST_S *pRequest);
+static void ipcReceiveRequest(int index, int slot);
+static void ipcQueueRequest(IPC_USAGE_TYPE_E usageType, int fd, int index, int slot, int muxIndex);
+static void ipcHandleRequest(void);
+static void ipcSendResponse(IPC_SERVER_REQUEST_S *pRequest);
+static int ipcBuildFrame(IPC_SERVER_INFO_S *pInfo, int topic, const void *pData, int size);
+static int ipcSendMuxFrame(int fd, IPC_SERVER_INFO_S *pInfo, int messageSize, int flags);
+#ifdef IPC_USE_IO_URING
+static void ipcAbandonFrame(IPC_SERVER_INFO_S *pInfo);
+#endif
+static void ipcArmPersistTimer(void);
+static void ipcCopyPersist(void);
+static void ipcFlushPersist(void);
+static void ipcSendQueueInit(void);
+static int ipcPushSendQueue(IPC_USAGE_TYPE_E usageType, int topic, const void *pData, int size);
+static void ipcDrainSendQueue(void);
+static void ipcStopAsyncSend(IPC_USAGE_TYPE_E usageType);
+static void ipcLeaveAsyncSend(IPC_USAGE_TYPE_E usageType);
+static IPC_RET_E ipcSendToClients(IPC_SERVER_INFO_S *pInfo, int topic, const void *pData, int size);
+static IPC_RET_E ipcSendInternal(IPC_USAGE_TYPE_E usageType, int topic, const void *pData, int size);
+static IPC_RET_E ipcServerStartInternal(IPC_USAGE_TYPE_E usageType, int listenFd);
+static int ipcAddServer(IPC_USAGE_TYPE_E usageType, int listenFd);
 static int ipcAddConnectClient(int index, int clientFd);
 static int ipcRemoveServer(IPC_USAGE_TYPE_E usageType);
 static int ipcCountServer(void);
 
+// == Lock function ==
+static void ipcServerLock(void)
+{
+    g_mutexLockedTime = ipcStatsLock(&g_mutex, &g_ipcServerLockStats);
+}
+
+static void ipcServerUnlock(void)
+{
+    ipcStatsUnlock(&g_mutex, &g_ipcServerLockStats, g_mutexLockedTime);
+}
+
 // == Thread function ==
 static void *ipcServerThread(void *arg)
 {
@@ -73,33 +209,63 @@ static void *ipcServerThread(void *arg)
     int i;
     char dummy;
     int rc;
+    eventfd_t count;
+    int cancelState;
+    int index;
+    int slot;
 
     while(g_threadRunning != false) {
-        fdNum = epoll_wait(g_epollFd, epEvents, IPC_SERVER_USAGE_MAX_NUM, -1);
+        fdNum = epoll_wait(g_epollFd, epEvents, IPC_SERVER_EPOLL_WAIT_NUM, -1);
         if (g_threadRunning == false) {
             break;
         }
 
-        pthread_mutex_lock(&g_mutex);
+        ipcServerLock();
         for (i = 0; i < fdNum; i++) {
             if (epEvents[i].data.fd == g_threadCtlPipeFd[0]) {
                 // dummy notify from API function.
                 rc = read(g_threadCtlPipeFd[0], &dummy, 1);
                 if (rc < 0) {
-                    printf("[##ERROR##] %s:%s:%d (%s) is false. (%s=%d)\n", __FILE__, __func__, __LINE__, "rc < 0", "rc", (int)rc);
+                    IPC_LOG(IPC_LOG_LEVEL_ERROR, "rc >= 0", rc);
                     continue;
                 }
             }
+            else if (epEvents[i].data.fd == g_sendQueue.eventFd) {
+                eventfd_read(g_sendQueue.eventFd, &count);
+                ipcDrainSendQueue();
+            }
+            else if (epEvents[i].data.fd == g_persistTimerFd) {
+                rc = read(g_persistTimerFd, &count, sizeof(count));
+                ipcCopyPersist();
+            }
             else {
                 if (epEvents[i].events & EPOLLRDHUP) {
                     ipcCloseClient(epEvents[i].data.fd);
                 }
                 else if (epEvents[i].events & EPOLLIN) {
-                    ipcAcceptClient(epEvents[i].data.fd);
+                    if (epEvents[i].data.fd == g_muxFd) {
+                        ipcAcceptMuxClient();
+                    }
+                    else if (ipcGetMuxClientIndex(epEvents[i].data.fd) >= 0) {
+                        ipcReceiveMuxMessage(ipcGetMuxClientIndex(epEvents[i].data.fd));
+                    }
+                    else if ((index = ipcGetClientSlot(epEvents[i].data.fd, &slot)) >= 0) {
+                        ipcReceiveRequest(index, slot);
+                    }
+                    else {
+                        ipcAcceptClient(epEvents[i].data.fd);
+                    }
                 }
             }
         }
-        pthread_mutex_unlock(&g_mutex);
+        ipcServerUnlock();
+
+        // not cancelled by ipcServerDeinit while a file is written (with the lock of ipc_persist.c),
+        // or a request handler is running
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancelState);
+        ipcFlushPersist();
+        ipcHandleRequest();
+        pthread_setcancelstate(cancelState, NULL);
     }
 
     pthread_exit(NULL);
@@ -115,10 +281,17 @@ static int ipcServerInit(void)
     struct epoll_event epollEv;
 
     if (g_initedFlag == false) {
+        ipcRtAcquire(); // the settings are fixed until ipcServerDeinit
+        ipcRtInitMutex(&g_mutex); // not used while the server is not initialized
         for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
             ipcServerInfoClear(i);
         }
+        for (i = 0; i < IPC_LISTEN_CLIENT_NUM; i++) {
+            g_muxClient[i].fd = -1;
+            g_muxClient[i].usageMask = 0;
+        }
         g_threadRunning = false;
+        g_requestNum = 0;
         rc = pipe(g_threadCtlPipeFd);
         IPC_E_CHECK(rc == 0, rc, end);
 
@@ -129,6 +302,38 @@ static int ipcServerInit(void)
         epollEv.data.fd = g_threadCtlPipeFd[0];
         epoll_ctl(g_epollFd, EPOLL_CTL_ADD, epollEv.data.fd, &epollEv);
 
+        ipcSendQueueInit();
+        ipcRtLockMemory(&g_sendQueue, sizeof(g_sendQueue));
+        g_sendQueue.eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        IPC_E_CHECK(g_sendQueue.eventFd >= 0, errno, end);
+        epollEv.events = EPOLLIN;
+        epollEv.data.fd = g_sendQueue.eventFd;
+        epoll_ctl(g_epollFd, EPOLL_CTL_ADD, epollEv.data.fd, &epollEv);
+
+        g_persistTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        IPC_E_CHECK(g_persistTimerFd >= 0, errno, end);
+        epollEv.events = EPOLLIN;
+        epollEv.data.fd = g_persistTimerFd;
+        epoll_ctl(g_epollFd, EPOLL_CTL_ADD, epollEv.data.fd, &epollEv);
+        for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
+            g_persistCopy[i].usage = IPC_USAGE_NONE;
+        }
+
+#ifdef IPC_USE_IO_URING
+        // If io_uring is not available, g_uring.fd stays -1 and send() is used.
+        (void)ipcUringInit(&g_uring, IPC_LISTEN_CLIENT_NUM);
+#endif
+
+        if (ipcIsMuxEnabled() == true) {
+            // If the socket can not be created, the usages are served only by their own sockets.
+            g_muxFd = ipcServerCreateMuxSocket(&g_muxExternalFd);
+            if (g_muxFd >= 0) {
+                epollEv.events = EPOLLIN;
+                epollEv.data.fd = g_muxFd;
+                epoll_ctl(g_epollFd, EPOLL_CTL_ADD, epollEv.data.fd, &epollEv);
+            }
+        }
+
         g_initedFlag = true;
     }
 
@@ -136,12 +341,21 @@ static int ipcServerInit(void)
 
 end:
     if (ret == -1) {
+        ipcRtRelease();
         for (i = 0; i < 2; i++) {
             if (g_threadCtlPipeFd[i] >= 0) {
                 close(g_threadCtlPipeFd[i]);
                 g_threadCtlPipeFd[i] = -1;
             }
         }
+        if (g_sendQueue.eventFd >= 0) {
+            close(g_sendQueue.eventFd);
+            g_sendQueue.eventFd = -1;
+        }
+        if (g_epollFd >= 0) {
+            close(g_epollFd);
+            g_epollFd = -1;
+        }
     }
     return ret;
 }
@@ -149,6 +363,8 @@ end:
 static int ipcServerDeinit(void)
 {
     int i;
+    char domainName[IPC_DOMAIN_PATH_MAX] = "";
+    int domainLen = IPC_DOMAIN_PATH_MAX;
 
     if (g_initedFlag == true) {
         if (g_threadRunning == true) {
@@ -159,16 +375,42 @@ static int ipcServerDeinit(void)
         for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
             ipcServerInfoClear(i);
         }
+        if (g_muxFd >= 0) {
+            for (i = 0; i < IPC_LISTEN_CLIENT_NUM; i++) {
+                ipcCloseMuxClient(i);
+            }
+            if (g_muxExternalFd == false) {
+                shutdown(g_muxFd, SHUT_RDWR);
+                close(g_muxFd);
+                if (ipcCreateMuxDomainName(IPC_SIDE_SERVER, domainName, &domainLen) == 0) {
+                    unlink(domainName);
+                }
+            }
+            else {
+                epoll_ctl(g_epollFd, EPOLL_CTL_DEL, g_muxFd, NULL);
+            }
+            g_muxFd = -1;
+            g_muxExternalFd = false;
+        }
         for (i = 0; i < 2; i++) {
             if (g_threadCtlPipeFd[i] >= 0) {
                 close(g_threadCtlPipeFd[i]);
                 g_threadCtlPipeFd[i] = -1;
             }
         }
+        close(g_sendQueue.eventFd);
+        g_sendQueue.eventFd = -1;
+        close(g_persistTimerFd);
+        g_persistTimerFd = -1;
         close(g_epollFd);
         g_epollFd = -1;
+#ifdef IPC_USE_IO_URING
+        ipcUringDeinit(&g_uring);
+#endif
 
         g_initedFlag = false;
+        ipcRtRelease();
+        ipcLogFlush();
     }
 
     return 0;
@@ -180,8 +422,19 @@ static void ipcServerInfoClear(int index)
 
     IPC_E_CHECK(0 <= index && index < IPC_SERVER_USAGE_MAX_NUM, index, end);
 
-    g_serverInfo[index].usage = IPC_USAGE_TYPE_MAX;
+    g_serverInfo[index].usage = IPC_USAGE_NONE;
     g_serverInfo[index].fd = -1;
+    g_serverInfo[index].externalFd = false;
+    g_serverInfo[index].pFrame = NULL;
+    g_serverInfo[index].pSnapshot = NULL;
+    g_serverInfo[index].snapshotSize = 0;
+    g_serverInfo[index].topicNum = 0;
+    memset(g_serverInfo[index].topicSeq, 0, sizeof(g_serverInfo[index].topicSeq));
+    g_serverInfo[index].persistInterval = -1;
+    g_serverInfo[index].persistDirty = false;
+    g_serverInfo[index].persistTime = 0;
+    g_serverInfo[index].requestHandlerCb = NULL;
+    g_serverInfo[index].pRequestUserData = NULL;
     for (i = 0; i < IPC_LISTEN_CLIENT_NUM; i++) {
         g_serverInfo[index].clientFd[i] = -1;
     }
@@ -205,23 +458,62 @@ static int ipcGetServerInfoIndex(IPC_USAGE_TYPE_E usageType)
     return index;
 }
 
-static int ipcServerCreateSocket(IPC_USAGE_TYPE_E usageType)
+static int ipcServerCreateSocket(IPC_USAGE_TYPE_E usageType, bool *pExternalFd)
 {
     int rc;
-    int fd = -1;
-    struct sockaddr_un unixAddr;
-    int len;
+    int fd;
     char domainName[IPC_DOMAIN_PATH_MAX] = "";
     int domainLen = IPC_DOMAIN_PATH_MAX;
 
     IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, err);
 
-    fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    IPC_E_CHECK(fd >= 0, fd, err);
+    rc = ipcCreateDomainName(usageType, IPC_SIDE_SERVER, domainName, &domainLen);
+    IPC_E_CHECK(rc == 0, rc, err);
+
+    fd = ipcFindListenFd(domainName);
+    *pExternalFd = (fd >= 0);
+    if (fd >= 0) {
+        return fd;
+    }
+
+    return ipcServerListen(domainName);
+
+err:
+    return -1;
+}
+
+static int ipcServerCreateMuxSocket(bool *pExternalFd)
+{
+    int rc;
+    int fd;
+    char domainName[IPC_DOMAIN_PATH_MAX] = "";
+    int domainLen = IPC_DOMAIN_PATH_MAX;
 
-    rc = ipcCreateDomainName(usageType, domainName, &domainLen);
+    rc = ipcCreateMuxDomainName(IPC_SIDE_SERVER, domainName, &domainLen);
     IPC_E_CHECK(rc == 0, rc, err);
 
+    fd = ipcFindListenFd(domainName);
+    *pExternalFd = (fd >= 0);
+    if (fd >= 0) {
+        return fd;
+    }
+
+    return ipcServerListen(domainName);
+
+err:
+    return -1;
+}
+
+static int ipcServerListen(const char *domainName)
+{
+    int rc;
+    int fd = -1;
+    struct sockaddr_un unixAddr;
+    int len;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    IPC_E_CHECK(fd >= 0, fd, err);
+
     rc = ipcCreateUnixDomainAddr(domainName, &unixAddr, &len);
     IPC_E_CHECK(rc == 0, rc, err);
 
@@ -242,6 +534,71 @@ err:
     return -1;
 }
 
+// a listening unix domain stream socket (for the sockets created by another process)
+static bool ipcIsListenSocket(int fd)
+{
+    int value;
+    socklen_t len;
+
+    len = sizeof(value);
+    if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &value, &len) != 0 || value != AF_UNIX) {
+        return false;
+    }
+    len = sizeof(value);
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &value, &len) != 0 || value != SOCK_STREAM) {
+        return false;
+    }
+    len = sizeof(value);
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &value, &len) != 0 || value == 0) {
+        return false;
+    }
+
+    return true;
+}
+
+// Returns the socket of domainName passed by the service manager (socket activation), or -1.
+// The sockets are matched by the file (the path of the service manager may be written differently).
+// They are left in the environment, so a usage finds its socket again when it is restarted.
+static int ipcFindListenFd(const char *domainName)
+{
+    const char *pPid = getenv("LISTEN_PID");
+    const char *pFds = getenv("LISTEN_FDS");
+    struct stat domainStat;
+    struct stat socketStat;
+    struct sockaddr_un unixAddr;
+    socklen_t len;
+    int fdNum;
+    int fd;
+    int i;
+
+    if (pPid == NULL || pFds == NULL || strtol(pPid, NULL, 10) != (long)getpid()) {
+        return -1;
+    }
+    if (stat(domainName, &domainStat) != 0 || !S_ISSOCK(domainStat.st_mode)) {
+        return -1;
+    }
+
+    fdNum = (int)strtol(pFds, NULL, 10);
+    for (i = 0; i < fdNum; i++) {
+        fd = IPC_LISTEN_FDS_START + i;
+        if (ipcIsListenSocket(fd) == false) {
+            continue;
+        }
+        len = sizeof(unixAddr);
+        memset(&unixAddr, 0, sizeof(unixAddr));
+        if (getsockname(fd, (struct sockaddr *)&unixAddr, &len) != 0 || unixAddr.sun_path[0] == '\0') {
+            continue; // abstract or unnamed
+        }
+        if (stat(unixAddr.sun_path, &socketStat) == 0 && socketStat.st_dev == domainStat.st_dev
+            && socketStat.st_ino == domainStat.st_ino) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            return fd;
+        }
+    }
+
+    return -1;
+}
+
 static void ipcAcceptClient(int eventFd)
 {
     int rc;
@@ -253,6 +610,7 @@ static void ipcAcceptClient(int eventFd)
     IPC_SERVER_INFO_S *pInfo;
     int index = -1;
     int i;
+    int size;
     struct epoll_event epollEv;
 
     for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
@@ -264,7 +622,7 @@ static void ipcAcceptClient(int eventFd)
     IPC_E_CHECK(0 <= index && index < IPC_SERVER_USAGE_MAX_NUM, eventFd, end);
     pInfo = &(g_serverInfo[index]);
 
-    rc = ipcCreateDomainName(pInfo->usage, domainName, &domainLen);
+    rc = ipcCreateDomainName(pInfo->usage, IPC_SIDE_SERVER, domainName, &domainLen);
     IPC_E_CHECK(rc == 0, rc, end);
 
     rc = ipcCreateUnixDomainAddr(domainName, &unixAddr, &len);
@@ -274,11 +632,37 @@ static void ipcAcceptClient(int eventFd)
     clientFd = accept(pInfo->fd, (struct sockaddr*)&unixAddr, (socklen_t *)&len);
     if (clientFd >= 0) {
         rc = ipcAddConnectClient(index, clientFd);
-        if (rc == 0) {
+        if (rc >= 0) {
+            IPC_STATS_ADD(g_ipcStats[pInfo->usage].server.connects, 1);
+            IPC_TRACE(accept, pInfo->usage, rc, clientFd, g_ipcStats[pInfo->usage].server.messagesSent);
             memset(&epollEv, 0, sizeof(epollEv));
-            epollEv.events = EPOLLRDHUP;
+            epollEv.events = EPOLLIN | EPOLLRDHUP; // EPOLLIN: requests
             epollEv.data.fd = clientFd;
             epoll_ctl(g_epollFd, EPOLL_CTL_ADD, clientFd, &epollEv);
+
+            // A registered usage: the client checks the schema hash before receiving the data.
+            if (g_ipcDomainInfoList[pInfo->usage].schemaHash != 0) {
+                rc = send(clientFd, &(g_ipcDomainInfoList[pInfo->usage].schemaHash), sizeof(unsigned long long),
+                          MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (rc != (int)sizeof(unsigned long long)) {
+                    // the client would take the first bytes of the data for the hash
+                    IPC_LOG(IPC_LOG_LEVEL_WARN, "send() == sizeof(schemaHash)", errno);
+                    ipcCloseClient(clientFd);
+                    goto end;
+                }
+            }
+
+            // Send the current state, so a (re)connected client does not wait for the next change.
+            // The socket buffer of a new connection is empty, so this does not block.
+            if (pInfo->snapshotSize > 0) {
+                size = ipcBuildFrame(pInfo, IPC_TOPIC_WHOLE, pInfo->pSnapshot, pInfo->snapshotSize);
+                rc = send(clientFd, pInfo->pFrame + sizeof(IPC_MUX_HEADER_S), size, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (rc != size) {
+                    // without the state (or with a part of it) the stream of the client is broken for good
+                    IPC_LOG(IPC_LOG_LEVEL_WARN, "send() == size", errno);
+                    ipcCloseClient(clientFd);
+                }
+            }
         }
         else { // The number of connections is already limited.
             shutdown(clientFd, SHUT_RDWR);
@@ -297,15 +681,23 @@ static void ipcCloseClient(int eventFd)
     IPC_SERVER_INFO_S *pInfo;
     struct epoll_event epollEv;
 
+    index = ipcGetMuxClientIndex(eventFd);
+    if (index >= 0) {
+        ipcCloseMuxClient(index);
+        return;
+    }
+
     for (index = 0; index < IPC_SERVER_USAGE_MAX_NUM; index++) {
         pInfo = &(g_serverInfo[index]);
-        if (pInfo->usage == IPC_USAGE_TYPE_MAX) {
+        if (pInfo->usage == IPC_USAGE_NONE) {
             continue;
         }
 
         for (i = 0; i < IPC_LISTEN_CLIENT_NUM; i++) {
             if (pInfo->clientFd[i] == eventFd) {
                 pInfo->clientFd[i] = -1;
+                IPC_STATS_ADD(g_ipcStats[pInfo->usage].server.disconnects, 1);
+                IPC_TRACE(close, pInfo->usage, i, eventFd, g_ipcStats[pInfo->usage].server.messagesSent);
 
                 shutdown(eventFd, SHUT_RDWR);
                 close(eventFd);
@@ -319,171 +711,1021 @@ static void ipcCloseClient(int eventFd)
     }
 }
 
-static int ipcAddServer(IPC_USAGE_TYPE_E usageType)
+static int ipcGetMuxClientIndex(int fd)
 {
-    int ret = -1;
-    int index = -1;
     int i;
-    int fd;
-    IPC_SERVER_INFO_S *pInfo;
-    struct epoll_event epollEv;
 
-    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    if (g_muxFd < 0 || fd < 0) {
+        return -1;
+    }
+    for (i = 0; i < IPC_LISTEN_CLIENT_NUM; i++) {
+        if (g_muxClient[i].fd == fd) {
+            return i;
+        }
+    }
 
-    // check if the usageType is used
-    index = ipcGetServerInfoIndex(usageType);
-    IPC_E_CHECK(index == -1, usageType, end);
+    return -1;
+}
 
-    // find empty index
-    for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
-        pInfo = &(g_serverInfo[i]);
-        if (pInfo->usage == IPC_USAGE_TYPE_MAX) {
-            pInfo->usage = usageType;
-            index = i;
+// A multiplexed client receives nothing until it subscribes (see ipcReceiveMuxMessage).
+static void ipcAcceptMuxClient(void)
+{
+    int clientFd;
+    int i;
+    struct epoll_event epollEv;
+
+    clientFd = accept(g_muxFd, NULL, NULL);
+    IPC_E_CHECK(clientFd >= 0, errno, end);
+
+    for (i = 0; i < IPC_LISTEN_CLIENT_NUM; i++) {
+        if (g_muxClient[i].fd == -1) {
+            g_muxClient[i].fd = clientFd;
+            g_muxClient[i].usageMask = 0;
             break;
         }
     }
-    IPC_E_CHECK(index >= 0, i, end);
-    pInfo = &(g_serverInfo[index]);
-
-    fd = ipcServerCreateSocket(usageType);
-
-    IPC_E_CHECK(fd >= 0, usageType, end);
+    if (i == IPC_LISTEN_CLIENT_NUM) { // The number of connections is already limited.
+        shutdown(clientFd, SHUT_RDWR);
+        close(clientFd);
+        goto end;
+    }
 
-    pInfo->fd = fd;
     memset(&epollEv, 0, sizeof(epollEv));
-    epollEv.events = EPOLLIN;
-    epollEv.data.fd = fd;
-    epoll_ctl(g_epollFd, EPOLL_CTL_ADD, epollEv.data.fd, &epollEv);
-
-    ret = 0;
+    epollEv.events = EPOLLIN | EPOLLRDHUP;
+    epollEv.data.fd = clientFd;
+    epoll_ctl(g_epollFd, EPOLL_CTL_ADD, clientFd, &epollEv);
 
 end:
-    if (ret == -1 && index >= 0) {
-        ipcServerInfoClear(index);
-    }
-    return ret;
+    return;
 }
 
-static int ipcAddConnectClient(int index, int clientFd)
+static void ipcCloseMuxClient(int muxIndex)
 {
-    int ret = -1;
-    int i;
-    IPC_SERVER_INFO_S *pInfo;
+    struct epoll_event epollEv;
+    int fd = g_muxClient[muxIndex].fd;
 
-    if (clientFd < 0) {
-        // do nothing
-        goto end;
+    if (fd < 0) {
+        return;
     }
 
-    pInfo = &(g_serverInfo[index]);
-
-    // find empty index
-    for (i = 0; i < IPC_LISTEN_CLIENT_NUM; i++) {
-        if (pInfo->clientFd[i] == -1) {
-            pInfo->clientFd[i] = clientFd;
-            ret = 0;
-            break;
-        }
-    }
+    memset(&epollEv, 0, sizeof(epollEv));
+    epoll_ctl(g_epollFd, EPOLL_CTL_DEL, fd, &epollEv);
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
 
-end:
-    return ret;
+    g_muxClient[muxIndex].fd = -1;
+    g_muxClient[muxIndex].usageMask = 0;
 }
 
-static int ipcRemoveServer(IPC_USAGE_TYPE_E usageType)
+// A message of a multiplexed client: IPC_MUX_TYPE_SUBSCRIBE or IPC_MUX_TYPE_REQUEST.
+static void ipcReceiveMuxMessage(int muxIndex)
 {
-    int ret = -1;
     int rc;
-    int index;
-    char domainName[IPC_DOMAIN_PATH_MAX] = "";
-    int domainLen = IPC_DOMAIN_PATH_MAX;
-    IPC_SERVER_INFO_S *pInfo;
-    struct epoll_event epollEv;
+    IPC_MUX_CLIENT_S *pMux = &(g_muxClient[muxIndex]);
+    IPC_MUX_HEADER_S header;
+    unsigned int usageMask;
+    IPC_SERVER_REQUEST_S *pRequest;
 
-    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    if (g_requestNum >= IPC_SERVER_REQUEST_NUM) {
+        return; // received at the next wakeup (the messages of a client are kept in order)
+    }
 
-    index = ipcGetServerInfoIndex(usageType);
-    IPC_E_CHECK(index >= 0, usageType, end);
+    rc = recv(pMux->fd, &header, sizeof(header), MSG_DONTWAIT);
+    if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    IPC_E_CHECK(rc == sizeof(header), rc, err);
+
+    // the payload is sent with the header by one send()
+    if (header.type == IPC_MUX_TYPE_SUBSCRIBE) {
+        IPC_E_CHECK(header.size == sizeof(usageMask), header.size, err);
+        rc = recv(pMux->fd, &usageMask, sizeof(usageMask), MSG_DONTWAIT);
+        IPC_E_CHECK(rc == sizeof(usageMask), rc, err);
+        rc = ipcMuxSubscribe(muxIndex, usageMask);
+        IPC_E_CHECK(rc == 0, errno, err);
+    }
+    else {
+        IPC_E_CHECK(header.type == IPC_MUX_TYPE_REQUEST, header.type, err);
+        IPC_E_CHECK(header.usage < IPC_USAGE_TYPE_MAX, header.usage, err);
+        pRequest = &(g_request[g_requestNum]);
+        rc = ipcReadRequest(pMux->fd, pRequest);
+        IPC_E_CHECK(rc == 1, rc, err);
+        IPC_E_CHECK(header.size == sizeof(pRequest->header) + pRequest->header.size, header.size, err);
+        ipcQueueRequest((IPC_USAGE_TYPE_E)header.usage, pMux->fd,
+                        ipcGetServerInfoIndex((IPC_USAGE_TYPE_E)header.usage), -1, muxIndex);
+    }
 
-    pInfo = &(g_serverInfo[index]);
+    return;
 
-    rc = ipcCreateDomainName(pInfo->usage, domainName, &domainLen);
-    IPC_E_CHECK(rc == 0, rc, end);
+err:
+    ipcCloseMuxClient(muxIndex);
+}
 
-    shutdown(pInfo->fd, SHUT_RDWR);
-    close(pInfo->fd);
-    unlink(domainName);
+// The subscription replaces the previous one. The newly subscribed usages are resynchronized with their snapshots.
+static int ipcMuxSubscribe(int muxIndex, unsigned int usageMask)
+{
+    int ret = -1;
+    int rc;
+    int i;
+    IPC_MUX_CLIENT_S *pMux = &(g_muxClient[muxIndex]);
+    IPC_SERVER_INFO_S *pInfo;
+    unsigned int addedMask;
 
-    memset(&epollEv, 0, sizeof(epollEv));
-    epoll_ctl(g_epollFd, EPOLL_CTL_DEL, pInfo->fd, &epollEv);
+    // the registered usages are not multiplexed (their numbers are local to each process)
+    usageMask &= (1U << IPC_USAGE_TYPE_MAX) - 1;
+    addedMask = usageMask & ~(pMux->usageMask);
+    pMux->usageMask = usageMask;
 
-    ipcServerInfoClear(index);
+    for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
+        pInfo = &(g_serverInfo[i]);
+        if (pInfo->usage == IPC_USAGE_NONE || (addedMask & (1U << pInfo->usage)) == 0
+            || pInfo->snapshotSize == 0) {
+            continue;
+        }
+        rc = ipcBuildFrame(pInfo, IPC_TOPIC_WHOLE, pInfo->pSnapshot, pInfo->snapshotSize);
+        rc = ipcSendMuxFrame(pMux->fd, pInfo, rc, MSG_DONTWAIT);
+        IPC_E_CHECK(rc == 0, errno, end);
+    }
 
     ret = 0;
-
 end:
     return ret;
 }
 
-static int ipcCountServer(void)
+// returns the index of g_serverInfo and the slot (*pSlot) of the connection of a client, or -1.
+static int ipcGetClientSlot(int fd, int *pSlot)
 {
-    int count = 0;
+    int index;
     int i;
 
-    for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
-        if (g_serverInfo[i].usage != IPC_USAGE_TYPE_MAX) {
-            count++;
+    for (index = 0; index < IPC_SERVER_USAGE_MAX_NUM; index++) {
+        if (g_serverInfo[index].usage == IPC_USAGE_NONE) {
+            continue;
+        }
+        for (i = 0; i < IPC_LISTEN_CLIENT_NUM; i++) {
+            if (g_serverInfo[index].clientFd[i] == fd) {
+                *pSlot = i;
+                return index;
+            }
         }
     }
 
-    return count;
+    return -1;
 }
 
-// == API function for server ==
-IPC_RET_E ipcServerStart(IPC_USAGE_TYPE_E usageType)
+// Reads IPC_REQUEST_HEADER_S and the payload to pRequest.
+// returns 1: read, 0: nothing to read, -1: the connection has to be closed.
+static int ipcReadRequest(int fd, IPC_SERVER_REQUEST_S *pRequest)
 {
-    IPC_RET_E ret;
     int rc;
-    char dummy = 's';
 
-    ret = IPC_ERR_PARAM;
-    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    rc = recv(fd, &(pRequest->header), sizeof(pRequest->header), MSG_DONTWAIT);
+    if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    IPC_E_CHECK(rc == sizeof(pRequest->header), rc, err);
+    IPC_E_CHECK(pRequest->header.size <= IPC_REQUEST_MAX_SIZE, pRequest->header.size, err);
 
-    ret = IPC_ERR_OTHER;
-    rc = ipcServerInit();
-    IPC_E_CHECK(rc == 0, rc, end);
+    // the payload is sent with the header by one send()
+    if (pRequest->header.size > 0) {
+        rc = recv(fd, pRequest->payload, pRequest->header.size, MSG_DONTWAIT);
+        IPC_E_CHECK(rc == pRequest->header.size, rc, err);
+    }
 
-    pthread_mutex_lock(&g_mutex);
-    rc = ipcAddServer(usageType);
-    pthread_mutex_unlock(&g_mutex);
+    return 1;
 
-    ret = IPC_ERR_NO_RESOURCE;
-    IPC_E_CHECK(rc == 0, rc, end);
+err:
+    return -1;
+}
 
-    if (g_threadRunning == false) {
-        rc = pthread_create(&g_serverThread, NULL, ipcServerThread, NULL);
-        IPC_E_CHECK(rc == 0, rc, end);
+// A request on the own connection of the usage. The response is sent as a message with IPC_TOPIC_HEADER_S,
+// so only the usages with topics accept requests (the messages of the others have no header).
+static void ipcReceiveRequest(int index, int slot)
+{
+    int rc;
+    IPC_SERVER_INFO_S *pInfo = &(g_serverInfo[index]);
+    int fd = pInfo->clientFd[slot];
 
-        g_threadRunning = true;
+    if (g_requestNum >= IPC_SERVER_REQUEST_NUM) {
+        return; // received at the next wakeup
     }
 
-    rc = write(g_threadCtlPipeFd[1], &dummy, 1); // for wakeup epoll_wait
-    IPC_E_CHECK(rc >= 0, rc, end);
-    ret = IPC_RET_OK;
+    IPC_E_CHECK(pInfo->topicNum > 0, pInfo->usage, err);
+    rc = ipcReadRequest(fd, &(g_request[g_requestNum]));
+    if (rc == 0) {
+        return;
+    }
+    IPC_E_CHECK(rc == 1, rc, err);
+    ipcQueueRequest(pInfo->usage, fd, index, slot, -1);
 
-end:
-    return ret;
+    return;
+
+err:
+    ipcCloseClient(fd);
 }
 
-IPC_RET_E ipcSendMessage(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size)
+// queues the request read to g_request[g_requestNum] with the handler of the usage.
+static void ipcQueueRequest(IPC_USAGE_TYPE_E usageType, int fd, int index, int slot, int muxIndex)
+{
+    IPC_SERVER_REQUEST_S *pRequest = &(g_request[g_requestNum]);
+
+    pRequest->usage = usageType;
+    pRequest->fd = fd;
+    pRequest->index = index;
+    pRequest->slot = slot;
+    pRequest->muxIndex = muxIndex;
+    pRequest->requestHandlerCb = (index >= 0) ? g_serverInfo[index].requestHandlerCb : NULL;
+    pRequest->pUserData = (index >= 0) ? g_serverInfo[index].pRequestUserData : NULL;
+    g_requestNum++;
+}
+
+// Calls the handlers of the requests received in this wakeup (without g_mutex), and sends the responses.
+static void ipcHandleRequest(void)
+{
+    int i;
+    IPC_SERVER_REQUEST_S *pRequest;
+    signed int status;
+    signed int size;
+
+    if (g_requestNum == 0) {
+        return;
+    }
+
+    for (i = 0; i < g_requestNum; i++) {
+        pRequest = &(g_request[i]);
+        if (pRequest->requestHandlerCb == NULL) {
+            pRequest->header.code = 0;
+            pRequest->header.ret = IPC_ERR_PARAM;
+            pRequest->header.size = 0;
+            continue;
+        }
+
+        size = 0;
+        status = pRequest->requestHandlerCb(pRequest->usage, pRequest->header.code, pRequest->payload,
+                                            pRequest->header.size, pRequest->response, &size, pRequest->pUserData);
+        if (size < 0 || size > IPC_REQUEST_MAX_SIZE) {
+            IPC_LOG(IPC_LOG_LEVEL_ERROR, "0 <= size <= IPC_REQUEST_MAX_SIZE", size);
+            size = 0;
+        }
+        pRequest->header.code = status;
+        pRequest->header.ret = IPC_RET_OK;
+        pRequest->header.size = size;
+    }
+
+    ipcServerLock();
+    ipcDrainSendQueue(); // the data queued by the handlers (IPC_SEND_MODE_ASYNC) is sent before the responses
+    for (i = 0; i < g_requestNum; i++) {
+        ipcSendResponse(&(g_request[i]));
+    }
+    ipcServerUnlock();
+
+    g_requestNum = 0;
+}
+
+// sends the response to the connection of the request, if it is not closed while the request was handled.
+// (with g_mutex, so it is not interleaved with the messages)
+static void ipcSendResponse(IPC_SERVER_REQUEST_S *pRequest)
+{
+    int rc;
+    char frame[sizeof(IPC_MUX_HEADER_S) + sizeof(IPC_REQUEST_HEADER_S) + IPC_REQUEST_MAX_SIZE];
+    IPC_MUX_HEADER_S muxHeader;
+    IPC_TOPIC_HEADER_S topicHeader;
+    IPC_SERVER_INFO_S *pInfo = NULL;
+    int headerSize;
+    int size = sizeof(IPC_REQUEST_HEADER_S) + pRequest->header.size;
+
+    _Static_assert(sizeof(IPC_TOPIC_HEADER_S) == sizeof(IPC_MUX_HEADER_S), "frame is too small");
+
+    if (pRequest->muxIndex >= 0) {
+        if (g_muxClient[pRequest->muxIndex].fd != pRequest->fd) {
+            return;
+        }
+        muxHeader.usage = pRequest->usage;
+        muxHeader.type = IPC_MUX_TYPE_RESPONSE;
+        muxHeader.size = size;
+        memcpy(frame, &muxHeader, sizeof(muxHeader));
+        headerSize = sizeof(muxHeader);
+    }
+    else {
+        pInfo = &(g_serverInfo[pRequest->index]);
+        if (pInfo->usage != pRequest->usage || pInfo->clientFd[pRequest->slot] != pRequest->fd) {
+            return;
+        }
+        topicHeader.topic = IPC_TOPIC_RESPONSE;
+        topicHeader.size = size;
+        topicHeader.seq = 0;
+        memcpy(frame, &topicHeader, sizeof(topicHeader));
+        headerSize = sizeof(topicHeader);
+    }
+    memcpy(frame + headerSize, &(pRequest->header), sizeof(pRequest->header));
+    memcpy(frame + headerSize + sizeof(pRequest->header), pRequest->response, pRequest->header.size);
+
+    rc = send(pRequest->fd, frame, headerSize + size, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (rc < 0 && pInfo != NULL) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            IPC_STATS_ADD(g_ipcStats[pInfo->usage].server.connection[pRequest->slot].writeAgains, 1);
+        }
+        else {
+            IPC_STATS_ADD(g_ipcStats[pInfo->usage].server.connection[pRequest->slot].writeErrors, 1);
+        }
+    }
+    if (rc != headerSize + size) {
+        // A part of the response breaks the stream, and a lost one would keep the request waiting until its
+        // timeout (or forever), so the connection is closed: the client fails its requests (IPC_ERR_NO_RESOURCE).
+        IPC_LOG(IPC_LOG_LEVEL_WARN, "send() == size", errno);
+        ipcCloseClient(pRequest->fd);
+    }
+}
+
+// Writes the message after IPC_MUX_HEADER_S of pFrame, and returns its size.
+// topic: pData is the whole data structure and only the range of the topic is sent,
+// IPC_TOPIC_WHOLE: size bytes from the top of pData are sent.
+static int ipcBuildFrame(IPC_SERVER_INFO_S *pInfo, int topic, const void *pData, int size)
+{
+    char *pMessage = pInfo->pFrame + sizeof(IPC_MUX_HEADER_S);
+    IPC_TOPIC_HEADER_S *pHeader;
+    const IPC_POOL_SEGMENT_S *pRange;
+
+    if (pInfo->topicNum == 0) {
+        memcpy(pMessage, pData, size);
+        return size;
+    }
+
+    pHeader = (IPC_TOPIC_HEADER_S *)pMessage;
+    pHeader->topic = topic;
+    if (topic == IPC_TOPIC_WHOLE) {
+        pHeader->seq = pInfo->topicSeq[IPC_TOPIC_MAX_NUM];
+    }
+    else {
+        pRange = &(g_ipcTopicTbl[pInfo->usage].pRange[topic]);
+        pHeader->seq = pInfo->topicSeq[topic];
+        pData += pRange->offset;
+        size = pRange->size;
+    }
+    pHeader->size = size;
+    memcpy(pMessage + sizeof(IPC_TOPIC_HEADER_S), pData, size);
+
+    return sizeof(IPC_TOPIC_HEADER_S) + size;
+}
+
+// sends the message built by ipcBuildFrame with the header (pFrame).
+// returns -1 unless the whole frame is sent: a part of a frame breaks the framing of the
+// connection for all its usages, so the caller closes the multiplexed client.
+static int ipcSendMuxFrame(int fd, IPC_SERVER_INFO_S *pInfo, int messageSize, int flags)
+{
+    int rc;
+    int size = sizeof(IPC_MUX_HEADER_S) + messageSize;
+
+    ((IPC_MUX_HEADER_S *)pInfo->pFrame)->size = messageSize;
+    rc = send(fd, pInfo->pFrame, size, MSG_NOSIGNAL | flags);
+    if (rc >= 0) {
+        IPC_STATS_ADD(g_ipcStats[pInfo->usage].server.bytesSent, rc);
+    }
+    if (rc != size) {
+        if (rc >= 0) {
+            errno = EAGAIN;
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+#ifdef IPC_USE_IO_URING
+// Replaces pFrame with a copy after the io_uring ring is torn down with sends in flight. The kernel may still
+// read the old buffer, so it is not written nor freed any more (it is left allocated on purpose).
+static void ipcAbandonFrame(IPC_SERVER_INFO_S *pInfo)
+{
+    int size = sizeof(IPC_MUX_HEADER_S) + sizeof(IPC_TOPIC_HEADER_S) + g_ipcDomainInfoList[pInfo->usage].size;
+    void *pFrame;
+
+    pFrame = malloc(size);
+    IPC_E_CHECK(pFrame != NULL, 0, end);
+    memcpy(pFrame, pInfo->pFrame, size);
+    ipcRtLockMemory(pFrame, size);
+    pInfo->pFrame = pFrame;
+
+end:
+    return;
+}
+#endif
+
+// arms g_persistTimerFd with the shortest interval of the usages (disarmed if there is none). (with g_mutex)
+static void ipcArmPersistTimer(void)
+{
+    struct itimerspec timerSpec;
+    int interval = 0;
+    int i;
+
+    for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
+        if (g_serverInfo[i].usage != IPC_USAGE_NONE && g_serverInfo[i].persistInterval > 0
+            && (interval == 0 || g_serverInfo[i].persistInterval < interval)) {
+            interval = g_serverInfo[i].persistInterval;
+        }
+    }
+
+    memset(&timerSpec, 0, sizeof(timerSpec));
+    timerSpec.it_interval.tv_sec = interval / 1000;
+    timerSpec.it_interval.tv_nsec = (interval % 1000) * 1000000L;
+    timerSpec.it_value = timerSpec.it_interval;
+    timerfd_settime(g_persistTimerFd, 0, &timerSpec, NULL);
+}
+
+// copies the snapshots to be persisted at this tick. (with g_mutex, by the server thread)
+static void ipcCopyPersist(void)
+{
+    IPC_SERVER_INFO_S *pInfo;
+    unsigned long long now = ipcGetTimeNs();
+    int i;
+
+    for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
+        pInfo = &(g_serverInfo[i]);
+        if (pInfo->usage == IPC_USAGE_NONE || pInfo->persistInterval <= 0 || pInfo->persistDirty == false
+            || pInfo->snapshotSize == 0
+            || now - pInfo->persistTime + IPC_SERVER_PERSIST_SLACK_TIME * 1000000ULL
+               < (unsigned long long)pInfo->persistInterval * 1000000ULL) {
+            continue;
+        }
+        g_persistCopy[i].usage = pInfo->usage;
+        g_persistCopy[i].size = g_ipcDomainInfoList[pInfo->usage].size;
+        g_persistCopy[i].seq = ++g_persistSeq;
+        memcpy(&(g_persistCopy[i].data), pInfo->pSnapshot, g_persistCopy[i].size);
+        pInfo->persistDirty = false;
+        pInfo->persistTime = now;
+    }
+}
+
+// writes the copies of ipcCopyPersist. (without g_mutex, by the server thread)
+static void ipcFlushPersist(void)
+{
+    int i;
+
+    for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
+        if (g_persistCopy[i].usage != IPC_USAGE_NONE) {
+            (void)ipcWritePersist(g_persistCopy[i].usage, &(g_persistCopy[i].data), g_persistCopy[i].size,
+                                  g_persistCopy[i].seq);
+            g_persistCopy[i].usage = IPC_USAGE_NONE;
+        }
+    }
+}
+
+static void ipcSendQueueInit(void)
+{
+    int i;
+
+    g_sendQueue.head = 0;
+    g_sendQueue.tail = 0;
+    g_sendQueue.wakeupPending = 0;
+    for (i = 0; i < IPC_SEND_QUEUE_NUM; i++) {
+        g_sendQueue.entry[i].seq = i;
+    }
+    for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
+        g_sendMode[i] = IPC_SEND_MODE_SYNC;
+    }
+}
+
+// Called by the producers without g_mutex. returns -1 if the queue is full.
+static int ipcPushSendQueue(IPC_USAGE_TYPE_E usageType, int topic, const void *pData, int size)
+{
+    int offset = 0;
+    unsigned long long pos;
+    unsigned long long seq;
+    IPC_SEND_QUEUE_ENTRY_S *pEntry;
+
+    pos = __atomic_load_n(&(g_sendQueue.head), __ATOMIC_RELAXED);
+    for (;;) {
+        pEntry = &(g_sendQueue.entry[pos & (IPC_SEND_QUEUE_NUM - 1)]);
+        seq = __atomic_load_n(&(pEntry->seq), __ATOMIC_ACQUIRE);
+        if (seq == pos) {
+            // the entry is free, reserve it (pos is reloaded on failure)
+            if (__atomic_compare_exchange_n(&(g_sendQueue.head), &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if ((long long)(seq - pos) < 0) {
+            return -1; // not consumed yet since the last round
+        }
+        else {
+            pos = __atomic_load_n(&(g_sendQueue.head), __ATOMIC_RELAXED);
+        }
+    }
+
+    if (topic != IPC_TOPIC_WHOLE) {
+        offset = g_ipcTopicTbl[usageType].pRange[topic].offset;
+        size = g_ipcTopicTbl[usageType].pRange[topic].size;
+    }
+    pEntry->usage = usageType;
+    pEntry->topic = topic;
+    pEntry->size = size;
+    memcpy((char *)&(pEntry->data) + offset, (const char *)pData + offset, size);
+    __atomic_store_n(&(pEntry->seq), pos + 1, __ATOMIC_RELEASE);
+
+    // only the first producer after a drain wakes the server thread up
+    if (__atomic_exchange_n(&(g_sendQueue.wakeupPending), 1, __ATOMIC_ACQ_REL) == 0) {
+        eventfd_write(g_sendQueue.eventFd, 1);
+    }
+
+    return 0;
+}
+
+// Consumes all queued messages, and sends only the latest one of each usage (and of each topic). (with g_mutex)
+// The messages are merged into latest[], so the ranges of the topics are taken from it.
+static void ipcDrainSendQueue(void)
+{
+    static IPC_ALL_USAGE_DATA_POOL_U latest[IPC_SERVER_USAGE_MAX_NUM]; // used with g_mutex
+    int latestSize[IPC_SERVER_USAGE_MAX_NUM]; // of IPC_TOPIC_WHOLE
+    unsigned int topicMask[IPC_SERVER_USAGE_MAX_NUM]; // queued topics
+    IPC_SEND_QUEUE_ENTRY_S *pEntry;
+    IPC_USAGE_TYPE_E usage;
+    int offset;
+    int index;
+    int i;
+    int topic;
+
+    for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
+        latestSize[i] = -1;
+        topicMask[i] = 0;
+    }
+
+    // the messages pushed after this are notified again
+    __atomic_exchange_n(&(g_sendQueue.wakeupPending), 0, __ATOMIC_ACQ_REL);
+
+    for (;;) {
+        pEntry = &(g_sendQueue.entry[g_sendQueue.tail & (IPC_SEND_QUEUE_NUM - 1)]);
+        if (__atomic_load_n(&(pEntry->seq), __ATOMIC_ACQUIRE) != g_sendQueue.tail + 1) {
+            break; // empty, or the producer is still writing it
+        }
+
+        usage = pEntry->usage;
+        if (pEntry->topic == IPC_TOPIC_WHOLE) {
+            if (latestSize[usage] >= 0) {
+                IPC_STATS_ADD(g_ipcStats[usage].server.messagesConflated, 1);
+            }
+            memcpy(&(latest[usage]), &(pEntry->data), pEntry->size);
+            latestSize[usage] = pEntry->size;
+        }
+        else {
+            if ((topicMask[usage] & (1U << pEntry->topic)) != 0) {
+                IPC_STATS_ADD(g_ipcStats[usage].server.messagesConflated, 1);
+            }
+            offset = g_ipcTopicTbl[usage].pRange[pEntry->topic].offset;
+            memcpy((char *)&(latest[usage]) + offset, (char *)&(pEntry->data) + offset, pEntry->size);
+            topicMask[usage] |= 1U << pEntry->topic;
+        }
+
+        __atomic_store_n(&(pEntry->seq), g_sendQueue.tail + IPC_SEND_QUEUE_NUM, __ATOMIC_RELEASE);
+        g_sendQueue.tail++;
+    }
+
+    for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
+        if (latestSize[i] < 0 && topicMask[i] == 0) {
+            continue;
+        }
+        // the usage may have been stopped after the message was queued
+        index = ipcGetServerInfoIndex((IPC_USAGE_TYPE_E)i);
+        if (index < 0 || g_serverInfo[index].fd < 0) {
+            continue;
+        }
+        if (latestSize[i] >= 0) {
+            (void)ipcSendToClients(&(g_serverInfo[index]), IPC_TOPIC_WHOLE, &(latest[i]), latestSize[i]);
+        }
+        for (topic = 0; topicMask[i] != 0; topic++) {
+            if ((topicMask[i] & (1U << topic)) != 0) {
+                topicMask[i] &= ~(1U << topic);
+                (void)ipcSendToClients(&(g_serverInfo[index]), topic, &(latest[i]), 0);
+            }
+        }
+    }
+}
+
+// Switches the usage to IPC_SEND_MODE_SYNC. (without g_mutex; call ipcDrainSendQueue with it after this)
+// A producer which has seen IPC_SEND_MODE_ASYNC may not have published its entry yet, so it is waited for:
+// otherwise its message would be sent by the server thread after the newer synchronous ones.
+// A synchronous send which takes g_mutex before the caller drains the queue first (see ipcSendInternal).
+static void ipcStopAsyncSend(IPC_USAGE_TYPE_E usageType)
+{
+    // (pairs with ipcSendInternal: either the producer sees SYNC, or it is counted here)
+    __atomic_store_n(&(g_sendMode[usageType]), IPC_SEND_MODE_SYNC, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&(g_asyncSenderNum[usageType]), __ATOMIC_SEQ_CST) == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_asyncStopMutex);
+    // (pairs with ipcLeaveAsyncSend: either the last producer sees the waiter, or its leave is seen here)
+    __atomic_add_fetch(&g_asyncStopWaiterNum, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&(g_asyncSenderNum[usageType]), __ATOMIC_SEQ_CST) > 0) {
+        pthread_cond_wait(&g_asyncStopCond, &g_asyncStopMutex);
+    }
+    __atomic_sub_fetch(&g_asyncStopWaiterNum, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&g_asyncStopMutex);
+}
+
+// Uncounts a producer of IPC_SEND_MODE_ASYNC. The lock is taken only while ipcStopAsyncSend is waiting.
+static void ipcLeaveAsyncSend(IPC_USAGE_TYPE_E usageType)
+{
+    if (__atomic_sub_fetch(&(g_asyncSenderNum[usageType]), 1, __ATOMIC_SEQ_CST) == 0
+        && __atomic_load_n(&g_asyncStopWaiterNum, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&g_asyncStopMutex);
+        pthread_cond_broadcast(&g_asyncStopCond);
+        pthread_mutex_unlock(&g_asyncStopMutex);
+    }
+}
+
+// Sends the message to all clients of the usage. (with g_mutex)
+// topic: pData is the whole data structure (size is not used), IPC_TOPIC_WHOLE: size bytes from the top of pData.
+static IPC_RET_E ipcSendToClients(IPC_SERVER_INFO_S *pInfo, int topic, const void *pData, int size)
+{
+    IPC_RET_E ret = IPC_ERR_PARAM;
+    int rc;
+    int i;
+    const IPC_POOL_SEGMENT_S *pRange;
+    char *pMessage = pInfo->pFrame + sizeof(IPC_MUX_HEADER_S);
+    int messageSize;
+    IPC_USAGE_TYPE_E usageType = pInfo->usage;
+    int clientFd[IPC_LISTEN_CLIENT_NUM];
+    int clientSlot[IPC_LISTEN_CLIENT_NUM];
+    int clientNum = 0;
+    IPC_STATS_SERVER_S *pStats;
+    unsigned long long seq = 0;
+    int uringNum = 0; // clients sent by io_uring (from the top of clientFd[])
+#ifdef IPC_USE_IO_URING
+    int result[IPC_LISTEN_CLIENT_NUM];
+#endif
+
+    if (topic == IPC_TOPIC_WHOLE) {
+        pInfo->topicSeq[IPC_TOPIC_MAX_NUM]++;
+        if (size > 0) {
+            memcpy(pInfo->pSnapshot, pData, size);
+            pInfo->snapshotSize = size;
+            if (pInfo->topicNum == 0 && size < g_ipcDomainInfoList[usageType].size) {
+                // the messages have no header: a short one is completed with the rest of the snapshot, so the
+                // stream of a connection can always be split by the size of the usage type (IPC_RECV_MODE_LATEST)
+                pData = pInfo->pSnapshot;
+                size = g_ipcDomainInfoList[usageType].size;
+                pInfo->snapshotSize = size;
+            }
+        }
+    }
+    else {
+        // the other topics are kept in the snapshot, so it is sent with the whole size from now.
+        pRange = &(g_ipcTopicTbl[usageType].pRange[topic]);
+        pInfo->topicSeq[topic]++;
+        memcpy(pInfo->pSnapshot + pRange->offset, pData + pRange->offset, pRange->size);
+        pInfo->snapshotSize = g_ipcDomainInfoList[usageType].size;
+        size = pRange->size;
+    }
+    pInfo->persistDirty = true;
+    messageSize = ipcBuildFrame(pInfo, topic, pData, size);
+
+    if (size > 0) {
+        // multiplexed clients first, the sending to the own clients below may end this function.
+        // (MSG_DONTWAIT: a multiplexed client which can not take the whole frame is closed, not waited for)
+        for (i = 0; g_muxFd >= 0 && i < IPC_LISTEN_CLIENT_NUM; i++) {
+            if (g_muxClient[i].fd != -1 && (g_muxClient[i].usageMask & (1U << usageType)) != 0) {
+                rc = ipcSendMuxFrame(g_muxClient[i].fd, pInfo, messageSize, MSG_DONTWAIT);
+                if (rc < 0) {
+                    IPC_LOG(IPC_LOG_LEVEL_WARN, "ipcSendMuxFrame() == 0", errno);
+                    ipcCloseMuxClient(i);
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < IPC_LISTEN_CLIENT_NUM; i++) {
+        if (pInfo->clientFd[i] != -1) {
+            clientSlot[clientNum] = i;
+            clientFd[clientNum++] = pInfo->clientFd[i];
+        }
+    }
+
+    pStats = &(g_ipcStats[usageType].server);
+    seq = __atomic_add_fetch(&(pStats->messagesSent), 1, __ATOMIC_RELAXED);
+    IPC_TRACE(send_entry, usageType, -1, size, seq);
+
+#ifdef IPC_USE_IO_URING
+    // Send to All Client by one io_uring_enter
+    if (g_uring.fd >= 0) {
+        uringNum = ipcUringSendAll(&g_uring, clientFd, clientNum, pMessage, messageSize, result);
+        if (g_uring.fd < 0) {
+            // the ring is torn down with sends in flight, which may still read the frame
+            ipcAbandonFrame(pInfo);
+        }
+        for (i = 0; i < uringNum; i++) {
+            IPC_TRACE(send_client, usageType, clientSlot[i], result[i], seq);
+            if (result[i] >= 0) {
+                IPC_STATS_ADD(pStats->bytesSent, result[i]);
+            }
+            else if (result[i] == -EAGAIN || result[i] == -EWOULDBLOCK) {
+                IPC_STATS_ADD(pStats->connection[clientSlot[i]].writeAgains, 1);
+            }
+            else {
+                IPC_STATS_ADD(pStats->connection[clientSlot[i]].writeErrors, 1);
+                if (result[i] == -ECANCELED) {
+                    // not reaped: how much of the message the client gets is unknown
+                    ipcCloseClient(clientFd[i]);
+                }
+            }
+        }
+    }
+#endif
+
+    // Send to All Client (which are not sent by io_uring)
+    // (MSG_NOSIGNAL: a client which has just gone away must not raise SIGPIPE in the server process)
+    for (i = uringNum; i < clientNum; i++) {
+        rc = send(clientFd[i], pMessage, messageSize, MSG_NOSIGNAL);
+        IPC_TRACE(send_client, usageType, clientSlot[i], rc, seq);
+        if (rc >= 0) {
+            IPC_STATS_ADD(pStats->bytesSent, rc);
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            IPC_STATS_ADD(pStats->connection[clientSlot[i]].writeAgains, 1);
+        }
+        else {
+            IPC_STATS_ADD(pStats->connection[clientSlot[i]].writeErrors, 1);
+        }
+        IPC_E_CHECK(rc >= 0, rc, end);
+    }
+#ifdef IPC_USE_IO_URING
+    for (i = 0; i < uringNum; i++) {
+        IPC_E_CHECK(result[i] >= 0, result[i], end);
+    }
+#endif
+
+    ret = IPC_RET_OK;
+end:
+    IPC_TRACE(send_exit, usageType, -1, ret, seq);
+    return ret;
+}
+
+// listenFd: the listening socket of ipcServerStartWithFd, or -1 (found in LISTEN_FDS, or created)
+static int ipcAddServer(IPC_USAGE_TYPE_E usageType, int listenFd)
+{
+    int ret = -1;
+    int index = -1;
+    int i;
+    int fd;
+    IPC_SERVER_INFO_S *pInfo;
+    struct epoll_event epollEv;
+
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+
+    // check if the usageType is used (index stays -1, so the used slot is not cleared on error)
+    IPC_E_CHECK(ipcGetServerInfoIndex(usageType) == -1, usageType, end);
+
+    // find empty index
+    for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
+        pInfo = &(g_serverInfo[i]);
+        if (pInfo->usage == IPC_USAGE_NONE) {
+            pInfo->usage = usageType;
+            index = i;
+            break;
+        }
+    }
+    IPC_E_CHECK(index >= 0, i, end);
+    pInfo = &(g_serverInfo[index]);
+
+    pInfo->topicNum = g_ipcTopicTbl[usageType].num;
+    IPC_E_CHECK(pInfo->topicNum <= IPC_TOPIC_MAX_NUM, pInfo->topicNum, end);
+    pInfo->pFrame = malloc(sizeof(IPC_MUX_HEADER_S) + sizeof(IPC_TOPIC_HEADER_S) + g_ipcDomainInfoList[usageType].size);
+    IPC_E_CHECK(pInfo->pFrame != NULL, 0, end);
+    memset(pInfo->pFrame, 0, sizeof(IPC_MUX_HEADER_S));
+    ((IPC_MUX_HEADER_S *)pInfo->pFrame)->usage = usageType;
+    ((IPC_MUX_HEADER_S *)pInfo->pFrame)->type = IPC_MUX_TYPE_DATA;
+    pInfo->pSnapshot = calloc(1, g_ipcDomainInfoList[usageType].size);
+    IPC_E_CHECK(pInfo->pSnapshot != NULL, 0, end);
+    ipcRtLockMemory(pInfo->pFrame, sizeof(IPC_MUX_HEADER_S) + sizeof(IPC_TOPIC_HEADER_S) + g_ipcDomainInfoList[usageType].size);
+    ipcRtLockMemory(pInfo->pSnapshot, g_ipcDomainInfoList[usageType].size);
+
+    if (listenFd >= 0) {
+        for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
+            IPC_E_CHECK(i == index || g_serverInfo[i].fd != listenFd, listenFd, end);
+        }
+        fd = listenFd;
+        pInfo->externalFd = true;
+    }
+    else {
+        fd = ipcServerCreateSocket(usageType, &(pInfo->externalFd));
+    }
+
+    IPC_E_CHECK(fd >= 0, usageType, end);
+
+    pInfo->fd = fd;
+    memset(&epollEv, 0, sizeof(epollEv));
+    epollEv.events = EPOLLIN;
+    epollEv.data.fd = fd;
+    epoll_ctl(g_epollFd, EPOLL_CTL_ADD, epollEv.data.fd, &epollEv);
+
+    ret = 0;
+
+end:
+    if (ret == -1 && index >= 0) {
+        free(g_serverInfo[index].pFrame);
+        free(g_serverInfo[index].pSnapshot);
+        ipcServerInfoClear(index);
+    }
+    return ret;
+}
+
+// returns the connection slot, or -1 if there is no empty slot.
+static int ipcAddConnectClient(int index, int clientFd)
+{
+    int ret = -1;
+    int i;
+    IPC_SERVER_INFO_S *pInfo;
+
+    if (clientFd < 0) {
+        // do nothing
+        goto end;
+    }
+
+    pInfo = &(g_serverInfo[index]);
+
+    // find empty index
+    for (i = 0; i < IPC_LISTEN_CLIENT_NUM; i++) {
+        if (pInfo->clientFd[i] == -1) {
+            pInfo->clientFd[i] = clientFd;
+            ret = i;
+            break;
+        }
+    }
+
+end:
+    return ret;
+}
+
+static int ipcRemoveServer(IPC_USAGE_TYPE_E usageType)
+{
+    int ret = -1;
+    int rc;
+    int index;
+    char domainName[IPC_DOMAIN_PATH_MAX] = "";
+    int domainLen = IPC_DOMAIN_PATH_MAX;
+    IPC_SERVER_INFO_S *pInfo;
+    struct epoll_event epollEv;
+
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+
+    index = ipcGetServerInfoIndex(usageType);
+    IPC_E_CHECK(index >= 0, usageType, end);
+
+    pInfo = &(g_serverInfo[index]);
+
+    rc = ipcCreateDomainName(pInfo->usage, IPC_SIDE_SERVER, domainName, &domainLen);
+    IPC_E_CHECK(rc == 0, rc, end);
+
+    // the queued messages are sent before the usage is removed (see ipcServerStop)
+    ipcDrainSendQueue();
+
+    if (pInfo->persistInterval >= 0 && pInfo->persistDirty == true && pInfo->snapshotSize > 0) {
+        // the last state is read by the clients at the next start
+        (void)ipcWritePersist(usageType, pInfo->pSnapshot, g_ipcDomainInfoList[usageType].size, ++g_persistSeq);
+    }
+
+    // remove from epoll first, or the server thread gets an event of the shut down socket.
+    memset(&epollEv, 0, sizeof(epollEv));
+    epoll_ctl(g_epollFd, EPOLL_CTL_DEL, pInfo->fd, &epollEv);
+
+    if (pInfo->externalFd == false) {
+        shutdown(pInfo->fd, SHUT_RDWR);
+        close(pInfo->fd);
+        unlink(domainName);
+    }
+    // else: the clients connecting while stopped are queued, and accepted when the usage is started again
+
+    free(pInfo->pFrame);
+    free(pInfo->pSnapshot);
+    ipcServerInfoClear(index);
+    ipcArmPersistTimer();
+
+    ret = 0;
+
+end:
+    return ret;
+}
+
+static int ipcCountServer(void)
+{
+    int count = 0;
+    int i;
+
+    for (i = 0; i < IPC_SERVER_USAGE_MAX_NUM; i++) {
+        if (g_serverInfo[i].usage != IPC_USAGE_NONE) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+// topic: pData is the whole data structure, IPC_TOPIC_WHOLE: size bytes from the top of pData.
+static IPC_RET_E ipcSendInternal(IPC_USAGE_TYPE_E usageType, int topic, const void *pData, int size)
 {
     IPC_RET_E ret;
     int rc;
     int index;
     IPC_SERVER_INFO_S *pInfo = NULL;
-    int i;
-    int clientFd;
+
+    if (__atomic_load_n(&(g_sendMode[usageType]), __ATOMIC_RELAXED) == IPC_SEND_MODE_ASYNC) {
+        // counted until the message is queued, and the mode is read again after counting (see ipcStopAsyncSend)
+        __atomic_add_fetch(&(g_asyncSenderNum[usageType]), 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&(g_sendMode[usageType]), __ATOMIC_SEQ_CST) == IPC_SEND_MODE_ASYNC) {
+            // no lock and no system call unless the server thread has to be woken up
+            rc = ipcPushSendQueue(usageType, topic, pData, size);
+            ipcLeaveAsyncSend(usageType);
+            if (rc != 0) {
+                IPC_STATS_ADD(g_ipcStats[usageType].server.queueFulls, 1);
+            }
+            ret = IPC_ERR_NO_RESOURCE;
+            IPC_E_CHECK(rc == 0, usageType, end);
+            ret = IPC_RET_OK;
+            goto end;
+        }
+        ipcLeaveAsyncSend(usageType); // changed to IPC_SEND_MODE_SYNC meanwhile
+    }
+
+    ipcServerLock();
+    if (__atomic_load_n(&(g_sendQueue.head), __ATOMIC_ACQUIRE) != g_sendQueue.tail) {
+        // the messages queued before a change to IPC_SEND_MODE_SYNC go first (see ipcStopAsyncSend)
+        ipcDrainSendQueue();
+    }
+    index = ipcGetServerInfoIndex(usageType);
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+    pInfo = &(g_serverInfo[index]);
+
+    IPC_E_CHECK(pInfo->fd >= 0, usageType, end_with_unlock);
+
+    ret = ipcSendToClients(pInfo, topic, pData, size);
+
+end_with_unlock:
+    ipcServerUnlock();
+
+end:
+    return ret;
+}
+
+static IPC_RET_E ipcServerStartInternal(IPC_USAGE_TYPE_E usageType, int listenFd)
+{
+    IPC_RET_E ret;
+    int rc;
+    char dummy = 's';
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+
+    ret = IPC_ERR_OTHER;
+    rc = ipcServerInit();
+    IPC_E_CHECK(rc == 0, rc, end);
+
+    ipcServerLock();
+    rc = ipcAddServer(usageType, listenFd);
+    ipcServerUnlock();
+
+    ret = IPC_ERR_NO_RESOURCE;
+    IPC_E_CHECK(rc == 0, rc, end);
+
+    if (g_threadRunning == false) {
+        // set before creation; the thread exits as soon as it sees false.
+        g_threadRunning = true;
+        rc = ipcRtCreateThread(&g_serverThread, ipcServerThread);
+        if (rc != 0) {
+            g_threadRunning = false;
+        }
+        IPC_E_CHECK(rc == 0, rc, end);
+    }
+
+    rc = write(g_threadCtlPipeFd[1], &dummy, 1); // for wakeup epoll_wait
+    IPC_E_CHECK(rc >= 0, rc, end);
+    ret = IPC_RET_OK;
+
+end:
+    return ret;
+}
+
+// == API function for server ==
+IPC_RET_E ipcServerStart(IPC_USAGE_TYPE_E usageType)
+{
+    return ipcServerStartInternal(usageType, -1);
+}
+
+IPC_RET_E ipcServerStartWithFd(IPC_USAGE_TYPE_E usageType, int listenFd)
+{
+    IPC_RET_E ret;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(listenFd >= 0 && ipcIsListenSocket(listenFd) == true, listenFd, end);
+
+    ret = ipcServerStartInternal(usageType, listenFd);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcSendMessage(IPC_USAGE_TYPE_E usageType, const void* pData, signed int size)
+{
+    IPC_RET_E ret;
 
     ret = IPC_ERR_SEQUENCE;
     IPC_E_CHECK(g_initedFlag != false, g_initedFlag, end);
@@ -491,30 +1733,124 @@ IPC_RET_E ipcSendMessage(IPC_USAGE_TYPE_E usageType, const void* pData, signed i
     ret = IPC_ERR_PARAM;
     IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
     IPC_E_CHECK(pData != NULL, 0, end);
-    IPC_E_CHECK(g_ipcDomainInfoList[usageType].size >= size, size, end);
+    IPC_E_CHECK(0 <= size && size <= g_ipcDomainInfoList[usageType].size, size, end);
+
+    ret = ipcSendInternal(usageType, IPC_TOPIC_WHOLE, pData, size);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcSendTopic(IPC_USAGE_TYPE_E usageType, int topic, const void* pData, signed int size)
+{
+    IPC_RET_E ret;
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(g_initedFlag != false, g_initedFlag, end);
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(0 <= topic && topic < g_ipcTopicTbl[usageType].num, topic, end);
+    IPC_E_CHECK(pData != NULL, 0, end);
+    IPC_E_CHECK(g_ipcDomainInfoList[usageType].size == size, size, end);
+
+    ret = ipcSendInternal(usageType, topic, pData, size);
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcServerSetSendMode(IPC_USAGE_TYPE_E usageType, IPC_SEND_MODE_E mode)
+{
+    IPC_RET_E ret;
+    int index;
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(g_initedFlag != false, g_initedFlag, end);
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(mode == IPC_SEND_MODE_SYNC || mode == IPC_SEND_MODE_ASYNC, mode, end);
 
-    pthread_mutex_lock(&g_mutex);
+    if (mode == IPC_SEND_MODE_SYNC) {
+        // the producers still queuing are waited for without the lock (they never take it)
+        ipcStopAsyncSend(usageType);
+    }
+
+    ipcServerLock();
     index = ipcGetServerInfoIndex(usageType);
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+
+    if (mode == IPC_SEND_MODE_SYNC) {
+        // the queued messages are sent before the synchronous ones
+        ipcDrainSendQueue();
+    }
+    else {
+        __atomic_store_n(&(g_sendMode[usageType]), mode, __ATOMIC_RELAXED);
+    }
+    ret = IPC_RET_OK;
+
+end_with_unlock:
+    ipcServerUnlock();
+
+end:
+    return ret;
+}
+
+IPC_RET_E ipcServerSetPersist(IPC_USAGE_TYPE_E usageType, signed int intervalMs)
+{
+    IPC_RET_E ret;
+    int index;
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(g_initedFlag != false, g_initedFlag, end);
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(intervalMs >= -1, intervalMs, end);
+
+    ret = IPC_ERR_NO_RESOURCE;
+    IPC_E_CHECK(intervalMs < 0 || getenv(IPC_ENV_PERSIST_PATH) != NULL, intervalMs, end);
 
+    ipcServerLock();
+    index = ipcGetServerInfoIndex(usageType);
     ret = IPC_ERR_PARAM;
     IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
-    pInfo = &(g_serverInfo[index]);
 
-    IPC_E_CHECK(pInfo->fd >= 0, usageType, end_with_unlock);
+    g_serverInfo[index].persistInterval = intervalMs;
+    ipcArmPersistTimer();
+    ret = IPC_RET_OK;
 
-    // Send to All Client
-    for (i = 0; i < IPC_LISTEN_CLIENT_NUM; i++) {
-        clientFd = pInfo->clientFd[i];
-        if (clientFd == -1) {
-            continue;
-        }
-        rc = write(clientFd, pData, size);
-        IPC_E_CHECK(rc >= 0, rc, end_with_unlock);
-    }
+end_with_unlock:
+    ipcServerUnlock();
 
+end:
+    return ret;
+}
+
+IPC_RET_E ipcServerSetRequestHandler(IPC_USAGE_TYPE_E usageType, IPC_REQUEST_HANDLER_CB requestHandlerCb,
+                                     void* pUserData)
+{
+    IPC_RET_E ret;
+    int index;
+
+    ret = IPC_ERR_SEQUENCE;
+    IPC_E_CHECK(g_initedFlag != false, g_initedFlag, end);
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+
+    ipcServerLock();
+    index = ipcGetServerInfoIndex(usageType);
+    IPC_E_CHECK(index >= 0, usageType, end_with_unlock);
+
+    // the requests received before this are handled by the previous handler
+    g_serverInfo[index].requestHandlerCb = requestHandlerCb;
+    g_serverInfo[index].pRequestUserData = pUserData;
     ret = IPC_RET_OK;
+
 end_with_unlock:
-    pthread_mutex_unlock(&g_mutex);
+    ipcServerUnlock();
 
 end:
     return ret;
@@ -532,7 +1868,10 @@ IPC_RET_E ipcServerStop(IPC_USAGE_TYPE_E usageType)
     ret = IPC_ERR_PARAM;
     IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
 
-    pthread_mutex_lock(&g_mutex);
+    // the producers still queuing are waited for without the lock (see ipcServerSetSendMode)
+    ipcStopAsyncSend(usageType);
+
+    ipcServerLock();
     rc = ipcRemoveServer(usageType);
     ret = IPC_ERR_PARAM;
     IPC_E_CHECK(rc == 0, rc, end_with_unlock);
@@ -541,11 +1880,11 @@ IPC_RET_E ipcServerStop(IPC_USAGE_TYPE_E usageType)
     IPC_E_CHECK(rc >= 0, rc, end_with_unlock);
 
     if (ipcCountServer() == 0) {
-        pthread_mutex_unlock(&g_mutex);
+        ipcServerUnlock();
         ipcServerDeinit();
     }
     else {
-        pthread_mutex_unlock(&g_mutex);
+        ipcServerUnlock();
     }
 
     ret = IPC_RET_OK;
@@ -554,7 +1893,7 @@ end:
     return ret;
 
 end_with_unlock:
-    pthread_mutex_unlock(&g_mutex);
+    ipcServerUnlock();
     return ret;
 }
 
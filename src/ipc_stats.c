@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <cluster_ipc.h>
+#include "ipc_internal.h"
+
+// == statistics ==
+//   index of [] is IPC_USAGE_TYPE_E
+IPC_STATS_S g_ipcStats[IPC_USAGE_NUM];
+IPC_STATS_LOCK_S g_ipcServerLockStats;
+
+// lock the mutex and count wait time. returns the time when the lock was taken.
+unsigned long long ipcStatsLock(pthread_mutex_t *pMutex, IPC_STATS_LOCK_S *pStats)
+{
+    unsigned long long startTime;
+    unsigned long long lockedTime;
+
+    startTime = ipcGetTimeNs();
+    pthread_mutex_lock(pMutex);
+    lockedTime = ipcGetTimeNs();
+
+    // maxWaitTimeNs is updated with the lock held, so it does not need CAS.
+    IPC_STATS_ADD(pStats->waitNum, 1);
+    IPC_STATS_ADD(pStats->waitTimeNs, lockedTime - startTime);
+    if (lockedTime - startTime > pStats->maxWaitTimeNs) {
+        __atomic_store_n(&(pStats->maxWaitTimeNs), lockedTime - startTime, __ATOMIC_RELAXED);
+    }
+
+    return lockedTime;
+}
+
+void ipcStatsUnlock(pthread_mutex_t *pMutex, IPC_STATS_LOCK_S *pStats, unsigned long long lockedTime)
+{
+    IPC_STATS_ADD(pStats->holdTimeNs, ipcGetTimeNs() - lockedTime);
+    pthread_mutex_unlock(pMutex);
+}
+
+static void ipcStatsCopy(unsigned long long *pDst, unsigned long long *pSrc, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size / sizeof(unsigned long long); i++) {
+        pDst[i] = __atomic_load_n(&(pSrc[i]), __ATOMIC_RELAXED);
+    }
+}
+
+// == API function for server/client ==
+IPC_RET_E ipcGetStats(IPC_USAGE_TYPE_E usageType, IPC_STATS_S *pStats)
+{
+    IPC_RET_E ret;
+
+    ret = IPC_ERR_PARAM;
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(pStats != NULL, 0, end);
+
+    ipcStatsCopy((unsigned long long *)pStats, (unsigned long long *)&(g_ipcStats[usageType]), sizeof(IPC_STATS_S));
+    ipcStatsCopy((unsigned long long *)&(pStats->server.lock), (unsigned long long *)&g_ipcServerLockStats,
+                 sizeof(IPC_STATS_LOCK_S));
+
+    ret = IPC_RET_OK;
+
+end:
+    return ret;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IPC_TRACE_H
+#define IPC_TRACE_H
+
+// USDT (SystemTap SDT) probes of provider "cluster_ipc".
+//   A probe is a single nop in the code until perf/bpftrace attaches to it.
+//   All probes have the same arguments: (usage, kind, size, seq)
+//     kind : IPC_KIND_xxx for diff/callback probes, connection slot for the others (-1: not applicable)
+//     size : data size, or the result of the system call
+//     seq  : messagesSent (server) / messagesReceived (client) of ipcGetStats()
+//
+//   probe name     | place
+//   ---------------+----------------------------------------------------------
+//   send_entry     | ipcSendMessage() entry
+//   send_client    | ipcSendMessage() result of sending to each client
+//   send_exit      | ipcSendMessage() exit (size = IPC_RET_E)
+//   accept         | ipcServerThread() a client is accepted (size = fd)
+//   close          | ipcServerThread() a client is closed (size = fd)
+//   recv           | ipcReceiveDataFromServer() recv() completion
+//   diff           | ipcCheckChangeAndCallback() a changed kind is found
+//   callback_entry | ipcCheckChangeAndCallback() before the callback
+//   callback_exit  | ipcCheckChangeAndCallback() after the callback
+//
+//   ex) bpftrace -e 'usdt:./libcluster_ipc.so:cluster_ipc:recv { @[arg0] = count(); }'
+
+#ifdef IPC_HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define IPC_TRACE(name, usage, kind, size, seq) \
+    DTRACE_PROBE4(cluster_ipc, name, (int)(usage), (int)(kind), (int)(size), (unsigned long long)(seq))
+#else
+#define IPC_TRACE(name, usage, kind, size, seq) \
+    do { (void)(usage); (void)(kind); (void)(size); (void)(seq); } while(0)
+#endif
+
+#endif // IPC_TRACE_H
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <cluster_ipc.h>
+#include "ipc_internal.h"
+
+#ifdef IPC_USE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+static int ipcUringSetup(unsigned int entries, struct io_uring_params *pParams)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, pParams);
+}
+
+static int ipcUringEnter(int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+// IORING_OP_SEND needs kernel 5.6, and IORING_FEAT_SINGLE_MMAP only 5.4. The probe (also 5.6) tells it.
+static bool ipcUringCanSend(int fd)
+{
+    struct {
+        struct io_uring_probe probe;
+        struct io_uring_probe_op ops[IORING_OP_SEND + 1];
+    } probe;
+    int rc;
+
+    memset(&probe, 0, sizeof(probe));
+    rc = (int)syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, &probe, IORING_OP_SEND + 1);
+    if (rc < 0 || probe.probe.last_op < IORING_OP_SEND) {
+        return false;
+    }
+
+    return (probe.ops[IORING_OP_SEND].flags & IO_URING_OP_SUPPORTED) != 0;
+}
+
+int ipcUringInit(IPC_URING_S *pRing, unsigned int entries)
+{
+    int ret = -1;
+    struct io_uring_params params;
+    size_t sqLen, cqLen;
+    char *pSq, *pCq;
+
+    IPC_E_CHECK(pRing != NULL, 0, end);
+
+    memset(pRing, 0, sizeof(*pRing));
+    pRing->fd = -1;
+    memset(&params, 0, sizeof(params));
+
+    pRing->fd = ipcUringSetup(entries, &params);
+    if (pRing->fd < 0) {
+        // io_uring is disabled or not supported; the caller falls back to send().
+        goto end;
+    }
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0 || ipcUringCanSend(pRing->fd) == false) {
+        goto end; // an older kernel: send() is used
+    }
+
+    sqLen = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cqLen = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (cqLen > sqLen) {
+        sqLen = cqLen;
+    }
+    pRing->ringLen = sqLen;
+    pRing->pRingMem = mmap(NULL, sqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           pRing->fd, IORING_OFF_SQ_RING);
+    IPC_E_CHECK(pRing->pRingMem != MAP_FAILED, errno, end);
+
+    pRing->sqeLen = params.sq_entries * sizeof(struct io_uring_sqe);
+    pRing->pSqes = mmap(NULL, pRing->sqeLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        pRing->fd, IORING_OFF_SQES);
+    IPC_E_CHECK(pRing->pSqes != MAP_FAILED, errno, end);
+
+    pSq = (char *)pRing->pRingMem;
+    pCq = (char *)pRing->pRingMem; // IORING_FEAT_SINGLE_MMAP
+    pRing->pSqHead = (unsigned int *)(pSq + params.sq_off.head);
+    pRing->pSqTail = (unsigned int *)(pSq + params.sq_off.tail);
+    pRing->pSqMask = (unsigned int *)(pSq + params.sq_off.ring_mask);
+    pRing->pSqArray = (unsigned int *)(pSq + params.sq_off.array);
+    pRing->pCqHead = (unsigned int *)(pCq + params.cq_off.head);
+    pRing->pCqTail = (unsigned int *)(pCq + params.cq_off.tail);
+    pRing->pCqMask = (unsigned int *)(pCq + params.cq_off.ring_mask);
+    pRing->pCqes = pCq + params.cq_off.cqes;
+    pRing->entries = params.sq_entries;
+
+    ret = 0;
+
+end:
+    if (ret != 0 && pRing != NULL) {
+        ipcUringDeinit(pRing);
+    }
+    return ret;
+}
+
+void ipcUringDeinit(IPC_URING_S *pRing)
+{
+    if (pRing->pSqes != NULL && pRing->pSqes != MAP_FAILED) {
+        munmap(pRing->pSqes, pRing->sqeLen);
+    }
+    if (pRing->pRingMem != NULL && pRing->pRingMem != MAP_FAILED) {
+        munmap(pRing->pRingMem, pRing->ringLen);
+    }
+    if (pRing->fd >= 0) {
+        close(pRing->fd);
+    }
+    memset(pRing, 0, sizeof(*pRing));
+    pRing->fd = -1;
+}
+
+// Reaps one completion, waiting for it if needed. returns -1 if the wait failed.
+static int ipcUringReap(IPC_URING_S *pRing, struct io_uring_cqe *pOutCqe)
+{
+    int rc;
+    unsigned int head;
+
+    head = *(pRing->pCqHead);
+    while (head == __atomic_load_n(pRing->pCqTail, __ATOMIC_ACQUIRE)) {
+        rc = ipcUringEnter(pRing->fd, 0, 1, IORING_ENTER_GETEVENTS);
+        if (rc < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+    *pOutCqe = ((struct io_uring_cqe *)pRing->pCqes)[head & *(pRing->pCqMask)];
+    __atomic_store_n(pRing->pCqHead, head + 1, __ATOMIC_RELEASE);
+    pRing->inflight--;
+
+    return 0;
+}
+
+// Sends pData to pFd[] by one io_uring_enter. The sends are submitted in the order of pFd[], and
+// returns the number of submitted ones: pResult[] of them is the result of the send, and the caller
+// sends the rest (pFd[ret..fdNum-1]) by itself. Nothing is sent twice, and all submitted sends are reaped
+// before it returns. If they can not be reaped, the ring is torn down (pRing->fd is -1) and the sends which
+// are not reaped have -ECANCELED: the kernel may still read pData, so the caller must not write it again.
+int ipcUringSendAll(IPC_URING_S *pRing, const int *pFd, int fdNum, const void *pData, int size, int *pResult)
+{
+    int submitted = 0;
+    int rc;
+    int i;
+    unsigned int tail, index;
+    struct io_uring_sqe *pSqe;
+    struct io_uring_cqe cqe;
+
+    IPC_E_CHECK(pRing != NULL && pRing->fd >= 0, 0, end);
+    IPC_E_CHECK(0 <= fdNum && fdNum <= (int)pRing->entries, fdNum, end);
+
+    if (fdNum == 0) {
+        goto end;
+    }
+
+    // Queue one send per client. user_data keeps the position in pFd[].
+    tail = *(pRing->pSqTail);
+    for (i = 0; i < fdNum; i++) {
+        index = tail & *(pRing->pSqMask);
+        pSqe = &(((struct io_uring_sqe *)pRing->pSqes)[index]);
+        memset(pSqe, 0, sizeof(*pSqe));
+        pSqe->opcode = IORING_OP_SEND;
+        pSqe->fd = pFd[i];
+        pSqe->addr = (unsigned long)pData;
+        pSqe->len = size;
+        pSqe->msg_flags = MSG_NOSIGNAL;
+        pSqe->user_data = i;
+        pRing->pSqArray[index] = index;
+        tail++;
+        pResult[i] = -ECANCELED;
+    }
+    __atomic_store_n(pRing->pSqTail, tail, __ATOMIC_RELEASE);
+
+    // Submit all and wait for all completions with a single syscall.
+    // A wait interrupted after the submission returns the submitted number, -1 (EINTR) means nothing is submitted.
+    while (submitted < fdNum) {
+        rc = ipcUringEnter(pRing->fd, fdNum - submitted, fdNum - submitted, IORING_ENTER_GETEVENTS);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        IPC_E_CHECK(rc > 0, errno, withdraw);
+        submitted += rc;
+        pRing->inflight += rc;
+    }
+
+withdraw:
+    if (submitted < fdNum) {
+        // withdraw the sends the kernel has not consumed, so they are not submitted by the next call
+        __atomic_store_n(pRing->pSqTail, __atomic_load_n(pRing->pSqHead, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    }
+
+    for (i = 0; i < submitted; i++) {
+        rc = ipcUringReap(pRing, &cqe);
+        if (rc != 0) {
+            rc = errno;
+            ipcUringDeinit(pRing); // the sends in flight are left to the kernel with the ring
+        }
+        IPC_E_CHECK(rc == 0, rc, end);
+        if (cqe.user_data < (unsigned long long)fdNum) {
+            pResult[cqe.user_data] = cqe.res;
+        }
+    }
+
+end:
+    return submitted;
+}
+
+#endif // IPC_USE_IO_URING
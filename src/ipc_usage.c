@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2021, Nippon Seiki Co., Ltd.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include <cluster_ipc.h>
+#include "ipc_internal.h"
+
+#define IPC_USAGE_DOMAIN_PREFIX "ipcUsage."
+#define IPC_FNV_OFFSET_BASIS (14695981039346656037ULL) // FNV-1a 64 bit
+#define IPC_FNV_PRIME (1099511628211ULL)
+
+// == Internal global values ==
+// The usages are numbered in the order of registration, and index the tables of ipc_usage_info_table.c,
+// so the lookup of a usage is O(1). The tables of a usage are written before g_ipcUsageNum is increased
+// (release), and never changed after that.
+int g_ipcUsageNum = IPC_USAGE_TYPE_MAX;
+static unsigned long long g_nameHash[IPC_REGISTERED_USAGE_MAX_NUM]; // used with g_usageMutex
+static pthread_mutex_t g_usageMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// == Prototype declaration
+static unsigned long long ipcHashBytes(unsigned long long hash, const void *pData, size_t size);
+static unsigned long long ipcSchemaHash(const char *pName, int size, const IPC_USAGE_FIELD_S *pField, int fieldNum);
+static bool ipcIsValidUsageName(const char *pName);
+static int ipcCheckUsageField(int size, const IPC_USAGE_FIELD_S *pField, int fieldNum);
+static int ipcFindRegisteredUsage(const char *pName, unsigned long long nameHash);
+
+// == Internal function ==
+static unsigned long long ipcHashBytes(unsigned long long hash, const void *pData, size_t size)
+{
+    const unsigned char *pByte = pData;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        hash = (hash ^ pByte[i]) * IPC_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+// The name, the size and the field table (in the order of the table) must be the same on the server and the client.
+static unsigned long long ipcSchemaHash(const char *pName, int size, const IPC_USAGE_FIELD_S *pField, int fieldNum)
+{
+    unsigned long long hash;
+    int i;
+
+    hash = ipcHashBytes(IPC_FNV_OFFSET_BASIS, pName, strlen(pName) + 1);
+    hash = ipcHashBytes(hash, &size, sizeof(size));
+    for (i = 0; i < fieldNum; i++) {
+        hash = ipcHashBytes(hash, &(pField[i].kind), sizeof(pField[i].kind));
+        hash = ipcHashBytes(hash, &(pField[i].offset), sizeof(pField[i].offset));
+        hash = ipcHashBytes(hash, &(pField[i].size), sizeof(pField[i].size));
+    }
+
+    return (hash != 0) ? hash : 1; // 0 is for the built-in usages
+}
+
+// used as the file name of the unix domain socket
+static bool ipcIsValidUsageName(const char *pName)
+{
+    size_t len;
+    size_t i;
+
+    if (pName == NULL) {
+        return false;
+    }
+
+    len = strlen(pName);
+    if (len == 0 || len > IPC_REGISTERED_USAGE_NAME_MAX_LEN) {
+        return false;
+    }
+
+    for (i = 0; i < len; i++) {
+        if (!(('0' <= pName[i] && pName[i] <= '9') || ('A' <= pName[i] && pName[i] <= 'Z')
+              || ('a' <= pName[i] && pName[i] <= 'z') || pName[i] == '_' || pName[i] == '-')) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int ipcCheckUsageField(int size, const IPC_USAGE_FIELD_S *pField, int fieldNum)
+{
+    int ret = -1;
+    int i, j;
+
+    for (i = 0; i < fieldNum; i++) {
+        IPC_E_CHECK(0 <= pField[i].kind && pField[i].kind < IPC_REGISTERED_USAGE_KIND_MAX_NUM, i, end);
+        IPC_E_CHECK(0 <= pField[i].offset && 0 < pField[i].size, i, end);
+        IPC_E_CHECK(pField[i].offset + pField[i].size <= size, i, end);
+        for (j = 0; j < i; j++) {
+            IPC_E_CHECK(pField[j].kind != pField[i].kind, pField[i].kind, end);
+        }
+    }
+
+    ret = 0;
+end:
+    return ret;
+}
+
+// returns the usage registered with the name, or -1. called with g_usageMutex.
+static int ipcFindRegisteredUsage(const char *pName, unsigned long long nameHash)
+{
+    int usage;
+
+    for (usage = IPC_USAGE_TYPE_MAX; usage < g_ipcUsageNum; usage++) {
+        if (g_nameHash[usage - IPC_USAGE_TYPE_MAX] == nameHash
+            && strcmp(g_ipcDomainInfoList[usage].domainName + strlen(IPC_USAGE_DOMAIN_PREFIX), pName) == 0) {
+            return usage;
+        }
+    }
+
+    return -1;
+}
+
+// == API function ==
+IPC_RET_E ipcRegisterUsage(const char* pName, signed int size, const IPC_USAGE_FIELD_S* pField, int fieldNum,
+                           IPC_USAGE_TYPE_E* pUsageType)
+{
+    IPC_RET_E ret = IPC_ERR_PARAM;
+    int rc;
+    int usage;
+    int i;
+    unsigned long long nameHash;
+    unsigned long long schemaHash;
+    char *pDomainName = NULL;
+    IPC_CHECK_CHANGE_INFO_S *pChangeInfo = NULL;
+
+    IPC_E_CHECK(pUsageType != NULL, 0, end);
+    IPC_E_CHECK(ipcIsValidUsageName(pName) == true, 0, end);
+    IPC_E_CHECK(0 < size && size <= IPC_REGISTERED_USAGE_MAX_SIZE, size, end);
+    IPC_E_CHECK(0 <= fieldNum && fieldNum <= IPC_REGISTERED_USAGE_KIND_MAX_NUM, fieldNum, end);
+    IPC_E_CHECK(fieldNum == 0 || pField != NULL, fieldNum, end);
+    rc = ipcCheckUsageField(size, pField, fieldNum);
+    IPC_E_CHECK(rc == 0, rc, end);
+
+    nameHash = ipcHashBytes(IPC_FNV_OFFSET_BASIS, pName, strlen(pName));
+    schemaHash = ipcSchemaHash(pName, size, pField, fieldNum);
+
+    pthread_mutex_lock(&g_usageMutex);
+
+    // registered again (e.g. by the server and the client in one process)
+    usage = ipcFindRegisteredUsage(pName, nameHash);
+    if (usage >= 0) {
+        IPC_E_CHECK(g_ipcDomainInfoList[usage].schemaHash == schemaHash, usage, end_with_unlock);
+        *pUsageType = usage;
+        ret = IPC_RET_OK;
+        goto end_with_unlock;
+    }
+
+    ret = IPC_ERR_NO_RESOURCE;
+    usage = g_ipcUsageNum;
+    IPC_E_CHECK(usage < IPC_USAGE_NUM, usage, end_with_unlock);
+
+    pDomainName = malloc(strlen(IPC_USAGE_DOMAIN_PREFIX) + strlen(pName) + 1);
+    IPC_E_CHECK(pDomainName != NULL, 0, end_with_unlock);
+    sprintf(pDomainName, "%s%s", IPC_USAGE_DOMAIN_PREFIX, pName);
+
+    pChangeInfo = malloc(sizeof(IPC_CHECK_CHANGE_INFO_S) * (fieldNum > 0 ? fieldNum : 1));
+    IPC_E_CHECK(pChangeInfo != NULL, 0, end_with_unlock);
+    for (i = 0; i < fieldNum; i++) {
+        pChangeInfo[i].kind = pField[i].kind;
+        pChangeInfo[i].offset = pField[i].offset;
+        pChangeInfo[i].size = pField[i].size;
+    }
+
+    g_ipcDomainInfoList[usage].size = size;
+    g_ipcDomainInfoList[usage].domainName = pDomainName;
+    g_ipcDomainInfoList[usage].schemaHash = schemaHash;
+    g_ipcCheckChangeInfoTbl[usage].pInfo = pChangeInfo;
+    g_ipcCheckChangeInfoTbl[usage].num = fieldNum;
+    g_nameHash[usage - IPC_USAGE_TYPE_MAX] = nameHash;
+    // one segment and no analog value (g_ipcPoolLayoutTbl and g_ipcAnalogInfoTbl are left empty)
+
+    __atomic_store_n(&g_ipcUsageNum, usage + 1, __ATOMIC_RELEASE);
+    pDomainName = NULL;
+    pChangeInfo = NULL;
+
+    *pUsageType = usage;
+    ret = IPC_RET_OK;
+
+end_with_unlock:
+    pthread_mutex_unlock(&g_usageMutex);
+end:
+    free(pDomainName);
+    free(pChangeInfo);
+    return ret;
+}
+
+IPC_RET_E ipcGetTopicRange(IPC_USAGE_TYPE_E usageType, int topic, signed int* pOffset, signed int* pSize)
+{
+    IPC_RET_E ret = IPC_ERR_PARAM;
+
+    IPC_E_CHECK(CHECK_VALID_USAGE(usageType), usageType, end);
+    IPC_E_CHECK(pOffset != NULL && pSize != NULL, 0, end);
+    IPC_E_CHECK(0 <= topic && topic < g_ipcTopicTbl[usageType].num, topic, end);
+
+    *pOffset = g_ipcTopicTbl[usageType].pRange[topic].offset;
+    *pSize = g_ipcTopicTbl[usageType].pRange[topic].size;
+    ret = IPC_RET_OK;
+
+end:
+    return ret;
+}
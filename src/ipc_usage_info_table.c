@@ -25,60 +25,93 @@
 #define DEFINE_CHANGE_INFO_TABLE(changeInfoName) \
     {changeInfoName, sizeof(changeInfoName) / sizeof(changeInfoName[0])}
 
+// segment from the member first to just before the member next (DEFINE_SEGMENT_LAST: to the end)
+#define DEFINE_SEGMENT(struct_name, first, next) \
+    {offsetof(struct_name, first), offsetof(struct_name, next) - offsetof(struct_name, first)}
+
+#define DEFINE_SEGMENT_LAST(struct_name, first) \
+    {offsetof(struct_name, first), sizeof(struct_name) - offsetof(struct_name, first)}
+
+#define DEFINE_POOL_LAYOUT_TABLE(segmentName) \
+    {segmentName, sizeof(segmentName) / sizeof(segmentName[0])}
+
+#define DEFINE_TOPIC_TABLE(rangeName) \
+    {rangeName, sizeof(rangeName) / sizeof(rangeName[0])}
+
+#define DEFINE_ANALOG(struct_name, member, kind) \
+    {kind, offsetof(struct_name, member), sizeof(((struct_name *)0)->member), \
+     ((__typeof__(((struct_name *)0)->member))-1 < 0)}
+
+#define DEFINE_ANALOG_INFO_TABLE(analogInfoName) \
+    {analogInfoName, sizeof(analogInfoName) / sizeof(analogInfoName[0])}
+
 // == check change table ==
+//   (the lists are in ipc_protocol.h, shared with cluster_ipc.hpp)
+#define DEFINE_CHANGE_LIST_ENTRY(struct_name, member, kind) \
+    DEFINE_OFFSET_SIZE(struct_name, member, kind),
+
 //   for IPC_USAGE_TYPE_IC_SERVICE
 static IPC_CHECK_CHANGE_INFO_S g_ipcCheckChangeIcService[] = {
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, turnR, IPC_KIND_ICS_TURN_R),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, turnL, IPC_KIND_ICS_TURN_L),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, brake, IPC_KIND_ICS_BRAKE),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, seatbelt, IPC_KIND_ICS_SEATBELT),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, highbeam, IPC_KIND_ICS_HIGHBEAM),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, door, IPC_KIND_ICS_DOOR),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, eps, IPC_KIND_ICS_EPS),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, srsAirbag, IPC_KIND_ICS_SRS_AIRBAG),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, abs, IPC_KIND_ICS_ABS),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, lowBattery, IPC_KIND_ICS_LOW_BATTERY),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, oilPress, IPC_KIND_ICS_OIL_PRESS),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, engine, IPC_KIND_ICS_ENGINE),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, fuel, IPC_KIND_ICS_FUEL),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, immobi, IPC_KIND_ICS_IMMOBI),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, tmFail, IPC_KIND_ICS_TM_FAIL),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, espAct, IPC_KIND_ICS_ESP_ACT),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, espOff, IPC_KIND_ICS_ESP_OFF),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, adaptingLighting, IPC_KIND_ICS_ADAPTING_LIGHTING),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, autoStop, IPC_KIND_ICS_AUTO_STOP),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, autoStopFail, IPC_KIND_ICS_AUTO_STOP_FAIL),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, parkingLights, IPC_KIND_ICS_PARKING_LIGHTS),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, frontFog, IPC_KIND_ICS_FRONT_FOG),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, exteriorLightFault, IPC_KIND_ICS_EXTERIOR_LIGHT_FAULT),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, accFail, IPC_KIND_ICS_ACC_FAIL),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, ldwOff, IPC_KIND_ICS_LDW_OFF),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, hillDescent, IPC_KIND_ICS_HILL_DESCENT),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, autoHiBeamGreen, IPC_KIND_ICS_AUTO_HI_BEAM_GREEN),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, autoHiBeamAmber, IPC_KIND_ICS_AUTO_HI_BEAM_AMBER),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, ldwOperate, IPC_KIND_ICS_LDW_OPERATE),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, generalWarn, IPC_KIND_ICS_GENERAL_WARN),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, sportsMode, IPC_KIND_ICS_SPORTS_MODE),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, drivingPowerMode, IPC_KIND_ICS_DRIVING_POWER_MODE),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, hotTemp, IPC_KIND_ICS_HOT_TEMP),
-    DEFINE_OFFSET_SIZE(IPC_DATA_IC_SERVICE_S, lowTemp, IPC_KIND_ICS_LOW_TEMP)
+    IPC_CHANGE_LIST_IC_SERVICE(DEFINE_CHANGE_LIST_ENTRY)
 };
+_Static_assert(sizeof(g_ipcCheckChangeIcService) / sizeof(g_ipcCheckChangeIcService[0]) == IPC_KIND_ICS_NUM,
+               "IPC_CHANGE_LIST_IC_SERVICE does not cover IPC_KIND_IC_SERVICE_E");
 
 //   for IPC_USAGE_TYPE_FOR_TEST
 static IPC_CHECK_CHANGE_INFO_S g_ipcCheckChangeForTest[] = {
-    DEFINE_OFFSET_SIZE(IPC_DATA_FOR_TEST_S, test, IPC_KIND_TEST_TEST)
+    IPC_CHANGE_LIST_FOR_TEST(DEFINE_CHANGE_LIST_ENTRY)
+};
+_Static_assert(sizeof(g_ipcCheckChangeForTest) / sizeof(g_ipcCheckChangeForTest[0]) == IPC_KIND_TEST_NUM,
+               "IPC_CHANGE_LIST_FOR_TEST does not cover IPC_KIND_FOR_TEST_E");
+
+// == client data pool layout ==
+//   for IPC_USAGE_TYPE_IC_SERVICE
+static IPC_POOL_SEGMENT_S g_ipcPoolLayoutIcService[] = {
+    DEFINE_SEGMENT(IPC_DATA_IC_SERVICE_S, gearAtVal, trcomTripAVal), // hot: ShiftPosition, Speed, Tacho
+    DEFINE_SEGMENT(IPC_DATA_IC_SERVICE_S, turnR, gearAtVal),         // Telltale
+    DEFINE_SEGMENT_LAST(IPC_DATA_IC_SERVICE_S, trcomTripAVal)        // TripComputer
+};
+
+// == topics for ipcSendTopic ==
+//   for IPC_USAGE_TYPE_IC_SERVICE (index of [] is IPC_TOPIC_IC_SERVICE_E)
+static IPC_POOL_SEGMENT_S g_ipcTopicIcService[] = {
+    DEFINE_SEGMENT(IPC_DATA_IC_SERVICE_S, gearAtVal, trcomTripAVal), // IPC_TOPIC_ICS_FAST
+    DEFINE_SEGMENT(IPC_DATA_IC_SERVICE_S, turnR, gearAtVal),         // IPC_TOPIC_ICS_TELLTALE
+    DEFINE_SEGMENT_LAST(IPC_DATA_IC_SERVICE_S, trcomTripAVal)        // IPC_TOPIC_ICS_TRIP_COMPUTER
+};
+
+// == analog values for ipcReadInterpolated ==
+//   for IPC_USAGE_TYPE_IC_SERVICE
+static IPC_ANALOG_INFO_S g_ipcAnalogIcService[] = {
+    DEFINE_ANALOG(IPC_DATA_IC_SERVICE_S, spAnalogVal, IPC_KIND_ICS_SP_ANALOG),
+    DEFINE_ANALOG(IPC_DATA_IC_SERVICE_S, taAnalogVal, IPC_KIND_ICS_TA_ANALOG),
+    DEFINE_ANALOG(IPC_DATA_IC_SERVICE_S, oTempVal, IPC_KIND_ICS_O_TEMP)
 };
 
 // == usage info table ==
-//   index of [] is IPC_USAGE_TYPE_E
-IPC_DOMAIN_INFO_S g_ipcDomainInfoList[] =
+//   index of [] is IPC_USAGE_TYPE_E, the entries after IPC_USAGE_TYPE_MAX are set by ipcRegisterUsage
+IPC_DOMAIN_INFO_S g_ipcDomainInfoList[IPC_USAGE_NUM] =
 {
     {sizeof(IPC_DATA_IC_SERVICE_S), "ipcIcService"},
     {sizeof(IPC_DATA_FOR_TEST_S), "ipcForTest"}
 };
 
-IPC_CHECK_CHANGE_INFO_TABLE_S g_ipcCheckChangeInfoTbl[] = {
+IPC_CHECK_CHANGE_INFO_TABLE_S g_ipcCheckChangeInfoTbl[IPC_USAGE_NUM] = {
     DEFINE_CHANGE_INFO_TABLE(g_ipcCheckChangeIcService),
     DEFINE_CHANGE_INFO_TABLE(g_ipcCheckChangeForTest)
 };
 
+IPC_POOL_LAYOUT_TABLE_S g_ipcPoolLayoutTbl[IPC_USAGE_NUM] = {
+    DEFINE_POOL_LAYOUT_TABLE(g_ipcPoolLayoutIcService),
+    {NULL, 0} // IPC_USAGE_TYPE_FOR_TEST
+};
+
+IPC_ANALOG_INFO_TABLE_S g_ipcAnalogInfoTbl[IPC_USAGE_NUM] = {
+    DEFINE_ANALOG_INFO_TABLE(g_ipcAnalogIcService),
+    {NULL, 0} // IPC_USAGE_TYPE_FOR_TEST
+};
+
+IPC_TOPIC_TABLE_S g_ipcTopicTbl[IPC_USAGE_NUM] = {
+    DEFINE_TOPIC_TABLE(g_ipcTopicIcService),
+    {NULL, 0} // IPC_USAGE_TYPE_FOR_TEST
+};